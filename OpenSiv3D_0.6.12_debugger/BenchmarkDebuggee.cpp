@@ -0,0 +1,114 @@
+﻿#include <Siv3D.hpp>
+#include "BenchmarkDebuggee.hpp"
+
+// 計測で名前から引いてブレークポイントを張るので、インライン展開させない
+#if SIV3D_PLATFORM(WINDOWS)
+#	define DEBUGGER_NOINLINE __declspec(noinline)
+#else
+#	define DEBUGGER_NOINLINE __attribute__((noinline))
+#endif
+
+// ベンチマークでブレークポイントを張る関数
+DEBUGGER_NOINLINE void BenchmarkTarget(volatile int64* sink, int64 value)
+{
+	const int64 current = *sink;
+	*sink = (current + value) ^ (value << 1);
+}
+
+// 条件付きブレークポイントの計測で条件式から読むグローバル変数
+volatile int64 BenchmarkIteration = 0;
+
+// ステップオーバーの計測用（1 行の中で count 回回るループ）
+DEBUGGER_NOINLINE int64 BenchmarkHeavyLine(int64 count)
+{
+	volatile int64 sum = 0;
+	for (int64 i = 0; i < count; ++i) { sum = sum + i; }
+	return sum;
+}
+
+// ステップアウトの計測用（return が複数ある再帰呼び出し）
+DEBUGGER_NOINLINE int64 BenchmarkRecursive(int64 depth)
+{
+	if (depth <= 0)
+	{
+		return 1;
+	}
+
+	if (depth % 2 == 0)
+	{
+		return BenchmarkRecursive(depth - 1) + 2;
+	}
+
+	return BenchmarkRecursive(depth - 1) * 3;
+}
+
+// ジャストマイコードの計測用（1 行でライブラリのコードを長く実行する）
+DEBUGGER_NOINLINE int64 BenchmarkLibraryCall(int64 count)
+{
+	std::vector<int64> values(static_cast<size_t>(count));
+	for (int64 i = 0; i < count; ++i) { values[i] = (i * 7919) % count; }
+	std::sort(values.begin(), values.end());
+	return values.front();
+}
+
+void RunBenchmarkDebuggee(size_t iterations)
+{
+	volatile int64 sink = BenchmarkHeavyLine(static_cast<int64>(iterations));
+	sink = sink + BenchmarkRecursive(8);
+	sink = sink + BenchmarkLibraryCall(static_cast<int64>(iterations));
+
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		BenchmarkIteration = static_cast<int64>(i);
+		BenchmarkTarget(&sink, static_cast<int64>(i));
+	}
+}
+
+// マルチスレッドの計測で、BenchmarkTarget の結果が合わなかったときに呼ぶ（デバッガが当たった回数を数える）
+DEBUGGER_NOINLINE void BenchmarkThreadError()
+{
+	static volatile int64 errors = 0;
+	errors = errors + 1;
+}
+
+// threads 個のスレッドが同時に BenchmarkTarget を iterations 回ずつ呼ぶ
+// ブレークポイントの張り直しで命令が壊れていないか、デバッガを通さずに計算した値と比べる
+void RunThreadedBenchmarkDebuggee(size_t threads, size_t iterations)
+{
+	std::atomic<bool> start = false;
+
+	Array<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&start, iterations]
+		{
+			while (not start.load())
+			{
+				std::this_thread::yield();
+			}
+
+			volatile int64 sink = 0;
+			int64 expected = 0;
+
+			for (size_t i = 0; i < iterations; ++i)
+			{
+				const int64 value = static_cast<int64>(i);
+				BenchmarkTarget(&sink, value);
+				expected = (expected + value) ^ (value << 1);
+
+				if (sink != expected)
+				{
+					BenchmarkThreadError();
+					sink = expected;
+				}
+			}
+		});
+	}
+
+	start = true;
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
@@ -0,0 +1,11 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+// DebuggerBenchmark がデバッグ対象として起動した自分自身（--benchmark-debuggee）で実行するコード
+// 計測は関数・変数を名前（BenchmarkTarget, BenchmarkIteration など）で引き、行はBenchmarkDebuggee.cpp で引く
+
+// BenchmarkTarget() を iterations 回呼ぶ（その前にステップ実行の計測用の関数を 1 回ずつ呼ぶ）
+void RunBenchmarkDebuggee(size_t iterations);
+
+// threads 個のスレッドが同時に BenchmarkTarget() を iterations 回ずつ呼ぶ
+void RunThreadedBenchmarkDebuggee(size_t threads, size_t iterations);
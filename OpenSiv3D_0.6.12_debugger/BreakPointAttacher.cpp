@@ -1,50 +1,92 @@
 ﻿#include "BreakPointAttacher.hpp"
 #include "ProcessHandle.hpp"
 
+namespace
+{
+	constexpr size_t PageSize = 4096;
+
+	constexpr uint8_t BreakOp = 0xCC;
+
+	// 昇順に並んだアドレスを同じページのものごとに区切って f(first, last) を呼ぶ
+	template <class Fty>
+	void ForEachPage(const Array<size_t>& sortedAddresses, Fty f)
+	{
+		for (auto first = sortedAddresses.begin(); first != sortedAddresses.end();)
+		{
+			const size_t pageEnd = (*first / PageSize + 1) * PageSize;
+			const auto last = std::lower_bound(first, sortedAddresses.end(), pageEnd);
+			f(first, last);
+			first = last;
+		}
+	}
+}
+
 void BreakPointAttacher::initializeBreakPointHelper()
 {
 	m_breakPoints.clear();
+	m_options.clear();
+	m_displacedStepping.reset();
+	m_threadStates.clear();
+	m_runToBps.clear();
+	m_temporaries.clear();
+	m_pendingResetCount = 0;
 	m_isFirstBpOccured = false;
 	m_isSecondBpOccured = false;
-	m_resetUserBpAddress = 0;
-
-	m_isBeingSingleInstruction = false;
-	m_isBeingStepOut = false;
-	m_isBeingStepOver = false;
 }
 
-BreakPointType BreakPointAttacher::getBreakPointType(size_t address)
+BreakPointType BreakPointAttacher::getBreakPointType(size_t address, DWORD threadID)
 {
-	// プロセス起動直後に自動で呼ばれるブレークポイント
-	if (not m_isFirstBpOccured)
+	// プロセス起動直後に自動で呼ばれるブレークポイント（こちらが int3 を張ったアドレスならそちらとして扱う）
+	if (not m_isFirstBpOccured && not m_breakPoints.contains(address))
 	{
 		m_isFirstBpOccured = true;
 		return BreakPointType::Init;
 	}
 
-	// Main()の先頭に張ったブレークポイント
+	// エントリのブレークポイント
+	// Windows（x64）では Main()の先頭に張ったブレークポイント、Linux では PtraceDebugBackend が _start に張ったもの
 	if (not m_isSecondBpOccured)
 	{
 		m_isSecondBpOccured = true;
+
+		// Main()の先頭のものはユーザーブレークポイントとしても数える（ProcessDebugger がそのまま止まる）
+		if (auto* breakPoint = m_breakPoints.find(address))
+		{
+			++breakPoint->hitCount;
+		}
 		return BreakPointType::Entry;
 	}
 
-	if (m_stepOverBp && m_stepOverBp.value().first == address)
+	// このスレッドの一時ブレークポイントと行まで実行を、ユーザーブレークポイントより先に見る
+	// 同じアドレスに複数あれば StepOver, StepOut, StepRange, RunTo の順（列挙の順）
+	// 同じアドレスのユーザーブレークポイントが止まらない種類・条件でも、行まで実行は止まる
+	const auto temporary = m_temporaries.find(address);
+	if (temporary != m_temporaries.end())
 	{
-		return BreakPointType::StepOver;
+		Optional<BreakPointType> type;
+		for (const auto& owner : temporary->second.owners)
+		{
+			if ((owner.threadID == threadID || owner.type == BreakPointType::RunTo) && (not type || owner.type < *type))
+			{
+				type = owner.type;
+			}
+		}
+
+		if (type)
+		{
+			return *type;
+		}
 	}
 
-	if (m_stepOutBp && m_stepOutBp.value().first == address)
+	if (auto* breakPoint = m_breakPoints.find(address); breakPoint && breakPoint->enabled)
 	{
-		return BreakPointType::StepOut;
+		++breakPoint->hitCount;
+		return BreakPointType::User;
 	}
 
-	for (const auto& breakPoint : m_breakPoints)
+	if (temporary != m_temporaries.end())
 	{
-		if (breakPoint.first == address)
-		{
-			return BreakPointType::User;
-		}
+		return BreakPointType::OtherThread;
 	}
 
 	return BreakPointType::Code;
@@ -52,28 +94,35 @@ BreakPointType BreakPointAttacher::getBreakPointType(size_t address)
 
 bool BreakPointAttacher::setUserBreakPointAt(const ProcessHandle& process, size_t address)
 {
-	for (const auto& breakPoint : m_breakPoints)
+	const auto [breakPoint, inserted] = m_breakPoints.insert(address);
+	if (not inserted)
 	{
-		if (breakPoint.first == address)
-		{
-			return false;
-		}
+		return false;
 	}
 
-	m_breakPoints[address] = setBreakPointAt(process, address);
+	// 一時ブレークポイントの int3 がすでにあればそれを使う
+	if (const auto original = findTemporaryOriginalByte(address))
+	{
+		breakPoint->originalByte = *original;
+		return true;
+	}
+
+	breakPoint->originalByte = setBreakPointAt(process, address);
 	return true;
 }
 
 bool BreakPointAttacher::cancelUserBreakPointAt(const ProcessHandle& process, size_t address)
 {
-	for (auto it = m_breakPoints.begin(); it != m_breakPoints.end(); ++it)
+	if (const auto* breakPoint = m_breakPoints.find(address))
 	{
-		if (it->first == address)
+		if (breakPoint->enabled && not findTemporaryOriginalByte(address))
 		{
-			recoverBreakPoint(process, it->first, it->second);
-			m_breakPoints.erase(it);
-			return true;
+			recoverBreakPoint(process, address, breakPoint->originalByte);
 		}
+		m_breakPoints.erase(address);
+		m_options.erase(address);
+		m_displacedStepping.release(address);
+		return true;
 	}
 
 	//std::cout << "アドレス:";
@@ -82,60 +131,279 @@ bool BreakPointAttacher::cancelUserBreakPointAt(const ProcessHandle& process, si
 	return false;
 }
 
-void BreakPointAttacher::setStepOverBreakPointAt(const ProcessHandle& process, size_t address)
+size_t BreakPointAttacher::setUserBreakPointsAt(const ProcessHandle& process, Array<size_t> addresses)
 {
-	BreakPoint bp;
-	bp.first = address;
-	bp.second = setBreakPointAt(process, address);
-	m_stepOverBp = bp;
+	std::sort(addresses.begin(), addresses.end());
+	addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+	addresses.remove_if([&](size_t address) { return address == 0 || m_breakPoints.contains(address); });
+
+	m_breakPoints.reserve(m_breakPoints.size() + addresses.size());
+
+	size_t count = 0;
+	Array<uint8_t> buffer;
+
+	// ページ内の最初から最後のブレークポイントまでを読んで、int3 を書き込んでから 1 回で書き戻す
+	ForEachPage(addresses, [&](auto first, auto last)
+	{
+		const size_t base = *first;
+		buffer.resize(*(last - 1) - base + 1);
+
+		if (not process.readMemory(base, buffer.size(), buffer.data()))
+		{
+			return;
+		}
+
+		for (auto it = first; it != last; ++it)
+		{
+			auto& byte = buffer[*it - base];
+			m_breakPoints.insert(*it).first->originalByte = findTemporaryOriginalByte(*it).value_or(byte);
+			byte = BreakOp;
+		}
+
+		if (process.writeMemory(base, buffer.size(), buffer.data()))
+		{
+			count += (last - first);
+		}
+		else
+		{
+			for (auto it = first; it != last; ++it)
+			{
+				m_breakPoints.erase(*it);
+			}
+		}
+	});
+
+	return count;
 }
 
-void BreakPointAttacher::cancelStepOverBreakPoint(const ProcessHandle& process)
+size_t BreakPointAttacher::cancelUserBreakPointsAt(const ProcessHandle& process, Array<size_t> addresses)
 {
-	if (m_stepOverBp)
+	std::sort(addresses.begin(), addresses.end());
+	addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+	addresses.remove_if([&](size_t address) { return not m_breakPoints.contains(address); });
+
+	size_t count = 0;
+	Array<uint8_t> buffer;
+
+	ForEachPage(addresses, [&](auto first, auto last)
 	{
-		const auto& bp = m_stepOverBp.value();
-		recoverBreakPoint(process, bp.first, bp.second);
-		m_stepOverBp = none;
+		const size_t base = *first;
+		buffer.resize(*(last - 1) - base + 1);
+
+		// 無効にしてあるものは書き換えないが、表からは消す
+		bool restored = process.readMemory(base, buffer.size(), buffer.data());
+		if (restored)
+		{
+			for (auto it = first; it != last; ++it)
+			{
+				const auto* breakPoint = m_breakPoints.find(*it);
+				if (breakPoint->enabled && not findTemporaryOriginalByte(*it))
+				{
+					buffer[*it - base] = breakPoint->originalByte;
+				}
+			}
+			restored = process.writeMemory(base, buffer.size(), buffer.data());
+		}
+
+		if (restored)
+		{
+			for (auto it = first; it != last; ++it)
+			{
+				m_breakPoints.erase(*it);
+				m_options.erase(*it);
+				m_displacedStepping.release(*it);
+			}
+			count += (last - first);
+		}
+	});
+
+	return count;
+}
+
+bool BreakPointAttacher::setUserBreakPointOptions(size_t address, BreakPointKind kind, BreakPointOptions options)
+{
+	auto* breakPoint = m_breakPoints.find(address);
+	if (not breakPoint)
+	{
+		return false;
 	}
-	//m_isBeingStepOver = false;
+
+	breakPoint->kind = kind;
+	breakPoint->hitCount = 0;
+	m_options.insert_or_assign(address, std::move(options));
+	return true;
 }
 
-void BreakPointAttacher::setStepOutBreakPointAt(const ProcessHandle& process, size_t address)
+const BreakPointOptions* BreakPointAttacher::getUserBreakPointOptions(size_t address) const
 {
-	BreakPoint bp;
-	bp.first = address;
-	bp.second = setBreakPointAt(process, address);
-	m_stepOutBp = bp;
+	const auto it = m_options.find(address);
+	return (it != m_options.end()) ? &it->second : nullptr;
 }
 
-void BreakPointAttacher::cancelStepOutBreakPoint(const ProcessHandle& process)
+bool BreakPointAttacher::setUserBreakPointEnabled(const ProcessHandle& process, size_t address, bool enabled)
 {
-	if (m_stepOutBp)
+	auto* breakPoint = m_breakPoints.find(address);
+	if (not breakPoint)
+	{
+		return false;
+	}
+
+	if (breakPoint->enabled != enabled)
 	{
-		const auto& bp = m_stepOutBp.value();
-		recoverBreakPoint(process, bp.first, bp.second);
-		m_stepOutBp = none;
+		// 一時ブレークポイントが同じアドレスにあれば int3 はそちらのために残す
+		// 張り直し待ちのスレッドがあれば今は元の命令が入っていて、resetUserBreakPoint が enabled を見て張り直す
+		if (not findTemporaryOriginalByte(address) && not isResetPending(address))
+		{
+			if (enabled)
+			{
+				setBreakPointAt(process, address);
+			}
+			else
+			{
+				recoverBreakPoint(process, address, breakPoint->originalByte);
+			}
+		}
+		breakPoint->enabled = enabled;
 	}
-	//m_isBeingStepOut = false;
+
+	return true;
 }
 
-bool BreakPointAttacher::recoverUserBreakPoint(const ProcessHandle& process, size_t address)
+void BreakPointAttacher::setStepOverBreakPointAt(const ProcessHandle& process, DWORD threadID, size_t address)
 {
-	for (const auto& breakPoint : m_breakPoints)
+	auto& state = m_threadStates[threadID];
+	cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOver, state.stepOverBp);
+	state.stepOverBp = setTemporaryBreakPointAt(process, threadID, BreakPointType::StepOver, address);
+}
+
+void BreakPointAttacher::cancelStepOverBreakPoint(const ProcessHandle& process, DWORD threadID)
+{
+	if (auto it = m_threadStates.find(threadID); it != m_threadStates.end())
+	{
+		cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOver, it->second.stepOverBp);
+	}
+}
+
+void BreakPointAttacher::setStepOutBreakPointAt(const ProcessHandle& process, DWORD threadID, size_t address, uint64 frame)
+{
+	auto& state = m_threadStates[threadID];
+	cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOut, state.stepOutBp);
+	state.stepOutBp = setTemporaryBreakPointAt(process, threadID, BreakPointType::StepOut, address);
+	state.stepOutFrame = frame;
+}
+
+void BreakPointAttacher::cancelStepOutBreakPoint(const ProcessHandle& process, DWORD threadID)
+{
+	if (auto it = m_threadStates.find(threadID); it != m_threadStates.end())
+	{
+		cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOut, it->second.stepOutBp);
+	}
+}
+
+void BreakPointAttacher::setStepRangeBreakPoints(const ProcessHandle& process, DWORD threadID, const StepRangeExits& exits, uint64 frame)
+{
+	cancelStepRangeBreakPoints(process, threadID);
+
+	Array<size_t> addresses = exits.targets;
+	addresses.insert(addresses.end(), exits.unresolved.begin(), exits.unresolved.end());
+	std::sort(addresses.begin(), addresses.end());
+	addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+	auto& state = m_threadStates[threadID];
+	state.stepRangeUnresolved = exits.unresolved;
+	state.stepRangeFrame = frame;
+
+	// ユーザーのコードに戻るまで実行させるときは、ユーザーの関数の先頭すべてに張る
+	setTemporaryBreakPointsAt(process, threadID, BreakPointType::StepRange, addresses, state.stepRangeBps);
+}
+
+void BreakPointAttacher::cancelStepRangeBreakPoints(const ProcessHandle& process, DWORD threadID)
+{
+	const auto it = m_threadStates.find(threadID);
+	if (it == m_threadStates.end())
+	{
+		return;
+	}
+
+	// 先に表から外してから戻す（まだ表にあると自分の int3 を元のバイトだと思ってしまう）
+	Array<BreakPoint> breakPoints = std::move(it->second.stepRangeBps);
+	it->second.stepRangeBps.clear();
+	it->second.stepRangeUnresolved.clear();
+
+	cancelTemporaryBreakPoints(process, threadID, BreakPointType::StepRange, std::move(breakPoints));
+}
+
+size_t BreakPointAttacher::setRunToBreakPoints(const ProcessHandle& process, Array<size_t> addresses)
+{
+	cancelRunToBreakPoints(process);
+
+	std::sort(addresses.begin(), addresses.end());
+	addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+	setTemporaryBreakPointsAt(process, 0, BreakPointType::RunTo, addresses, m_runToBps);
+	return m_runToBps.size();
+}
+
+void BreakPointAttacher::cancelRunToBreakPoints(const ProcessHandle& process)
+{
+	// 先に表から外してから戻す
+	Array<BreakPoint> breakPoints = std::move(m_runToBps);
+	m_runToBps.clear();
+
+	cancelTemporaryBreakPoints(process, 0, BreakPointType::RunTo, std::move(breakPoints));
+}
+
+void BreakPointAttacher::cancelSteps(const ProcessHandle& process)
+{
+	if (not m_runToBps.isEmpty())
 	{
-		if (breakPoint.first == address)
+		cancelRunToBreakPoints(process);
+	}
+
+	for (auto& [threadID, state] : m_threadStates)
+	{
+		if (not state.stepRangeBps.isEmpty())
 		{
-			recoverBreakPoint(process, breakPoint.first, breakPoint.second);
-			//std::cout << "アドレス:";
-			//printHex(address, false);
-			//std::cout << "の命令を ";
-			//printHex(bp.content, false);
-			//std::cout << " に復元しました" << std::endl;
+			cancelStepRangeBreakPoints(process, threadID);
+		}
 
-			return true;
+		if (state.isBeingStepOver)
+		{
+			cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOver, state.stepOverBp);
+			state.isBeingStepOver = false;
+		}
+
+		if (state.isBeingStepOut)
+		{
+			cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOut, state.stepOutBp);
+			state.isBeingStepOut = false;
 		}
 	}
+}
+
+bool BreakPointAttacher::recoverTemporaryBreakPoint(const ProcessHandle& process, size_t address)
+{
+	if (const auto original = findTemporaryOriginalByte(address))
+	{
+		recoverBreakPoint(process, address, *original);
+		return true;
+	}
+	return false;
+}
+
+bool BreakPointAttacher::recoverUserBreakPoint(const ProcessHandle& process, size_t address)
+{
+	if (const auto* breakPoint = m_breakPoints.find(address); breakPoint && breakPoint->enabled)
+	{
+		recoverBreakPoint(process, address, breakPoint->originalByte);
+		//std::cout << "アドレス:";
+		//printHex(address, false);
+		//std::cout << "の命令を ";
+		//printHex(bp.content, false);
+		//std::cout << " に復元しました" << std::endl;
+
+		return true;
+	}
 
 	//std::cout << "アドレス:";
 	//printHex(address, false);
@@ -143,21 +411,306 @@ bool BreakPointAttacher::recoverUserBreakPoint(const ProcessHandle& process, siz
 	return false;
 }
 
-void BreakPointAttacher::saveResetUserBreakPoint(size_t address)
+const DisplacedInstruction* BreakPointAttacher::prepareDisplacedInstruction(const ProcessHandle& process, const HashTable<DWORD, ThreadHandle>& threads, size_t address)
 {
-	m_resetUserBpAddress = address;
+	const auto* breakPoint = m_breakPoints.find(address);
+	if (not breakPoint || not breakPoint->enabled)
+	{
+		return nullptr;
+	}
+
+	const auto* instruction = m_displacedStepping.find(address);
+	if (not instruction)
+	{
+		// 命令の最大長だけ読み、上書きしてある int3 を元のバイトに戻してから解析する
+		uint8_t bytes[16] = {};
+		if (not process.readOriginalMemory(address, sizeof(bytes), bytes))
+		{
+			return nullptr;
+		}
+
+		instruction = &m_displacedStepping.prepare(process, threads, address, bytes, sizeof(bytes));
+	}
+
+	return (instruction->kind != DisplacedInstruction::Kind::Unsupported) ? instruction : nullptr;
+}
+
+void BreakPointAttacher::restoreOriginalBytes(size_t address, uint8* bytes, size_t size) const
+{
+	for (const size_t other : m_breakPoints.addressesInRange(address, address + size))
+	{
+		if (const auto* entry = m_breakPoints.find(other); entry->enabled)
+		{
+			bytes[other - address] = entry->originalByte;
+		}
+	}
+
+	// 命令を読むときのように狭い範囲ならアドレスごとに引き、広ければ一時ブレークポイントを順に見る
+	if (size < m_temporaries.size())
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			if (const auto it = m_temporaries.find(address + i); it != m_temporaries.end())
+			{
+				bytes[i] = it->second.originalByte;
+			}
+		}
+	}
+	else
+	{
+		for (const auto& [temporaryAddress, temporary] : m_temporaries)
+		{
+			if (address <= temporaryAddress && temporaryAddress < address + size)
+			{
+				bytes[temporaryAddress - address] = temporary.originalByte;
+			}
+		}
+	}
+}
+
+void BreakPointAttacher::saveResetUserBreakPoint(DWORD threadID, size_t address)
+{
+	auto& state = m_threadStates[threadID];
+	if (not state.resetAddress)
+	{
+		++m_pendingResetCount;
+	}
+	state.resetAddress = address;
+}
+
+void BreakPointAttacher::resetUserBreakPoint(const ProcessHandle& process, DWORD threadID)
+{
+	const auto it = m_threadStates.find(threadID);
+	if (it == m_threadStates.end() || not it->second.resetAddress)
+	{
+		return;
+	}
+
+	const size_t address = *it->second.resetAddress;
+	it->second.resetAddress = none;
+	--m_pendingResetCount;
+
+	// 同じアドレスで止まった他のスレッドがまだ元の命令を実行していなければ、そのスレッドが張り直す
+	if (isResetPending(address))
+	{
+		return;
+	}
+
+	// 復元している間に解除・無効化されていれば張り直さない
+	if (findOriginalByte(address))
+	{
+		process.writeMemory(address, BreakOp);
+	}
+}
+
+void BreakPointAttacher::onThreadExited(const ProcessHandle& process, DWORD threadID)
+{
+	const auto it = m_threadStates.find(threadID);
+	if (it == m_threadStates.end())
+	{
+		return;
+	}
+
+	resetUserBreakPoint(process, threadID);
+	cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOver, it->second.stepOverBp);
+	cancelTemporaryBreakPoint(process, threadID, BreakPointType::StepOut, it->second.stepOutBp);
+	cancelStepRangeBreakPoints(process, threadID);
+	m_threadStates.erase(threadID);
+}
+
+const BreakPointAttacher::ThreadBreakState& BreakPointAttacher::threadState(DWORD threadID) const
+{
+	static const ThreadBreakState Empty;
+
+	const auto it = m_threadStates.find(threadID);
+	return (it != m_threadStates.end()) ? it->second : Empty;
+}
+
+BreakPointAttacher::BreakPoint BreakPointAttacher::setTemporaryBreakPointAt(const ProcessHandle& process, DWORD threadID, BreakPointType type, size_t address)
+{
+	// すでに張ってあるか、張り直し待ちなら張り直すときに int3 が入る
+	const auto original = findOriginalByte(address);
+	const BreakPoint breakPoint{ address, original ? *original : setBreakPointAt(process, address) };
+
+	addTemporaryOwner(breakPoint, threadID, type);
+	return breakPoint;
+}
+
+void BreakPointAttacher::cancelTemporaryBreakPoint(const ProcessHandle& process, DWORD threadID, BreakPointType type, Optional<BreakPoint>& breakPoint)
+{
+	if (not breakPoint)
+	{
+		return;
+	}
+
+	const auto [address, original] = *breakPoint;
+	breakPoint = none;
+
+	// 先に表から外す（まだ表にあると自分の int3 を元のバイトだと思ってしまう）
+	removeTemporaryOwner(address, threadID, type);
+
+	// 張り直し待ちのときはすでに元の命令になっている
+	if (not findOriginalByte(address) && not isResetPending(address))
+	{
+		recoverBreakPoint(process, address, original);
+	}
+}
+
+void BreakPointAttacher::setTemporaryBreakPointsAt(const ProcessHandle& process, DWORD threadID, BreakPointType type, const Array<size_t>& sortedAddresses, Array<BreakPoint>& breakPoints)
+{
+	const size_t firstAdded = breakPoints.size();
+
+	Array<size_t> writeAddresses;
+	for (const auto address : sortedAddresses)
+	{
+		if (const auto original = findOriginalByte(address))
+		{
+			breakPoints.emplace_back(address, *original);
+		}
+		else if (isResetPending(address))
+		{
+			// 張り直し待ちで元の命令に戻っている（張り直すときに int3 が入る）
+			if (uint8_t original; process.readMemory(address, original))
+			{
+				breakPoints.emplace_back(address, original);
+			}
+		}
+		else
+		{
+			writeAddresses.push_back(address);
+		}
+	}
+
+	Array<uint8_t> buffer;
+	ForEachPage(writeAddresses, [&](auto first, auto last)
+	{
+		const size_t base = *first;
+		buffer.resize(*(last - 1) - base + 1);
+
+		if (not process.readMemory(base, buffer.size(), buffer.data()))
+		{
+			return;
+		}
+
+		const size_t begin = breakPoints.size();
+		for (auto it = first; it != last; ++it)
+		{
+			auto& byte = buffer[*it - base];
+			breakPoints.emplace_back(*it, byte);
+			byte = BreakOp;
+		}
+
+		if (not process.writeMemory(base, buffer.size(), buffer.data()))
+		{
+			breakPoints.resize(begin);
+		}
+	});
+
+	for (size_t i = firstAdded; i < breakPoints.size(); ++i)
+	{
+		addTemporaryOwner(breakPoints[i], threadID, type);
+	}
+}
+
+void BreakPointAttacher::cancelTemporaryBreakPoints(const ProcessHandle& process, DWORD threadID, BreakPointType type, Array<BreakPoint> breakPoints)
+{
+	for (const auto& breakPoint : breakPoints)
+	{
+		removeTemporaryOwner(breakPoint.first, threadID, type);
+	}
+
+	breakPoints.remove_if([&](const BreakPoint& breakPoint) { return findOriginalByte(breakPoint.first) || isResetPending(breakPoint.first); });
+	std::sort(breakPoints.begin(), breakPoints.end());
+
+	Array<size_t> addresses(breakPoints.size());
+	for (size_t i = 0; i < breakPoints.size(); ++i)
+	{
+		addresses[i] = breakPoints[i].first;
+	}
+
+	Array<uint8_t> buffer;
+	ForEachPage(addresses, [&](auto first, auto last)
+	{
+		const size_t base = *first;
+		buffer.resize(*(last - 1) - base + 1);
+
+		if (not process.readMemory(base, buffer.size(), buffer.data()))
+		{
+			return;
+		}
+
+		for (auto address = first; address != last; ++address)
+		{
+			buffer[*address - base] = breakPoints[address - addresses.begin()].second;
+		}
+
+		process.writeMemory(base, buffer.size(), buffer.data());
+	});
+}
+
+Optional<uint8_t> BreakPointAttacher::findOriginalByte(size_t address) const
+{
+	if (const auto* breakPoint = m_breakPoints.find(address); breakPoint && breakPoint->enabled)
+	{
+		return breakPoint->originalByte;
+	}
+
+	return findTemporaryOriginalByte(address);
+}
+
+Optional<uint8_t> BreakPointAttacher::findTemporaryOriginalByte(size_t address) const
+{
+	if (const auto it = m_temporaries.find(address); it != m_temporaries.end())
+	{
+		return it->second.originalByte;
+	}
+	return none;
+}
+
+void BreakPointAttacher::addTemporaryOwner(const BreakPoint& breakPoint, DWORD threadID, BreakPointType type)
+{
+	// 同じアドレスの 2 つ目からは最初に張ったときの元のバイトを使う
+	auto& temporary = m_temporaries.try_emplace(breakPoint.first, TemporaryBreakPoint{ breakPoint.second, {} }).first->second;
+	temporary.owners.push_back(TemporaryOwner{ threadID, type });
 }
 
-void BreakPointAttacher::resetUserBreakPoint(const ProcessHandle& process)
+void BreakPointAttacher::removeTemporaryOwner(size_t address, DWORD threadID, BreakPointType type)
 {
-	for (const auto& breakPoint : m_breakPoints)
+	const auto it = m_temporaries.find(address);
+	if (it == m_temporaries.end())
 	{
-		if (breakPoint.first == m_resetUserBpAddress)
+		return;
+	}
+
+	auto& owners = it->second.owners;
+	const auto owner = std::find_if(owners.begin(), owners.end(),
+		[&](const TemporaryOwner& o) { return (o.threadID == threadID) && (o.type == type); });
+	if (owner != owners.end())
+	{
+		owners.erase(owner);
+	}
+
+	if (owners.isEmpty())
+	{
+		m_temporaries.erase(it);
+	}
+}
+
+bool BreakPointAttacher::isResetPending(size_t address) const
+{
+	if (m_pendingResetCount == 0)
+	{
+		return false;
+	}
+
+	for (const auto& [threadID, state] : m_threadStates)
+	{
+		if (state.resetAddress == address)
 		{
-			setBreakPointAt(process, breakPoint.first);
-			m_resetUserBpAddress = none;
+			return true;
 		}
 	}
+	return false;
 }
 
 uint8_t BreakPointAttacher::setBreakPointAt(const ProcessHandle& process, size_t address)
@@ -165,8 +718,7 @@ uint8_t BreakPointAttacher::setBreakPointAt(const ProcessHandle& process, size_t
 	uint8_t original;
 	process.readMemory(address, original);
 
-	const uint8_t breakOp = 0xCC;
-	process.writeMemory(address, breakOp);
+	process.writeMemory(address, BreakOp);
 
 	return original;
 }
@@ -1,8 +1,27 @@
 ﻿#pragma once
-#include <Windows.h>
+#include "DebugTypes.hpp"
 #include "StepHandler.hpp"
+#include "BreakPointIndex.hpp"
+#include "BreakPointCondition.hpp"
+#include "DisplacedStepping.hpp"
 
 class ProcessHandle;
+class ThreadHandle;
+
+// 止まるかどうかを ProcessDebugger::onUserBreakPoint の中で決めるブレークポイントの設定
+struct BreakPointOptions
+{
+	// Conditional
+	Optional<BreakPointCondition> condition;
+
+	// Tracepoint: TracepointSink に登録した書式と、埋め込む値の式
+	uint32 messageFormatID = 0;
+
+	Array<BreakPointCondition> messageValues;
+
+	// HitCount, Tracepoint: この回数目に当たったときに止まる（0 なら止まらない）
+	uint32 stopAtHitCount = 0;
+};
 
 enum class BreakPointType
 {
@@ -12,69 +31,194 @@ enum class BreakPointType
 	User,
 	StepOver,
 	StepOut,
+	OtherThread, // 他のスレッドのステップ実行用の一時ブレークポイント（止まらずに通り抜ける）
+	StepRange,   // 行の範囲から出たところ・行き先のわからない命令
+	RunTo,       // 行まで実行の一時ブレークポイント（どのスレッドが当たっても止まる）
 };
 
-class BreakPointAttacher
+class BreakPointAttacher : public CodePatchSource
 {
 public:
 
 	void initializeBreakPointHelper();
 
-	BreakPointType getBreakPointType(size_t address);
+	BreakPointType getBreakPointType(size_t address, DWORD threadID);
 
 	bool setUserBreakPointAt(const ProcessHandle& process, size_t address);
 
 	bool cancelUserBreakPointAt(const ProcessHandle& process, size_t address);
 
-	void setStepOverBreakPointAt(const ProcessHandle& process, size_t address);
+	// まとめて張る・外す（ページごとに 1 回だけ読み書きする）
+	// 新しく張れた数・外した数を返す
+	size_t setUserBreakPointsAt(const ProcessHandle& process, Array<size_t> addresses);
+
+	size_t cancelUserBreakPointsAt(const ProcessHandle& process, Array<size_t> addresses);
+
+	// 張ってあるブレークポイントの種類を変えて設定を付ける（当たった回数は 0 に戻す）
+	bool setUserBreakPointOptions(size_t address, BreakPointKind kind, BreakPointOptions options);
+
+	// 設定がなければ nullptr
+	const BreakPointOptions* getUserBreakPointOptions(size_t address) const;
+
+	// 無効にしたブレークポイントは int3 を外したまま表に残す
+	bool setUserBreakPointEnabled(const ProcessHandle& process, size_t address, bool enabled);
+
+	// ステップオーバー・ステップアウトの一時ブレークポイントはスレッドごとに持ち、張ったスレッドでだけ止まる
+	void setStepOverBreakPointAt(const ProcessHandle& process, DWORD threadID, size_t address);
+
+	void cancelStepOverBreakPoint(const ProcessHandle& process, DWORD threadID);
+
+	// frame は戻ったときの RSP（それより深いフレームで当たったものは再帰呼び出しの中）
+	void setStepOutBreakPointAt(const ProcessHandle& process, DWORD threadID, size_t address, uint64 frame);
 
-	void cancelStepOverBreakPoint(const ProcessHandle& process);
+	void cancelStepOutBreakPoint(const ProcessHandle& process, DWORD threadID);
 
-	void setStepOutBreakPointAt(const ProcessHandle& process, size_t address);
+	// 行の範囲を実行させている間の一時ブレークポイント（exits の位置すべてに張る）
+	// frame はステップを始めたときの RSP（ステップオーバーで再帰呼び出しの中で当たったものを見分ける）
+	void setStepRangeBreakPoints(const ProcessHandle& process, DWORD threadID, const StepRangeExits& exits, uint64 frame);
 
-	void cancelStepOutBreakPoint(const ProcessHandle& process);
+	void cancelStepRangeBreakPoints(const ProcessHandle& process, DWORD threadID);
+
+	// address が行き先のわからない命令（そこからシングルステップする）か
+	bool isStepRangeUnresolved(DWORD threadID, size_t address) const { return threadState(threadID).stepRangeUnresolved.contains(address); }
+
+	uint64 stepRangeFrame(DWORD threadID) const { return threadState(threadID).stepRangeFrame; }
+
+	uint64 stepOutFrame(DWORD threadID) const { return threadState(threadID).stepOutFrame; }
+
+	// 行まで実行の一時ブレークポイント（行のすべての範囲の先頭に張り、最初に当たったところで全部外す）
+	// スレッドごとではなくプロセスで 1 組。張り直すと前の組は外す。張れた数を返す
+	size_t setRunToBreakPoints(const ProcessHandle& process, Array<size_t> addresses);
+
+	void cancelRunToBreakPoints(const ProcessHandle& process);
+
+	bool isRunningTo() const { return not m_runToBps.isEmpty(); }
+
+	// 全スレッドのステップオーバー・ステップアウトと行まで実行をやめる（どこかで止まったとき）
+	void cancelSteps(const ProcessHandle& process);
 
 	bool recoverUserBreakPoint(const ProcessHandle& process, size_t address);
 
-	void saveResetUserBreakPoint(size_t address);
+	// 他のスレッドの一時ブレークポイントを通り抜けるために元の命令に戻す
+	bool recoverTemporaryBreakPoint(const ProcessHandle& process, size_t address);
+
+	// address の命令を int3 を張ったまま外で実行する準備をする（初回だけ命令を解析してスクラッチ領域にコピーする）
+	// 外で実行できない命令なら nullptr
+	const DisplacedInstruction* prepareDisplacedInstruction(const ProcessHandle& process, const HashTable<DWORD, ThreadHandle>& threads, size_t address);
+
+	// address から読んだ size バイトのうち、張ってある int3 を元のバイトに戻す
+	void restoreOriginalBytes(size_t address, uint8* bytes, size_t size) const override;
 
-	void resetUserBreakPoint(const ProcessHandle& process);
+	// threadID が元の命令を 1 つ実行したら（次のシングルステップで）address に int3 を張り直す
+	void saveResetUserBreakPoint(DWORD threadID, size_t address);
 
-	bool needResetBreakPoint()
+	// 同じアドレスを他のスレッドがまだ実行していなければ張り直す
+	void resetUserBreakPoint(const ProcessHandle& process, DWORD threadID);
+
+	bool needResetBreakPoint(DWORD threadID) const
 	{
-		return m_resetUserBpAddress.has_value();
+		const auto it = m_threadStates.find(threadID);
+		return (it != m_threadStates.end()) && it->second.resetAddress.has_value();
 	}
 
-	const HashTable<size_t, uint8_t>& getUserBreakPoints()
+	// どれかのスレッドが張り直しを待っているか（その間は他のスレッドを止めておく）
+	bool hasPendingReset() const { return (m_pendingResetCount != 0); }
+
+	// 張り直し待ち・一時ブレークポイントを片付ける
+	void onThreadExited(const ProcessHandle& process, DWORD threadID);
+
+	const BreakPointIndex& getUserBreakPoints() const
 	{
 		return m_breakPoints;
 	}
 
-	bool isBeingStepOver() const { return m_isBeingStepOver; }
-	void setBeingStepOver(bool value) { m_isBeingStepOver = value; }
+	bool isBeingStepOver(DWORD threadID) const { return threadState(threadID).isBeingStepOver; }
+	void setBeingStepOver(DWORD threadID, bool value) { m_threadStates[threadID].isBeingStepOver = value; }
 
-	bool isBeingSingleInstruction() const { return m_isBeingSingleInstruction; }
-	void setBeingSingleInstruction(bool value) { m_isBeingSingleInstruction = value; }
+	bool isBeingSingleInstruction(DWORD threadID) const { return threadState(threadID).isBeingSingleInstruction; }
+	void setBeingSingleInstruction(DWORD threadID, bool value) { m_threadStates[threadID].isBeingSingleInstruction = value; }
 
-	bool isBeingStepOut() const { return m_isBeingStepOut; }
-	void setBeingStepOut(bool value) { m_isBeingStepOut = value; }
+	bool isBeingStepOut(DWORD threadID) const { return threadState(threadID).isBeingStepOut; }
+	void setBeingStepOut(DWORD threadID, bool value) { m_threadStates[threadID].isBeingStepOut = value; }
 
 private:
 
+	using BreakPoint = std::pair<size_t, uint8_t>;
+
+	// スレッドごとのステップ実行と張り直しの状態
+	// 複数のスレッドが続けてブレークポイントに当たっても、張り直しやステップ実行の状態が混ざらないようにする
+	struct ThreadBreakState
+	{
+		// 元の命令を 1 つ実行させるために int3 を外しているアドレス
+		Optional<size_t> resetAddress;
+
+		Optional<BreakPoint> stepOverBp;
+		Optional<BreakPoint> stepOutBp;
+		uint64 stepOutFrame = 0;
+
+		Array<BreakPoint> stepRangeBps;
+		Array<size_t> stepRangeUnresolved;
+		uint64 stepRangeFrame = 0;
+
+		bool isBeingStepOver = false;
+		bool isBeingStepOut = false;
+		bool isBeingSingleInstruction = false;
+	};
+
+	// 一時ブレークポイントを張ったスレッドと種類（行まで実行はスレッドによらないので threadID は 0）
+	struct TemporaryOwner
+	{
+		DWORD threadID = 0;
+
+		BreakPointType type = BreakPointType::StepOver;
+	};
+
+	// アドレスごとの一時ブレークポイント（同じアドレスに複数のスレッド・種類が張ることがある）
+	// getBreakPointType などで全スレッドの一時ブレークポイントを順に見なくて済むように、アドレスで引けるようにしておく
+	struct TemporaryBreakPoint
+	{
+		uint8_t originalByte = 0;
+
+		Array<TemporaryOwner> owners;
+	};
+
+	const ThreadBreakState& threadState(DWORD threadID) const;
+
 	uint8_t setBreakPointAt(const ProcessHandle& process, size_t address);
 
 	void recoverBreakPoint(const ProcessHandle& process, size_t address, uint8_t original);
 
-	using BreakPoint = std::pair<size_t, uint8_t>;
+	// 一時ブレークポイントを張る（すでに int3 を張ってあるアドレスなら書き込まずに元のバイトを引き継ぐ）
+	BreakPoint setTemporaryBreakPointAt(const ProcessHandle& process, DWORD threadID, BreakPointType type, size_t address);
+
+	// 他に int3 がいらなければ元に戻す
+	void cancelTemporaryBreakPoint(const ProcessHandle& process, DWORD threadID, BreakPointType type, Optional<BreakPoint>& breakPoint);
+
+	// 昇順のアドレスに一時ブレークポイントを張って breakPoints に足す
+	// すでに int3 が入っているもの・張り直し待ちのものは書き込まず、残りはページごとにまとめて書き込む
+	void setTemporaryBreakPointsAt(const ProcessHandle& process, DWORD threadID, BreakPointType type, const Array<size_t>& sortedAddresses, Array<BreakPoint>& breakPoints);
+
+	// 表から外した一時ブレークポイントのうち、他に int3 がいらないものをページごとにまとめて元に戻す
+	void cancelTemporaryBreakPoints(const ProcessHandle& process, DWORD threadID, BreakPointType type, Array<BreakPoint> breakPoints);
 
-	HashTable<size_t, uint8_t> m_breakPoints; // アドレス→元のバイト値
-	Optional<BreakPoint> m_stepOverBp;
-	Optional<BreakPoint> m_stepOutBp;
+	void addTemporaryOwner(const BreakPoint& breakPoint, DWORD threadID, BreakPointType type);
+
+	void removeTemporaryOwner(size_t address, DWORD threadID, BreakPointType type);
+
+	// address に張ってある（ユーザー・一時）ブレークポイントの元のバイト
+	Optional<uint8_t> findOriginalByte(size_t address) const;
+
+	Optional<uint8_t> findTemporaryOriginalByte(size_t address) const;
+
+	bool isResetPending(size_t address) const;
+
+	BreakPointIndex m_breakPoints;
+	HashTable<size_t, BreakPointOptions> m_options;
+	DisplacedStepping m_displacedStepping;
+	HashTable<DWORD, ThreadBreakState> m_threadStates;
+	Array<BreakPoint> m_runToBps;
+	HashTable<size_t, TemporaryBreakPoint> m_temporaries;
+	size_t m_pendingResetCount = 0;
 	bool m_isFirstBpOccured = false;
 	bool m_isSecondBpOccured = false;
-	Optional<size_t> m_resetUserBpAddress;
-
-	bool m_isBeingStepOver = false;
-	bool m_isBeingStepOut = false;
-	bool m_isBeingSingleInstruction = false;
 };
@@ -0,0 +1,892 @@
+﻿#include "BreakPointCondition.hpp"
+#include "ProcessHandle.hpp"
+
+namespace
+{
+	struct RegisterName
+	{
+		StringView name;
+
+		size_t offset;
+	};
+
+	constexpr RegisterName Registers[] =
+	{
+		{ U"rax", offsetof(CONTEXT, Rax) },
+		{ U"rcx", offsetof(CONTEXT, Rcx) },
+		{ U"rdx", offsetof(CONTEXT, Rdx) },
+		{ U"rbx", offsetof(CONTEXT, Rbx) },
+		{ U"rsp", offsetof(CONTEXT, Rsp) },
+		{ U"rbp", offsetof(CONTEXT, Rbp) },
+		{ U"rsi", offsetof(CONTEXT, Rsi) },
+		{ U"rdi", offsetof(CONTEXT, Rdi) },
+		{ U"r8", offsetof(CONTEXT, R8) },
+		{ U"r9", offsetof(CONTEXT, R9) },
+		{ U"r10", offsetof(CONTEXT, R10) },
+		{ U"r11", offsetof(CONTEXT, R11) },
+		{ U"r12", offsetof(CONTEXT, R12) },
+		{ U"r13", offsetof(CONTEXT, R13) },
+		{ U"r14", offsetof(CONTEXT, R14) },
+		{ U"r15", offsetof(CONTEXT, R15) },
+		{ U"rip", offsetof(CONTEXT, Rip) },
+	};
+
+	size_t SizeOf(ConditionValueType type)
+	{
+		switch (type)
+		{
+		case ConditionValueType::Bool:
+		case ConditionValueType::Int8:
+		case ConditionValueType::UInt8:
+			return 1;
+		case ConditionValueType::Int16:
+		case ConditionValueType::UInt16:
+			return 2;
+		case ConditionValueType::Int32:
+		case ConditionValueType::UInt32:
+		case ConditionValueType::Float:
+			return 4;
+		case ConditionValueType::Int64:
+		case ConditionValueType::UInt64:
+		case ConditionValueType::Double:
+		case ConditionValueType::Pointer:
+			return 8;
+		default:
+			return 0;
+		}
+	}
+
+	bool IsIdentifierChar(char32 ch)
+	{
+		return IsAlnum(ch) || ch == U'_';
+	}
+
+	using Value = ConditionValue;
+
+	Value LoadValue(ConditionValueType type, const uint8* data)
+	{
+		const auto load = [&]<class T>(T)
+		{
+			T value;
+			std::memcpy(&value, data, sizeof(T));
+			return value;
+		};
+
+		switch (type)
+		{
+		case ConditionValueType::Bool:    return Value::Int(load(uint8{}) != 0);
+		case ConditionValueType::Int8:    return Value::Int(load(int8{}));
+		case ConditionValueType::UInt8:   return Value::Int(load(uint8{}));
+		case ConditionValueType::Int16:   return Value::Int(load(int16{}));
+		case ConditionValueType::UInt16:  return Value::Int(load(uint16{}));
+		case ConditionValueType::Int32:   return Value::Int(load(int32{}));
+		case ConditionValueType::UInt32:  return Value::Int(load(uint32{}));
+		case ConditionValueType::Float:   return Value::Float(load(float{}));
+		case ConditionValueType::Double:  return Value::Float(load(double{}));
+		case ConditionValueType::UInt64:
+		case ConditionValueType::Pointer: return Value::UInt(load(uint64{}));
+		default:                          return Value::Int(load(int64{}));
+		}
+	}
+}
+
+// 式を読みながらそのままバイトコードを出力する（再帰下降）
+class ConditionCompiler
+{
+public:
+
+	ConditionCompiler(StringView expression, const ConditionSymbolResolver& resolver, BreakPointCondition& condition)
+		: m_text(expression)
+		, m_resolver(resolver)
+		, m_code(condition.m_code) {}
+
+	bool compile(bool asBool)
+	{
+		if (not parseValue(&ConditionCompiler::parseLogicalOr))
+		{
+			return false;
+		}
+
+		skipSpaces();
+		if (m_pos != m_text.size())
+		{
+			return fail(U"式の終わりに余分な文字があります");
+		}
+
+		if (asBool)
+		{
+			emit(ConditionOp::ToBool, 0);
+		}
+
+		if (BreakPointCondition::MaxStackDepth < static_cast<size_t>(m_maxDepth))
+		{
+			return fail(U"式が複雑すぎます");
+		}
+
+		return true;
+	}
+
+	const String& error() const { return m_error; }
+
+private:
+
+	// 解析した式が表すもの: 値（スタックに積んである）か、
+	// 変数などの場所（アドレスを積んであり、値として使うときに Load する）
+	struct Operand
+	{
+		bool isPlace = false;
+
+		ConditionSymbol symbol;
+	};
+
+	using ParseFunction = Optional<Operand>(ConditionCompiler::*)();
+
+	bool fail(StringView message)
+	{
+		if (m_error.isEmpty())
+		{
+			m_error = U"{} ({}文字目)"_fmt(message, m_pos + 1);
+		}
+		return false;
+	}
+
+	void emit(ConditionOp op, int stackEffect, int64 imm = 0, ConditionValueType type = ConditionValueType::None, uint16 registerOffset = 0)
+	{
+		m_code.push_back({ op, type, registerOffset, imm });
+		m_depth += stackEffect;
+		m_maxDepth = Max(m_maxDepth, m_depth);
+	}
+
+	// 直前の命令がアドレスの計算ならそこにまとめる
+	void emitAddOffset(int64 offset)
+	{
+		if (offset == 0)
+		{
+			return;
+		}
+
+		if (not m_code.empty() && (m_code.back().op == ConditionOp::PushInt || m_code.back().op == ConditionOp::LoadRegister))
+		{
+			m_code.back().imm += offset;
+			return;
+		}
+
+		emit(ConditionOp::PushInt, 1, offset);
+		emit(ConditionOp::Add, -1);
+	}
+
+	// 場所なら値を読む
+	bool toValue(Operand& operand)
+	{
+		if (not operand.isPlace)
+		{
+			return true;
+		}
+
+		if (operand.symbol.type == ConditionValueType::None)
+		{
+			return fail(U"構造体は値として使えません");
+		}
+
+		emit(ConditionOp::Load, 0, 0, operand.symbol.type);
+		operand.isPlace = false;
+		return true;
+	}
+
+	bool parseValue(ParseFunction parse)
+	{
+		auto operand = (this->*parse)();
+		return operand && toValue(*operand);
+	}
+
+	void skipSpaces()
+	{
+		while (m_pos < m_text.size() && IsSpace(m_text[m_pos]))
+		{
+			++m_pos;
+		}
+	}
+
+	bool consume(StringView token)
+	{
+		skipSpaces();
+		if (m_text.substr(m_pos).starts_with(token))
+		{
+			m_pos += token.size();
+			return true;
+		}
+		return false;
+	}
+
+	// token の直後に続く文字が exclude に含まれていれば読まない（& と && を区別する）
+	bool consumeOperator(StringView token, StringView exclude = U"")
+	{
+		skipSpaces();
+		if (not m_text.substr(m_pos).starts_with(token))
+		{
+			return false;
+		}
+
+		const size_t next = m_pos + token.size();
+		if (next < m_text.size() && exclude.contains(m_text[next]))
+		{
+			return false;
+		}
+
+		m_pos = next;
+		return true;
+	}
+
+	String readIdentifier()
+	{
+		skipSpaces();
+		const size_t begin = m_pos;
+		while (m_pos < m_text.size() && IsIdentifierChar(m_text[m_pos]))
+		{
+			++m_pos;
+		}
+		return String(m_text.substr(begin, m_pos - begin));
+	}
+
+	Optional<Operand> parseLogicalOr()
+	{
+		return parseShortCircuit(U"||", ConditionOp::JumpIfTrueOrPop, &ConditionCompiler::parseLogicalAnd);
+	}
+
+	Optional<Operand> parseLogicalAnd()
+	{
+		return parseShortCircuit(U"&&", ConditionOp::JumpIfFalseOrPop, &ConditionCompiler::parseBitOr);
+	}
+
+	Optional<Operand> parseShortCircuit(StringView token, ConditionOp jumpOp, ParseFunction parseOperand)
+	{
+		auto lhs = (this->*parseOperand)();
+		if (not lhs)
+		{
+			return none;
+		}
+
+		while (consumeOperator(token))
+		{
+			if (not toValue(*lhs))
+			{
+				return none;
+			}
+
+			emit(ConditionOp::ToBool, 0);
+			const size_t jump = m_code.size();
+			emit(jumpOp, -1);
+
+			if (not parseValue(parseOperand))
+			{
+				return none;
+			}
+
+			emit(ConditionOp::ToBool, 0);
+			m_code[jump].imm = static_cast<int64>(m_code.size());
+			lhs = Operand{};
+		}
+
+		return lhs;
+	}
+
+	struct BinaryOperator
+	{
+		StringView token;
+
+		StringView exclude;
+
+		ConditionOp op;
+	};
+
+	Optional<Operand> parseBinary(std::initializer_list<BinaryOperator> operators, ParseFunction parseOperand)
+	{
+		auto lhs = (this->*parseOperand)();
+		if (not lhs)
+		{
+			return none;
+		}
+
+		while (true)
+		{
+			const BinaryOperator* matched = nullptr;
+			for (const auto& candidate : operators)
+			{
+				if (consumeOperator(candidate.token, candidate.exclude))
+				{
+					matched = &candidate;
+					break;
+				}
+			}
+
+			if (not matched)
+			{
+				return lhs;
+			}
+
+			if (not toValue(*lhs) || not parseValue(parseOperand))
+			{
+				return none;
+			}
+
+			emit(matched->op, -1);
+			lhs = Operand{};
+		}
+	}
+
+	Optional<Operand> parseBitOr()
+	{
+		return parseBinary({ { U"|", U"|", ConditionOp::BitOr } }, &ConditionCompiler::parseBitXor);
+	}
+
+	Optional<Operand> parseBitXor()
+	{
+		return parseBinary({ { U"^", U"", ConditionOp::BitXor } }, &ConditionCompiler::parseBitAnd);
+	}
+
+	Optional<Operand> parseBitAnd()
+	{
+		return parseBinary({ { U"&", U"&", ConditionOp::BitAnd } }, &ConditionCompiler::parseEquality);
+	}
+
+	Optional<Operand> parseEquality()
+	{
+		return parseBinary({
+			{ U"==", U"", ConditionOp::Equal },
+			{ U"!=", U"", ConditionOp::NotEqual },
+		}, &ConditionCompiler::parseRelational);
+	}
+
+	Optional<Operand> parseRelational()
+	{
+		return parseBinary({
+			{ U"<=", U"", ConditionOp::LessEqual },
+			{ U">=", U"", ConditionOp::GreaterEqual },
+			{ U"<", U"<", ConditionOp::Less },
+			{ U">", U">", ConditionOp::Greater },
+		}, &ConditionCompiler::parseShift);
+	}
+
+	Optional<Operand> parseShift()
+	{
+		return parseBinary({
+			{ U"<<", U"", ConditionOp::ShiftLeft },
+			{ U">>", U"", ConditionOp::ShiftRight },
+		}, &ConditionCompiler::parseAdditive);
+	}
+
+	Optional<Operand> parseAdditive()
+	{
+		return parseBinary({
+			{ U"+", U"", ConditionOp::Add },
+			{ U"-", U">", ConditionOp::Sub },
+		}, &ConditionCompiler::parseMultiplicative);
+	}
+
+	Optional<Operand> parseMultiplicative()
+	{
+		return parseBinary({
+			{ U"*", U"", ConditionOp::Mul },
+			{ U"/", U"", ConditionOp::Div },
+			{ U"%", U"", ConditionOp::Mod },
+		}, &ConditionCompiler::parseUnary);
+	}
+
+	Optional<Operand> parseUnary()
+	{
+		const struct
+		{
+			StringView token;
+			StringView exclude;
+			ConditionOp op;
+		} unaryOperators[] =
+		{
+			{ U"!", U"=", ConditionOp::LogicalNot },
+			{ U"-", U"", ConditionOp::Negate },
+			{ U"~", U"", ConditionOp::BitNot },
+		};
+
+		for (const auto& unary : unaryOperators)
+		{
+			if (consumeOperator(unary.token, unary.exclude))
+			{
+				if (not parseValue(&ConditionCompiler::parseUnary))
+				{
+					return none;
+				}
+				emit(unary.op, 0);
+				return Operand{};
+			}
+		}
+
+		if (consumeOperator(U"+"))
+		{
+			return parseUnary();
+		}
+
+		// ポインタの参照: 値を読んで、指す先を場所にする
+		if (consumeOperator(U"*"))
+		{
+			auto operand = parseUnary();
+			if (not operand)
+			{
+				return none;
+			}
+			return dereference(*operand);
+		}
+
+		return parsePostfix();
+	}
+
+	Optional<Operand> dereference(Operand& pointer)
+	{
+		if (pointer.symbol.type != ConditionValueType::Pointer || not pointer.isPlace)
+		{
+			fail(U"ポインタではありません");
+			return none;
+		}
+
+		const auto pointee = m_resolver.findPointee(pointer.symbol);
+		if (not pointee)
+		{
+			fail(U"ポインタの指す先の型が分かりません");
+			return none;
+		}
+
+		emit(ConditionOp::Load, 0, 0, ConditionValueType::Pointer);
+		return Operand{ true, *pointee };
+	}
+
+	Optional<Operand> parsePostfix()
+	{
+		auto operand = parsePrimary();
+
+		while (operand)
+		{
+			if (consumeOperator(U"->"))
+			{
+				operand = dereference(*operand);
+				if (not operand)
+				{
+					return none;
+				}
+			}
+			else if (not consumeOperator(U".", U"0123456789"))
+			{
+				break;
+			}
+
+			if (not operand->isPlace)
+			{
+				fail(U"メンバーを持つ変数ではありません");
+				return none;
+			}
+
+			const String name = readIdentifier();
+			const auto member = m_resolver.findMember(operand->symbol, name);
+			if (not member)
+			{
+				fail(U"メンバー {} が見つかりません"_fmt(name));
+				return none;
+			}
+
+			emitAddOffset(member->offset);
+			operand->symbol = *member;
+		}
+
+		return operand;
+	}
+
+	Optional<Operand> parsePrimary()
+	{
+		skipSpaces();
+		if (m_text.size() <= m_pos)
+		{
+			fail(U"式が途中で終わっています");
+			return none;
+		}
+
+		if (consume(U"("))
+		{
+			auto operand = parseLogicalOr();
+			if (not operand || not consume(U")"))
+			{
+				fail(U") がありません");
+				return none;
+			}
+			return operand;
+		}
+
+		if (IsDigit(m_text[m_pos]))
+		{
+			return parseNumber();
+		}
+
+		// レジスタ
+		if (consume(U"$"))
+		{
+			const String name = readIdentifier().lowercased();
+			for (const auto& reg : Registers)
+			{
+				if (reg.name == name)
+				{
+					emit(ConditionOp::LoadRegister, 1, 0, ConditionValueType::None, static_cast<uint16>(reg.offset));
+					return Operand{};
+				}
+			}
+			fail(U"レジスタ ${} はありません"_fmt(name));
+			return none;
+		}
+
+		// 名前（名前空間を含む）
+		String name = readIdentifier();
+		while (consume(U"::"))
+		{
+			name += U"::" + readIdentifier();
+		}
+
+		if (name.isEmpty())
+		{
+			fail(U"式を読めません");
+			return none;
+		}
+
+		if (name == U"true" || name == U"false")
+		{
+			emit(ConditionOp::PushInt, 1, (name == U"true") ? 1 : 0);
+			return Operand{};
+		}
+
+		const auto symbol = m_resolver.findVariable(name);
+		if (not symbol)
+		{
+			fail(U"変数 {} が見つかりません"_fmt(name));
+			return none;
+		}
+
+		// 変数の場所をスタックに積む
+		if (symbol->registerOffset)
+		{
+			emit(ConditionOp::LoadRegister, 1, symbol->offset, ConditionValueType::None, *symbol->registerOffset);
+		}
+		else
+		{
+			emit(ConditionOp::PushInt, 1, symbol->offset);
+		}
+
+		return Operand{ true, *symbol };
+	}
+
+	Optional<Operand> parseNumber()
+	{
+		const size_t begin = m_pos;
+		bool isFloat = false;
+
+		if (m_text.substr(m_pos).starts_with(U"0x") || m_text.substr(m_pos).starts_with(U"0X"))
+		{
+			m_pos += 2;
+			while (m_pos < m_text.size() && IsXdigit(m_text[m_pos]))
+			{
+				++m_pos;
+			}
+		}
+		else
+		{
+			while (m_pos < m_text.size() && (IsDigit(m_text[m_pos]) || m_text[m_pos] == U'.'))
+			{
+				isFloat |= (m_text[m_pos] == U'.');
+				++m_pos;
+			}
+		}
+
+		const String token(m_text.substr(begin, m_pos - begin));
+
+		// 整数の接尾辞は u だけを見る（l は 64 ビットで計算するので関係ない）
+		bool hasUnsignedSuffix = false;
+		while (m_pos < m_text.size() && (m_text[m_pos] == U'u' || m_text[m_pos] == U'U' || m_text[m_pos] == U'l' || m_text[m_pos] == U'L' || (isFloat && m_text[m_pos] == U'f')))
+		{
+			hasUnsignedSuffix |= (m_text[m_pos] == U'u' || m_text[m_pos] == U'U');
+			++m_pos;
+		}
+
+		if (isFloat)
+		{
+			const auto value = ParseOpt<double>(token);
+			if (not value)
+			{
+				fail(U"数値を読めません");
+				return none;
+			}
+			emit(ConditionOp::PushFloat, 1, std::bit_cast<int64>(*value));
+		}
+		else
+		{
+			const auto value = token.starts_with(U"0x") || token.starts_with(U"0X")
+				? ParseIntOpt<uint64>(token.substr(2), Arg::radix = 16)
+				: ParseIntOpt<uint64>(token);
+			if (not value)
+			{
+				fail(U"数値を読めません");
+				return none;
+			}
+			// int64 に入らない数も C++ と同じく符号なしになる
+			const bool isUnsigned = (hasUnsignedSuffix || static_cast<uint64>(INT64_MAX) < *value);
+			emit(ConditionOp::PushInt, 1, static_cast<int64>(*value), (isUnsigned ? ConditionValueType::UInt64 : ConditionValueType::None));
+		}
+
+		return Operand{};
+	}
+
+	const StringView m_text;
+
+	const ConditionSymbolResolver& m_resolver;
+
+	Array<ConditionInstruction>& m_code;
+
+	size_t m_pos = 0;
+
+	int m_depth = 0;
+
+	int m_maxDepth = 0;
+
+	String m_error;
+};
+
+Optional<BreakPointCondition> BreakPointCondition::Compile(StringView expression, const ConditionSymbolResolver& resolver, String& errorMessage)
+{
+	BreakPointCondition condition;
+	condition.m_expression = expression;
+
+	ConditionCompiler compiler(expression, resolver, condition);
+	if (not compiler.compile(true))
+	{
+		errorMessage = compiler.error();
+		return none;
+	}
+
+	return condition;
+}
+
+Optional<BreakPointCondition> BreakPointCondition::CompileValue(StringView expression, const ConditionSymbolResolver& resolver, String& errorMessage)
+{
+	BreakPointCondition condition;
+	condition.m_expression = expression;
+
+	ConditionCompiler compiler(expression, resolver, condition);
+	if (not compiler.compile(false))
+	{
+		errorMessage = compiler.error();
+		return none;
+	}
+
+	return condition;
+}
+
+Optional<bool> BreakPointCondition::evaluate(const CONTEXT& context, const ProcessHandle& process) const
+{
+	if (const auto value = evaluateValue(context, process))
+	{
+		return value->isTrue();
+	}
+	return none;
+}
+
+Optional<ConditionValue> BreakPointCondition::evaluateValue(const CONTEXT& context, const ProcessHandle& process) const
+{
+	Value stack[MaxStackDepth];
+	size_t top = 0;
+
+	const auto* contextBytes = reinterpret_cast<const uint8*>(&context);
+
+	for (size_t pc = 0; pc < m_code.size(); ++pc)
+	{
+		const auto& instruction = m_code[pc];
+
+		switch (instruction.op)
+		{
+		case ConditionOp::PushInt:
+			stack[top++] = (instruction.type == ConditionValueType::UInt64) ? Value::UInt(static_cast<uint64>(instruction.imm)) : Value::Int(instruction.imm);
+			break;
+
+		case ConditionOp::PushFloat:
+			stack[top++] = Value::Float(std::bit_cast<double>(instruction.imm));
+			break;
+
+		case ConditionOp::LoadRegister:
+		{
+			uint64 value;
+			std::memcpy(&value, contextBytes + instruction.registerOffset, sizeof(value));
+			stack[top++] = Value::Int(static_cast<int64>(value) + instruction.imm);
+			break;
+		}
+
+		case ConditionOp::Load:
+		{
+			uint8 data[8];
+			if (not process.readMemory(static_cast<size_t>(stack[top - 1].i), SizeOf(instruction.type), data))
+			{
+				return none;
+			}
+			stack[top - 1] = LoadValue(instruction.type, data);
+			break;
+		}
+
+		case ConditionOp::Negate:
+			if (stack[top - 1].isFloat)
+			{
+				stack[top - 1] = Value::Float(-stack[top - 1].f);
+			}
+			else
+			{
+				// 符号なしは符号なしのまま 2 の補数を取る（INT64_MIN もあふれない）
+				stack[top - 1].i = static_cast<int64>(0 - static_cast<uint64>(stack[top - 1].i));
+			}
+			break;
+
+		case ConditionOp::BitNot:
+			stack[top - 1].i = ~stack[top - 1].i;
+			break;
+
+		case ConditionOp::LogicalNot:
+			stack[top - 1] = Value::Int(not stack[top - 1].isTrue());
+			break;
+
+		case ConditionOp::ToBool:
+			stack[top - 1] = Value::Int(stack[top - 1].isTrue());
+			break;
+
+		case ConditionOp::JumpIfFalseOrPop:
+			if (not stack[top - 1].isTrue())
+			{
+				pc = static_cast<size_t>(instruction.imm) - 1;
+			}
+			else
+			{
+				--top;
+			}
+			break;
+
+		case ConditionOp::JumpIfTrueOrPop:
+			if (stack[top - 1].isTrue())
+			{
+				pc = static_cast<size_t>(instruction.imm) - 1;
+			}
+			else
+			{
+				--top;
+			}
+			break;
+
+		default:
+		{
+			// 二項演算
+			const Value rhs = stack[--top];
+			const Value lhs = stack[top - 1];
+			Value& result = stack[top - 1];
+
+			// どちらかが小数なら小数で計算する（ビット演算・シフト・剰余は整数のみ）
+			if (lhs.isFloat || rhs.isFloat)
+			{
+				const double a = lhs.asFloat();
+				const double b = rhs.asFloat();
+
+				switch (instruction.op)
+				{
+				case ConditionOp::Add:          result = Value::Float(a + b); break;
+				case ConditionOp::Sub:          result = Value::Float(a - b); break;
+				case ConditionOp::Mul:          result = Value::Float(a * b); break;
+				case ConditionOp::Div:          result = Value::Float(a / b); break;
+				case ConditionOp::Equal:        result = Value::Int(a == b); break;
+				case ConditionOp::NotEqual:     result = Value::Int(a != b); break;
+				case ConditionOp::Less:         result = Value::Int(a < b); break;
+				case ConditionOp::LessEqual:    result = Value::Int(a <= b); break;
+				case ConditionOp::Greater:      result = Value::Int(a > b); break;
+				case ConditionOp::GreaterEqual: result = Value::Int(a >= b); break;
+				default:
+					return none;
+				}
+				break;
+			}
+
+			// どちらかが符号なしなら符号なしで計算する（シフトは左辺の型に合わせる）
+			if ((lhs.isUnsigned || rhs.isUnsigned) && (instruction.op != ConditionOp::ShiftLeft && instruction.op != ConditionOp::ShiftRight))
+			{
+				const uint64 a = static_cast<uint64>(lhs.i);
+				const uint64 b = static_cast<uint64>(rhs.i);
+
+				switch (instruction.op)
+				{
+				case ConditionOp::Add:          result = Value::UInt(a + b); break;
+				case ConditionOp::Sub:          result = Value::UInt(a - b); break;
+				case ConditionOp::Mul:          result = Value::UInt(a * b); break;
+				case ConditionOp::Div:
+				case ConditionOp::Mod:
+					if (b == 0)
+					{
+						return none;
+					}
+					result = Value::UInt((instruction.op == ConditionOp::Div) ? (a / b) : (a % b));
+					break;
+				case ConditionOp::BitAnd:       result = Value::UInt(a & b); break;
+				case ConditionOp::BitOr:        result = Value::UInt(a | b); break;
+				case ConditionOp::BitXor:       result = Value::UInt(a ^ b); break;
+				case ConditionOp::Equal:        result = Value::Int(a == b); break;
+				case ConditionOp::NotEqual:     result = Value::Int(a != b); break;
+				case ConditionOp::Less:         result = Value::Int(a < b); break;
+				case ConditionOp::LessEqual:    result = Value::Int(a <= b); break;
+				case ConditionOp::Greater:      result = Value::Int(a > b); break;
+				case ConditionOp::GreaterEqual: result = Value::Int(a >= b); break;
+				default:
+					return none;
+				}
+				break;
+			}
+
+			const int64 a = lhs.i;
+			const int64 b = rhs.i;
+
+			switch (instruction.op)
+			{
+			case ConditionOp::Add:          result = Value::Int(static_cast<int64>(static_cast<uint64>(a) + static_cast<uint64>(b))); break;
+			case ConditionOp::Sub:          result = Value::Int(static_cast<int64>(static_cast<uint64>(a) - static_cast<uint64>(b))); break;
+			case ConditionOp::Mul:          result = Value::Int(static_cast<int64>(static_cast<uint64>(a) * static_cast<uint64>(b))); break;
+			case ConditionOp::Div:
+			case ConditionOp::Mod:
+				if (b == 0 || (a == INT64_MIN && b == -1))
+				{
+					return none;
+				}
+				result = Value::Int((instruction.op == ConditionOp::Div) ? (a / b) : (a % b));
+				break;
+			case ConditionOp::BitAnd:       result = Value::Int(a & b); break;
+			case ConditionOp::BitOr:        result = Value::Int(a | b); break;
+			case ConditionOp::BitXor:       result = Value::Int(a ^ b); break;
+			case ConditionOp::ShiftLeft:    result = Value::Int(static_cast<int64>(static_cast<uint64>(a) << (b & 63))); break;
+			case ConditionOp::ShiftRight:   result = Value::Int(lhs.isUnsigned ? static_cast<int64>(static_cast<uint64>(a) >> (b & 63)) : (a >> (b & 63))); break;
+			case ConditionOp::Equal:        result = Value::Int(a == b); break;
+			case ConditionOp::NotEqual:     result = Value::Int(a != b); break;
+			case ConditionOp::Less:         result = Value::Int(a < b); break;
+			case ConditionOp::LessEqual:    result = Value::Int(a <= b); break;
+			case ConditionOp::Greater:      result = Value::Int(a > b); break;
+			case ConditionOp::GreaterEqual: result = Value::Int(a >= b); break;
+			default:
+				return none;
+			}
+
+			// シフトの結果は左辺の型
+			if (instruction.op == ConditionOp::ShiftLeft || instruction.op == ConditionOp::ShiftRight)
+			{
+				result.isUnsigned = lhs.isUnsigned;
+			}
+			break;
+		}
+		}
+	}
+
+	if (top != 1)
+	{
+		return none;
+	}
+
+	return stack[0];
+}
@@ -0,0 +1,182 @@
+﻿#pragma once
+#include "DebugTypes.hpp"
+
+class ProcessHandle;
+
+// 条件式で読み書きする値の型
+enum class ConditionValueType : uint8
+{
+	None,       // 構造体など、そのままでは値として読めないもの
+	Bool,
+	Int8,
+	UInt8,
+	Int16,
+	UInt16,
+	Int32,
+	UInt32,
+	Int64,
+	UInt64,
+	Float,
+	Double,
+	Pointer,
+};
+
+// 条件式の変数名・メンバー名を解決した結果
+struct ConditionSymbol
+{
+	ConditionValueType type = ConditionValueType::None;
+
+	// 変数: registerOffset（CONTEXT 内のレジスタの位置）があればそのレジスタからのオフセット（ローカル変数）、
+	// なければ絶対アドレス
+	// メンバー: 親の先頭からのオフセット
+	Optional<uint16> registerOffset;
+
+	int64 offset = 0;
+
+	// メンバーやポインタの先をたどるための型（解決する側だけが使う）
+	uint32 typeID = 0;
+
+	uint32 pointeeTypeID = 0;
+};
+
+// 名前の解決（デバッグ情報の読み方はプラットフォームごとに ProcessHandle が用意する）
+class ConditionSymbolResolver
+{
+public:
+
+	virtual ~ConditionSymbolResolver() = default;
+
+	virtual Optional<ConditionSymbol> findVariable(StringView name) const = 0;
+
+	virtual Optional<ConditionSymbol> findMember(const ConditionSymbol& parent, StringView name) const = 0;
+
+	// ポインタが指す先の型（オフセットは 0）
+	virtual Optional<ConditionSymbol> findPointee(const ConditionSymbol& pointer) const = 0;
+};
+
+enum class ConditionOp : uint8
+{
+	PushInt,          // imm（type が UInt64 なら符号なし）
+	PushFloat,        // imm（double のビット列）
+	LoadRegister,     // CONTEXT の registerOffset にあるレジスタ + imm
+	Load,             // アドレスを取り出して type の値を読む
+	Add,
+	Sub,
+	Mul,
+	Div,
+	Mod,
+	BitAnd,
+	BitOr,
+	BitXor,
+	ShiftLeft,
+	ShiftRight,
+	Equal,
+	NotEqual,
+	Less,
+	LessEqual,
+	Greater,
+	GreaterEqual,
+	Negate,
+	BitNot,
+	LogicalNot,
+	ToBool,
+	JumpIfFalseOrPop, // 先頭が偽なら残したまま imm へ、真なら取り除いて次へ（&&）
+	JumpIfTrueOrPop,  // ||
+};
+
+// 式の値（整数か小数）
+// 整数は 64 ビットで計算し、C++ と同じく片方が符号なし（uint64・ポインタ・u の付いた数）なら符号なしで計算・比較する
+// 32 ビット以下の符号なし整数は値を変えずに int64 にする
+struct ConditionValue
+{
+	union
+	{
+		int64 i;
+		double f;
+	};
+
+	bool isFloat;
+
+	// i を uint64 として扱う
+	bool isUnsigned;
+
+	static ConditionValue Int(int64 value)
+	{
+		ConditionValue v;
+		v.i = value;
+		v.isFloat = false;
+		v.isUnsigned = false;
+		return v;
+	}
+
+	static ConditionValue UInt(uint64 value)
+	{
+		ConditionValue v;
+		v.i = static_cast<int64>(value);
+		v.isFloat = false;
+		v.isUnsigned = true;
+		return v;
+	}
+
+	static ConditionValue Float(double value)
+	{
+		ConditionValue v;
+		v.f = value;
+		v.isFloat = true;
+		v.isUnsigned = false;
+		return v;
+	}
+
+	double asFloat() const { return isFloat ? f : (isUnsigned ? static_cast<double>(static_cast<uint64>(i)) : static_cast<double>(i)); }
+
+	bool isTrue() const { return isFloat ? (f != 0.0) : (i != 0); }
+};
+
+struct ConditionInstruction
+{
+	ConditionOp op;
+
+	ConditionValueType type = ConditionValueType::None;
+
+	uint16 registerOffset = 0;
+
+	int64 imm = 0;
+};
+
+// ブレークポイントの条件式
+//
+// `i == 1000 && player.hp < 0` のような式を、張るときに一度だけデバッグ情報で名前を解決して
+// スタックマシンのバイトコードにしておき、ブレークポイントに当たるたびにレジスタとメモリを直接読んで評価する
+//
+// 使えるもの: 整数・小数・true/false、変数、. と -> によるメンバー、単項 * によるポインタの参照、
+// $rax などのレジスタ、C++ と同じ優先順位の算術・比較・ビット・論理演算
+class BreakPointCondition
+{
+public:
+
+	// 解釈できなければ none を返し、errorMessage に理由を入れる
+	static Optional<BreakPointCondition> Compile(StringView expression, const ConditionSymbolResolver& resolver, String& errorMessage);
+
+	// 真偽値にせず値のまま返す式（トレースポイントのメッセージに埋め込む値など）
+	static Optional<BreakPointCondition> CompileValue(StringView expression, const ConditionSymbolResolver& resolver, String& errorMessage);
+
+	// 読めないメモリやゼロ除算に当たった場合は none
+	Optional<bool> evaluate(const CONTEXT& context, const ProcessHandle& process) const;
+
+	Optional<ConditionValue> evaluateValue(const CONTEXT& context, const ProcessHandle& process) const;
+
+	const String& expression() const { return m_expression; }
+
+	const Array<ConditionInstruction>& code() const { return m_code; }
+
+	// 評価に使うスタックの最大の深さ
+	static constexpr size_t MaxStackDepth = 32;
+
+private:
+
+	friend class ConditionCompiler;
+
+	String m_expression;
+
+	Array<ConditionInstruction> m_code;
+};
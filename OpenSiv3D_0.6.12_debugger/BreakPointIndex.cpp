@@ -0,0 +1,186 @@
+﻿#include "BreakPointIndex.hpp"
+#include <bit>
+#include <utility>
+
+namespace
+{
+	// フィボナッチハッシュ（命令のアドレスは下位ビットが偏るので掛け算で混ぜる）
+	constexpr uint64 HashMultiplier = 0x9E3779B97F4A7C15ull;
+}
+
+BreakPointEntry* BreakPointIndex::find(size_t address)
+{
+	return const_cast<BreakPointEntry*>(std::as_const(*this).find(address));
+}
+
+const BreakPointEntry* BreakPointIndex::find(size_t address) const
+{
+	if (m_size == 0 || address == EmptyAddress)
+	{
+		return nullptr;
+	}
+
+	const size_t mask = m_slots.size() - 1;
+	for (size_t i = slotOf(address);; i = (i + 1) & mask)
+	{
+		const auto& slot = m_slots[i];
+		if (slot.address == address)
+		{
+			return &slot;
+		}
+		if (slot.address == EmptyAddress)
+		{
+			return nullptr;
+		}
+	}
+}
+
+std::pair<BreakPointEntry*, bool> BreakPointIndex::insert(size_t address)
+{
+	if (address == EmptyAddress)
+	{
+		return { nullptr, false };
+	}
+
+	if (m_slots.size() < (m_size + 1) * 2)
+	{
+		rehash(Max(MinCapacity, m_slots.size() * 2));
+	}
+
+	const size_t mask = m_slots.size() - 1;
+	for (size_t i = slotOf(address);; i = (i + 1) & mask)
+	{
+		auto& slot = m_slots[i];
+		if (slot.address == address)
+		{
+			return { &slot, false };
+		}
+		if (slot.address == EmptyAddress)
+		{
+			slot = BreakPointEntry{};
+			slot.address = address;
+			++m_size;
+			m_isSortedDirty = true;
+			return { &slot, true };
+		}
+	}
+}
+
+bool BreakPointIndex::erase(size_t address)
+{
+	if (m_size == 0 || address == EmptyAddress)
+	{
+		return false;
+	}
+
+	const size_t mask = m_slots.size() - 1;
+	size_t hole = slotOf(address);
+	while (m_slots[hole].address != address)
+	{
+		if (m_slots[hole].address == EmptyAddress)
+		{
+			return false;
+		}
+		hole = (hole + 1) & mask;
+	}
+
+	// 墓標を残さず、後ろに続く要素を詰めて探索の列が途切れないようにする
+	for (size_t i = (hole + 1) & mask; m_slots[i].address != EmptyAddress; i = (i + 1) & mask)
+	{
+		const size_t home = slotOf(m_slots[i].address);
+
+		// home が (hole, i] の外なら hole に移せる
+		const bool between = (hole < i) ? (hole < home && home <= i) : (hole < home || home <= i);
+		if (not between)
+		{
+			m_slots[hole] = m_slots[i];
+			hole = i;
+		}
+	}
+
+	m_slots[hole] = BreakPointEntry{};
+	--m_size;
+	m_isSortedDirty = true;
+	return true;
+}
+
+void BreakPointIndex::clear()
+{
+	m_slots.clear();
+	m_size = 0;
+	m_sortedAddresses.clear();
+	m_isSortedDirty = false;
+}
+
+void BreakPointIndex::reserve(size_t count)
+{
+	size_t capacity = MinCapacity;
+	while (capacity < count * 2)
+	{
+		capacity *= 2;
+	}
+
+	if (m_slots.size() < capacity)
+	{
+		rehash(capacity);
+	}
+}
+
+Array<size_t> BreakPointIndex::addressesInRange(size_t begin, size_t end) const
+{
+	sortIfNeeded();
+
+	const auto first = std::lower_bound(m_sortedAddresses.begin(), m_sortedAddresses.end(), begin);
+	const auto last = std::lower_bound(first, m_sortedAddresses.end(), end);
+	return Array<size_t>(first, last);
+}
+
+Array<size_t> BreakPointIndex::addresses() const
+{
+	sortIfNeeded();
+	return m_sortedAddresses;
+}
+
+size_t BreakPointIndex::slotOf(size_t address) const
+{
+	// 容量は 2 のべき乗なので上位ビットをそのまま使う
+	const int shift = 64 - std::countr_zero(m_slots.size());
+	return static_cast<size_t>((static_cast<uint64>(address) * HashMultiplier) >> shift);
+}
+
+void BreakPointIndex::rehash(size_t capacity)
+{
+	Array<BreakPointEntry> old(capacity);
+	old.swap(m_slots);
+
+	const size_t mask = m_slots.size() - 1;
+	for (const auto& entry : old)
+	{
+		if (entry.address == EmptyAddress)
+		{
+			continue;
+		}
+
+		size_t i = slotOf(entry.address);
+		while (m_slots[i].address != EmptyAddress)
+		{
+			i = (i + 1) & mask;
+		}
+		m_slots[i] = entry;
+	}
+}
+
+void BreakPointIndex::sortIfNeeded() const
+{
+	if (not m_isSortedDirty)
+	{
+		return;
+	}
+
+	m_sortedAddresses.clear();
+	m_sortedAddresses.reserve(m_size);
+	forEach([&](const BreakPointEntry& entry) { m_sortedAddresses.push_back(entry.address); });
+	std::sort(m_sortedAddresses.begin(), m_sortedAddresses.end());
+
+	m_isSortedDirty = false;
+}
@@ -0,0 +1,97 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+// ユーザーが張るブレークポイントの種類
+enum class BreakPointKind : uint8
+{
+	User,
+	Conditional,    // 条件式が成り立つときだけ止まる（条件式は BreakPointAttacher が持つ）
+	Tracepoint,     // メッセージを出力して続行する（N 回目で止めることもできる）
+	Counter,        // 当たった回数を数えるだけで止まらない
+	HitCount,       // N 回目に当たったときだけ止まる
+};
+
+struct BreakPointEntry
+{
+	size_t address = 0;
+
+	// int3 で上書きする前の命令のバイト
+	uint8 originalByte = 0;
+
+	BreakPointKind kind = BreakPointKind::User;
+
+	// false のときは int3 を外して元の命令に戻してある
+	bool enabled = true;
+
+	uint32 hitCount = 0;
+};
+
+// アドレス → ブレークポイントの表
+//
+// ブレークポイントに当たるたびに引くので、線形探索のオープンアドレス法で
+// 数が増えても 1 回の検索がほぼ一定の時間で済むようにする
+// 範囲の問い合わせ（関数内のブレークポイント全部など）用にアドレス順の配列も持つ
+class BreakPointIndex
+{
+public:
+
+	BreakPointEntry* find(size_t address);
+
+	const BreakPointEntry* find(size_t address) const;
+
+	bool contains(size_t address) const { return find(address) != nullptr; }
+
+	// 追加した要素と、新しく追加したかどうかを返す（すでにあれば既存の要素）
+	// アドレス 0 は空きの印に使うので追加できない
+	std::pair<BreakPointEntry*, bool> insert(size_t address);
+
+	bool erase(size_t address);
+
+	void clear();
+
+	void reserve(size_t count);
+
+	size_t size() const { return m_size; }
+
+	bool isEmpty() const { return m_size == 0; }
+
+	// [begin, end) にあるブレークポイントのアドレスを昇順で返す
+	Array<size_t> addressesInRange(size_t begin, size_t end) const;
+
+	// 全要素をアドレス順に
+	Array<size_t> addresses() const;
+
+	template <class Fty>
+	void forEach(Fty f) const
+	{
+		for (const auto& slot : m_slots)
+		{
+			if (slot.address != EmptyAddress)
+			{
+				f(slot);
+			}
+		}
+	}
+
+private:
+
+	static constexpr size_t EmptyAddress = 0;
+
+	static constexpr size_t MinCapacity = 16;
+
+	size_t slotOf(size_t address) const;
+
+	void rehash(size_t capacity);
+
+	void sortIfNeeded() const;
+
+	// 要素数は容量の半分以下に保つ（線形探索が長くならないように）
+	Array<BreakPointEntry> m_slots;
+
+	size_t m_size = 0;
+
+	// 範囲の問い合わせのときだけ並べ直す
+	mutable Array<size_t> m_sortedAddresses;
+
+	mutable bool m_isSortedDirty = false;
+};
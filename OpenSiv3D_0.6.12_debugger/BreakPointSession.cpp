@@ -0,0 +1,155 @@
+﻿#include "BreakPointSession.hpp"
+#include "LineTable.hpp"
+#include "FunctionIndex.hpp"
+
+namespace
+{
+	Array<size_t> ResolveLine(const LineTable& lineTable, const FunctionIndex& functionIndex, const Array<uint32>& fileIDs, uint32 lineNumber)
+	{
+		Array<size_t> addresses;
+
+		for (const auto fileID : fileIDs)
+		{
+			const FunctionEntry* lastFunction = nullptr;
+
+			// アドレス順なので、関数が変わったところだけ取れば関数ごとに一番前の範囲になる
+			for (const auto address : lineTable.findLineAddresses(fileID, lineNumber))
+			{
+				const FunctionEntry* function = functionIndex.findContaining(address);
+				if (function == nullptr || function != lastFunction)
+				{
+					addresses.push_back(address);
+				}
+				lastFunction = function;
+			}
+		}
+
+		return addresses;
+	}
+}
+
+FilePath BreakPointSession::DefaultPath(FilePathView exeFilePath)
+{
+	return FilePath{ exeFilePath } + U".breakpoints.json";
+}
+
+bool BreakPointSession::load(FilePathView path)
+{
+	m_breakPoints.clear();
+
+	const JSON json = JSON::Load(path);
+	if (not json)
+	{
+		return false;
+	}
+
+	for (const auto& element : json[U"breakpoints"].arrayView())
+	{
+		SessionBreakPoint breakPoint;
+
+		if (element.hasElement(U"file"))
+		{
+			breakPoint.fileName = element[U"file"].getString();
+			breakPoint.lineNumber = element[U"line"].get<uint32>();
+		}
+		else if (element.hasElement(U"function"))
+		{
+			breakPoint.pattern = element[U"function"].getString();
+		}
+		else
+		{
+			continue;
+		}
+
+		// 保存したときに重複は除いてあるので、そのまま足す
+		m_breakPoints.push_back(std::move(breakPoint));
+	}
+
+	return true;
+}
+
+bool BreakPointSession::save(FilePathView path) const
+{
+	JSON json;
+	json[U"breakpoints"] = Array<JSON>{};
+
+	for (const auto& breakPoint : m_breakPoints)
+	{
+		JSON element;
+		if (breakPoint.isLine())
+		{
+			element[U"file"] = breakPoint.fileName;
+			element[U"line"] = breakPoint.lineNumber;
+		}
+		else
+		{
+			element[U"function"] = breakPoint.pattern;
+		}
+		json[U"breakpoints"].push_back(element);
+	}
+
+	return json.save(path);
+}
+
+void BreakPointSession::add(const SessionBreakPoint& breakPoint)
+{
+	if (not m_breakPoints.contains(breakPoint))
+	{
+		m_breakPoints.push_back(breakPoint);
+	}
+}
+
+bool BreakPointSession::remove(const SessionBreakPoint& breakPoint)
+{
+	const size_t before = m_breakPoints.size();
+	m_breakPoints.remove_if([&](const SessionBreakPoint& element) { return element == breakPoint; });
+	return m_breakPoints.size() != before;
+}
+
+Array<size_t> BreakPointSession::resolve(const LineTable& lineTable, const FunctionIndex& functionIndex, size_t& unresolved) const
+{
+	// 同じファイルの行がたくさんあるので、ファイル名の照合はファイルごとに 1 回にする
+	HashTable<String, Array<uint32>> fileIDs;
+
+	Array<size_t> addresses;
+	unresolved = 0;
+
+	for (const auto& breakPoint : m_breakPoints)
+	{
+		Array<size_t> found;
+
+		if (breakPoint.isLine())
+		{
+			auto it = fileIDs.find(breakPoint.fileName);
+			if (it == fileIDs.end())
+			{
+				it = fileIDs.emplace(breakPoint.fileName, lineTable.findFiles(breakPoint.fileName)).first;
+			}
+			found = ResolveLine(lineTable, functionIndex, it->second, breakPoint.lineNumber);
+		}
+		else
+		{
+			found = functionIndex.findByPattern(breakPoint.pattern);
+		}
+
+		if (found.isEmpty())
+		{
+			++unresolved;
+		}
+
+		addresses.insert(addresses.end(), found.begin(), found.end());
+	}
+
+	std::sort(addresses.begin(), addresses.end());
+	addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+	return addresses;
+}
+
+Array<size_t> BreakPointSession::Resolve(const SessionBreakPoint& breakPoint, const LineTable& lineTable, const FunctionIndex& functionIndex)
+{
+	if (breakPoint.isLine())
+	{
+		return ResolveLine(lineTable, functionIndex, lineTable.findFiles(breakPoint.fileName), breakPoint.lineNumber);
+	}
+	return functionIndex.findByPattern(breakPoint.pattern);
+}
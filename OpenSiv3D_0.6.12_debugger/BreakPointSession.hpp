@@ -0,0 +1,75 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+class LineTable;
+class FunctionIndex;
+
+// 次のセッションに持ち越すユーザーブレークポイント
+// アドレスは起動ごとに変わるので、ファイル:行か関数名のパターンで覚えておく
+struct SessionBreakPoint
+{
+	// 空なら関数のブレークポイント
+	String fileName;
+
+	uint32 lineNumber = 0;
+
+	// setFunctionBreakPoints に渡したパターン（Game::*Update* など）
+	String pattern;
+
+	bool isLine() const { return not fileName.isEmpty(); }
+
+	bool operator==(const SessionBreakPoint&) const = default;
+};
+
+// 前回のセッションのブレークポイントを張り直した結果
+struct SessionRestoreResult
+{
+	size_t breakPoints = 0;
+
+	// 張ったアドレスの数（1 つの行が複数の関数に展開されていれば複数）
+	size_t installed = 0;
+
+	// 行・関数が見つからなかった数
+	size_t unresolved = 0;
+
+	std::chrono::nanoseconds elapsed{ 0 };
+};
+
+// ユーザーブレークポイントを保存するファイル（実行ファイルごと）
+//
+// エントリポイントに着いたときに行番号テーブルと関数の索引でまとめてアドレスに直し、
+// Main の先頭で止まる前に 1 回の setBreakPoints で張る
+class BreakPointSession
+{
+public:
+
+	// 実行ファイルの隣に置く（Game.exe → Game.exe.breakpoints.json）
+	static FilePath DefaultPath(FilePathView exeFilePath);
+
+	// ファイルがなければ空のセッションにして false
+	bool load(FilePathView path);
+
+	bool save(FilePathView path) const;
+
+	// すでにあれば何もしない
+	void add(const SessionBreakPoint& breakPoint);
+
+	bool remove(const SessionBreakPoint& breakPoint);
+
+	void clear() { m_breakPoints.clear(); }
+
+	bool isEmpty() const { return m_breakPoints.isEmpty(); }
+
+	const Array<SessionBreakPoint>& breakPoints() const { return m_breakPoints; }
+
+	// 全部のアドレス（昇順・重複なし）。見つからなかったものは unresolved に数える
+	Array<size_t> resolve(const LineTable& lineTable, const FunctionIndex& functionIndex, size_t& unresolved) const;
+
+	// 1 つ分のアドレス
+	// 行は各関数（インライン展開・テンプレートの実体ごと）で一番前の範囲の先頭に張る
+	static Array<size_t> Resolve(const SessionBreakPoint& breakPoint, const LineTable& lineTable, const FunctionIndex& functionIndex);
+
+private:
+
+	Array<SessionBreakPoint> m_breakPoints;
+};
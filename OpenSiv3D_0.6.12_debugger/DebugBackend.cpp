@@ -0,0 +1,26 @@
+﻿#include "DebugBackend.hpp"
+#include "WindowsDebugBackend.hpp"
+#include "PtraceDebugBackend.hpp"
+
+bool DebugBackend::setTrapFlag(HANDLE thread)
+{
+	CONTEXT context = {};
+	context.ContextFlags = CONTEXT_FULL;
+
+	if (not getThreadContext(thread, context))
+	{
+		return false;
+	}
+
+	context.EFlags |= 0x100; // TFビット
+	return setThreadContext(thread, context);
+}
+
+std::unique_ptr<DebugBackend> DebugBackend::CreateDefault()
+{
+#if SIV3D_PLATFORM(WINDOWS)
+	return std::make_unique<WindowsDebugBackend>();
+#else
+	return std::make_unique<PtraceDebugBackend>();
+#endif
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+#include "DebugTypes.hpp"
+
+// OS のデバッグ API を抽象化したインターフェース
+// ProcessDebugger / ProcessHandle / ThreadHandle はこのインターフェースを通してのみデバッグ対象にアクセスする
+class DebugBackend
+{
+public:
+
+	virtual ~DebugBackend() = default;
+
+	// デバッグ対象を一時停止状態で起動する（最初の ResumeThread で実行が始まる）
+	// arguments は空白区切りのコマンドライン引数
+	virtual bool createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo) = 0;
+
+	// milliseconds に INFINITE を指定するとイベントが来るまで待つ
+	virtual bool waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds) = 0;
+
+	virtual bool continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus) = 0;
+
+	virtual bool getThreadContext(HANDLE thread, CONTEXT& context) = 0;
+
+	virtual bool setThreadContext(HANDLE thread, const CONTEXT& context) = 0;
+
+	// 次の1命令の実行後に EXCEPTION_SINGLE_STEP を発生させる
+	virtual bool setTrapFlag(HANDLE thread);
+
+	virtual void suspendThread(HANDLE thread) = 0;
+
+	virtual void resumeThread(HANDLE thread) = 0;
+
+	virtual bool readMemory(HANDLE process, size_t address, size_t size, void* buffer) = 0;
+
+	// 書き込み後に命令キャッシュもフラッシュする
+	virtual bool writeMemory(HANDLE process, size_t address, size_t size, const void* buffer) = 0;
+
+	// 読み書き・実行できるメモリを確保する（nearAddress から ±2GB 以内に取れればそこに）
+	virtual bool allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address) = 0;
+
+	virtual bool debugBreakProcess(HANDLE process) = 0;
+
+	virtual void closeHandle(HANDLE handle) = 0;
+
+	// 呼び出したスレッドで最後に失敗した処理のエラーコード（GetLastError と同じくスレッドごと）
+	virtual uint32 lastError() const = 0;
+
+	// 実行中のプラットフォームの標準バックエンドを作成する
+	static std::unique_ptr<DebugBackend> CreateDefault();
+};
@@ -0,0 +1,145 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+#include "DebugTypes.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <variant>
+
+enum class OperationCommandType
+{
+	Go,
+	StepIn,
+	StepOver,
+	StepOut,
+};
+
+enum class ShowCommandType
+{
+	ShowGlovalVariables,
+	ShowLocalVariables,
+	ShowCallstack,
+};
+
+// UI スレッド → デバッガースレッド
+
+// デバッグ対象を起動して最初に止まるところまで進める
+struct StartSessionCommand
+{
+	FilePath exeFilePath;
+};
+
+// 実行・ステップ実行
+struct OperationCommand
+{
+	OperationCommandType type;
+};
+
+// 変数・コールスタックの取得
+struct ShowCommand
+{
+	ShowCommandType type;
+};
+
+// 実行中のデバッグ対象を止める（ProcessDebugger::requestDebugBreak）
+// UI スレッドが直接 requestDebugBreak を呼ぶので、キューには積まずに記録・再生にだけ使う
+struct BreakCommand
+{
+};
+
+using DebugCommand = std::variant<StartSessionCommand, OperationCommand, ShowCommand, BreakCommand>;
+
+// デバッガースレッド → UI スレッド
+
+// デバッグ対象が止まった（UI はここで受け取った値だけを表示に使う）
+struct StoppedResult
+{
+	String fileName;
+	uint32 fileID = 0;
+	int lineNumber = 0;
+	DWORD mainThreadID = 0;
+	DWORD userThreadID = 0;
+};
+
+// デバッグ対象が終了した、または起動に失敗した
+struct SessionEndedResult
+{
+};
+
+// ShowCommand の結果
+struct ShowResult
+{
+	ShowCommandType type;
+	String text;
+};
+
+using DebugResult = std::variant<StoppedResult, SessionEndedResult, ShowResult>;
+
+// 複数のスレッドから push し、1つのスレッドが取り出すキュー
+// waitPop はメッセージが来るか close されるまでスレッドを眠らせる
+template <class Message>
+class MessageQueue
+{
+public:
+
+	void push(Message message)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			if (m_isClosed)
+			{
+				return;
+			}
+			m_messages.push_back(std::move(message));
+		}
+		m_condition.notify_one();
+	}
+
+	// close された後は残りを捨てて none を返す
+	Optional<Message> waitPop()
+	{
+		std::unique_lock lock(m_mutex);
+		m_condition.wait(lock, [&] { return m_isClosed || not m_messages.empty(); });
+
+		if (m_isClosed)
+		{
+			return none;
+		}
+
+		Message message = std::move(m_messages.front());
+		m_messages.pop_front();
+		return message;
+	}
+
+	Optional<Message> tryPop()
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_isClosed || m_messages.empty())
+		{
+			return none;
+		}
+
+		Message message = std::move(m_messages.front());
+		m_messages.pop_front();
+		return message;
+	}
+
+	void close()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_isClosed = true;
+		}
+		m_condition.notify_all();
+	}
+
+private:
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_condition;
+
+	std::deque<Message> m_messages;
+
+	bool m_isClosed = false;
+};
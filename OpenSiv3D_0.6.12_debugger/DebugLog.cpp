@@ -0,0 +1,309 @@
+﻿#include "DebugLog.hpp"
+#include "DebugMetrics.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	constexpr size_t RingCapacity = 1024; // 2 の累乗
+
+	constexpr auto DrainInterval = std::chrono::milliseconds(20);
+
+	// 1つのスレッドが書き込み、出力スレッドが読み出すリングバッファ
+	class LogRing
+	{
+	public:
+
+		bool push(const LogRecord& record)
+		{
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			const size_t tail = m_tail.load(std::memory_order_acquire);
+
+			if (head - tail == RingCapacity)
+			{
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			m_records[head & (RingCapacity - 1)] = record;
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		void drainTo(Array<LogRecord>& records)
+		{
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			const size_t head = m_head.load(std::memory_order_acquire);
+
+			for (; tail != head; ++tail)
+			{
+				records.push_back(m_records[tail & (RingCapacity - 1)]);
+			}
+
+			m_tail.store(tail, std::memory_order_release);
+		}
+
+		uint64 dropped() const
+		{
+			return m_dropped.load(std::memory_order_relaxed);
+		}
+
+	private:
+
+		std::array<LogRecord, RingCapacity> m_records;
+
+		alignas(64) std::atomic<size_t> m_head = 0;
+
+		alignas(64) std::atomic<size_t> m_tail = 0;
+
+		std::atomic<uint64> m_dropped = 0;
+	};
+
+	class LogSink
+	{
+	public:
+
+		static LogSink& i()
+		{
+			static LogSink instance;
+			return instance;
+		}
+
+		// スレッドごとのリングバッファ（最初の書き込みのときだけ登録する）
+		LogRing& ring()
+		{
+			thread_local LogRing* t_ring = nullptr;
+
+			if (not t_ring)
+			{
+				std::lock_guard lock(m_mutex);
+				m_rings.push_back(std::make_unique<LogRing>());
+				t_ring = m_rings.back().get();
+			}
+
+			return *t_ring;
+		}
+
+		void start()
+		{
+			std::lock_guard lock(m_mutex);
+
+			if (m_thread.joinable())
+			{
+				return;
+			}
+
+			m_isRunning = true;
+			m_thread = std::thread([this] { run(); });
+		}
+
+		void stop()
+		{
+			{
+				std::lock_guard lock(m_mutex);
+				if (not m_thread.joinable())
+				{
+					return;
+				}
+				m_isRunning = false;
+			}
+
+			m_condition.notify_all();
+			m_thread.join();
+		}
+
+		uint64 dropped()
+		{
+			std::lock_guard lock(m_mutex);
+
+			uint64 count = 0;
+			for (const auto& ring : m_rings)
+			{
+				count += ring->dropped();
+			}
+			return count;
+		}
+
+	private:
+
+		void run()
+		{
+			std::unique_lock lock(m_mutex);
+
+			while (m_isRunning)
+			{
+				m_condition.wait_for(lock, DrainInterval, [this] { return not m_isRunning; });
+				drain();
+			}
+
+			// 始まる前に stop された場合も、それまでのログ（と longText）を残さない
+			drain();
+		}
+
+		// m_mutex を取った状態で呼ぶ
+		void drain()
+		{
+			m_records.clear();
+
+			for (auto& ring : m_rings)
+			{
+				ring->drainTo(m_records);
+			}
+
+			// スレッドをまたいで時刻順に並べる
+			std::stable_sort(m_records.begin(), m_records.end(),
+				[](const LogRecord& a, const LogRecord& b) { return a.timestamp < b.timestamp; });
+
+			for (const auto& record : m_records)
+			{
+				String message;
+				{
+					ScopedMetric metric(Metric::LogFormat);
+					message = FormatRecord(record);
+				}
+				Console << message;
+
+				delete[] record.longText;
+			}
+		}
+
+		static String FormatRecord(const LogRecord& record);
+
+		std::mutex m_mutex;
+
+		std::condition_variable m_condition;
+
+		std::thread m_thread;
+
+		bool m_isRunning = false;
+
+		Array<std::unique_ptr<LogRing>> m_rings;
+
+		Array<LogRecord> m_records;
+	};
+
+	StringView LevelName(LogLevel level)
+	{
+		switch (level)
+		{
+		case LogLevel::Trace: return U"TRACE";
+		case LogLevel::Debug: return U"DEBUG";
+		case LogLevel::Info: return U"INFO";
+		case LogLevel::Warning: return U"WARN";
+		case LogLevel::Error: return U"ERROR";
+		default: return U"";
+		}
+	}
+
+	StringView CategoryName(LogCategory category)
+	{
+		switch (category)
+		{
+		case LogCategory::Event: return U"event";
+		case LogCategory::BreakPoint: return U"breakpoint";
+		case LogCategory::Step: return U"step";
+		case LogCategory::Symbol: return U"symbol";
+		case LogCategory::Memory: return U"memory";
+		case LogCategory::Thread: return U"thread";
+		case LogCategory::Process: return U"process";
+		case LogCategory::Output: return U"output";
+		default: return U"";
+		}
+	}
+
+	String LogSink::FormatRecord(const LogRecord& record)
+	{
+		String message = U"[{}][{}] "_fmt(LevelName(record.level), CategoryName(record.category));
+
+		size_t argIndex = 0;
+
+		for (const char32_t* p = record.format; *p; ++p)
+		{
+			if (*p == U'{' && argIndex < record.argCount)
+			{
+				const StringView rest(p);
+				if (rest.starts_with(U"{}"))
+				{
+					if (record.signedArgs & (1u << argIndex))
+					{
+						message += U"{}"_fmt(static_cast<int64>(record.args[argIndex++]));
+					}
+					else
+					{
+						message += U"{}"_fmt(record.args[argIndex++]);
+					}
+					++p;
+					continue;
+				}
+				if (rest.starts_with(U"{:X}"))
+				{
+					message += U"{:X}"_fmt(record.args[argIndex++]);
+					p += 3;
+					continue;
+				}
+			}
+
+			message.push_back(*p);
+		}
+
+		message.append((record.longText ? record.longText : record.text), record.textLength);
+
+		return message;
+	}
+}
+
+void DebugLog::Start()
+{
+	LogSink::i().start();
+}
+
+void DebugLog::Stop()
+{
+	LogSink::i().stop();
+}
+
+void DebugLog::WriteText(LogLevel level, LogCategory category, const char32_t* format, StringView text)
+{
+	if (not IsEnabled(level, category))
+	{
+		return;
+	}
+
+	LogRecord record;
+	record.format = format;
+	record.level = level;
+	record.category = category;
+	record.argCount = 0;
+	record.signedArgs = 0;
+	record.textLength = static_cast<uint32>(Min<size_t>(text.size(), UINT32_MAX));
+	record.longText = nullptr;
+
+	if (record.textLength <= LogRecord::MaxTextLength)
+	{
+		std::copy_n(text.begin(), record.textLength, record.text);
+	}
+	else
+	{
+		// 長い文字列（OutputDebugString など）だけはリングバッファの外に置く
+		record.longText = new char32_t[record.textLength];
+		std::copy_n(text.begin(), record.textLength, record.longText);
+	}
+
+	Push(record);
+}
+
+uint64 DebugLog::DroppedCount()
+{
+	return LogSink::i().dropped();
+}
+
+void DebugLog::Push(LogRecord& record)
+{
+	record.timestamp = static_cast<uint64>(std::chrono::steady_clock::now().time_since_epoch().count());
+
+	if (not LogSink::i().ring().push(record))
+	{
+		delete[] record.longText;
+	}
+}
@@ -0,0 +1,147 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+#include <atomic>
+
+enum class LogLevel : uint8
+{
+	Trace,
+	Debug,
+	Info,
+	Warning,
+	Error,
+	Off,
+};
+
+enum class LogCategory : uint8
+{
+	Event,      // デバッグイベント
+	BreakPoint,
+	Step,
+	Symbol,     // シンボル・行情報
+	Memory,
+	Thread,
+	Process,
+	Output,     // デバッグ対象の OutputDebugString
+	Count,
+};
+
+// 書式化前のログ1件
+// format は文字列リテラル（{} は10進数、{:X} は16進数で args に置き換える）
+// MaxTextLength より長い文字列は longText に確保し、出力スレッドが書式化した後で解放する
+struct LogRecord
+{
+	static constexpr size_t MaxArgs = 4;
+
+	static constexpr size_t MaxTextLength = 64;
+
+	uint64 timestamp;
+
+	const char32_t* format;
+
+	uint64 args[MaxArgs];
+
+	LogLevel level;
+
+	LogCategory category;
+
+	uint8 argCount;
+
+	// args[i] が符号付きの整数なら i ビット目が立つ（{} で負の値として出す）
+	uint8 signedArgs;
+
+	uint32 textLength;
+
+	// WriteText で渡された文字列（末尾に付ける）
+	// textLength が MaxTextLength 以下なら text、それより長ければ longText に入っている
+	char32_t* longText;
+
+	char32_t text[MaxTextLength];
+};
+
+// デバッガー内部のログ
+//
+// 書き込んだスレッドごとのリングバッファ（ロックフリー）にバイナリのまま積み、
+// 書式化と Console への出力はバックグラウンドのスレッドでまとめて行う
+// レベル・カテゴリで無効なログは書き込み側で何もせずに捨てる
+class DebugLog
+{
+public:
+
+	// 出力スレッドを開始する
+	static void Start();
+
+	// 残っているログを出力して出力スレッドを止める
+	static void Stop();
+
+	static void SetLevel(LogLevel level)
+	{
+		i().m_level.store(level, std::memory_order_relaxed);
+	}
+
+	static void SetCategoryEnabled(LogCategory category, bool enabled)
+	{
+		const uint32 bit = 1u << static_cast<uint32>(category);
+
+		if (enabled)
+		{
+			i().m_enabledCategories.fetch_or(bit, std::memory_order_relaxed);
+		}
+		else
+		{
+			i().m_enabledCategories.fetch_and(~bit, std::memory_order_relaxed);
+		}
+	}
+
+	static bool IsEnabled(LogLevel level, LogCategory category)
+	{
+		const auto& instance = i();
+		return instance.m_level.load(std::memory_order_relaxed) <= level
+			&& (instance.m_enabledCategories.load(std::memory_order_relaxed) & (1u << static_cast<uint32>(category)));
+	}
+
+	template <class... Args>
+	static void Write(LogLevel level, LogCategory category, const char32_t* format, const Args&... args)
+	{
+		static_assert(sizeof...(Args) <= LogRecord::MaxArgs);
+		static_assert(((std::is_integral_v<Args> || std::is_enum_v<Args>) && ...), "DebugLog::Write の引数は整数か列挙型");
+
+		if (not IsEnabled(level, category))
+		{
+			return;
+		}
+
+		LogRecord record;
+		record.format = format;
+		record.level = level;
+		record.category = category;
+		record.argCount = static_cast<uint8>(sizeof...(Args));
+		record.signedArgs = 0;
+		record.textLength = 0;
+		record.longText = nullptr;
+
+		size_t index = 0;
+		((record.signedArgs |= static_cast<uint8>(std::is_signed_v<Args> ? (1u << index) : 0u), record.args[index++] = static_cast<uint64>(args)), ...);
+
+		Push(record);
+	}
+
+	// format の後ろに text を付けて出力する（長さの制限はない）
+	static void WriteText(LogLevel level, LogCategory category, const char32_t* format, StringView text);
+
+	// リングバッファがいっぱいで捨てたログの数
+	static uint64 DroppedCount();
+
+private:
+
+	static DebugLog& i()
+	{
+		static DebugLog instance;
+		return instance;
+	}
+
+	static void Push(LogRecord& record);
+
+	std::atomic<LogLevel> m_level = LogLevel::Info;
+
+	std::atomic<uint32> m_enabledCategories = ~0u;
+};
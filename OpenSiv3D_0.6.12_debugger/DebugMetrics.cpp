@@ -0,0 +1,303 @@
+﻿#include "DebugMetrics.hpp"
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	constexpr uint32 SubBucketBits = 4;
+
+	constexpr uint64 SubBucketCount = 1ull << SubBucketBits;
+
+	// 64bit の値すべてを表せる数
+	constexpr size_t BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+
+	constexpr size_t BucketIndex(uint64 value)
+	{
+		if (value < SubBucketCount)
+		{
+			return static_cast<size_t>(value);
+		}
+
+		const uint32 msb = static_cast<uint32>(std::bit_width(value)) - 1;
+		const uint32 shift = msb - SubBucketBits;
+		const uint64 subBucket = (value >> shift) & (SubBucketCount - 1);
+		return (msb - SubBucketBits + 1) * SubBucketCount + subBucket;
+	}
+
+	// バケットに入る値の最大値
+	constexpr uint64 BucketHighestValue(size_t index)
+	{
+		if (index < SubBucketCount)
+		{
+			return index;
+		}
+
+		const uint32 msb = static_cast<uint32>(index / SubBucketCount) + SubBucketBits - 1;
+		const uint32 shift = msb - SubBucketBits;
+		const uint64 subBucket = index % SubBucketCount;
+		const uint64 lowest = (SubBucketCount | subBucket) << shift;
+		return lowest + ((1ull << shift) - 1);
+	}
+
+	static_assert(BucketIndex(15) == 15);
+	static_assert(BucketIndex(16) == 16);
+	static_assert(BucketIndex(31) == 31);
+	static_assert(BucketIndex(32) == 32);
+	static_assert(BucketHighestValue(BucketIndex(1000)) >= 1000);
+	static_assert(BucketIndex(~0ull) == BucketCount - 1);
+
+	// 記録はデバッガースレッド、読み出しは UI や保存用のスレッドから行う
+	struct Histogram
+	{
+		std::atomic<uint64> count = 0;
+
+		std::atomic<uint64> total = 0;
+
+		std::atomic<uint64> max = 0;
+
+		std::array<std::atomic<uint64>, BucketCount> buckets = {};
+
+		void record(uint64 value)
+		{
+			count.fetch_add(1, std::memory_order_relaxed);
+			total.fetch_add(value, std::memory_order_relaxed);
+			buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+
+			uint64 currentMax = max.load(std::memory_order_relaxed);
+			while (currentMax < value && not max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		void reset()
+		{
+			count.store(0, std::memory_order_relaxed);
+			total.store(0, std::memory_order_relaxed);
+			max.store(0, std::memory_order_relaxed);
+			for (auto& bucket : buckets)
+			{
+				bucket.store(0, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	constexpr std::array<StringView, static_cast<size_t>(Metric::Count)> MetricNames =
+	{
+		U"event.exception",
+		U"event.create_thread",
+		U"event.create_process",
+		U"event.exit_thread",
+		U"event.exit_process",
+		U"event.load_dll",
+		U"event.unload_dll",
+		U"event.output_debug_string",
+		U"event.rip",
+		U"event.unknown",
+
+		U"breakpoint.init",
+		U"breakpoint.entry",
+		U"breakpoint.code",
+		U"breakpoint.user",
+		U"breakpoint.step_over",
+		U"breakpoint.step_out",
+		U"breakpoint.other_thread",
+		U"breakpoint.step_range",
+		U"breakpoint.run_to",
+
+		U"step.handle_single_step",
+		U"breakpoint.hardware",
+		U"breakpoint.condition",
+		U"breakpoint.tracepoint",
+		U"symbol.line_lookup",
+		U"memory.read",
+		U"memory.write",
+		U"backend.continue_debug_event",
+		U"backend.event_round_trip",
+		U"log.format",
+	};
+
+	class MetricsStorage
+	{
+	public:
+
+		static MetricsStorage& i()
+		{
+			static MetricsStorage instance;
+			return instance;
+		}
+
+		std::array<Histogram, static_cast<size_t>(Metric::Count)> histograms;
+
+		void startDump(FilePathView path, std::chrono::milliseconds interval)
+		{
+			stopDump();
+
+			std::lock_guard lock(m_mutex);
+			m_isDumping = true;
+			m_dumpThread = std::thread([this, path = FilePath(path), interval] { runDump(path, interval); });
+		}
+
+		void stopDump()
+		{
+			{
+				std::lock_guard lock(m_mutex);
+				if (not m_dumpThread.joinable())
+				{
+					return;
+				}
+				m_isDumping = false;
+			}
+
+			m_condition.notify_all();
+			m_dumpThread.join();
+		}
+
+	private:
+
+		void runDump(const FilePath& path, std::chrono::milliseconds interval)
+		{
+			std::unique_lock lock(m_mutex);
+
+			while (m_isDumping)
+			{
+				m_condition.wait_for(lock, interval, [this] { return not m_isDumping; });
+				DebugMetrics::Save(path);
+			}
+		}
+
+		std::mutex m_mutex;
+
+		std::condition_variable m_condition;
+
+		std::thread m_dumpThread;
+
+		bool m_isDumping = false;
+	};
+
+	double ToMicroseconds(uint64 nanoseconds)
+	{
+		return nanoseconds / 1000.0;
+	}
+}
+
+void DebugMetrics::Record(Metric metric, std::chrono::nanoseconds elapsed)
+{
+	MetricsStorage::i().histograms[static_cast<size_t>(metric)].record(static_cast<uint64>(Max<int64>(elapsed.count(), 0)));
+}
+
+Array<MetricSnapshot> DebugMetrics::Snapshot()
+{
+	Array<MetricSnapshot> snapshot;
+
+	const auto& histograms = MetricsStorage::i().histograms;
+
+	for (size_t metricIndex = 0; metricIndex < histograms.size(); ++metricIndex)
+	{
+		const auto& histogram = histograms[metricIndex];
+
+		// 記録中に読むので、バケットを先に写してから数える
+		std::array<uint64, BucketCount> buckets;
+		uint64 count = 0;
+		for (size_t i = 0; i < BucketCount; ++i)
+		{
+			buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+			count += buckets[i];
+		}
+
+		MetricSnapshot metric;
+		metric.name = MetricNames[metricIndex];
+		metric.count = count;
+		metric.total = histogram.total.load(std::memory_order_relaxed);
+		metric.max = histogram.max.load(std::memory_order_relaxed);
+
+		const auto percentile = [&](double p)
+		{
+			const uint64 rank = Max<uint64>(static_cast<uint64>(std::ceil(p * count)), 1);
+			uint64 seen = 0;
+			for (size_t i = 0; i < BucketCount; ++i)
+			{
+				seen += buckets[i];
+				if (rank <= seen)
+				{
+					return Min(BucketHighestValue(i), metric.max);
+				}
+			}
+			return metric.max;
+		};
+
+		if (count != 0)
+		{
+			metric.p50 = percentile(0.50);
+			metric.p90 = percentile(0.90);
+			metric.p99 = percentile(0.99);
+		}
+
+		snapshot.push_back(metric);
+	}
+
+	return snapshot;
+}
+
+void DebugMetrics::Reset()
+{
+	for (auto& histogram : MetricsStorage::i().histograms)
+	{
+		histogram.reset();
+	}
+}
+
+JSON DebugMetrics::ToJSON(const Array<MetricSnapshot>& snapshot)
+{
+	JSON json;
+
+	for (const auto& metric : snapshot)
+	{
+		if (metric.count == 0)
+		{
+			continue;
+		}
+
+		JSON entry;
+		entry[U"count"] = static_cast<int64>(metric.count);
+		entry[U"total_us"] = ToMicroseconds(metric.total);
+		entry[U"mean_us"] = ToMicroseconds(metric.total) / metric.count;
+		entry[U"p50_us"] = ToMicroseconds(metric.p50);
+		entry[U"p90_us"] = ToMicroseconds(metric.p90);
+		entry[U"p99_us"] = ToMicroseconds(metric.p99);
+		entry[U"max_us"] = ToMicroseconds(metric.max);
+		json[metric.name] = entry;
+	}
+
+	return json;
+}
+
+bool DebugMetrics::Save(FilePathView path)
+{
+	JSON json;
+	json[U"date"] = DateTime::Now().format();
+	json[U"metrics"] = ToJSON(Snapshot());
+	return json.save(path);
+}
+
+void DebugMetrics::StartPeriodicDump(FilePathView path, std::chrono::milliseconds interval)
+{
+	MetricsStorage::i().startDump(path, interval);
+}
+
+void DebugMetrics::StopPeriodicDump()
+{
+	MetricsStorage::i().stopDump();
+}
+
+Metric DebugMetrics::EventMetric(DWORD debugEventCode)
+{
+	if (EXCEPTION_DEBUG_EVENT <= debugEventCode && debugEventCode <= RIP_EVENT)
+	{
+		return static_cast<Metric>(static_cast<uint32>(Metric::EventException) + (debugEventCode - EXCEPTION_DEBUG_EVENT));
+	}
+
+	return Metric::EventUnknown;
+}
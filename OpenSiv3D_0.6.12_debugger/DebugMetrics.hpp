@@ -0,0 +1,106 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+#include "DebugTypes.hpp"
+
+// 計測する処理（Event* は DEBUG_EVENT の dwDebugEventCode の順）
+enum class Metric : uint8
+{
+	EventException,
+	EventCreateThread,
+	EventCreateProcess,
+	EventExitThread,
+	EventExitProcess,
+	EventLoadDll,
+	EventUnloadDll,
+	EventOutputDebugString,
+	EventRip,
+	EventUnknown,
+
+	BreakPointInit,     // BreakPointType ごと
+	BreakPointEntry,
+	BreakPointCode,
+	BreakPointUser,
+	BreakPointStepOver,
+	BreakPointStepOut,
+	BreakPointOtherThread,
+	BreakPointStepRange,
+	BreakPointRunTo,
+
+	HandleSingleStep,
+	BreakPointHardware, // デバッグレジスタのブレークポイント・ウォッチポイント
+	ConditionEvaluate,  // 条件付きブレークポイントの条件式
+	TracepointWrite,    // トレースポイントの値の評価と TracepointSink への記録
+	LineLookup,         // StepHandler::isLineChanged の行情報の取得
+	ReadMemory,
+	WriteMemory,
+	ContinueDebugEvent,
+	EventRoundTrip,     // ContinueDebugEvent から次のイベントが届くまで
+	LogFormat,          // DebugLog の書式化（1件ごと）
+
+	Count,
+};
+
+struct MetricSnapshot
+{
+	StringView name;
+
+	uint64 count = 0;
+
+	// 以下はナノ秒
+	uint64 total = 0;
+	uint64 p50 = 0;
+	uint64 p90 = 0;
+	uint64 p99 = 0;
+	uint64 max = 0;
+};
+
+// 処理ごとの回数と所要時間のヒストグラム
+//
+// ヒストグラムは HDR Histogram と同じく、2 の累乗ごとの範囲を 16 分割した
+// 対数・線形のバケットで、相対誤差 1/16 以内で 1ns から記録できる
+class DebugMetrics
+{
+public:
+
+	static void Record(Metric metric, std::chrono::nanoseconds elapsed);
+
+	static Array<MetricSnapshot> Snapshot();
+
+	static void Reset();
+
+	static JSON ToJSON(const Array<MetricSnapshot>& snapshot);
+
+	// 現在の値を path に JSON で保存する
+	static bool Save(FilePathView path);
+
+	// interval ごとに path に保存する
+	static void StartPeriodicDump(FilePathView path, std::chrono::milliseconds interval);
+
+	static void StopPeriodicDump();
+
+	static Metric EventMetric(DWORD debugEventCode);
+};
+
+// スコープを抜けるまでの時間を記録する
+class ScopedMetric
+{
+public:
+
+	explicit ScopedMetric(Metric metric)
+		: m_metric(metric)
+		, m_start(std::chrono::steady_clock::now()) {}
+
+	~ScopedMetric()
+	{
+		DebugMetrics::Record(m_metric, std::chrono::steady_clock::now() - m_start);
+	}
+
+	ScopedMetric(const ScopedMetric&) = delete;
+	ScopedMetric& operator=(const ScopedMetric&) = delete;
+
+private:
+
+	Metric m_metric;
+
+	std::chrono::steady_clock::time_point m_start;
+};
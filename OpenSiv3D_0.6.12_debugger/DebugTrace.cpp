@@ -0,0 +1,343 @@
+﻿#include "DebugTrace.hpp"
+
+namespace DebugTrace
+{
+	namespace
+	{
+		constexpr DWORD64 CONTEXT::* Registers64[] =
+		{
+			&CONTEXT::Dr0, &CONTEXT::Dr1, &CONTEXT::Dr2, &CONTEXT::Dr3, &CONTEXT::Dr6, &CONTEXT::Dr7,
+			&CONTEXT::Rax, &CONTEXT::Rcx, &CONTEXT::Rdx, &CONTEXT::Rbx, &CONTEXT::Rsp, &CONTEXT::Rbp, &CONTEXT::Rsi, &CONTEXT::Rdi,
+			&CONTEXT::R8, &CONTEXT::R9, &CONTEXT::R10, &CONTEXT::R11, &CONTEXT::R12, &CONTEXT::R13, &CONTEXT::R14, &CONTEXT::R15,
+			&CONTEXT::Rip,
+		};
+
+		static_assert(2 + std::size(Registers64) == RegisterCount);
+
+		// DebugCommand の中での Command の番号（DebugCommand::index() の値）
+		template <class Command, class... Commands>
+		constexpr size_t VariantIndexOf(const std::variant<Commands...>*)
+		{
+			constexpr bool matches[] = { std::is_same_v<Command, Commands>... };
+
+			size_t index = 0;
+			while (not matches[index])
+			{
+				++index;
+			}
+			return index;
+		}
+
+		template <class Command>
+		constexpr size_t CommandIndex = VariantIndexOf<Command>(static_cast<const DebugCommand*>(nullptr));
+
+		// 幅の違う DWORD / WORD のフィールドを uint32 で読む
+		template <class Field>
+		bool ReadAs32(PayloadReader& reader, Field& field)
+		{
+			uint32 value = 0;
+			if (not reader.read(value))
+			{
+				return false;
+			}
+			field = static_cast<Field>(value);
+			return true;
+		}
+	}
+
+	Registers ToRegisters(const CONTEXT& context)
+	{
+		Registers registers = {};
+		registers[0] = context.ContextFlags;
+		registers[1] = context.EFlags;
+
+		for (size_t i = 0; i < std::size(Registers64); ++i)
+		{
+			registers[2 + i] = context.*Registers64[i];
+		}
+
+		return registers;
+	}
+
+	CONTEXT FromRegisters(const Registers& registers)
+	{
+		CONTEXT context;
+		std::memset(&context, 0, sizeof(context));
+		context.ContextFlags = static_cast<DWORD>(registers[0]);
+		context.EFlags = static_cast<DWORD>(registers[1]);
+
+		for (size_t i = 0; i < std::size(Registers64); ++i)
+		{
+			context.*Registers64[i] = registers[2 + i];
+		}
+
+		return context;
+	}
+
+	Header CurrentHeader()
+	{
+		Header header = {};
+		std::copy(std::begin(Magic), std::end(Magic), header.magic);
+		header.version = Version;
+#if SIV3D_PLATFORM(WINDOWS)
+		header.platform = 0;
+#else
+		header.platform = 1;
+#endif
+		return header;
+	}
+
+	bool IsCompatible(const Header& header)
+	{
+		return std::equal(std::begin(Magic), std::end(Magic), header.magic)
+			&& header.version == Version;
+	}
+
+	void PayloadWriter::writeBytes(const void* data, size_t size)
+	{
+		const auto* bytes = static_cast<const uint8*>(data);
+		m_data.insert(m_data.end(), bytes, bytes + size);
+	}
+
+	void PayloadWriter::writeProcessInformation(const PROCESS_INFORMATION& processInfo)
+	{
+		writePointer(processInfo.hProcess);
+		writePointer(processInfo.hThread);
+		write(static_cast<uint32>(processInfo.dwProcessId));
+		write(static_cast<uint32>(processInfo.dwThreadId));
+	}
+
+	void PayloadWriter::writeDebugEvent(const DEBUG_EVENT& debugEvent)
+	{
+		write(static_cast<uint32>(debugEvent.dwDebugEventCode));
+		write(static_cast<uint32>(debugEvent.dwProcessId));
+		write(static_cast<uint32>(debugEvent.dwThreadId));
+
+		const auto& u = debugEvent.u;
+
+		switch (debugEvent.dwDebugEventCode)
+		{
+		case EXCEPTION_DEBUG_EVENT:
+			write(static_cast<uint32>(u.Exception.ExceptionRecord.ExceptionCode));
+			write(static_cast<uint32>(u.Exception.ExceptionRecord.ExceptionFlags));
+			writePointer(u.Exception.ExceptionRecord.ExceptionAddress);
+			write(static_cast<uint32>(u.Exception.dwFirstChance));
+			break;
+		case CREATE_THREAD_DEBUG_EVENT:
+			writePointer(u.CreateThread.hThread);
+			writePointer(u.CreateThread.lpThreadLocalBase);
+			writePointer(u.CreateThread.lpStartAddress);
+			break;
+		case CREATE_PROCESS_DEBUG_EVENT:
+			writePointer(u.CreateProcessInfo.hFile);
+			writePointer(u.CreateProcessInfo.hProcess);
+			writePointer(u.CreateProcessInfo.hThread);
+			writePointer(u.CreateProcessInfo.lpBaseOfImage);
+			writePointer(u.CreateProcessInfo.lpStartAddress);
+			break;
+		case EXIT_THREAD_DEBUG_EVENT:
+			write(static_cast<uint32>(u.ExitThread.dwExitCode));
+			break;
+		case EXIT_PROCESS_DEBUG_EVENT:
+			write(static_cast<uint32>(u.ExitProcess.dwExitCode));
+			break;
+		case LOAD_DLL_DEBUG_EVENT:
+			writePointer(u.LoadDll.hFile);
+			writePointer(u.LoadDll.lpBaseOfDll);
+			break;
+		case UNLOAD_DLL_DEBUG_EVENT:
+			writePointer(u.UnloadDll.lpBaseOfDll);
+			break;
+		case OUTPUT_DEBUG_STRING_EVENT:
+			writePointer(u.DebugString.lpDebugStringData);
+			write(static_cast<uint32>(u.DebugString.fUnicode));
+			write(static_cast<uint32>(u.DebugString.nDebugStringLength));
+			break;
+		case RIP_EVENT:
+			write(static_cast<uint32>(u.RipInfo.dwError));
+			write(static_cast<uint32>(u.RipInfo.dwType));
+			break;
+		default:
+			break;
+		}
+	}
+
+	void PayloadWriter::writeContextDelta(const CONTEXT& context, Registers& previous)
+	{
+		static_assert(RegisterCount <= 0xFF);
+
+		const Registers registers = ToRegisters(context);
+
+		// 変わったレジスタの数を先に書くので、位置を覚えておく
+		const size_t countPosition = m_data.size();
+		uint8 changedCount = 0;
+		write(changedCount);
+
+		for (size_t i = 0; i < RegisterCount; ++i)
+		{
+			if (registers[i] != previous[i])
+			{
+				write(static_cast<uint8>(i));
+				write(registers[i]);
+				++changedCount;
+			}
+		}
+
+		m_data[countPosition] = changedCount;
+		previous = registers;
+	}
+
+	bool PayloadWriter::writeCommand(const DebugCommand& command)
+	{
+		if (std::holds_alternative<StartSessionCommand>(command))
+		{
+			// 起動は CreateProcess のレコードで分かる
+			return false;
+		}
+
+		write(static_cast<uint8>(command.index()));
+
+		if (const auto* operation = std::get_if<OperationCommand>(&command))
+		{
+			write(static_cast<uint8>(operation->type));
+		}
+		else if (const auto* show = std::get_if<ShowCommand>(&command))
+		{
+			write(static_cast<uint8>(show->type));
+		}
+
+		return true;
+	}
+
+	bool PayloadReader::readBytes(void* data, size_t size)
+	{
+		if (remaining() < size)
+		{
+			return false;
+		}
+
+		std::memcpy(data, m_data + m_position, size);
+		m_position += size;
+		return true;
+	}
+
+	bool PayloadReader::readProcessInformation(PROCESS_INFORMATION& processInfo)
+	{
+		processInfo = {};
+		return readPointer(processInfo.hProcess)
+			&& readPointer(processInfo.hThread)
+			&& ReadAs32(*this, processInfo.dwProcessId)
+			&& ReadAs32(*this, processInfo.dwThreadId);
+	}
+
+	bool PayloadReader::readDebugEvent(DEBUG_EVENT& debugEvent)
+	{
+		std::memset(&debugEvent, 0, sizeof(debugEvent));
+
+		if (not ReadAs32(*this, debugEvent.dwDebugEventCode)
+			|| not ReadAs32(*this, debugEvent.dwProcessId)
+			|| not ReadAs32(*this, debugEvent.dwThreadId))
+		{
+			return false;
+		}
+
+		auto& u = debugEvent.u;
+
+		switch (debugEvent.dwDebugEventCode)
+		{
+		case EXCEPTION_DEBUG_EVENT:
+			return ReadAs32(*this, u.Exception.ExceptionRecord.ExceptionCode)
+				&& ReadAs32(*this, u.Exception.ExceptionRecord.ExceptionFlags)
+				&& readPointer(u.Exception.ExceptionRecord.ExceptionAddress)
+				&& ReadAs32(*this, u.Exception.dwFirstChance);
+		case CREATE_THREAD_DEBUG_EVENT:
+			return readPointer(u.CreateThread.hThread)
+				&& readPointer(u.CreateThread.lpThreadLocalBase)
+				&& readPointer(u.CreateThread.lpStartAddress);
+		case CREATE_PROCESS_DEBUG_EVENT:
+			return readPointer(u.CreateProcessInfo.hFile)
+				&& readPointer(u.CreateProcessInfo.hProcess)
+				&& readPointer(u.CreateProcessInfo.hThread)
+				&& readPointer(u.CreateProcessInfo.lpBaseOfImage)
+				&& readPointer(u.CreateProcessInfo.lpStartAddress);
+		case EXIT_THREAD_DEBUG_EVENT:
+			return ReadAs32(*this, u.ExitThread.dwExitCode);
+		case EXIT_PROCESS_DEBUG_EVENT:
+			return ReadAs32(*this, u.ExitProcess.dwExitCode);
+		case LOAD_DLL_DEBUG_EVENT:
+			return readPointer(u.LoadDll.hFile)
+				&& readPointer(u.LoadDll.lpBaseOfDll);
+		case UNLOAD_DLL_DEBUG_EVENT:
+			return readPointer(u.UnloadDll.lpBaseOfDll);
+		case OUTPUT_DEBUG_STRING_EVENT:
+			return readPointer(u.DebugString.lpDebugStringData)
+				&& ReadAs32(*this, u.DebugString.fUnicode)
+				&& ReadAs32(*this, u.DebugString.nDebugStringLength);
+		case RIP_EVENT:
+			return ReadAs32(*this, u.RipInfo.dwError)
+				&& ReadAs32(*this, u.RipInfo.dwType);
+		default:
+			return true;
+		}
+	}
+
+	bool PayloadReader::readContextDelta(Registers& previous)
+	{
+		uint8 changedCount = 0;
+		if (not read(changedCount))
+		{
+			return false;
+		}
+
+		for (uint8 i = 0; i < changedCount; ++i)
+		{
+			uint8 index = 0;
+			uint64 value = 0;
+			if (not read(index) || not read(value) || RegisterCount <= index)
+			{
+				return false;
+			}
+			previous[index] = value;
+		}
+
+		return true;
+	}
+
+	bool PayloadReader::readCommand(DebugCommand& command)
+	{
+		uint8 index = 0;
+		if (not read(index))
+		{
+			return false;
+		}
+
+		switch (index)
+		{
+		case CommandIndex<OperationCommand>:
+		{
+			uint8 type = 0;
+			if (not read(type))
+			{
+				return false;
+			}
+			command = OperationCommand{ static_cast<OperationCommandType>(type) };
+			return true;
+		}
+		case CommandIndex<ShowCommand>:
+		{
+			uint8 type = 0;
+			if (not read(type))
+			{
+				return false;
+			}
+			command = ShowCommand{ static_cast<ShowCommandType>(type) };
+			return true;
+		}
+		case CommandIndex<BreakCommand>:
+			command = BreakCommand{};
+			return true;
+		default:
+			return false;
+		}
+	}
+}
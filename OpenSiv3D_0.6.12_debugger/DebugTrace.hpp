@@ -0,0 +1,143 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+#include <array>
+#include "DebugTypes.hpp"
+#include "DebugCommandQueue.hpp"
+
+// デバッグセッションの記録ファイルの形式
+//
+//   ヘッダー  : "SIVDBGTR" / バージョン / 記録したプラットフォーム
+//   レコード  : [種類 uint8][内容の長さ uint32][内容] の繰り返し
+//
+// 値は幅を決めたリトルエンディアンで書き、DEBUG_EVENT・PROCESS_INFORMATION も構造体のままではなく
+// デバッガが使うフィールドだけを決まった順に書く（Windows と Linux で構造体の大きさが違っても読める）
+// CONTEXT は Registers の順のレジスタを、同じスレッドの前回の値との差分（[番号 uint8][値 uint64]）で記録する
+namespace DebugTrace
+{
+	constexpr char Magic[8] = { 'S', 'I', 'V', 'D', 'B', 'G', 'T', 'R' };
+
+	constexpr uint32 Version = 3;
+
+	// 記録する CONTEXT のレジスタ（ContextFlags, EFlags, Dr0～Dr3, Dr6, Dr7, Rax～R15, Rip の順）
+	constexpr size_t RegisterCount = 25;
+
+	using Registers = std::array<uint64, RegisterCount>;
+
+	Registers ToRegisters(const CONTEXT& context);
+
+	// 記録していないレジスタは 0 になる
+	CONTEXT FromRegisters(const Registers& registers);
+
+	enum class RecordKind : uint8
+	{
+		CreateProcess,      // 結果 / エラー / PROCESS_INFORMATION / 実行ファイルのパス(UTF-8)
+		WaitForDebugEvent,  // 結果 / エラー / DEBUG_EVENT（成功時）
+		ContinueDebugEvent, // 結果 / エラー / スレッドID / 継続ステータス
+		GetThreadContext,   // スレッド / 結果 / エラー / CONTEXT の差分（成功時）
+		SetThreadContext,   // スレッド / 結果 / エラー
+		SetTrapFlag,        // スレッド / 結果 / エラー
+		ReadMemory,         // アドレス / サイズ / 結果 / エラー / 読んだ内容（成功時）
+		WriteMemory,        // アドレス / サイズ / 結果 / エラー
+		DebugBreakProcess,  // 結果 / エラー
+		Command,            // UI からの操作（DebugCommand の種類 / 種類ごとの値）
+		AllocateMemory,     // 希望アドレス / サイズ / 結果 / エラー / 確保したアドレス
+	};
+
+	struct Header
+	{
+		char magic[8];
+		uint32 version;
+		uint32 platform; // 0: Windows, 1: Linux（再生には使わない）
+	};
+
+	Header CurrentHeader();
+
+	bool IsCompatible(const Header& header);
+
+	// レコードの内容を組み立てる
+	class PayloadWriter
+	{
+	public:
+
+		template <class Type>
+		void write(const Type& value)
+		{
+			static_assert(std::is_trivially_copyable_v<Type>);
+			writeBytes(&value, sizeof(Type));
+		}
+
+		void writeBytes(const void* data, size_t size);
+
+		template <class Pointer>
+		void writePointer(Pointer pointer)
+		{
+			write(static_cast<uint64>(reinterpret_cast<uintptr_t>(pointer)));
+		}
+
+		void writeProcessInformation(const PROCESS_INFORMATION& processInfo);
+
+		void writeDebugEvent(const DEBUG_EVENT& debugEvent);
+
+		void writeContextDelta(const CONTEXT& context, Registers& previous);
+
+		// 記録しない操作（StartSessionCommand）なら false
+		bool writeCommand(const DebugCommand& command);
+
+		const Array<uint8>& data() const { return m_data; }
+
+	private:
+
+		Array<uint8> m_data;
+	};
+
+	// レコードの内容を先頭から読む（足りないときは false）
+	class PayloadReader
+	{
+	public:
+
+		PayloadReader(const uint8* data, size_t size)
+			: m_data(data), m_size(size) {}
+
+		template <class Type>
+		bool read(Type& value)
+		{
+			static_assert(std::is_trivially_copyable_v<Type>);
+			return readBytes(&value, sizeof(Type));
+		}
+
+		bool readBytes(void* data, size_t size);
+
+		template <class Pointer>
+		bool readPointer(Pointer& pointer)
+		{
+			uint64 value = 0;
+			if (not read(value))
+			{
+				return false;
+			}
+			pointer = reinterpret_cast<Pointer>(static_cast<uintptr_t>(value));
+			return true;
+		}
+
+		bool readProcessInformation(PROCESS_INFORMATION& processInfo);
+
+		bool readDebugEvent(DEBUG_EVENT& debugEvent);
+
+		// previous に差分を当てる
+		bool readContextDelta(Registers& previous);
+
+		bool readCommand(DebugCommand& command);
+
+		size_t remaining() const { return m_size - m_position; }
+
+		const uint8* current() const { return m_data + m_position; }
+
+	private:
+
+		const uint8* m_data;
+
+		size_t m_size;
+
+		size_t m_position = 0;
+	};
+}
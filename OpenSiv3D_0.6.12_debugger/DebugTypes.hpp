@@ -0,0 +1,210 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+// デバッガ本体が扱う型・定数の定義
+// Windows では Win32 の定義をそのまま使い、
+// Linux では同じ名前・同じ値の最小限の互換定義を置くことで
+// ProcessDebugger のイベント処理をバックエンドに依存させない
+
+#if SIV3D_PLATFORM(WINDOWS)
+
+#include <Windows.h>
+
+#else
+
+#include <cstdint>
+
+using BYTE = std::uint8_t;
+using WORD = std::uint16_t;
+using DWORD = std::uint32_t;
+using DWORD64 = std::uint64_t;
+using BOOL = int;
+using HANDLE = void*;
+using LPVOID = void*;
+using LPCVOID = const void*;
+using LPSTR = char*;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
+
+// WaitForDebugEvent がタイムアウトしたときの GetLastError()
+#define ERROR_SEM_TIMEOUT 121L
+
+#define DBG_CONTINUE ((DWORD)0x00010002L)
+#define DBG_EXCEPTION_NOT_HANDLED ((DWORD)0x80010001L)
+
+// PtraceDebugBackend は debugBreakProcess で送った SIGTRAP をこの例外として通知する
+#define DBG_CONTROL_BREAK ((DWORD)0x40010008L)
+
+#define EXCEPTION_DEBUG_EVENT 1
+#define CREATE_THREAD_DEBUG_EVENT 2
+#define CREATE_PROCESS_DEBUG_EVENT 3
+#define EXIT_THREAD_DEBUG_EVENT 4
+#define EXIT_PROCESS_DEBUG_EVENT 5
+#define LOAD_DLL_DEBUG_EVENT 6
+#define UNLOAD_DLL_DEBUG_EVENT 7
+#define OUTPUT_DEBUG_STRING_EVENT 8
+#define RIP_EVENT 9
+
+#define EXCEPTION_ACCESS_VIOLATION ((DWORD)0xC0000005L)
+#define EXCEPTION_DATATYPE_MISALIGNMENT ((DWORD)0x80000002L)
+#define EXCEPTION_BREAKPOINT ((DWORD)0x80000003L)
+#define EXCEPTION_SINGLE_STEP ((DWORD)0x80000004L)
+#define EXCEPTION_ARRAY_BOUNDS_EXCEEDED ((DWORD)0xC000008CL)
+#define EXCEPTION_FLT_DENORMAL_OPERAND ((DWORD)0xC000008DL)
+#define EXCEPTION_FLT_DIVIDE_BY_ZERO ((DWORD)0xC000008EL)
+#define EXCEPTION_FLT_INEXACT_RESULT ((DWORD)0xC000008FL)
+#define EXCEPTION_FLT_INVALID_OPERATION ((DWORD)0xC0000090L)
+#define EXCEPTION_FLT_OVERFLOW ((DWORD)0xC0000091L)
+#define EXCEPTION_FLT_STACK_CHECK ((DWORD)0xC0000092L)
+#define EXCEPTION_FLT_UNDERFLOW ((DWORD)0xC0000093L)
+#define EXCEPTION_INT_DIVIDE_BY_ZERO ((DWORD)0xC0000094L)
+#define EXCEPTION_INT_OVERFLOW ((DWORD)0xC0000095L)
+#define EXCEPTION_PRIV_INSTRUCTION ((DWORD)0xC0000096L)
+#define EXCEPTION_IN_PAGE_ERROR ((DWORD)0xC0000006L)
+#define EXCEPTION_ILLEGAL_INSTRUCTION ((DWORD)0xC000001DL)
+#define EXCEPTION_NONCONTINUABLE_EXCEPTION ((DWORD)0xC0000025L)
+#define EXCEPTION_STACK_OVERFLOW ((DWORD)0xC00000FDL)
+#define EXCEPTION_INVALID_DISPOSITION ((DWORD)0xC0000026L)
+#define EXCEPTION_GUARD_PAGE ((DWORD)0x80000001L)
+#define EXCEPTION_INVALID_HANDLE ((DWORD)0xC0000008L)
+
+#define IMAGE_FILE_MACHINE_AMD64 0x8664
+
+#define CONTEXT_FULL 0x0010000BL
+#define CONTEXT_DEBUG_REGISTERS 0x00100010L
+
+// x64 の CONTEXT のうちデバッガが参照するレジスタのみ
+struct CONTEXT
+{
+	DWORD ContextFlags;
+	DWORD EFlags;
+
+	DWORD64 Dr0;
+	DWORD64 Dr1;
+	DWORD64 Dr2;
+	DWORD64 Dr3;
+	DWORD64 Dr6;
+	DWORD64 Dr7;
+
+	DWORD64 Rax;
+	DWORD64 Rcx;
+	DWORD64 Rdx;
+	DWORD64 Rbx;
+	DWORD64 Rsp;
+	DWORD64 Rbp;
+	DWORD64 Rsi;
+	DWORD64 Rdi;
+	DWORD64 R8;
+	DWORD64 R9;
+	DWORD64 R10;
+	DWORD64 R11;
+	DWORD64 R12;
+	DWORD64 R13;
+	DWORD64 R14;
+	DWORD64 R15;
+
+	DWORD64 Rip;
+};
+
+struct PROCESS_INFORMATION
+{
+	HANDLE hProcess;
+	HANDLE hThread;
+	DWORD dwProcessId;
+	DWORD dwThreadId;
+};
+
+struct EXCEPTION_RECORD
+{
+	DWORD ExceptionCode;
+	DWORD ExceptionFlags;
+	EXCEPTION_RECORD* ExceptionRecord;
+	LPVOID ExceptionAddress;
+};
+
+struct EXCEPTION_DEBUG_INFO
+{
+	EXCEPTION_RECORD ExceptionRecord;
+	DWORD dwFirstChance;
+};
+
+struct CREATE_THREAD_DEBUG_INFO
+{
+	HANDLE hThread;
+	LPVOID lpThreadLocalBase;
+	LPVOID lpStartAddress;
+};
+
+struct CREATE_PROCESS_DEBUG_INFO
+{
+	HANDLE hFile;
+	HANDLE hProcess;
+	HANDLE hThread;
+	LPVOID lpBaseOfImage;
+	LPVOID lpStartAddress;
+};
+
+struct EXIT_THREAD_DEBUG_INFO
+{
+	DWORD dwExitCode;
+};
+
+struct EXIT_PROCESS_DEBUG_INFO
+{
+	DWORD dwExitCode;
+};
+
+struct LOAD_DLL_DEBUG_INFO
+{
+	HANDLE hFile;
+	LPVOID lpBaseOfDll;
+};
+
+struct UNLOAD_DLL_DEBUG_INFO
+{
+	LPVOID lpBaseOfDll;
+};
+
+struct OUTPUT_DEBUG_STRING_INFO
+{
+	LPSTR lpDebugStringData;
+	WORD fUnicode;
+	WORD nDebugStringLength;
+};
+
+struct RIP_INFO
+{
+	DWORD dwError;
+	DWORD dwType;
+};
+
+struct DEBUG_EVENT
+{
+	DWORD dwDebugEventCode;
+	DWORD dwProcessId;
+	DWORD dwThreadId;
+	union
+	{
+		EXCEPTION_DEBUG_INFO Exception;
+		CREATE_THREAD_DEBUG_INFO CreateThread;
+		CREATE_PROCESS_DEBUG_INFO CreateProcessInfo;
+		EXIT_THREAD_DEBUG_INFO ExitThread;
+		EXIT_PROCESS_DEBUG_INFO ExitProcess;
+		LOAD_DLL_DEBUG_INFO LoadDll;
+		UNLOAD_DLL_DEBUG_INFO UnloadDll;
+		OUTPUT_DEBUG_STRING_INFO DebugString;
+		RIP_INFO RipInfo;
+	} u;
+};
+
+#endif
@@ -0,0 +1,172 @@
+﻿#include "DebuggerBenchmarkFixture.hpp"
+#include "DebugMetrics.hpp"
+
+namespace DebuggerBenchmark
+{
+	LatencySummary Summarize(Array<double> samples)
+	{
+		LatencySummary summary;
+		if (samples.isEmpty())
+		{
+			return summary;
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		const auto percentile = [&](double p)
+		{
+			const size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+			return samples[Clamp<size_t>(rank, 1, samples.size()) - 1];
+		};
+
+		double total = 0.0;
+		for (const auto sample : samples)
+		{
+			total += sample;
+		}
+
+		summary.count = samples.size();
+		summary.mean = total / samples.size();
+		summary.p50 = percentile(0.50);
+		summary.p90 = percentile(0.90);
+		summary.p99 = percentile(0.99);
+		summary.max = samples.back();
+		summary.perSecond = (0.0 < total) ? (samples.size() * 1'000'000.0 / total) : 0.0;
+		return summary;
+	}
+
+	Optional<Options> ParseCommandLine(const Array<String>& args)
+	{
+		auto it = std::find(args.begin(), args.end(), U"--benchmark");
+		if (it == args.end())
+		{
+			return none;
+		}
+
+		Options options;
+
+		if (++it != args.end() && not it->starts_with(U"--"))
+		{
+			options.outputPath = *it;
+
+			if (++it != args.end() && not it->starts_with(U"--"))
+			{
+				options.iterations = ParseOr<size_t>(*it, options.iterations);
+
+				if (++it != args.end() && not it->starts_with(U"--"))
+				{
+					options.threads = ParseOr<size_t>(*it, options.threads);
+				}
+			}
+		}
+
+		return options;
+	}
+
+	bool IsDebuggeeMode(const Array<String>& args)
+	{
+		return std::find(args.begin(), args.end(), U"--benchmark-debuggee") != args.end();
+	}
+
+	size_t DebuggeeIterations(const Array<String>& args)
+	{
+		auto it = std::find(args.begin(), args.end(), U"--benchmark-debuggee");
+		if (it == args.end() || ++it == args.end())
+		{
+			return 0;
+		}
+		return ParseOr<size_t>(*it, 0);
+	}
+
+	size_t DebuggeeThreads(const Array<String>& args)
+	{
+		auto it = std::find(args.begin(), args.end(), U"--benchmark-threads");
+		if (it == args.end() || ++it == args.end())
+		{
+			return 0;
+		}
+		return ParseOr<size_t>(*it, 0);
+	}
+
+	bool Run(const Options& options)
+	{
+		// 計測中にデバッグ対象が終わらないよう、ループは多めに回させる
+		BenchmarkSession session;
+		if (not session.start(options.iterations * 11))
+		{
+			return false;
+		}
+
+		auto& debugger = session.debugger();
+
+		const auto targetOpt = debugger.process().findAddress(U"BenchmarkTarget");
+		if (not targetOpt)
+		{
+			Console << U"BenchmarkTarget が見つかりません";
+			return false;
+		}
+
+		const size_t target = targetOpt.value();
+
+		session.probe().clearSamples();
+		DebugMetrics::Reset();
+
+		JSON json;
+#if SIV3D_PLATFORM(WINDOWS)
+		json[U"platform"] = U"Windows";
+#else
+		json[U"platform"] = U"Linux";
+#endif
+		json[U"date"] = DateTime::Now().format();
+		json[U"iterations"] = static_cast<int64>(options.iterations);
+
+		// ---- 1 つのデバッグ対象で順に計る（止まったまま次の計測に渡す）----
+		json[U"operations"][U"user_breakpoint"] = RunUserBreakPointBenchmark(session, target, options);
+		json[U"conditional_breakpoint"] = RunConditionalBreakPointBenchmark(session, target, options);
+		json[U"operations"][U"hardware_breakpoint"] = RunHardwareBreakPointBenchmark(session, target, options);
+		json[U"operations"][U"watchpoint"] = RunWatchPointBenchmark(session, target, options);
+		json[U"tracepoint"] = RunTracepointBenchmark(session, target, options);
+		json[U"hit_count_breakpoint"] = RunHitCountBreakPointBenchmark(session, target, options);
+		json[U"displaced_stepping"] = RunDisplacedSteppingBenchmark(session, target, options);
+
+		const JSON stepIn = RunStepInLineBenchmark(session, options);
+		json[U"operations"][U"step_in_line"] = stepIn[U"operation"];
+		json[U"single_step_events"] = stepIn[U"single_step_events"];
+		json[U"single_step_events_per_second"] = stepIn[U"single_step_events_per_second"];
+
+		// ここまでのイベントの往復時間
+		const auto roundTripSummary = Summarize(session.probe().roundTrips());
+		PrintSummary(U"event_round_trip", roundTripSummary);
+		json[U"operations"][U"event_round_trip"] = ToJSON(roundTripSummary);
+		json[U"metrics"] = DebugMetrics::ToJSON(DebugMetrics::Snapshot());
+
+		// 以下は止まっている状態で計る（デバッグ対象は進めない）
+		if (session.isStopped())
+		{
+			json[U"batch_install"] = RunBatchInstallBenchmark(debugger, target);
+			json[U"function_index"] = RunFunctionIndexBenchmark(debugger);
+			json[U"line_lookup"] = RunLineLookupBenchmark(debugger);
+			json[U"memory_cache"] = RunMemoryCacheBenchmark(debugger);
+			json[U"instruction_decoder"] = RunInstructionDecoderBenchmark(debugger);
+		}
+
+		session.runToEnd();
+
+		// 正しさの確認（失敗したら Run は false を返す）
+		bool passed = true;
+		json[U"instruction_decoder_test"] = RunInstructionDecoderTest(options.outputPath, passed);
+
+		json[U"breakpoint_index"] = RunBreakPointIndexBenchmark();
+
+		// ---- 計測ごとに新しいデバッグ対象を起動する ----
+		json[U"multi_thread"][U"stopping"] = RunMultiThreadBenchmark(options, true);
+		json[U"multi_thread"][U"counter"] = RunMultiThreadBenchmark(options, false);
+		json[U"session_restore"] = RunSessionRestoreBenchmark();
+		json[U"step_over"] = RunStepOverBenchmark(options);
+		json[U"step_in_library"] = RunStepInLibraryBenchmark(options);
+		json[U"step_out"] = RunStepOutBenchmark(options);
+		json[U"run_to_line"] = RunRunToLineBenchmark(options);
+
+		return json.save(options.outputPath) && passed;
+	}
+}
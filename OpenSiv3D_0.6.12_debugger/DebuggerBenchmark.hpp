@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+// ProcessDebugger をウィンドウなしで動かし、デバッグイベント処理のコストを計測する
+//
+//   起動オプション: --benchmark [結果の出力先.json] [反復回数] [スレッド数]
+//
+// デバッグ対象には自分自身の実行ファイルを --benchmark-debuggee 付きで起動し、
+// BenchmarkDebuggee.cpp の BenchmarkTarget() を呼び続けるループを使う
+// マルチスレッドの計測では --benchmark-threads も付けて、複数のスレッドから同じ関数を呼ばせる
+namespace DebuggerBenchmark
+{
+	struct Options
+	{
+		FilePath outputPath = U"debugger_benchmark.json";
+
+		size_t iterations = 2000;
+
+		// マルチスレッドの計測で同じブレークポイントに当たり続けるスレッドの数
+		size_t threads = 4;
+	};
+
+	// 計測対象の操作ごとの集計（単位はマイクロ秒）
+	struct LatencySummary
+	{
+		size_t count = 0;
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+		double perSecond = 0.0;
+	};
+
+	LatencySummary Summarize(Array<double> samples);
+
+	Optional<Options> ParseCommandLine(const Array<String>& args);
+
+	bool IsDebuggeeMode(const Array<String>& args);
+
+	// デバッグ対象として起動されたときのループの回数
+	size_t DebuggeeIterations(const Array<String>& args);
+
+	// 0 ならシングルスレッドのループ
+	size_t DebuggeeThreads(const Array<String>& args);
+
+	// 計測を行い、結果を options.outputPath に JSON で保存する
+	// 保存できなかったか、正しさの確認（命令デコーダーと objdump の比較）に失敗したら false
+	bool Run(const Options& options);
+}
@@ -0,0 +1,571 @@
+﻿#include "DebuggerBenchmarkFixture.hpp"
+#include "BreakPointIndex.hpp"
+#include "InstructionDecoder.hpp"
+#include <random>
+
+namespace
+{
+	using DebuggerBenchmark::Clock;
+	using DebuggerBenchmark::ElapsedMicroseconds;
+
+	// begin から最初の ret までの命令の先頭アドレス
+	Array<size_t> InstructionAddressesUntilReturn(const ProcessHandle& process, size_t begin)
+	{
+		constexpr size_t MaxBytes = 256;
+
+		uint8 code[MaxBytes + 16] = {};
+		if (not process.readMemory(begin, sizeof(code), code))
+		{
+			return {};
+		}
+
+		Array<size_t> addresses;
+		for (size_t offset = 0; offset < MaxBytes;)
+		{
+			const auto decoded = DecodeInstruction(code + offset, sizeof(code) - offset);
+			if (not decoded)
+			{
+				break;
+			}
+
+			addresses.push_back(begin + offset);
+			if (decoded->flow == InstructionFlow::Return)
+			{
+				break;
+			}
+			offset += decoded->length;
+		}
+		return addresses;
+	}
+
+	// 張ってある target で止まるまで実行し、当たった回数を所要時間で割る
+	double HitsPerSecondUntilStop(ProcessDebugger& debugger, size_t target)
+	{
+		const auto start = Clock::now();
+		debugger.continueDebugSession();
+		const double seconds = ElapsedMicroseconds(start) / 1'000'000.0;
+
+		if (debugger.status() == ProcessStatus::None || seconds <= 0.0)
+		{
+			return 0.0;
+		}
+		return debugger.userBreakPoints().find(target)->hitCount / seconds;
+	}
+}
+
+namespace DebuggerBenchmark
+{
+	// 復元・backRip・TF・再設定を通る、毎回止まるユーザーブレークポイント
+	JSON RunUserBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		Array<double> samples;
+		debugger.setBreakPoint(target);
+
+		for (size_t i = 0; i < options.iterations && session.isStopped(); ++i)
+		{
+			const auto start = Clock::now();
+			debugger.continueDebugSession();
+			samples.push_back(ElapsedMicroseconds(start));
+		}
+
+		debugger.cancelBreakPoint(target);
+
+		const auto summary = Summarize(samples);
+		PrintSummary(U"user_breakpoint", summary);
+		return ToJSON(summary);
+	}
+
+	// 条件付きブレークポイント（条件が偽なら止まらずに続ける）
+	// 100 回に 1 回だけ成り立つ条件にして、止まるまでの時間を当たった回数で割る
+	// 止まっている状態のレジスタとメモリを使った、条件式の評価だけの速さも計る
+	JSON RunConditionalBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		const StringView conditionExpression = U"BenchmarkIteration % 100 == 0";
+		size_t conditionalHits = 0;
+		double conditionalSeconds = 0.0;
+		double memoryConditionsPerSecond = 0.0;
+		double registerConditionsPerSecond = 0.0;
+
+		if (debugger.setConditionalBreakPoint(target, conditionExpression))
+		{
+			const auto hitCount = [&] { return debugger.userBreakPoints().find(target)->hitCount; };
+			const size_t hitsBefore = hitCount();
+			const size_t stops = Max<size_t>(options.iterations / 100, 1);
+
+			const auto start = Clock::now();
+			for (size_t i = 0; i < stops && session.isStopped(); ++i)
+			{
+				debugger.continueDebugSession();
+			}
+			conditionalSeconds = ElapsedMicroseconds(start) / 1'000'000.0;
+
+			if (session.isStopped())
+			{
+				conditionalHits = hitCount() - hitsBefore;
+			}
+
+			const auto evaluationsPerSecond = [&](StringView expression)
+			{
+				constexpr size_t EvaluationCount = 100'000;
+
+				String errorMessage;
+				const auto resolver = debugger.process().createConditionResolver(target);
+				const auto condition = BreakPointCondition::Compile(expression, *resolver, errorMessage);
+				const auto context = debugger.userThread().getContext();
+				if (not condition || not context)
+				{
+					return 0.0;
+				}
+
+				size_t trueCount = 0;
+				const auto evaluateStart = Clock::now();
+				for (size_t i = 0; i < EvaluationCount; ++i)
+				{
+					trueCount += condition->evaluate(*context, debugger.process()).value_or(false);
+				}
+				const double us = ElapsedMicroseconds(evaluateStart);
+				return (0.0 < us) ? (EvaluationCount * 1'000'000.0 / us) : 0.0;
+			};
+
+			if (session.isStopped())
+			{
+				memoryConditionsPerSecond = evaluationsPerSecond(conditionExpression);
+				registerConditionsPerSecond = evaluationsPerSecond(U"$rip != 0 && ($rsp & 0xF) == 8");
+			}
+
+			debugger.cancelBreakPoint(target);
+		}
+
+		const double conditionalHitsPerSecond = (0.0 < conditionalSeconds) ? (conditionalHits / conditionalSeconds) : 0.0;
+		Console << U"conditional_bp       hits={} ({:.1f}/s, {:.2f}us/hit)  eval memory={:.0f}/s registers={:.0f}/s"_fmt(
+			conditionalHits, conditionalHitsPerSecond, (0 < conditionalHits) ? (conditionalSeconds * 1'000'000.0 / conditionalHits) : 0.0,
+			memoryConditionsPerSecond, registerConditionsPerSecond);
+
+		JSON json;
+		json[U"expression"] = conditionExpression;
+		json[U"hits"] = static_cast<int64>(conditionalHits);
+		json[U"hits_per_second"] = conditionalHitsPerSecond;
+		json[U"memory_evaluations_per_second"] = memoryConditionsPerSecond;
+		json[U"register_evaluations_per_second"] = registerConditionsPerSecond;
+		return json;
+	}
+
+	// デバッグレジスタのブレークポイント（命令を書き換えない）
+	JSON RunHardwareBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		Array<double> samples;
+		if (const auto slot = debugger.setHardwareBreakPoint(target))
+		{
+			for (size_t i = 0; i < options.iterations && session.isStopped(); ++i)
+			{
+				const auto start = Clock::now();
+				debugger.continueDebugSession();
+				samples.push_back(ElapsedMicroseconds(start));
+			}
+			debugger.cancelHardwareBreakPoint(*slot);
+		}
+
+		const auto summary = Summarize(samples);
+		PrintSummary(U"hardware_breakpoint", summary);
+		return ToJSON(summary);
+	}
+
+	// ループごとに書き換わる BenchmarkIteration への書き込みで止める
+	JSON RunWatchPointBenchmark(BenchmarkSession& session, size_t target, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		Array<double> samples;
+		if (const auto variable = debugger.process().createConditionResolver(target)->findVariable(U"BenchmarkIteration");
+			variable && not variable->registerOffset)
+		{
+			if (const auto slot = debugger.setWatchPoint(static_cast<size_t>(variable->offset), sizeof(int64)))
+			{
+				for (size_t i = 0; i < options.iterations && session.isStopped(); ++i)
+				{
+					const auto start = Clock::now();
+					debugger.continueDebugSession();
+					samples.push_back(ElapsedMicroseconds(start));
+				}
+				debugger.cancelHardwareBreakPoint(*slot);
+			}
+		}
+
+		const auto summary = Summarize(samples);
+		PrintSummary(U"watchpoint", summary);
+		return ToJSON(summary);
+	}
+
+	// UI に渡さずに続けるトレースポイント。iterations 回目で止まるようにして、そこまでの時間を当たった回数で割る
+	JSON RunTracepointBenchmark(BenchmarkSession& session, size_t target, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		const StringView tracepointMessage = U"i={BenchmarkIteration} rdx={$rdx}";
+		double hitsPerSecond = 0.0;
+		uint64 written = 0;
+		uint64 dropped = 0;
+
+		debugger.tracepointSink().setOutputPath(options.outputPath + U".tracepoints.txt");
+		if (debugger.setTracepoint(target, tracepointMessage, static_cast<uint32>(options.iterations)))
+		{
+			hitsPerSecond = HitsPerSecondUntilStop(debugger, target);
+			debugger.tracepointSink().flush();
+			written = debugger.tracepointSink().writtenCount();
+			dropped = debugger.tracepointSink().droppedCount();
+		}
+		debugger.cancelBreakPoint(target);
+
+		Console << U"tracepoint           {:.1f} hits/s (written={}, dropped={})"_fmt(hitsPerSecond, written, dropped);
+
+		JSON json;
+		json[U"message"] = tracepointMessage;
+		json[U"hits_per_second"] = hitsPerSecond;
+		json[U"written"] = static_cast<int64>(written);
+		json[U"dropped"] = static_cast<int64>(dropped);
+		return json;
+	}
+
+	// iterations 回目だけ止まるブレークポイント
+	JSON RunHitCountBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		double hitsPerSecond = 0.0;
+		if (session.isStopped() && debugger.setHitCountBreakPoint(target, static_cast<uint32>(options.iterations)))
+		{
+			hitsPerSecond = HitsPerSecondUntilStop(debugger, target);
+		}
+		debugger.cancelBreakPoint(target);
+
+		Console << U"hit_count            {:.1f} hits/s"_fmt(hitsPerSecond);
+
+		JSON json;
+		json[U"hits_per_second"] = hitsPerSecond;
+		return json;
+	}
+
+	// 止まらないブレークポイントを命令ごとに張る（退避した命令を外で実行する）
+	// ループの本体と BenchmarkTarget の全命令に Counter を張り、BenchmarkTarget の先頭の iterations 回目で止める
+	// ループ内の命令はどれも iterations 回前後当たっていて、デバッグ対象が正しく動き続けていることを確かめる
+	JSON RunDisplacedSteppingBenchmark(BenchmarkSession& session, size_t target, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		double hitsPerSecond = 0.0;
+		size_t breakPoints = 0;
+		size_t mismatches = 0;
+		const size_t singleStepsBefore = session.probe().singleStepCount();
+
+		if (const auto loopOpt = debugger.process().findAddress(U"RunBenchmarkDebuggee"); loopOpt && session.isStopped())
+		{
+			auto addresses = InstructionAddressesUntilReturn(debugger.process(), *loopOpt);
+			for (const auto address : InstructionAddressesUntilReturn(debugger.process(), target))
+			{
+				if (address != target)
+				{
+					addresses.push_back(address);
+				}
+			}
+
+			debugger.setBreakPoints(addresses);
+			for (const auto address : addresses)
+			{
+				debugger.setCounterBreakPoint(address);
+			}
+			debugger.setHitCountBreakPoint(target, static_cast<uint32>(options.iterations));
+
+			const auto start = Clock::now();
+			debugger.continueDebugSession();
+			const double seconds = ElapsedMicroseconds(start) / 1'000'000.0;
+
+			if (session.isStopped())
+			{
+				size_t totalHits = 0;
+				for (const auto address : addresses)
+				{
+					const uint32 hits = debugger.userBreakPoints().find(address)->hitCount;
+					totalHits += hits;
+
+					// 関数の入口・出口（0 か 1 回）以外は iterations 回前後
+					if (1 < hits && (hits + 1 < options.iterations || options.iterations < hits))
+					{
+						++mismatches;
+					}
+				}
+				hitsPerSecond = (0.0 < seconds) ? (totalHits / seconds) : 0.0;
+			}
+
+			breakPoints = addresses.size();
+			addresses.push_back(target);
+			debugger.cancelBreakPoints(addresses);
+		}
+
+		const size_t singleSteps = session.probe().singleStepCount() - singleStepsBefore;
+
+		Console << U"displaced_stepping   {} breakpoints {:.1f} hits/s (single_steps={}, mismatches={})"_fmt(
+			breakPoints, hitsPerSecond, singleSteps, mismatches);
+
+		JSON json;
+		json[U"breakpoints"] = static_cast<int64>(breakPoints);
+		json[U"hits_per_second"] = hitsPerSecond;
+		json[U"single_step_events"] = static_cast<int64>(singleSteps);
+		json[U"mismatches"] = static_cast<int64>(mismatches);
+		return json;
+	}
+
+	// デバッグ対象のコードに 1 つずつ張って外す場合と、まとめて張って外す場合を比べる
+	// 張ったものは再開する前にすべて外すので、どこに張ってもかまわない
+	JSON RunBatchInstallBenchmark(ProcessDebugger& debugger, size_t codeAddress)
+	{
+		constexpr size_t PageSize = 4096;
+		constexpr size_t MaxRegionSize = 16 * 1024 * 1024;
+
+		const auto& process = debugger.process();
+		const auto isReadable = [&](size_t page)
+		{
+			uint8 byte;
+			return process.readMemory(page, byte);
+		};
+
+		// codeAddress を含む読めるページの範囲
+		size_t regionBegin = codeAddress / PageSize * PageSize;
+		size_t regionEnd = regionBegin + PageSize;
+		while (regionEnd - regionBegin < MaxRegionSize && PageSize <= regionBegin && isReadable(regionBegin - PageSize))
+		{
+			regionBegin -= PageSize;
+		}
+		while (regionEnd - regionBegin < MaxRegionSize && isReadable(regionEnd))
+		{
+			regionEnd += PageSize;
+		}
+
+		Array<uint8> before(regionEnd - regionBegin), after(regionEnd - regionBegin);
+		process.readMemory(regionBegin, before.size(), before.data());
+
+		JSON json;
+
+		for (const size_t breakPointCount : { 10'000, 100'000 })
+		{
+			// 行ごとのブレークポイントくらいの密度で並べる
+			const size_t stride = Clamp<size_t>((regionEnd - regionBegin) / breakPointCount, 1, 16);
+			Array<size_t> addresses;
+			for (size_t address = regionBegin; address < regionEnd && addresses.size() < breakPointCount; address += stride)
+			{
+				addresses.push_back(address);
+			}
+
+			auto start = Clock::now();
+			for (const auto address : addresses)
+			{
+				debugger.setBreakPoint(address);
+			}
+			const double singleSetUs = ElapsedMicroseconds(start);
+
+			start = Clock::now();
+			for (const auto address : addresses)
+			{
+				debugger.cancelBreakPoint(address);
+			}
+			const double singleCancelUs = ElapsedMicroseconds(start);
+
+			start = Clock::now();
+			const size_t installed = debugger.setBreakPoints(addresses);
+			const double batchSetUs = ElapsedMicroseconds(start);
+
+			start = Clock::now();
+			debugger.cancelBreakPoints(addresses);
+			const double batchCancelUs = ElapsedMicroseconds(start);
+
+			process.readMemory(regionBegin, after.size(), after.data());
+			const bool restored = (before == after);
+
+			const auto perSecond = [&](double us) { return (0.0 < us) ? (addresses.size() * 1'000'000.0 / us) : 0.0; };
+
+			Console << U"batch_install        n={:<7} single set={:>9.1f}ms cancel={:>9.1f}ms  batch set={:>8.2f}ms cancel={:>8.2f}ms  x{:.1f} restored={}"_fmt(
+				addresses.size(), singleSetUs / 1000, singleCancelUs / 1000, batchSetUs / 1000, batchCancelUs / 1000,
+				(singleSetUs + singleCancelUs) / Max(batchSetUs + batchCancelUs, 1.0), restored);
+
+			JSON result;
+			result[U"breakpoints"] = static_cast<int64>(addresses.size());
+			result[U"installed"] = static_cast<int64>(installed);
+			result[U"pages"] = static_cast<int64>((addresses.back() - addresses.front()) / PageSize + 1);
+			result[U"single_set_per_second"] = perSecond(singleSetUs);
+			result[U"single_cancel_per_second"] = perSecond(singleCancelUs);
+			result[U"batch_set_per_second"] = perSecond(batchSetUs);
+			result[U"batch_cancel_per_second"] = perSecond(batchCancelUs);
+			result[U"memory_restored"] = restored;
+			json[Format(breakPointCount)] = result;
+		}
+
+		return json;
+	}
+
+	// ブレークポイントの数を変えて、当たったときの検索 1 回にかかる時間を計る
+	// （デバッグ対象のコードを 10 万か所書き換えるわけにはいかないので表だけで計る）
+	JSON RunBreakPointIndexBenchmark()
+	{
+		constexpr size_t LookupCount = 1'000'000;
+		constexpr size_t LinearScanLookupCount = 1'000;
+		constexpr size_t TextBase = 0x140001000;
+		constexpr size_t TextSize = 64 * 1024 * 1024;
+
+		JSON json;
+		std::mt19937_64 rng(12345);
+
+		for (const size_t breakPointCount : { 1'000, 10'000, 100'000 })
+		{
+			BreakPointIndex index;
+			HashTable<size_t, uint8> linear;
+			Array<size_t> addresses;
+
+			std::uniform_int_distribution<size_t> distribution(TextBase, TextBase + TextSize - 1);
+			while (addresses.size() < breakPointCount)
+			{
+				const size_t address = distribution(rng);
+				if (index.insert(address).second)
+				{
+					linear.emplace(address, uint8(0xCC));
+					addresses.push_back(address);
+				}
+			}
+
+			std::shuffle(addresses.begin(), addresses.end(), rng);
+
+			// 当たり（並びはばらばら）
+			size_t found = 0;
+			auto start = Clock::now();
+			for (size_t i = 0; i < LookupCount; ++i)
+			{
+				found += (index.find(addresses[i % addresses.size()]) != nullptr);
+			}
+			const double hitNs = ElapsedMicroseconds(start) * 1000.0 / LookupCount;
+
+			// 外れ（ブレークポイントのない int3 など）
+			start = Clock::now();
+			for (size_t i = 0; i < LookupCount; ++i)
+			{
+				found += (index.find(addresses[i % addresses.size()] + 1) != nullptr);
+			}
+			const double missNs = ElapsedMicroseconds(start) * 1000.0 / LookupCount;
+
+			// 以前の実装（HashTable を先頭から走査）
+			start = Clock::now();
+			for (size_t i = 0; i < LinearScanLookupCount; ++i)
+			{
+				const size_t address = addresses[i % addresses.size()];
+				for (const auto& breakPoint : linear)
+				{
+					if (breakPoint.first == address)
+					{
+						++found;
+						break;
+					}
+				}
+			}
+			const double linearNs = ElapsedMicroseconds(start) * 1000.0 / LinearScanLookupCount;
+
+			// 関数 1 つ分くらいの範囲の問い合わせ（初回は並べ直しを含む）
+			start = Clock::now();
+			found += index.addressesInRange(TextBase, TextBase + 4096).size();
+			const double firstRangeUs = ElapsedMicroseconds(start);
+
+			start = Clock::now();
+			for (size_t i = 0; i < 1000; ++i)
+			{
+				const size_t begin = addresses[i % addresses.size()];
+				found += index.addressesInRange(begin, begin + 4096).size();
+			}
+			const double rangeUs = ElapsedMicroseconds(start) / 1000;
+
+			Console << U"breakpoint_index     n={:<7} hit={:>6.1f}ns miss={:>6.1f}ns linear_scan={:>10.1f}ns range={:>6.2f}us (first {:.1f}us) [{}]"_fmt(
+				breakPointCount, hitNs, missNs, linearNs, rangeUs, firstRangeUs, found);
+
+			JSON result;
+			result[U"breakpoints"] = static_cast<int64>(breakPointCount);
+			result[U"lookup_hit_ns"] = hitNs;
+			result[U"lookup_miss_ns"] = missNs;
+			result[U"linear_scan_ns"] = linearNs;
+			result[U"range_query_us"] = rangeUs;
+			result[U"first_range_query_us"] = firstRangeUs;
+			json[Format(breakPointCount)] = result;
+		}
+
+		return json;
+	}
+
+	// 複数のスレッドが同じブレークポイントに当たり続けるときの正しさと速さ
+	// stopping: 毎回止まるブレークポイント（int3 を外して 1 命令実行させ、張り直す）
+	// counter: 止まらないブレークポイント（命令を外で実行する）
+	// 当たった回数が threads * iterations と一致し、デバッグ対象の計算が合っていれば正しい
+	JSON RunMultiThreadBenchmark(const Options& options, bool stopping)
+	{
+		JSON json;
+		json[U"threads"] = static_cast<int64>(options.threads);
+
+		BenchmarkSession session;
+		if (not session.start(options.iterations, options.threads))
+		{
+			return json;
+		}
+
+		auto& debugger = session.debugger();
+		const auto targetOpt = debugger.process().findAddress(U"BenchmarkTarget");
+		const auto errorOpt = debugger.process().findAddress(U"BenchmarkThreadError");
+		if (not targetOpt || not errorOpt)
+		{
+			return json;
+		}
+
+		if (stopping)
+		{
+			debugger.setBreakPoint(targetOpt.value());
+		}
+		else
+		{
+			debugger.setCounterBreakPoint(targetOpt.value());
+		}
+		debugger.setCounterBreakPoint(errorOpt.value());
+
+		size_t stops = 0;
+		const auto start = Clock::now();
+
+		while (session.isStopped())
+		{
+			debugger.continueDebugSession();
+			stops += session.isStopped();
+		}
+
+		const double seconds = ElapsedMicroseconds(start) / 1'000'000.0;
+
+		// 終了しても表は次のセッションまで残っている（張れていなかったり消えていたりしたら正しくない）
+		const auto* targetEntry = debugger.userBreakPoints().find(targetOpt.value());
+		const auto* errorEntry = debugger.userBreakPoints().find(errorOpt.value());
+		const bool hasBreakPoints = (targetEntry != nullptr) && (errorEntry != nullptr);
+		const size_t hits = targetEntry ? targetEntry->hitCount : 0;
+		const size_t errors = errorEntry ? errorEntry->hitCount : 0;
+		const size_t expected = options.threads * options.iterations;
+		const bool correct = hasBreakPoints && (hits == expected) && (errors == 0) && (not stopping || stops == expected);
+		const double hitsPerSecond = (0.0 < seconds) ? (hits / seconds) : 0.0;
+
+		json[U"hits"] = static_cast<int64>(hits);
+		json[U"expected_hits"] = static_cast<int64>(expected);
+		json[U"stops"] = static_cast<int64>(stops);
+		json[U"debuggee_errors"] = static_cast<int64>(errors);
+		json[U"breakpoints_found"] = hasBreakPoints;
+		json[U"correct"] = correct;
+		json[U"hits_per_second"] = hitsPerSecond;
+
+		Console << U"multi_thread_{:<11} threads={} hits={}/{} stops={} errors={} {:.1f} hits/s {}"_fmt(
+			(stopping ? U"stopping" : U"counter"), options.threads, hits, expected, stops, errors,
+			hitsPerSecond, (correct ? U"OK" : U"NG"));
+
+		return json;
+	}
+}
@@ -0,0 +1,391 @@
+﻿#include "DebuggerBenchmarkFixture.hpp"
+#include "InstructionDecoder.hpp"
+#include <random>
+
+namespace
+{
+#if SIV3D_PLATFORM(LINUX)
+
+	// objdump が命令とは別の行に出す、プレフィックスだけの行（"rex.W", "gs repnz rex.WRX" など）
+	bool IsPrefixOnly(const std::string& text)
+	{
+		std::istringstream stream{ text };
+		std::string word;
+		bool any = false;
+
+		while (stream >> word)
+		{
+			// rex, rex.W, rex.WRXB など
+			bool isPrefix = word.starts_with("rex");
+
+			for (const char* prefix : { "data16", "addr32", "cs", "ds", "es", "fs", "gs", "ss", "lock", "rep", "repz", "repnz", "bnd", "notrack", "xacquire", "xrelease" })
+			{
+				isPrefix |= (word == prefix);
+			}
+
+			if (not isPrefix)
+			{
+				return false;
+			}
+
+			any = true;
+		}
+
+		return any;
+	}
+
+	struct DisassemblerComparison
+	{
+		// DecodeInstruction が解釈した命令のうち、objdump も解釈できて長さを比べた数と食い違った数
+		size_t compared = 0;
+
+		size_t mismatches = 0;
+
+		// DecodeInstruction が解釈できなかった命令のうち、objdump で調べた数と objdump は解釈できた数
+		size_t rejected = 0;
+
+		size_t rejectedValid = 0;
+	};
+
+	// でたらめな命令の長さを objdump と比べる（命令の後ろを nop で埋め、objdump がずれても次の命令で揃うようにする）
+	// 66 を付けた相対分岐の長さは Intel と AMD で違うので、Intel の解釈（-M intel64）に合わせる
+	// objdump がないときは none
+	Optional<DisassemblerComparison> CompareWithDisassembler(const FilePath& blobPath, size_t sampleCount)
+	{
+		constexpr size_t Padding = 16;
+		constexpr uint8 Nop = 0x90;
+
+		std::mt19937_64 rng{ 12345 };
+		const auto randomByte = [&] { return static_cast<uint8>(rng()); };
+
+		Array<uint8> blob;
+		HashTable<size_t, size_t> expectedLengths;
+
+		// 解釈できなかったものは 15 バイトすべてを置く
+		Array<size_t> rejectedOffsets;
+
+		for (size_t i = 0; i < sampleCount; ++i)
+		{
+			uint8 bytes[15] = {};
+			for (auto& byte : bytes)
+			{
+				byte = randomByte();
+			}
+
+			size_t pos = 0;
+
+			// レガシープレフィックス 0～2 個と REX（半分の確率）
+			constexpr uint8 LegacyPrefixes[] = { 0x66, 0x67, 0xF2, 0xF3, 0xF0, 0x2E, 0x64, 0x65 };
+			for (size_t count = rng() % 3; 0 < count; --count)
+			{
+				bytes[pos++] = LegacyPrefixes[rng() % std::size(LegacyPrefixes)];
+			}
+			if (rng() % 2)
+			{
+				bytes[pos++] = static_cast<uint8>(0x40 | (rng() % 16));
+			}
+
+			// オペコードのマップを散らす
+			switch (rng() % 12)
+			{
+			case 0: case 1: case 2: case 3:
+				// REX の後ろにさらにプレフィックスが続くと、CPU はその REX を無視するが objdump は効かせるので避ける
+				while (((bytes[pos] & 0xF0) == 0x40) || std::ranges::find(LegacyPrefixes, bytes[pos]) != std::end(LegacyPrefixes)
+					|| bytes[pos] == 0x26 || bytes[pos] == 0x36 || bytes[pos] == 0x3E)
+				{
+					bytes[pos] = randomByte();
+				}
+				break;
+			case 4: case 5:
+				bytes[pos++] = 0x0F;
+				break;
+			case 6:
+				bytes[pos++] = 0x0F;
+				bytes[pos++] = 0x38;
+				break;
+			case 7:
+				bytes[pos++] = 0x0F;
+				bytes[pos++] = 0x3A;
+				break;
+			case 8:
+				bytes[pos++] = 0xC5;
+				break;
+			case 9:
+				// EVEX（マップ 1～3, 5, 6。P0 の 3 ビット目は 0、P1 の 2 ビット目は 1 でないと #UD）
+				bytes[pos++] = 0x62;
+				bytes[pos] = static_cast<uint8>((bytes[pos] & 0xF0) | std::array<uint8, 5>{ 1, 2, 3, 5, 6 }[rng() % 5]);
+				bytes[pos + 1] |= 0x04;
+				break;
+			case 10:
+				// XOP（マップ 8～10。それより小さければ 8F は POP）
+				bytes[pos++] = 0x8F;
+				bytes[pos] = static_cast<uint8>((bytes[pos] & 0xE0) | (8 + rng() % 3));
+				break;
+			default:
+				// 3 バイト VEX（マップ 1～3）
+				bytes[pos++] = 0xC4;
+				bytes[pos] = static_cast<uint8>((bytes[pos] & 0xE0) | (1 + rng() % 3));
+				break;
+			}
+
+			const auto decoded = DecodeInstruction(bytes, sizeof(bytes));
+			if (decoded)
+			{
+				expectedLengths.emplace(blob.size(), decoded->length);
+			}
+			else
+			{
+				rejectedOffsets.push_back(blob.size());
+			}
+
+			blob.insert(blob.end(), bytes, bytes + (decoded ? decoded->length : sizeof(bytes)));
+			blob.insert(blob.end(), Padding, Nop);
+		}
+
+		{
+			BinaryWriter writer{ blobPath };
+			if (not writer || not writer.write(blob.data(), static_cast<int64>(blob.size())))
+			{
+				return none;
+			}
+		}
+
+		const std::string command = "objdump -D -b binary -m i386:x86-64 -M intel64 -w '" + Unicode::ToUTF8(blobPath) + "' 2>/dev/null";
+		FILE* pipe = ::popen(command.c_str(), "r");
+		if (not pipe)
+		{
+			return none;
+		}
+
+		// "   1f:\t66 0f 1f 44 00 00 \tnopw   0x0(%rax,%rax,1)" を { 位置, 長さ, 命令の文字列 } にする
+		struct Line
+		{
+			size_t length;
+
+			std::string text;
+		};
+
+		HashTable<size_t, Line> lines;
+		char buffer[1024];
+		while (std::fgets(buffer, sizeof(buffer), pipe))
+		{
+			const std::string line = buffer;
+			const size_t colon = line.find(":\t");
+			const size_t secondTab = (colon == std::string::npos) ? std::string::npos : line.find('\t', colon + 2);
+			if (secondTab == std::string::npos)
+			{
+				continue;
+			}
+
+			char* end = nullptr;
+			const size_t offset = std::strtoull(line.c_str(), &end, 16);
+			if (end != line.c_str() + colon)
+			{
+				continue;
+			}
+
+			std::istringstream byteStream{ line.substr(colon + 2, secondTab - colon - 2) };
+			std::string byteText;
+			size_t length = 0;
+			while (byteStream >> byteText)
+			{
+				++length;
+			}
+
+			// 同じ行に並ぶプレフィックスも含めた命令の文字列（"repz lock rex.WRX (bad)" など）
+			std::string text = line.substr(secondTab + 1);
+			text = text.substr(0, text.find_last_not_of(" \n") + 1);
+			lines.emplace(offset, Line{ length, text });
+		}
+
+		if (::pclose(pipe) != 0 || lines.empty())
+		{
+			return none;
+		}
+
+		// offset からの objdump の命令の長さ（プレフィックスだけの行は後ろの命令とつなげる）。(bad) なら none
+		const auto objdumpLength = [&](size_t offset) -> Optional<size_t>
+		{
+			size_t length = 0;
+			const Line* line = nullptr;
+			for (auto it = lines.find(offset); it != lines.end(); it = lines.find(offset + length))
+			{
+				line = &it->second;
+				length += line->length;
+				if (not IsPrefixOnly(line->text))
+				{
+					break;
+				}
+			}
+
+			if (not line || line->text.find("(bad)") != std::string::npos)
+			{
+				return none;
+			}
+			return length;
+		};
+
+		// 食い違ったものは最初のいくつかだけバイト列を出す
+		constexpr size_t MaxReports = 8;
+		size_t reports = 0;
+		const auto report = [&](StringView kind, size_t offset, size_t length)
+		{
+			if (MaxReports <= reports++)
+			{
+				return;
+			}
+
+			String hex;
+			for (size_t i = 0; i < length && offset + i < blob.size(); ++i)
+			{
+				hex += U"{:02X} "_fmt(blob[offset + i]);
+			}
+			Console << U"instruction_decoder  {}: {}"_fmt(kind, hex);
+		};
+
+		DisassemblerComparison result;
+		for (const auto& [offset, expected] : expectedLengths)
+		{
+			const auto length = objdumpLength(offset);
+			if (not length)
+			{
+				continue;
+			}
+
+			++result.compared;
+			if (*length != expected)
+			{
+				++result.mismatches;
+				report(U"length mismatch", offset, Max(*length, expected));
+			}
+		}
+
+		for (const auto offset : rejectedOffsets)
+		{
+			++result.rejected;
+			if (const auto length = objdumpLength(offset))
+			{
+				++result.rejectedValid;
+				report(U"rejected but valid", offset, *length);
+			}
+		}
+
+		return result;
+	}
+
+#endif
+}
+
+namespace DebuggerBenchmark
+{
+	// デバッグ対象の関数のコードを先頭から順に解析する速さ（ステップ実行の範囲を調べるのと同じ使い方）
+	JSON RunInstructionDecoderBenchmark(const ProcessDebugger& debugger)
+	{
+		constexpr size_t MaxCodeBytes = 4 * 1024 * 1024;
+		constexpr size_t MinDecodedInstructions = 10'000'000;
+
+		JSON json;
+
+		Array<uint8> code;
+		Array<std::pair<size_t, size_t>> functions;
+		for (const auto& entry : debugger.process().functionIndex().entries())
+		{
+			if (entry.size == 0 || MaxCodeBytes < code.size() + entry.size)
+			{
+				continue;
+			}
+
+			const size_t offset = code.size();
+			code.resize(offset + entry.size);
+			if (debugger.process().readMemory(entry.address, entry.size, code.data() + offset))
+			{
+				functions.emplace_back(offset, entry.size);
+			}
+			else
+			{
+				code.resize(offset);
+			}
+		}
+
+		// 解析できないバイト（関数の間の埋め草など）は 1 バイト飛ばす
+		size_t instructions = 0, undecodable = 0, bytes = 0;
+		const auto sweep = [&]
+		{
+			for (const auto& [offset, size] : functions)
+			{
+				for (size_t pos = 0; pos < size;)
+				{
+					if (const auto decoded = DecodeInstruction(code.data() + offset + pos, size - pos))
+					{
+						++instructions;
+						pos += decoded->length;
+					}
+					else
+					{
+						++undecodable;
+						++pos;
+					}
+				}
+				bytes += size;
+			}
+		};
+
+		sweep();
+		const size_t instructionsPerSweep = instructions;
+		const size_t undecodablePerSweep = undecodable;
+
+		size_t sweeps = 0;
+		const auto start = Clock::now();
+		while (0 < instructionsPerSweep && instructions < MinDecodedInstructions + instructionsPerSweep)
+		{
+			sweep();
+			++sweeps;
+		}
+		const double seconds = ElapsedMicroseconds(start) / 1'000'000.0;
+
+		const double instructionsPerSecond = (0.0 < seconds) ? (sweeps * instructionsPerSweep / seconds) : 0.0;
+		const double megabytesPerSecond = (0.0 < seconds) ? (sweeps * code.size() / seconds / (1024 * 1024)) : 0.0;
+
+		Console << U"instruction_decoder  code={}KB instructions={} undecodable={} {:.1f}M inst/s {:.1f}MB/s"_fmt(
+			code.size() / 1024, instructionsPerSweep, undecodablePerSweep, instructionsPerSecond / 1'000'000, megabytesPerSecond);
+
+		json[U"code_bytes"] = static_cast<int64>(code.size());
+		json[U"instructions"] = static_cast<int64>(instructionsPerSweep);
+		json[U"undecodable_bytes"] = static_cast<int64>(undecodablePerSweep);
+		json[U"instructions_per_second"] = instructionsPerSecond;
+		json[U"megabytes_per_second"] = megabytesPerSecond;
+
+		return json;
+	}
+
+	JSON RunInstructionDecoderTest(const FilePath& outputPath, bool& passed)
+	{
+		JSON json;
+
+#if SIV3D_PLATFORM(LINUX)
+		if (const auto result = CompareWithDisassembler(outputPath + U".decoder.bin", 100'000))
+		{
+			const bool ok = (result->mismatches == 0) && (result->rejectedValid == 0);
+			passed = passed && ok;
+
+			Console << U"instruction_decoder  objdump compared={} mismatches={} rejected={} rejected_valid={} {}"_fmt(
+				result->compared, result->mismatches, result->rejected, result->rejectedValid, (ok ? U"OK" : U"NG"));
+
+			json[U"compared"] = static_cast<int64>(result->compared);
+			json[U"mismatches"] = static_cast<int64>(result->mismatches);
+			json[U"rejected"] = static_cast<int64>(result->rejected);
+			json[U"rejected_valid"] = static_cast<int64>(result->rejectedValid);
+			json[U"correct"] = ok;
+		}
+		else
+		{
+			Console << U"instruction_decoder  objdump not found (skipped)";
+		}
+#else
+		(void)outputPath;
+		(void)passed;
+#endif
+
+		return json;
+	}
+}
@@ -0,0 +1,112 @@
+﻿#include "DebuggerBenchmarkFixture.hpp"
+
+namespace DebuggerBenchmark
+{
+	double ElapsedMicroseconds(Clock::time_point from)
+	{
+		return std::chrono::duration<double, std::micro>(Clock::now() - from).count();
+	}
+
+	JSON ToJSON(const LatencySummary& summary)
+	{
+		JSON json;
+		json[U"count"] = static_cast<int64>(summary.count);
+		json[U"mean_us"] = summary.mean;
+		json[U"p50_us"] = summary.p50;
+		json[U"p90_us"] = summary.p90;
+		json[U"p99_us"] = summary.p99;
+		json[U"max_us"] = summary.max;
+		json[U"per_second"] = summary.perSecond;
+		return json;
+	}
+
+	void PrintSummary(StringView name, const LatencySummary& summary)
+	{
+		Console << U"{:<20} n={:<7} p50={:>9.2f}us p90={:>9.2f}us p99={:>9.2f}us max={:>9.2f}us {:>10.1f}/s"_fmt(
+			name, summary.count, summary.p50, summary.p90, summary.p99, summary.max, summary.perSecond);
+	}
+
+	bool MeasuringBackend::waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds)
+	{
+		if (not m_backend->waitForDebugEvent(debugEvent, milliseconds))
+		{
+			return false;
+		}
+
+		if (m_continuedAt)
+		{
+			m_roundTrips.push_back(ElapsedMicroseconds(*m_continuedAt));
+			m_continuedAt.reset();
+		}
+
+		if (debugEvent.dwDebugEventCode == EXCEPTION_DEBUG_EVENT
+			&& debugEvent.u.Exception.ExceptionRecord.ExceptionCode == EXCEPTION_SINGLE_STEP)
+		{
+			++m_singleStepCount;
+		}
+
+		return true;
+	}
+
+	BenchmarkSession::BenchmarkSession()
+		: BenchmarkSession(std::make_unique<MeasuringBackend>(DebugBackend::CreateDefault())) {}
+
+	BenchmarkSession::BenchmarkSession(std::unique_ptr<MeasuringBackend> backend)
+		: m_probe(*backend)
+		, m_debugger(std::move(backend)) {}
+
+	BenchmarkSession::~BenchmarkSession()
+	{
+		runToEnd();
+	}
+
+	bool BenchmarkSession::start(size_t iterations, size_t threads)
+	{
+		String arguments = U"--benchmark-debuggee {}"_fmt(iterations);
+		if (threads != 0)
+		{
+			arguments += U" --benchmark-threads {}"_fmt(threads);
+		}
+
+		const auto startTime = Clock::now();
+		if (not m_debugger.startDebugSession(FileSystem::ModulePath(), arguments))
+		{
+			return false;
+		}
+
+		// Main() の先頭のブレークポイントまで進める
+		m_debugger.continueDebugSession();
+		m_startupMilliseconds = ElapsedMicroseconds(startTime) / 1000;
+
+		return isStopped();
+	}
+
+	const FunctionEntry* BenchmarkSession::runToFunction(StringView name)
+	{
+		const auto entryOpt = m_debugger.process().findAddress(String{ name });
+		const auto* function = entryOpt ? m_debugger.process().functionIndex().findContaining(*entryOpt) : nullptr;
+		if (not function)
+		{
+			return nullptr;
+		}
+
+		m_debugger.setBreakPoint(function->address);
+		m_debugger.continueDebugSession();
+		m_debugger.cancelBreakPoint(function->address);
+
+		return isStopped() ? function : nullptr;
+	}
+
+	void BenchmarkSession::runToEnd()
+	{
+		if (isStopped())
+		{
+			m_debugger.cancelBreakPoints(m_debugger.userBreakPoints().addresses());
+		}
+
+		while (isStopped())
+		{
+			m_debugger.continueDebugSession();
+		}
+	}
+}
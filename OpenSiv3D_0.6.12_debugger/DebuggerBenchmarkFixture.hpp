@@ -0,0 +1,160 @@
+﻿#pragma once
+#include "DebuggerBenchmark.hpp"
+#include "ProcessDebugger.hpp"
+
+// DebuggerBenchmark の計測（DebuggerBenchmark*.cpp）で共有する道具と、計測ごとの関数
+namespace DebuggerBenchmark
+{
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedMicroseconds(Clock::time_point from);
+
+	JSON ToJSON(const LatencySummary& summary);
+
+	void PrintSummary(StringView name, const LatencySummary& summary);
+
+	// 実際のバックエンドに処理を委ねつつ、ContinueDebugEvent から次のイベントまでの時間を計る
+	class MeasuringBackend : public DebugBackend
+	{
+	public:
+
+		explicit MeasuringBackend(std::unique_ptr<DebugBackend> backend)
+			: m_backend(std::move(backend)) {}
+
+		bool createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo) override
+		{
+			return m_backend->createProcess(exeFilePath, arguments, processInfo);
+		}
+
+		bool waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds) override;
+
+		bool continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus) override
+		{
+			m_continuedAt = Clock::now();
+			return m_backend->continueDebugEvent(processID, threadID, continueStatus);
+		}
+
+		bool getThreadContext(HANDLE thread, CONTEXT& context) override { return m_backend->getThreadContext(thread, context); }
+
+		bool setThreadContext(HANDLE thread, const CONTEXT& context) override { return m_backend->setThreadContext(thread, context); }
+
+		bool setTrapFlag(HANDLE thread) override { return m_backend->setTrapFlag(thread); }
+
+		void suspendThread(HANDLE thread) override { m_backend->suspendThread(thread); }
+
+		void resumeThread(HANDLE thread) override { m_backend->resumeThread(thread); }
+
+		bool readMemory(HANDLE process, size_t address, size_t size, void* buffer) override
+		{
+			++m_readCount;
+			return m_backend->readMemory(process, address, size, buffer);
+		}
+
+		bool writeMemory(HANDLE process, size_t address, size_t size, const void* buffer) override { return m_backend->writeMemory(process, address, size, buffer); }
+
+		bool allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address) override { return m_backend->allocateMemory(process, nearAddress, size, address); }
+
+		bool debugBreakProcess(HANDLE process) override { return m_backend->debugBreakProcess(process); }
+
+		void closeHandle(HANDLE handle) override { m_backend->closeHandle(handle); }
+
+		uint32 lastError() const override { return m_backend->lastError(); }
+
+		void clearSamples()
+		{
+			m_roundTrips.clear();
+		}
+
+		const Array<double>& roundTrips() const { return m_roundTrips; }
+
+		size_t singleStepCount() const { return m_singleStepCount; }
+
+		size_t readCount() const { return m_readCount; }
+
+	private:
+
+		std::unique_ptr<DebugBackend> m_backend;
+
+		Optional<Clock::time_point> m_continuedAt;
+
+		Array<double> m_roundTrips;
+
+		size_t m_singleStepCount = 0;
+
+		size_t m_readCount = 0;
+	};
+
+	// 自分自身を --benchmark-debuggee 付きで起動したデバッグ対象
+	// start で Main() の先頭のブレークポイントまで進め、破棄するときにブレークポイントを外して最後まで実行させる
+	class BenchmarkSession
+	{
+	public:
+
+		BenchmarkSession();
+
+		~BenchmarkSession();
+
+		// threads が 0 でなければ --benchmark-threads も付けて、複数のスレッドから BenchmarkTarget() を呼ばせる
+		bool start(size_t iterations, size_t threads = 0);
+
+		// start から Main() の先頭で止まるまでのミリ秒
+		double startupMilliseconds() const { return m_startupMilliseconds; }
+
+		bool isStopped() { return m_debugger.status() != ProcessStatus::None; }
+
+		// name の関数の先頭まで実行する（そのために張ったブレークポイントは外す）
+		// 関数が見つからなければ nullptr
+		const FunctionEntry* runToFunction(StringView name);
+
+		void runToEnd();
+
+		ProcessDebugger& debugger() { return m_debugger; }
+
+		MeasuringBackend& probe() { return m_probe; }
+
+	private:
+
+		explicit BenchmarkSession(std::unique_ptr<MeasuringBackend> backend);
+
+		MeasuringBackend& m_probe;
+
+		ProcessDebugger m_debugger;
+
+		double m_startupMilliseconds = 0.0;
+	};
+
+	// session を受け取る計測は、止まっている session のデバッグ対象を使い、止まったまま返す
+	// target は BenchmarkTarget() の先頭
+
+	// DebuggerBenchmarkBreakPoints.cpp
+	JSON RunUserBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options);
+	JSON RunConditionalBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options);
+	JSON RunHardwareBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options);
+	JSON RunWatchPointBenchmark(BenchmarkSession& session, size_t target, const Options& options);
+	JSON RunTracepointBenchmark(BenchmarkSession& session, size_t target, const Options& options);
+	JSON RunHitCountBreakPointBenchmark(BenchmarkSession& session, size_t target, const Options& options);
+	JSON RunDisplacedSteppingBenchmark(BenchmarkSession& session, size_t target, const Options& options);
+	JSON RunBatchInstallBenchmark(ProcessDebugger& debugger, size_t codeAddress);
+	JSON RunBreakPointIndexBenchmark();
+	JSON RunMultiThreadBenchmark(const Options& options, bool stopping);
+
+	// DebuggerBenchmarkStepping.cpp
+	JSON RunStepInLineBenchmark(BenchmarkSession& session, const Options& options);
+	JSON RunStepOverBenchmark(const Options& options);
+	JSON RunStepInLibraryBenchmark(const Options& options);
+	JSON RunStepOutBenchmark(const Options& options);
+	JSON RunRunToLineBenchmark(const Options& options);
+
+	// DebuggerBenchmarkSymbols.cpp
+	JSON RunFunctionIndexBenchmark(ProcessDebugger& debugger);
+	JSON RunLineLookupBenchmark(const ProcessDebugger& debugger);
+	JSON RunMemoryCacheBenchmark(ProcessDebugger& debugger);
+	JSON RunSessionRestoreBenchmark();
+
+	// DebuggerBenchmarkDecoder.cpp
+	JSON RunInstructionDecoderBenchmark(const ProcessDebugger& debugger);
+
+	// Linux ではでたらめな命令（EVEX・XOP を含む）を objdump と比べる（objdump がなければ比べない）
+	// 長さが食い違った・objdump だけが解釈できた命令があれば passed を false にする
+	JSON RunInstructionDecoderTest(const FilePath& outputPath, bool& passed);
+}
@@ -0,0 +1,359 @@
+﻿#include "DebuggerBenchmarkFixture.hpp"
+
+namespace
+{
+	using DebuggerBenchmark::Clock;
+	using DebuggerBenchmark::ElapsedMicroseconds;
+
+	// 行単位のステップ実行の計測の設定
+	struct LineStepMode
+	{
+		StringView name;
+
+		bool stepInto = false;
+
+		bool rangeStepping = true;
+
+		bool justMyCode = true;
+	};
+
+	// functionName の先頭から、関数を出るまで 1 行ずつステップイン・ステップオーバーする
+	// 止まった行を lines に記録し、設定を変えても同じ行で止まるかを比べられるようにする
+	JSON RunLineStepBenchmark(const DebuggerBenchmark::Options& options, StringView functionName, const LineStepMode& mode, Array<int32>& lines)
+	{
+		JSON json;
+
+		DebuggerBenchmark::BenchmarkSession session;
+		auto& debugger = session.debugger();
+		auto& probe = session.probe();
+		debugger.setRangeSteppingEnabled(mode.rangeStepping);
+		debugger.setJustMyCodeEnabled(mode.justMyCode);
+
+		if (not session.start(options.iterations))
+		{
+			return json;
+		}
+
+		const auto* function = session.runToFunction(functionName);
+		if (not function)
+		{
+			return json;
+		}
+
+		probe.clearSamples();
+		const size_t singleStepsBefore = probe.singleStepCount();
+		const size_t readsBefore = probe.readCount();
+		const uint64 readCallsBefore = debugger.process().memoryCacheStats().reads;
+
+		size_t steps = 0;
+		const auto start = Clock::now();
+
+		// 呼び出し元に戻るまで（念のため回数に上限を付ける）
+		while (session.isStopped() && steps < 100)
+		{
+			if (mode.stepInto)
+			{
+				debugger.stepIn();
+			}
+			else
+			{
+				debugger.stepOver();
+			}
+			debugger.continueDebugSession();
+			++steps;
+
+			if (not session.isStopped())
+			{
+				break;
+			}
+
+			const auto contextOpt = debugger.userThread().getContext();
+			if (not contextOpt || contextOpt->Rip < function->address || function->address + function->size <= contextOpt->Rip)
+			{
+				break;
+			}
+			lines.push_back(debugger.currentLine());
+		}
+
+		const double ms = ElapsedMicroseconds(start) / 1000;
+		const size_t events = probe.roundTrips().size();
+		const size_t singleSteps = probe.singleStepCount() - singleStepsBefore;
+		const size_t reads = probe.readCount() - readsBefore;
+		const uint64 readCalls = debugger.process().memoryCacheStats().reads - readCallsBefore;
+		const size_t decodedFunctions = debugger.functionFlows().decodeCount();
+
+		Console << U"{:<20} loop={} steps={} events={} single_steps={} reads={}/{} decoded_functions={} {:.2f}ms"_fmt(
+			mode.name, options.iterations, steps, events, singleSteps, reads, readCalls, decodedFunctions, ms);
+
+		json[U"loop_iterations"] = static_cast<int64>(options.iterations);
+		json[U"steps"] = static_cast<int64>(steps);
+		json[U"debug_events"] = static_cast<int64>(events);
+		json[U"single_step_events"] = static_cast<int64>(singleSteps);
+		json[U"memory_reads"] = static_cast<int64>(reads);
+		json[U"memory_read_calls"] = static_cast<int64>(readCalls);
+		json[U"decoded_functions"] = static_cast<int64>(decodedFunctions);
+		json[U"ms"] = ms;
+		return json;
+	}
+}
+
+namespace DebuggerBenchmark
+{
+	// 1 行ずつのステップイン（1 行ごとに handleSingleStep を何回も通る）
+	JSON RunStepInLineBenchmark(BenchmarkSession& session, const Options& options)
+	{
+		auto& debugger = session.debugger();
+
+		Array<double> samples;
+		const size_t singleStepsBefore = session.probe().singleStepCount();
+		const auto stepStart = Clock::now();
+
+		for (size_t i = 0; i < options.iterations && session.isStopped(); ++i)
+		{
+			const auto start = Clock::now();
+			debugger.stepIn();
+			debugger.continueDebugSession();
+			samples.push_back(ElapsedMicroseconds(start));
+		}
+
+		const double stepSeconds = ElapsedMicroseconds(stepStart) / 1'000'000.0;
+		const size_t singleSteps = session.probe().singleStepCount() - singleStepsBefore;
+		const double singleStepsPerSecond = (0.0 < stepSeconds) ? (singleSteps / stepSeconds) : 0.0;
+
+		const auto summary = Summarize(samples);
+		PrintSummary(U"step_in_line", summary);
+		Console << U"single_step_events   {} ({:.1f}/s)"_fmt(singleSteps, singleStepsPerSecond);
+
+		JSON json;
+		json[U"operation"] = ToJSON(summary);
+		json[U"single_step_events"] = static_cast<int64>(singleSteps);
+		json[U"single_step_events_per_second"] = singleStepsPerSecond;
+		return json;
+	}
+
+	// ループを 1 行に書いた行を、行の範囲から出るところに張る一時ブレークポイントで越えるか、
+	// 1 命令ずつシングルステップで越えるかを比べる
+	JSON RunStepOverBenchmark(const Options& options)
+	{
+		JSON json;
+		Array<int32> rangeLines, singleLines;
+		json[U"range"] = RunLineStepBenchmark(options, U"BenchmarkHeavyLine", { .name = U"step_over_range" }, rangeLines);
+		json[U"single_step"] = RunLineStepBenchmark(options, U"BenchmarkHeavyLine", { .name = U"step_over_single", .rangeStepping = false }, singleLines);
+		json[U"same_lines"] = (rangeLines == singleLines);
+		Console << U"step_over            lines={} same_lines={}"_fmt(rangeLines.size(), (rangeLines == singleLines));
+		return json;
+	}
+
+	// ライブラリの関数を呼ぶ行にステップインしたとき、ユーザーのコードに戻るまでをブレークポイントで実行させるか、
+	// シングルステップで進めるかを比べる
+	JSON RunStepInLibraryBenchmark(const Options& options)
+	{
+		JSON json;
+		Array<int32> justMyCodeLines, singleLines;
+		json[U"just_my_code"] = RunLineStepBenchmark(options, U"BenchmarkLibraryCall", { .name = U"step_in_just_my_code", .stepInto = true }, justMyCodeLines);
+		json[U"single_step"] = RunLineStepBenchmark(options, U"BenchmarkLibraryCall", { .name = U"step_in_single", .stepInto = true, .justMyCode = false }, singleLines);
+		json[U"same_lines"] = (justMyCodeLines == singleLines);
+		Console << U"step_in_library      lines={} same_lines={}"_fmt(justMyCodeLines.size(), (justMyCodeLines == singleLines));
+		return json;
+	}
+
+	// 再帰呼び出しの途中の深さで止まり、元の呼び出し元に戻るまでステップアウトを繰り返す
+	// 1 回のステップアウトで止まるのは 1 回だけで、戻った先が求めておいた戻り先・RSP と一致するかを見る
+	// （より深いフレームが同じ戻り先に戻ってくるたびに、止まらずに通り抜けるイベントが増える）
+	JSON RunStepOutBenchmark(const Options& options)
+	{
+		constexpr size_t StepOutDepth = 4;
+
+		JSON json;
+
+		BenchmarkSession session;
+		if (not session.start(options.iterations))
+		{
+			return json;
+		}
+
+		auto& debugger = session.debugger();
+		auto& probe = session.probe();
+
+		const auto entryOpt = debugger.process().findAddress(U"BenchmarkRecursive");
+		if (not entryOpt)
+		{
+			return json;
+		}
+
+		// 再帰呼び出しの StepOutDepth 段目の先頭で止まる
+		debugger.setBreakPoint(*entryOpt);
+		for (size_t i = 0; i < StepOutDepth && session.isStopped(); ++i)
+		{
+			debugger.continueDebugSession();
+		}
+		debugger.cancelBreakPoint(*entryOpt);
+
+		probe.clearSamples();
+
+		size_t stepOuts = 0;
+		size_t matched = 0;
+		const auto start = Clock::now();
+
+		while (session.isStopped() && stepOuts < StepOutDepth)
+		{
+			const auto expected = debugger.process().getReturnFrame(debugger.userThread());
+			if (not expected)
+			{
+				break;
+			}
+
+			debugger.stepOut();
+			debugger.continueDebugSession();
+			++stepOuts;
+
+			if (not session.isStopped())
+			{
+				break;
+			}
+
+			const auto contextOpt = debugger.userThread().getContext();
+			if (contextOpt && contextOpt->Rip == expected->returnAddress && contextOpt->Rsp == expected->stackPointer)
+			{
+				++matched;
+			}
+		}
+
+		const double ms = ElapsedMicroseconds(start) / 1000;
+		const size_t events = probe.roundTrips().size();
+
+		Console << U"step_out             step_outs={} matched={} events={} {:.2f}ms"_fmt(stepOuts, matched, events, ms);
+
+		json[U"step_outs"] = static_cast<int64>(stepOuts);
+		json[U"matched"] = static_cast<int64>(matched);
+		json[U"debug_events"] = static_cast<int64>(events);
+		json[U"ms"] = ms;
+		return json;
+	}
+
+	// BenchmarkTarget の先頭から、その中でコードがいちばん多い行まで続けて行まで実行する
+	// 止まったのがその行の範囲の先頭か、止まったあとに行のどのアドレスにも int3 が残っていないかを見る
+	// 2 回目からは今いる行への実行なので、すぐに当たらずに次の呼び出しで止まる（1 回につき元の命令のシングルステップと int3 の 2 イベント）
+	JSON RunRunToLineBenchmark(const Options& options)
+	{
+		constexpr size_t RunCount = 4;
+
+		JSON json;
+
+		BenchmarkSession session;
+		if (not session.start(options.iterations))
+		{
+			return json;
+		}
+
+		auto& debugger = session.debugger();
+		auto& probe = session.probe();
+
+		const auto& process = debugger.process();
+		const auto entryOpt = process.findAddress(U"BenchmarkTarget");
+		const auto* function = entryOpt ? process.functionIndex().findContaining(*entryOpt) : nullptr;
+		if (not function)
+		{
+			return json;
+		}
+
+		const auto& lineTable = process.lineTable();
+		const size_t functionEnd = function->address + function->size;
+
+		const SourceLine* target = nullptr;
+		size_t targetBytes = 0;
+		for (const auto& line : lineTable.lines())
+		{
+			if (line.address < function->address || functionEnd <= line.address || line.lineNumber == 0 || not lineTable.files().isUserFile(line.fileID))
+			{
+				continue;
+			}
+
+			size_t bytes = 0;
+			for (const auto& range : lineTable.findLineRanges(line.address, function->address, functionEnd))
+			{
+				bytes += (range.end - range.begin);
+			}
+
+			if (targetBytes < bytes)
+			{
+				target = &line;
+				targetBytes = bytes;
+			}
+		}
+
+		if (not target)
+		{
+			return json;
+		}
+
+		const String fileName = FileSystem::FileName(process.sourceFilePath(target->fileID));
+		const uint32 lineNumber = target->lineNumber;
+		const auto addresses = lineTable.findLineAddresses(target->fileID, lineNumber);
+
+		Array<uint8> originalBytes(addresses.size());
+		for (size_t i = 0; i < addresses.size(); ++i)
+		{
+			process.readMemory(addresses[i], originalBytes[i]);
+		}
+
+		debugger.setBreakPoint(function->address);
+		debugger.continueDebugSession();
+		debugger.cancelBreakPoint(function->address);
+
+		probe.clearSamples();
+
+		size_t runs = 0;
+		size_t matched = 0;
+		size_t restored = 0;
+		size_t breakPoints = 0;
+		const auto start = Clock::now();
+
+		while (session.isStopped() && runs < RunCount)
+		{
+			breakPoints = debugger.runToLine(fileName, lineNumber);
+			if (breakPoints == 0)
+			{
+				break;
+			}
+
+			debugger.continueDebugSession();
+			++runs;
+
+			if (not session.isStopped())
+			{
+				break;
+			}
+
+			const auto contextOpt = debugger.userThread().getContext();
+			const auto lineOpt = process.getCurrentLineInfo(debugger.userThread());
+			if (contextOpt && addresses.contains(contextOpt->Rip) && lineOpt && lineOpt->lineNumber == lineNumber)
+			{
+				++matched;
+			}
+
+			bool isRestored = true;
+			for (size_t i = 0; i < addresses.size(); ++i)
+			{
+				uint8 byte = 0;
+				isRestored &= (process.readMemory(addresses[i], byte) && byte == originalBytes[i]);
+			}
+			restored += isRestored;
+		}
+
+		const double ms = ElapsedMicroseconds(start) / 1000;
+		const size_t events = probe.roundTrips().size();
+
+		Console << U"run_to_line          line={} breakpoints={} runs={} matched={} restored={} events={} {:.2f}ms"_fmt(
+			lineNumber, breakPoints, runs, matched, restored, events, ms);
+
+		json[U"line"] = static_cast<int64>(lineNumber);
+		json[U"breakpoints"] = static_cast<int64>(breakPoints);
+		json[U"runs"] = static_cast<int64>(runs);
+		json[U"matched"] = static_cast<int64>(matched);
+		json[U"restored"] = static_cast<int64>(restored);
+		json[U"debug_events"] = static_cast<int64>(events);
+		json[U"ms"] = ms;
+		return json;
+	}
+}
@@ -0,0 +1,249 @@
+﻿#include "DebuggerBenchmarkFixture.hpp"
+#include <random>
+
+namespace DebuggerBenchmark
+{
+	// 関数の索引を引く時間と、パターンに一致する全関数の先頭にまとめて張る時間を計る
+	// 張ったものは再開する前にすべて外す
+	JSON RunFunctionIndexBenchmark(ProcessDebugger& debugger)
+	{
+		const auto& index = debugger.process().functionIndex();
+
+		const double buildMs = std::chrono::duration<double, std::milli>(debugger.process().functionIndexBuildTime()).count();
+
+		JSON json;
+		json[U"functions"] = static_cast<int64>(index.size());
+		json[U"build_ms"] = buildMs;
+
+		if (index.size() == 0)
+		{
+			return json;
+		}
+
+		std::mt19937_64 rng{ 12345 };
+		Array<String> names;
+		for (size_t i = 0; i < 1000; ++i)
+		{
+			names.push_back(index.entries()[rng() % index.size()].name);
+		}
+
+		// 1 回あたりのマイクロ秒
+		const auto measure = [&](size_t repeat, auto f)
+		{
+			size_t found = 0;
+			const auto start = Clock::now();
+			for (size_t i = 0; i < repeat; ++i)
+			{
+				found += f(i);
+			}
+			const double us = ElapsedMicroseconds(start) / repeat;
+			return std::pair{ us, found / repeat };
+		};
+
+		const auto [exactUs, exactFound] = measure(names.size(), [&](size_t i) { return index.findExact(names[i]).size(); });
+		const auto [prefixUs, prefixFound] = measure(100, [&](size_t) { return index.findByPrefix(U"std::").size(); });
+		const auto [patternUs, patternFound] = measure(100, [&](size_t) { return index.findByPattern(U"*Benchmark*").size(); });
+		const auto [fileUs, fileFound] = measure(100, [&](size_t) { return index.findInFile(U"BenchmarkDebuggee.cpp").size(); });
+
+		// 全関数の先頭に張る（すでに張ってあるものは触らない）
+		Array<size_t> addresses = index.findByPattern(U"*");
+		addresses.remove_if([&](size_t address) { return debugger.userBreakPoints().contains(address); });
+
+		Array<uint8> before(addresses.size()), after(addresses.size());
+		for (size_t i = 0; i < addresses.size(); ++i)
+		{
+			debugger.process().readMemory(addresses[i], before[i]);
+		}
+
+		auto start = Clock::now();
+		const size_t installed = debugger.setBreakPoints(addresses);
+		const double setUs = ElapsedMicroseconds(start);
+
+		start = Clock::now();
+		debugger.cancelBreakPoints(addresses);
+		const double cancelUs = ElapsedMicroseconds(start);
+
+		for (size_t i = 0; i < addresses.size(); ++i)
+		{
+			debugger.process().readMemory(addresses[i], after[i]);
+		}
+		const bool restored = (before == after);
+
+		Console << U"function_index       n={} build={:.2f}ms exact={:.3f}us prefix={:.1f}us({}) pattern={:.1f}us({}) file={:.1f}us({})"_fmt(
+			index.size(), buildMs, exactUs, prefixUs, prefixFound, patternUs, patternFound, fileUs, fileFound);
+		Console << U"function_breakpoints n={} set={:.2f}ms cancel={:.2f}ms restored={}"_fmt(
+			installed, setUs / 1000, cancelUs / 1000, restored);
+
+		json[U"exact_lookup_us"] = exactUs;
+		json[U"exact_found"] = static_cast<int64>(exactFound);
+		json[U"prefix_lookup_us"] = prefixUs;
+		json[U"prefix_matches"] = static_cast<int64>(prefixFound);
+		json[U"pattern_lookup_us"] = patternUs;
+		json[U"pattern_matches"] = static_cast<int64>(patternFound);
+		json[U"file_lookup_us"] = fileUs;
+		json[U"file_matches"] = static_cast<int64>(fileFound);
+		json[U"install"][U"breakpoints"] = static_cast<int64>(installed);
+		json[U"install"][U"set_ms"] = setUs / 1000;
+		json[U"install"][U"cancel_ms"] = cancelUs / 1000;
+		json[U"install"][U"memory_restored"] = restored;
+		return json;
+	}
+
+	// アドレスから行を引く 1 回あたりの時間を、行番号テーブルとシンボル（DbgHelp・ElfModule）で比べる
+	// ステップ実行では 1 回止まるたびに行が変わったかを見るので、この差がそのまま 1 ステップの重さになる
+	JSON RunLineLookupBenchmark(const ProcessDebugger& debugger)
+	{
+		constexpr size_t LookupCount = 1'000'000;
+
+		const auto& process = debugger.process();
+		const auto& lines = process.lineTable().lines();
+
+		JSON json;
+		if (lines.isEmpty())
+		{
+			return json;
+		}
+
+		// 行の先頭から少しずらしたアドレス（命令の途中や、行情報のない隙間も混ざる）
+		std::mt19937_64 rng{ 12345 };
+		Array<size_t> addresses(4096);
+		for (auto& address : addresses)
+		{
+			address = lines[rng() % lines.size()].address + (rng() % 16);
+		}
+
+		size_t mismatches = 0;
+		for (const auto address : addresses)
+		{
+			const auto fromTable = process.findLineInfo(address);
+			const auto fromSymbols = process.findSymbolLineInfo(address);
+			if (fromTable.has_value() != fromSymbols.has_value()
+				|| (fromTable && (fromTable->fileID != fromSymbols->fileID || fromTable->lineNumber != fromSymbols->lineNumber)))
+			{
+				++mismatches;
+			}
+		}
+
+		// 1 回あたりのナノ秒
+		const auto measure = [&](auto f)
+		{
+			size_t found = 0;
+			const auto start = Clock::now();
+			for (size_t i = 0; i < LookupCount; ++i)
+			{
+				found += f(addresses[i % addresses.size()]);
+			}
+			return std::pair{ ElapsedMicroseconds(start) * 1000 / LookupCount, found };
+		};
+
+		const auto [tableNs, tableFound] = measure([&](size_t address) { return (process.lineTable().findLine(address) != nullptr) ? 1 : 0; });
+		const auto [lineInfoNs, lineInfoFound] = measure([&](size_t address) { return process.findLineInfo(address).has_value() ? 1 : 0; });
+		const auto [symbolNs, symbolFound] = measure([&](size_t address) { return process.findSymbolLineInfo(address).has_value() ? 1 : 0; });
+
+		Console << U"line_lookup          n={} table={:.1f}ns line_info={:.1f}ns symbols={:.1f}ns ({:.1f}x) mismatches={} sizeof(LineInfo)={}"_fmt(
+			LookupCount, tableNs, lineInfoNs, symbolNs, (0.0 < lineInfoNs) ? (symbolNs / lineInfoNs) : 0.0, mismatches, sizeof(LineInfo));
+
+		json[U"lookups"] = static_cast<int64>(LookupCount);
+		json[U"table_ns"] = tableNs;
+		json[U"table_found"] = static_cast<int64>(tableFound);
+		json[U"line_info_ns"] = lineInfoNs;
+		json[U"line_info_found"] = static_cast<int64>(lineInfoFound);
+		json[U"symbols_ns"] = symbolNs;
+		json[U"symbols_found"] = static_cast<int64>(symbolFound);
+		json[U"mismatches"] = static_cast<int64>(mismatches);
+		json[U"line_info_bytes"] = static_cast<int64>(sizeof(LineInfo));
+		return json;
+	}
+
+	// 止まっているときに変数と呼び出し履歴を表示する間の、readMemory の呼び出し回数とデバッグ対象を実際に読んだ回数
+	// キャッシュがなければ呼び出し 1 回ごとに 1 往復かかる
+	JSON RunMemoryCacheBenchmark(ProcessDebugger& debugger)
+	{
+		auto& process = debugger.process();
+		const auto before = process.memoryCacheStats();
+
+		const auto start = Clock::now();
+		process.fetchLocalVariables(debugger.userThread());
+		process.fetchGlobalVariables();
+		process.fetchCallstack(debugger.userThread());
+		const double us = ElapsedMicroseconds(start);
+
+		const auto after = process.memoryCacheStats();
+		const uint64 calls = after.reads - before.reads;
+		const uint64 roundTrips = (after.pageFills - before.pageFills) + (after.directReads - before.directReads);
+
+		Console << U"memory_cache         show: read_calls={} round_trips={} hits={} {:.1f}us"_fmt(
+			calls, roundTrips, after.hits - before.hits, us);
+
+		JSON json;
+		json[U"show"][U"read_calls"] = static_cast<int64>(calls);
+		json[U"show"][U"round_trips"] = static_cast<int64>(roundTrips);
+		json[U"show"][U"hits"] = static_cast<int64>(after.hits - before.hits);
+		json[U"show"][U"us"] = us;
+		return json;
+	}
+
+	// 1 回目のセッションで張ったことにした行・関数のブレークポイントを、2 回目のプロセスのエントリポイントで張り直す
+	// Main で止まるまでの時間を、ブレークポイントを持ち越さない場合と比べる
+	JSON RunSessionRestoreBenchmark()
+	{
+		JSON json;
+
+		BreakPointSession session;
+		double baselineMs = 0.0;
+		double lineTableMs = 0.0;
+		size_t lineCount = 0;
+		{
+			BenchmarkSession first;
+			if (not first.start(1))
+			{
+				return json;
+			}
+			baselineMs = first.startupMilliseconds();
+
+			const auto& lineTable = first.debugger().process().lineTable();
+			lineTableMs = std::chrono::duration<double, std::milli>(first.debugger().process().lineTableBuildTime()).count();
+			lineCount = lineTable.size();
+
+			// 計測のファイルとデバッグ対象のコードのある行すべて
+			Array<uint32> fileIDs;
+			for (const auto fileName : { U"DebuggerBenchmark.cpp", U"DebuggerBenchmarkBreakPoints.cpp", U"DebuggerBenchmarkStepping.cpp",
+				U"DebuggerBenchmarkSymbols.cpp", U"DebuggerBenchmarkDecoder.cpp", U"BenchmarkDebuggee.cpp" })
+			{
+				fileIDs.append(lineTable.findFiles(fileName));
+			}
+
+			for (const auto& line : lineTable.lines())
+			{
+				if (line.lineNumber != 0 && fileIDs.contains(line.fileID))
+				{
+					session.add(SessionBreakPoint{ .fileName = FileSystem::FileName(lineTable.files().path(line.fileID)), .lineNumber = line.lineNumber, .pattern = String{} });
+				}
+			}
+			session.add(SessionBreakPoint{ .fileName = String{}, .lineNumber = 0, .pattern = U"*Benchmark*" });
+		}
+
+		BenchmarkSession second;
+		second.debugger().breakPointSession() = session;
+		second.start(1);
+		const double restoredMs = second.startupMilliseconds();
+		const auto& restore = second.debugger().lastSessionRestore();
+		const double restoreMs = std::chrono::duration<double, std::milli>(restore.elapsed).count();
+		const bool stoppedAtMain = second.isStopped() && (second.debugger().userBreakPoints().size() == restore.installed + 1);
+		second.runToEnd();
+
+		Console << U"session_restore      breakpoints={} addresses={} unresolved={} restore={:.2f}ms startup={:.1f}ms (without={:.1f}ms) stopped_at_main={} line_table n={} build={:.2f}ms"_fmt(
+			restore.breakPoints, restore.installed, restore.unresolved, restoreMs, restoredMs, baselineMs, stoppedAtMain, lineCount, lineTableMs);
+
+		json[U"breakpoints"] = static_cast<int64>(restore.breakPoints);
+		json[U"addresses"] = static_cast<int64>(restore.installed);
+		json[U"unresolved"] = static_cast<int64>(restore.unresolved);
+		json[U"restore_ms"] = restoreMs;
+		json[U"startup_ms"] = restoredMs;
+		json[U"startup_without_session_ms"] = baselineMs;
+		json[U"stopped_at_main"] = stoppedAtMain;
+		json[U"line_table"][U"lines"] = static_cast<int64>(lineCount);
+		json[U"line_table"][U"build_ms"] = lineTableMs;
+		return json;
+	}
+}
@@ -0,0 +1,253 @@
+﻿#include "DisplacedStepping.hpp"
+#include "ProcessHandle.hpp"
+#include "ThreadHandle.hpp"
+
+namespace
+{
+	// jmp [rip+0] の後ろに 8 バイトの飛び先を置く
+	constexpr uint8 AbsoluteJump[6] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+
+	// slot に置いた命令から address の近くを RIP 相対（±2GB）で指せるか
+	constexpr bool IsReachable(size_t slot, size_t address)
+	{
+		const uint64 distance = (slot < address) ? (address - slot) : (slot + DisplacedStepping::SlotSize - address);
+		return distance <= static_cast<uint64>(INT32_MAX);
+	}
+}
+
+const DisplacedInstruction& DisplacedStepping::prepare(const ProcessHandle& process, const HashTable<DWORD, ThreadHandle>& threads, size_t address, const uint8* originalBytes, size_t size)
+{
+	if (const auto it = m_instructions.find(address); it != m_instructions.end())
+	{
+		return it->second;
+	}
+
+	DisplacedInstruction instruction;
+	const auto decoded = DecodeInstruction(originalBytes, size);
+
+	if (decoded)
+	{
+		instruction.next = address + decoded->length;
+
+		switch (decoded->flow)
+		{
+		case InstructionFlow::Jump:
+			instruction.kind = DisplacedInstruction::Kind::Jump;
+			instruction.target = instruction.next + decoded->relativeDisplacement(originalBytes);
+			break;
+
+		case InstructionFlow::ConditionalJump:
+			instruction.kind = DisplacedInstruction::Kind::ConditionalJump;
+			instruction.condition = decoded->condition;
+			instruction.target = instruction.next + decoded->relativeDisplacement(originalBytes);
+			break;
+
+		case InstructionFlow::Call:
+			instruction.kind = DisplacedInstruction::Kind::Call;
+			instruction.target = instruction.next + decoded->relativeDisplacement(originalBytes);
+			break;
+
+		// 戻り先がスクラッチ領域になる間接 call と、int3 などの割り込みはコピーすると動きが変わる
+		case InstructionFlow::Loop:
+		case InstructionFlow::IndirectCall:
+		case InstructionFlow::Interrupt:
+			break;
+
+		default:
+			if (const auto slot = allocateSlot(process, threads, address))
+			{
+				uint8 code[SlotSize] = {};
+				std::memcpy(code, originalBytes, decoded->length);
+
+				// [rip + disp32] は同じ場所を指すように付け替える
+				bool relocated = true;
+				if (const auto offset = decoded->ripDisplacementOffset)
+				{
+					int32 displacement = 0;
+					std::memcpy(&displacement, originalBytes + *offset, sizeof(displacement));
+
+					const int64 newDisplacement = static_cast<int64>(instruction.next + displacement) - static_cast<int64>(*slot + decoded->length);
+					relocated = (INT32_MIN <= newDisplacement && newDisplacement <= INT32_MAX);
+
+					displacement = static_cast<int32>(newDisplacement);
+					std::memcpy(code + *offset, &displacement, sizeof(displacement));
+				}
+
+				std::memcpy(code + decoded->length, AbsoluteJump, sizeof(AbsoluteJump));
+				std::memcpy(code + decoded->length + sizeof(AbsoluteJump), &instruction.next, sizeof(uint64));
+
+				if (relocated && process.writeMemory(*slot, SlotSize, code))
+				{
+					instruction.kind = DisplacedInstruction::Kind::Relocated;
+					instruction.scratch = *slot;
+				}
+				else
+				{
+					m_freeSlots.push_back(*slot);
+				}
+			}
+			break;
+		}
+	}
+
+	return m_instructions.emplace(address, instruction).first->second;
+}
+
+const DisplacedInstruction* DisplacedStepping::find(size_t address) const
+{
+	const auto it = m_instructions.find(address);
+	return (it != m_instructions.end()) ? &it->second : nullptr;
+}
+
+void DisplacedStepping::release(size_t address)
+{
+	const auto it = m_instructions.find(address);
+	if (it == m_instructions.end())
+	{
+		return;
+	}
+
+	if (it->second.kind == DisplacedInstruction::Kind::Relocated)
+	{
+		m_freeSlots.push_back(it->second.scratch);
+	}
+
+	m_instructions.erase(it);
+}
+
+void DisplacedStepping::reset()
+{
+	m_instructions.clear();
+	m_freeSlots.clear();
+	m_scratchRegions.clear();
+	m_isScratchUnavailable = false;
+}
+
+bool DisplacedStepping::Apply(const DisplacedInstruction& instruction, const ProcessHandle& process, CONTEXT& context)
+{
+	switch (instruction.kind)
+	{
+	case DisplacedInstruction::Kind::Relocated:
+		context.Rip = instruction.scratch;
+		return true;
+
+	case DisplacedInstruction::Kind::Jump:
+		context.Rip = instruction.target;
+		return true;
+
+	case DisplacedInstruction::Kind::ConditionalJump:
+		context.Rip = IsConditionSatisfied(instruction.condition, context.EFlags) ? instruction.target : instruction.next;
+		return true;
+
+	case DisplacedInstruction::Kind::Call:
+	{
+		const uint64 returnAddress = instruction.next;
+		if (not process.writeMemory(context.Rsp - sizeof(uint64), returnAddress))
+		{
+			return false;
+		}
+		context.Rsp -= sizeof(uint64);
+		context.Rip = instruction.target;
+		return true;
+	}
+
+	case DisplacedInstruction::Kind::Unsupported:
+	default:
+		return false;
+	}
+}
+
+Optional<size_t> DisplacedStepping::allocateSlot(const ProcessHandle& process, const HashTable<DWORD, ThreadHandle>& threads, size_t nearAddress)
+{
+	// 空いた区画のうち一番近いもの
+	// 止まらないヒットの途中（区画の命令か jmp の手前）で止まっているスレッドがあれば、その区画は書き換えない
+	auto nearest = m_freeSlots.end();
+
+	if (not m_freeSlots.isEmpty())
+	{
+		Array<size_t> threadAddresses;
+		threadAddresses.reserve(threads.size());
+		for (const auto& [threadID, thread] : threads)
+		{
+			if (const auto contextOpt = thread.getContext())
+			{
+				threadAddresses.push_back(static_cast<size_t>(contextOpt->Rip));
+			}
+		}
+
+		uint64 nearestDistance = UINT64_MAX;
+
+		for (auto it = m_freeSlots.begin(); it != m_freeSlots.end(); ++it)
+		{
+			const size_t slot = *it;
+
+			const bool isExecuting = std::any_of(threadAddresses.begin(), threadAddresses.end(),
+				[slot](size_t rip) { return (slot <= rip) && (rip < slot + SlotSize); });
+			if (isExecuting)
+			{
+				continue;
+			}
+
+			const uint64 distance = (slot < nearAddress) ? (nearAddress - slot) : (slot - nearAddress);
+			if (distance < nearestDistance)
+			{
+				nearest = it;
+				nearestDistance = distance;
+			}
+		}
+	}
+
+	const auto takeFreeSlot = [&]()
+	{
+		const size_t slot = *nearest;
+		*nearest = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		return slot;
+	};
+
+	if (nearest != m_freeSlots.end() && IsReachable(*nearest, nearAddress))
+	{
+		return takeFreeSlot();
+	}
+
+	// 確保済みの領域で届くもの
+	for (auto& region : m_scratchRegions)
+	{
+		if ((region.nextSlot + SlotSize <= region.end) && IsReachable(region.nextSlot, nearAddress))
+		{
+			const size_t slot = region.nextSlot;
+			region.nextSlot += SlotSize;
+			return slot;
+		}
+	}
+
+	// 届く区画がなければ nearAddress の近くに領域を確保する
+	if (not m_isScratchUnavailable)
+	{
+		if (const auto buffer = process.allocateMemory(nearAddress, ScratchSize))
+		{
+			m_scratchRegions.push_back(ScratchRegion{ .nextSlot = *buffer + SlotSize, .end = *buffer + ScratchSize });
+			return *buffer;
+		}
+
+		m_isScratchUnavailable = true;
+	}
+
+	// 確保できなければ遠い区画を使う（RIP 相対でない命令ならどこでも実行できる）
+	if (nearest != m_freeSlots.end())
+	{
+		return takeFreeSlot();
+	}
+
+	for (auto& region : m_scratchRegions)
+	{
+		if (region.nextSlot + SlotSize <= region.end)
+		{
+			const size_t slot = region.nextSlot;
+			region.nextSlot += SlotSize;
+			return slot;
+		}
+	}
+
+	return none;
+}
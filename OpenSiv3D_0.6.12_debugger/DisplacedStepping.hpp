@@ -0,0 +1,86 @@
+﻿#pragma once
+#include "DebugTypes.hpp"
+#include "InstructionDecoder.hpp"
+
+class ProcessHandle;
+class ThreadHandle;
+
+// ブレークポイントの int3 で上書きした命令を、元の場所の外で実行する方法
+struct DisplacedInstruction
+{
+	enum class Kind : uint8
+	{
+		Unsupported,     // 元の方法（元に戻す → シングルステップ → 張り直す）で実行する
+		Relocated,       // スクラッチ領域にコピーした命令と元の場所への jmp を実行する
+		Jump,            // 相対 jmp: RIP を target にするだけ
+		ConditionalJump, // 相対 Jcc: EFLAGS を見て target か next へ
+		Call,            // 相対 call: 戻り先を積んで target へ
+	};
+
+	Kind kind = Kind::Unsupported;
+
+	uint8 condition = 0;
+
+	// Relocated ならスクラッチ領域のアドレス
+	size_t scratch = 0;
+
+	size_t target = 0;
+
+	// 元の命令の次の命令
+	size_t next = 0;
+};
+
+// ブレークポイントを張ったままで、止まらないヒット（条件が偽・トレースポイントなど）を 1 回のイベントで済ませる
+//
+// 命令を元に戻して 1 命令だけ実行し、シングルステップで int3 を書き直す方法はヒットごとに
+// イベント 2 回とメモリの書き込み 2 回がかかり、その間に他のスレッドが素通りしてしまう
+// 代わりに命令をデバッグ対象の中のスクラッチ領域にコピーしておき（RIP 相対のオフセットは付け替える）、
+// RIP をそこに移して実行させる。相対分岐はデバッガ側で分岐先を計算して RIP を書き換える
+class DisplacedStepping
+{
+public:
+
+	// originalBytes は address からの元の命令列（int3 で上書きする前のもの）
+	// 初めてのときはスクラッチ領域を確保する
+	// threads は使い終わった区画を使い回すときに、まだ中を実行しているスレッドがないかを見るのに使う
+	const DisplacedInstruction& prepare(const ProcessHandle& process, const HashTable<DWORD, ThreadHandle>& threads, size_t address, const uint8* originalBytes, size_t size);
+
+	const DisplacedInstruction* find(size_t address) const;
+
+	// スクラッチ領域の区画は使い回す（中を実行しているスレッドがいなくなってから）
+	void release(size_t address);
+
+	// プロセスが変わったとき（スクラッチ領域はプロセスと一緒に消える）
+	void reset();
+
+	// context（RIP はブレークポイントのアドレス）を、命令を実行した後・または実行する場所に進める
+	// Call は戻り先を書き込むので process も使う
+	static bool Apply(const DisplacedInstruction& instruction, const ProcessHandle& process, CONTEXT& context);
+
+	// 命令 + 絶対アドレスへの jmp（FF 25 00000000 + 8 バイト）が入る大きさ
+	static constexpr size_t SlotSize = 32;
+
+	static constexpr size_t ScratchSize = 64 * 1024;
+
+private:
+
+	// 確保したスクラッチ領域の、次に切り出す位置と終わり
+	struct ScratchRegion
+	{
+		size_t nextSlot = 0;
+
+		size_t end = 0;
+	};
+
+	// RIP 相対のオフセット（±2GB）で nearAddress から届く区画を選ぶ
+	Optional<size_t> allocateSlot(const ProcessHandle& process, const HashTable<DWORD, ThreadHandle>& threads, size_t nearAddress);
+
+	HashTable<size_t, DisplacedInstruction> m_instructions;
+
+	Array<size_t> m_freeSlots;
+
+	Array<ScratchRegion> m_scratchRegions;
+
+	// 一度確保に失敗したらこのプロセスでは新しく確保しない
+	bool m_isScratchUnavailable = false;
+};
@@ -0,0 +1,977 @@
+﻿#include "ElfModule.hpp"
+
+#if SIV3D_PLATFORM(LINUX)
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <fstream>
+
+namespace
+{
+	// DWARF のバイト列を先頭から読む
+	class DwarfReader
+	{
+	public:
+
+		DwarfReader(const uint8* begin, const uint8* end)
+			: m_pos(begin)
+			, m_end(end) {}
+
+		bool empty() const { return m_end <= m_pos; }
+
+		const uint8* pos() const { return m_pos; }
+
+		void seek(const uint8* pos) { m_pos = pos; }
+
+		void skip(size_t size) { m_pos += size; }
+
+		template <class Type>
+		Type read()
+		{
+			Type value = {};
+			if (m_pos + sizeof(Type) <= m_end)
+			{
+				std::memcpy(&value, m_pos, sizeof(Type));
+			}
+			m_pos += sizeof(Type);
+			return value;
+		}
+
+		uint64 readOffset(bool is64) { return is64 ? read<uint64>() : read<uint32>(); }
+
+		uint64 readUleb()
+		{
+			uint64 value = 0;
+			for (uint32 shift = 0; m_pos < m_end; shift += 7)
+			{
+				const uint8 byte = *m_pos++;
+				value |= static_cast<uint64>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+				{
+					break;
+				}
+			}
+			return value;
+		}
+
+		int64 readSleb()
+		{
+			int64 value = 0;
+			uint32 shift = 0;
+			uint8 byte = 0;
+			do
+			{
+				byte = (m_pos < m_end) ? *m_pos++ : 0;
+				value |= static_cast<int64>(byte & 0x7F) << shift;
+				shift += 7;
+			} while ((byte & 0x80) && m_pos < m_end);
+
+			if (shift < 64 && (byte & 0x40))
+			{
+				value |= -(static_cast<int64>(1) << shift);
+			}
+			return value;
+		}
+
+		std::string readString()
+		{
+			const auto begin = m_pos;
+			while (m_pos < m_end && *m_pos)
+			{
+				++m_pos;
+			}
+			std::string str(reinterpret_cast<const char*>(begin), m_pos - begin);
+			++m_pos;
+			return str;
+		}
+
+	private:
+
+		const uint8* m_pos;
+		const uint8* m_end;
+	};
+
+	struct Section
+	{
+		const uint8* begin = nullptr;
+		const uint8* end = nullptr;
+		uint64 address = 0; // 読み込まれる仮想アドレス（ロードバイアスを足す前）
+	};
+
+	Section FindSection(const Array<uint8>& image, const char* name)
+	{
+		const auto header = reinterpret_cast<const Elf64_Ehdr*>(image.data());
+		const auto sections = reinterpret_cast<const Elf64_Shdr*>(image.data() + header->e_shoff);
+		const auto& names = sections[header->e_shstrndx];
+
+		for (size_t i = 0; i < header->e_shnum; ++i)
+		{
+			const char* sectionName = reinterpret_cast<const char*>(image.data() + names.sh_offset + sections[i].sh_name);
+			if (std::strcmp(sectionName, name) == 0 && sections[i].sh_type != SHT_NOBITS)
+			{
+				const auto begin = image.data() + sections[i].sh_offset;
+				return{ begin, begin + sections[i].sh_size, sections[i].sh_addr };
+			}
+		}
+
+		return{};
+	}
+
+	// 関数名からパラメータリストを除いたもの（"Game::update(double) const" → "Game::update"）
+	String DemangleFunctionName(const char* mangled)
+	{
+		int status = 0;
+		char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+		std::string name = (status == 0 && demangled) ? demangled : mangled;
+		std::free(demangled);
+
+		// ラムダやテンプレート引数の中の括弧を除いた、最後のパラメータリストで切る
+		size_t depth = 0;
+		size_t parameterPos = std::string::npos;
+		for (size_t i = 0; i < name.size(); ++i)
+		{
+			switch (name[i])
+			{
+			case '(':
+				if (depth == 0)
+				{
+					parameterPos = i;
+				}
+				++depth;
+				break;
+			case '<':
+			case '{':
+				++depth;
+				break;
+			case ')':
+			case '>':
+			case '}':
+				depth = (depth == 0) ? 0 : depth - 1;
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (parameterPos != std::string::npos && parameterPos != 0)
+		{
+			name.resize(parameterPos);
+		}
+
+		return Unicode::FromUTF8(name);
+	}
+
+	std::string ReadFormString(DwarfReader& reader, uint64 form, bool is64, Section debugStr, Section debugLineStr)
+	{
+		switch (form)
+		{
+		case 0x08: // DW_FORM_string
+			return reader.readString();
+		case 0x0e: // DW_FORM_strp
+		case 0x1f: // DW_FORM_line_strp
+		{
+			const auto offset = reader.readOffset(is64);
+			const auto section = (form == 0x0e) ? debugStr : debugLineStr;
+			if (section.begin && section.begin + offset < section.end)
+			{
+				return reinterpret_cast<const char*>(section.begin + offset);
+			}
+			return {};
+		}
+		default:
+			return {};
+		}
+	}
+
+	uint64 ReadFormValue(DwarfReader& reader, uint64 form, bool is64)
+	{
+		switch (form)
+		{
+		case 0x0b: return reader.read<uint8>();  // DW_FORM_data1
+		case 0x05: return reader.read<uint16>(); // DW_FORM_data2
+		case 0x06: return reader.read<uint32>(); // DW_FORM_data4
+		case 0x07: return reader.read<uint64>(); // DW_FORM_data8
+		case 0x0f: return reader.readUleb();     // DW_FORM_udata
+		case 0x0d: return static_cast<uint64>(reader.readSleb()); // DW_FORM_sdata
+		case 0x1e: reader.skip(16); return 0;    // DW_FORM_data16
+		case 0x09: reader.skip(reader.readUleb()); return 0; // DW_FORM_block
+		case 0x08: reader.readString(); return 0;
+		case 0x0e:
+		case 0x1f: reader.readOffset(is64); return 0;
+		default: return 0;
+		}
+	}
+
+	// DW_EH_PE_* で符号化されたポインタ（fieldAddress は読む位置の実行時のアドレス、pcrel 用）
+	uint64 ReadEncodedPointer(DwarfReader& reader, uint8 encoding, uint64 fieldAddress, size_t loadBias)
+	{
+		if (encoding == 0xFF) // DW_EH_PE_omit
+		{
+			return 0;
+		}
+
+		uint64 value = 0;
+		switch (encoding & 0x0F)
+		{
+		case 0x00: value = reader.read<uint64>(); break; // absptr
+		case 0x01: value = reader.readUleb(); break;
+		case 0x02: value = reader.read<uint16>(); break;
+		case 0x03: value = reader.read<uint32>(); break;
+		case 0x04: value = reader.read<uint64>(); break;
+		case 0x09: value = static_cast<uint64>(reader.readSleb()); break;
+		case 0x0A: value = static_cast<uint64>(static_cast<int64>(reader.read<int16>())); break;
+		case 0x0B: value = static_cast<uint64>(static_cast<int64>(reader.read<int32>())); break;
+		case 0x0C: value = reader.read<uint64>(); break;
+		default: break;
+		}
+
+		switch (encoding & 0x70)
+		{
+		case 0x00: return value + loadBias; // 絶対アドレス
+		case 0x10: return value + fieldAddress; // DW_EH_PE_pcrel
+		default: return value;
+		}
+	}
+
+	// CFA 命令を実行した結果（1 行分）
+	struct FrameState
+	{
+		uint32 cfaRegister = 7;
+		int64 cfaOffset = 8;
+		Optional<int64> returnAddressOffset;
+		bool isSupported = true; // DW_CFA_def_cfa_expression などは扱わない
+	};
+
+	// location から始まる命令列を、target を越える行まで実行する
+	void ExecuteFrameInstructions(DwarfReader reader, uint64 codeAlignment, int64 dataAlignment, uint64 returnAddressRegister,
+		const FrameState& initial, size_t location, size_t target, FrameState& state)
+	{
+		Array<FrameState> stack;
+
+		const auto setOffset = [&](uint64 reg, int64 offset)
+		{
+			if (reg == returnAddressRegister)
+			{
+				state.returnAddressOffset = offset;
+			}
+		};
+
+		const auto restore = [&](uint64 reg)
+		{
+			if (reg == returnAddressRegister)
+			{
+				state.returnAddressOffset = initial.returnAddressOffset;
+			}
+		};
+
+		while (not reader.empty())
+		{
+			const uint8 op = reader.read<uint8>();
+			const uint8 operand = (op & 0x3F);
+
+			size_t advance = 0;
+			switch (op & 0xC0)
+			{
+			case 0x40: // DW_CFA_advance_loc
+				advance = operand * codeAlignment;
+				break;
+			case 0x80: // DW_CFA_offset
+				setOffset(operand, static_cast<int64>(reader.readUleb()) * dataAlignment);
+				continue;
+			case 0xC0: // DW_CFA_restore
+				restore(operand);
+				continue;
+			default:
+				break;
+			}
+
+			switch ((op & 0xC0) ? 0xFF : op)
+			{
+			case 0xFF:
+				break;
+			case 0x00: // DW_CFA_nop
+				break;
+			case 0x02: advance = reader.read<uint8>() * codeAlignment; break;  // DW_CFA_advance_loc1
+			case 0x03: advance = reader.read<uint16>() * codeAlignment; break; // DW_CFA_advance_loc2
+			case 0x04: advance = reader.read<uint32>() * codeAlignment; break; // DW_CFA_advance_loc4
+			case 0x05: // DW_CFA_offset_extended
+			{
+				const auto reg = reader.readUleb();
+				setOffset(reg, static_cast<int64>(reader.readUleb()) * dataAlignment);
+				break;
+			}
+			case 0x06: restore(reader.readUleb()); break; // DW_CFA_restore_extended
+			case 0x07: // DW_CFA_undefined
+			case 0x08: // DW_CFA_same_value
+				if (reader.readUleb() == returnAddressRegister)
+				{
+					state.returnAddressOffset = none;
+				}
+				break;
+			case 0x09: // DW_CFA_register
+				if (reader.readUleb() == returnAddressRegister)
+				{
+					state.isSupported = false;
+				}
+				reader.readUleb();
+				break;
+			case 0x0A: // DW_CFA_remember_state
+				stack.push_back(state);
+				break;
+			case 0x0B: // DW_CFA_restore_state
+				if (not stack.isEmpty())
+				{
+					state = stack.back();
+					stack.pop_back();
+				}
+				break;
+			case 0x0C: // DW_CFA_def_cfa
+				state.cfaRegister = static_cast<uint32>(reader.readUleb());
+				state.cfaOffset = static_cast<int64>(reader.readUleb());
+				break;
+			case 0x0D: // DW_CFA_def_cfa_register
+				state.cfaRegister = static_cast<uint32>(reader.readUleb());
+				break;
+			case 0x0E: // DW_CFA_def_cfa_offset
+				state.cfaOffset = static_cast<int64>(reader.readUleb());
+				break;
+			case 0x0F: // DW_CFA_def_cfa_expression
+				state.isSupported = false;
+				reader.skip(reader.readUleb());
+				break;
+			case 0x10: // DW_CFA_expression
+			case 0x16: // DW_CFA_val_expression
+				if (reader.readUleb() == returnAddressRegister)
+				{
+					state.isSupported = false;
+				}
+				reader.skip(reader.readUleb());
+				break;
+			case 0x11: // DW_CFA_offset_extended_sf
+			{
+				const auto reg = reader.readUleb();
+				setOffset(reg, reader.readSleb() * dataAlignment);
+				break;
+			}
+			case 0x12: // DW_CFA_def_cfa_sf
+				state.cfaRegister = static_cast<uint32>(reader.readUleb());
+				state.cfaOffset = reader.readSleb() * dataAlignment;
+				break;
+			case 0x13: // DW_CFA_def_cfa_offset_sf
+				state.cfaOffset = reader.readSleb() * dataAlignment;
+				break;
+			case 0x14: // DW_CFA_val_offset
+				reader.readUleb();
+				reader.readUleb();
+				break;
+			case 0x15: // DW_CFA_val_offset_sf
+				reader.readUleb();
+				reader.readSleb();
+				break;
+			case 0x2E: // DW_CFA_GNU_args_size
+				reader.readUleb();
+				break;
+			case 0x2F: // DW_CFA_GNU_negative_offset_extended
+			{
+				const auto reg = reader.readUleb();
+				setOffset(reg, -static_cast<int64>(reader.readUleb()) * dataAlignment);
+				break;
+			}
+			default: // DW_CFA_set_loc など、.eh_frame では使われないもの
+				state.isSupported = false;
+				return;
+			}
+
+			if (advance != 0)
+			{
+				location += advance;
+				if (target < location)
+				{
+					return;
+				}
+			}
+		}
+	}
+
+	String JoinPath(const std::string& directory, const std::string& name)
+	{
+		if (name.starts_with('/') || directory.empty())
+		{
+			return Unicode::FromUTF8(name);
+		}
+
+		return Unicode::FromUTF8(directory + '/' + name);
+	}
+}
+
+bool ElfModule::load(const FilePathView path, size_t imageBase)
+{
+	clear();
+
+	std::ifstream file(Unicode::ToUTF8(path), std::ios::binary);
+	if (not file)
+	{
+		return false;
+	}
+
+	Array<uint8> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (image.size() < sizeof(Elf64_Ehdr) || std::memcmp(image.data(), ELFMAG, SELFMAG) != 0)
+	{
+		return false;
+	}
+
+	const auto header = reinterpret_cast<const Elf64_Ehdr*>(image.data());
+	if (header->e_ident[EI_CLASS] != ELFCLASS64)
+	{
+		return false;
+	}
+
+	// PIE は先頭の PT_LOAD からのずれをロードバイアスとする
+	size_t loadBias = 0;
+	if (header->e_type == ET_DYN)
+	{
+		const auto programs = reinterpret_cast<const Elf64_Phdr*>(image.data() + header->e_phoff);
+		for (size_t i = 0; i < header->e_phnum; ++i)
+		{
+			if (programs[i].p_type == PT_LOAD)
+			{
+				loadBias = imageBase - (programs[i].p_vaddr & ~(programs[i].p_align - 1));
+				break;
+			}
+		}
+	}
+
+	loadFunctions(image, loadBias);
+	loadLines(image, loadBias);
+	loadFrames(image, loadBias);
+	return true;
+}
+
+void ElfModule::clear()
+{
+	m_functions.clear();
+	m_variables.clear();
+	m_lines.clear();
+	m_files.clear();
+	m_fileIndices.clear();
+	m_ehFrame.clear();
+	m_ehFrameAddress = 0;
+	m_frameCies.clear();
+	m_frameEntries.clear();
+	m_pltRanges.clear();
+}
+
+Optional<size_t> ElfModule::findAddress(StringView name) const
+{
+	for (const auto& function : m_functions)
+	{
+		if (function.name == name)
+		{
+			return function.address;
+		}
+	}
+	return none;
+}
+
+const ElfFunction* ElfModule::findFunction(size_t address) const
+{
+	auto it = std::upper_bound(m_functions.begin(), m_functions.end(), address,
+		[](size_t value, const ElfFunction& function) { return value < function.address; });
+
+	if (it == m_functions.begin())
+	{
+		return nullptr;
+	}
+
+	--it;
+	if (address < it->address + it->size)
+	{
+		return &*it;
+	}
+	return nullptr;
+}
+
+const ElfVariable* ElfModule::findVariable(StringView name) const
+{
+	for (const auto& variable : m_variables)
+	{
+		if (variable.name == name)
+		{
+			return &variable;
+		}
+	}
+	return nullptr;
+}
+
+const ElfLine* ElfModule::findLine(size_t address) const
+{
+	auto it = std::upper_bound(m_lines.begin(), m_lines.end(), address,
+		[](size_t value, const ElfLine& line) { return value < line.address; });
+
+	if (it == m_lines.begin())
+	{
+		return nullptr;
+	}
+
+	--it;
+	if (it->lineNumber == 0)
+	{
+		return nullptr;
+	}
+	return &*it;
+}
+
+Optional<ElfFrameRule> ElfModule::findFrameRule(size_t address) const
+{
+	// PLT の FDE は DW_CFA_def_cfa_expression で書かれているが、
+	// 遅延バインディングの push を通る前なら RSP は呼ばれたときのまま
+	for (const auto& [begin, end] : m_pltRanges)
+	{
+		if (begin <= address && address < end)
+		{
+			return ElfFrameRule{ 7, 8, -8 };
+		}
+	}
+
+	auto it = std::upper_bound(m_frameEntries.begin(), m_frameEntries.end(), address,
+		[](size_t value, const FrameEntry& entry) { return value < entry.begin; });
+
+	if (it == m_frameEntries.begin() || (--it)->end <= address)
+	{
+		return none;
+	}
+
+	const auto& cie = m_frameCies[it->cieIndex];
+	const auto instructions = [&](uint32 begin, uint32 end) { return DwarfReader(m_ehFrame.data() + begin, m_ehFrame.data() + end); };
+
+	// CIE の命令列が関数の先頭の状態を作り、FDE の命令列がそこから address までの変化を表す
+	FrameState initial;
+	ExecuteFrameInstructions(instructions(cie.instructionsBegin, cie.instructionsEnd), cie.codeAlignment, cie.dataAlignment, cie.returnAddressRegister,
+		initial, it->begin, SIZE_MAX, initial);
+
+	FrameState state = initial;
+	ExecuteFrameInstructions(instructions(it->instructionsBegin, it->instructionsEnd), cie.codeAlignment, cie.dataAlignment, cie.returnAddressRegister,
+		initial, it->begin, address, state);
+
+	if (not state.isSupported || not state.returnAddressOffset)
+	{
+		return none;
+	}
+
+	return ElfFrameRule{ state.cfaRegister, state.cfaOffset, *state.returnAddressOffset };
+}
+
+void ElfModule::loadFrames(const Array<uint8>& image, size_t loadBias)
+{
+	for (const char* name : { ".plt", ".plt.sec", ".plt.got" })
+	{
+		if (const auto plt = FindSection(image, name); plt.begin)
+		{
+			const size_t begin = static_cast<size_t>(plt.address) + loadBias;
+			m_pltRanges.emplace_back(begin, begin + (plt.end - plt.begin));
+		}
+	}
+
+	const auto ehFrame = FindSection(image, ".eh_frame");
+	if (not ehFrame.begin)
+	{
+		return;
+	}
+
+	m_ehFrame.assign(ehFrame.begin, ehFrame.end);
+	m_ehFrameAddress = static_cast<size_t>(ehFrame.address) + loadBias;
+
+	const uint8* data = m_ehFrame.data();
+	const uint8* dataEnd = data + m_ehFrame.size();
+	const auto offsetOf = [&](const uint8* pos) { return static_cast<uint32>(pos - data); };
+
+	HashTable<uint32, uint32> cieIndices; // .eh_frame の中のオフセット → m_frameCies の添字
+
+	DwarfReader reader(data, dataEnd);
+	while (not reader.empty())
+	{
+		const uint8* entryBegin = reader.pos();
+
+		uint64 length = reader.read<uint32>();
+		if (length == 0) // 終端
+		{
+			break;
+		}
+		if (length == 0xFFFF'FFFF)
+		{
+			length = reader.read<uint64>();
+		}
+
+		const uint8* idPos = reader.pos();
+		const uint8* entryEnd = idPos + length;
+		if (dataEnd < entryEnd)
+		{
+			break;
+		}
+
+		const uint32 id = reader.read<uint32>();
+
+		if (id == 0) // CIE
+		{
+			FrameCie cie;
+			const uint8 version = reader.read<uint8>();
+			const std::string augmentation = reader.readString();
+			if (augmentation.find("eh") != std::string::npos)
+			{
+				reader.read<uint64>();
+			}
+
+			cie.codeAlignment = reader.readUleb();
+			cie.dataAlignment = reader.readSleb();
+			cie.returnAddressRegister = (version == 1) ? reader.read<uint8>() : reader.readUleb();
+
+			if (augmentation.starts_with('z'))
+			{
+				cie.hasAugmentationData = true;
+				const uint64 augmentationLength = reader.readUleb();
+				const uint8* augmentationEnd = reader.pos() + augmentationLength;
+
+				for (size_t i = 1; i < augmentation.size(); ++i)
+				{
+					switch (augmentation[i])
+					{
+					case 'R':
+						cie.pointerEncoding = reader.read<uint8>();
+						break;
+					case 'P':
+					{
+						const uint8 encoding = reader.read<uint8>();
+						ReadEncodedPointer(reader, encoding, 0, 0);
+						break;
+					}
+					case 'L':
+						reader.read<uint8>();
+						break;
+					default:
+						break;
+					}
+				}
+
+				reader.seek(augmentationEnd);
+			}
+
+			cie.instructionsBegin = offsetOf(reader.pos());
+			cie.instructionsEnd = offsetOf(entryEnd);
+
+			cieIndices.emplace(offsetOf(entryBegin), static_cast<uint32>(m_frameCies.size()));
+			m_frameCies.push_back(cie);
+		}
+		else // FDE（id は自分の位置から CIE までの距離）
+		{
+			const auto it = cieIndices.find(offsetOf(idPos) - id);
+			if (it != cieIndices.end())
+			{
+				const auto& cie = m_frameCies[it->second];
+
+				const size_t begin = ReadEncodedPointer(reader, cie.pointerEncoding, m_ehFrameAddress + offsetOf(reader.pos()), loadBias);
+				const size_t range = ReadEncodedPointer(reader, (cie.pointerEncoding & 0x0F), 0, 0);
+
+				if (cie.hasAugmentationData)
+				{
+					reader.skip(reader.readUleb());
+				}
+
+				if (range != 0)
+				{
+					m_frameEntries.push_back(FrameEntry{ begin, begin + range, it->second, offsetOf(reader.pos()), offsetOf(entryEnd) });
+				}
+			}
+		}
+
+		reader.seek(entryEnd);
+	}
+
+	std::sort(m_frameEntries.begin(), m_frameEntries.end(), [](const FrameEntry& a, const FrameEntry& b) { return a.begin < b.begin; });
+}
+
+void ElfModule::loadFunctions(const Array<uint8>& image, size_t loadBias)
+{
+	const auto header = reinterpret_cast<const Elf64_Ehdr*>(image.data());
+	const auto sections = reinterpret_cast<const Elf64_Shdr*>(image.data() + header->e_shoff);
+
+	// strip されていなければ .symtab、されていれば .dynsym を使う
+	const Elf64_Shdr* symbolTable = nullptr;
+	for (size_t i = 0; i < header->e_shnum; ++i)
+	{
+		if (sections[i].sh_type == SHT_SYMTAB)
+		{
+			symbolTable = &sections[i];
+			break;
+		}
+		if (sections[i].sh_type == SHT_DYNSYM)
+		{
+			symbolTable = &sections[i];
+		}
+	}
+
+	if (not symbolTable)
+	{
+		return;
+	}
+
+	const auto& stringTable = sections[symbolTable->sh_link];
+	const auto symbols = reinterpret_cast<const Elf64_Sym*>(image.data() + symbolTable->sh_offset);
+	const size_t count = symbolTable->sh_size / sizeof(Elf64_Sym);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& symbol = symbols[i];
+		if (symbol.st_shndx == SHN_UNDEF || symbol.st_value == 0)
+		{
+			continue;
+		}
+
+		const char* name = reinterpret_cast<const char*>(image.data() + stringTable.sh_offset + symbol.st_name);
+
+		if (ELF64_ST_TYPE(symbol.st_info) == STT_FUNC)
+		{
+			m_functions.push_back(ElfFunction{ loadBias + symbol.st_value, symbol.st_size, DemangleFunctionName(name) });
+		}
+		// グローバル変数も同じシンボルテーブルにある（条件付きブレークポイント用）
+		else if (ELF64_ST_TYPE(symbol.st_info) == STT_OBJECT && symbol.st_shndx != SHN_COMMON)
+		{
+			m_variables.push_back(ElfVariable{ loadBias + symbol.st_value, symbol.st_size, DemangleFunctionName(name) });
+		}
+	}
+
+	std::sort(m_functions.begin(), m_functions.end(),
+		[](const ElfFunction& a, const ElfFunction& b) { return a.address < b.address; });
+}
+
+void ElfModule::loadLines(const Array<uint8>& image, size_t loadBias)
+{
+	const auto debugLine = FindSection(image, ".debug_line");
+	const auto debugStr = FindSection(image, ".debug_str");
+	const auto debugLineStr = FindSection(image, ".debug_line_str");
+
+	if (not debugLine.begin)
+	{
+		return;
+	}
+
+	DwarfReader reader(debugLine.begin, debugLine.end);
+
+	while (not reader.empty())
+	{
+		// ---- ヘッダ ----
+		uint64 unitLength = reader.read<uint32>();
+		const bool is64 = (unitLength == 0xFFFFFFFF);
+		if (is64)
+		{
+			unitLength = reader.read<uint64>();
+		}
+
+		const uint8* unitEnd = reader.pos() + unitLength;
+		const uint16 version = reader.read<uint16>();
+
+		if (version < 2 || 5 < version)
+		{
+			reader.seek(unitEnd);
+			continue;
+		}
+
+		if (5 <= version)
+		{
+			reader.read<uint8>(); // address_size
+			reader.read<uint8>(); // segment_selector_size
+		}
+
+		const uint64 headerLength = reader.readOffset(is64);
+		const uint8* programBegin = reader.pos() + headerLength;
+
+		const uint8 minInstructionLength = reader.read<uint8>();
+		if (4 <= version)
+		{
+			reader.read<uint8>(); // maximum_operations_per_instruction
+		}
+		reader.read<uint8>(); // default_is_stmt
+		const int8 lineBase = reader.read<int8>();
+		const uint8 lineRange = reader.read<uint8>();
+		const uint8 opcodeBase = reader.read<uint8>();
+
+		Array<uint8> standardOpcodeLengths(opcodeBase);
+		for (uint8 i = 1; i < opcodeBase; ++i)
+		{
+			standardOpcodeLengths[i] = reader.read<uint8>();
+		}
+
+		// ---- ディレクトリ・ファイル ----
+		Array<std::string> directories;
+		Array<uint32> fileIndices; // ユニット内のファイル番号 → m_files のインデックス
+
+		if (version < 5)
+		{
+			directories.push_back({});
+			while (true)
+			{
+				auto directory = reader.readString();
+				if (directory.empty())
+				{
+					break;
+				}
+				directories.push_back(std::move(directory));
+			}
+
+			// v4 以前のファイル番号は1から始まる
+			fileIndices.push_back(0);
+			while (true)
+			{
+				auto name = reader.readString();
+				if (name.empty())
+				{
+					break;
+				}
+				const auto directoryIndex = reader.readUleb();
+				reader.readUleb(); // mtime
+				reader.readUleb(); // length
+				const auto& directory = (directoryIndex < directories.size()) ? directories[directoryIndex] : directories[0];
+				fileIndices.push_back(addFile(JoinPath(directory, name)));
+			}
+		}
+		else
+		{
+			const auto readEntries = [&](auto&& onEntry)
+			{
+				Array<std::pair<uint64, uint64>> formats(reader.read<uint8>());
+				for (auto& format : formats)
+				{
+					format.first = reader.readUleb();
+					format.second = reader.readUleb();
+				}
+
+				const uint64 count = reader.readUleb();
+				for (uint64 i = 0; i < count; ++i)
+				{
+					std::string path;
+					uint64 directoryIndex = 0;
+					for (const auto& [contentType, form] : formats)
+					{
+						if (contentType == 1) // DW_LNCT_path
+						{
+							path = ReadFormString(reader, form, is64, debugStr, debugLineStr);
+						}
+						else if (contentType == 2) // DW_LNCT_directory_index
+						{
+							directoryIndex = ReadFormValue(reader, form, is64);
+						}
+						else
+						{
+							ReadFormValue(reader, form, is64);
+						}
+					}
+					onEntry(path, directoryIndex);
+				}
+			};
+
+			readEntries([&](const std::string& path, uint64) { directories.push_back(path); });
+			readEntries([&](const std::string& path, uint64 directoryIndex)
+			{
+				const std::string directory = (directoryIndex < directories.size()) ? directories[directoryIndex] : std::string{};
+				fileIndices.push_back(addFile(JoinPath(directory, path)));
+			});
+		}
+
+		// ---- 行番号プログラム ----
+		reader.seek(programBegin);
+
+		size_t address = 0;
+		uint64 file = 1;
+		int64 line = 1;
+
+		const auto emitRow = [&](bool endSequence)
+		{
+			const uint32 fileIndex = (file < fileIndices.size()) ? fileIndices[file] : 0;
+			m_lines.push_back(ElfLine{ loadBias + address, fileIndex, endSequence ? 0u : static_cast<uint32>(line) });
+		};
+
+		while (reader.pos() < unitEnd)
+		{
+			const uint8 opcode = reader.read<uint8>();
+
+			if (opcodeBase <= opcode)
+			{
+				const uint8 adjusted = opcode - opcodeBase;
+				address += (adjusted / lineRange) * minInstructionLength;
+				line += lineBase + (adjusted % lineRange);
+				emitRow(false);
+				continue;
+			}
+
+			switch (opcode)
+			{
+			case 0: // 拡張オペコード
+			{
+				const uint64 length = reader.readUleb();
+				const uint8* next = reader.pos() + length;
+				const uint8 extended = reader.read<uint8>();
+
+				if (extended == 1) // DW_LNE_end_sequence
+				{
+					emitRow(true);
+					address = 0;
+					file = 1;
+					line = 1;
+				}
+				else if (extended == 2) // DW_LNE_set_address
+				{
+					address = reader.read<uint64>();
+				}
+
+				reader.seek(next);
+				break;
+			}
+			case 1: // DW_LNS_copy
+				emitRow(false);
+				break;
+			case 2: // DW_LNS_advance_pc
+				address += reader.readUleb() * minInstructionLength;
+				break;
+			case 3: // DW_LNS_advance_line
+				line += reader.readSleb();
+				break;
+			case 4: // DW_LNS_set_file
+				file = reader.readUleb();
+				break;
+			case 8: // DW_LNS_const_add_pc
+				address += ((255 - opcodeBase) / lineRange) * minInstructionLength;
+				break;
+			case 9: // DW_LNS_fixed_advance_pc
+				address += reader.read<uint16>();
+				break;
+			default:
+				for (uint8 i = 0; i < standardOpcodeLengths[opcode]; ++i)
+				{
+					reader.readUleb();
+				}
+				break;
+			}
+		}
+
+		reader.seek(unitEnd);
+	}
+
+	// シーケンスの終端は同じアドレスから始まる行より前に置く
+	// それ以外は同じアドレスでも出てきた順のまま（長さ 0 の行の後の行が、そのアドレスの行になる）
+	std::stable_sort(m_lines.begin(), m_lines.end(),
+		[](const ElfLine& a, const ElfLine& b) { return (a.address != b.address) ? (a.address < b.address) : (a.lineNumber == 0 && b.lineNumber != 0); });
+}
+
+uint32 ElfModule::addFile(const String& path)
+{
+	if (auto it = m_fileIndices.find(path); it != m_fileIndices.end())
+	{
+		return it->second;
+	}
+
+	const auto index = static_cast<uint32>(m_files.size());
+	m_files.push_back(path);
+	m_fileIndices.emplace(path, index);
+	return index;
+}
+
+#endif
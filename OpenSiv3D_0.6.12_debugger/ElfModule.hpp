@@ -0,0 +1,125 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+#if SIV3D_PLATFORM(LINUX)
+
+// ELF の関数シンボル
+struct ElfFunction
+{
+	size_t address;
+	size_t size;
+	String name;
+};
+
+// ELF のデータシンボル（グローバル変数。型の情報はない）
+struct ElfVariable
+{
+	size_t address;
+	size_t size;
+	String name;
+};
+
+// .debug_line の1行分（lineNumber == 0 はシーケンスの終端）
+struct ElfLine
+{
+	size_t address;
+	uint32 fileIndex;
+	uint32 lineNumber;
+};
+
+// .eh_frame から求めた、ある命令で止まっているときの呼び出し元のフレームの求め方
+// CFA = （cfaRegister の値）+ cfaOffset で、戻りアドレスは [CFA + returnAddressOffset] にある
+// CFA は呼び出し元に戻ったときの RSP
+struct ElfFrameRule
+{
+	uint32 cfaRegister; // DWARF のレジスタ番号（6: rbp, 7: rsp）
+
+	int64 cfaOffset;
+
+	int64 returnAddressOffset;
+};
+
+// Linux で DbgHelp の代わりに使う、実行ファイルのシンボル・行番号テーブル
+class ElfModule
+{
+public:
+
+	bool load(const FilePathView path, size_t imageBase);
+
+	void clear();
+
+	Optional<size_t> findAddress(StringView name) const;
+
+	// address を含む関数
+	const ElfFunction* findFunction(size_t address) const;
+
+	const ElfVariable* findVariable(StringView name) const;
+
+	// address を含む行
+	const ElfLine* findLine(size_t address) const;
+
+	// address で止まっているときの CFA と戻りアドレスの位置（.eh_frame になければ none）
+	Optional<ElfFrameRule> findFrameRule(size_t address) const;
+
+	const Array<ElfFunction>& functions() const { return m_functions; }
+
+	const Array<ElfLine>& lines() const { return m_lines; }
+
+	const Array<String>& files() const { return m_files; }
+
+private:
+
+	void loadFunctions(const Array<uint8>& image, size_t loadBias);
+
+	void loadLines(const Array<uint8>& image, size_t loadBias);
+
+	void loadFrames(const Array<uint8>& image, size_t loadBias);
+
+	uint32 addFile(const String& path);
+
+	// .eh_frame の CIE（同じ関数群に共通の設定と、最初に実行する命令列）
+	struct FrameCie
+	{
+		uint64 codeAlignment = 1;
+		int64 dataAlignment = 1;
+		uint64 returnAddressRegister = 16;
+		uint8 pointerEncoding = 0;
+		bool hasAugmentationData = false;
+		uint32 instructionsBegin = 0; // m_ehFrame の中の範囲
+		uint32 instructionsEnd = 0;
+	};
+
+	// .eh_frame の FDE（関数 1 つ分の命令列）
+	struct FrameEntry
+	{
+		size_t begin;
+		size_t end;
+		uint32 cieIndex;
+		uint32 instructionsBegin;
+		uint32 instructionsEnd;
+	};
+
+	Array<ElfFunction> m_functions; // アドレス順
+
+	Array<ElfVariable> m_variables;
+
+	Array<ElfLine> m_lines; // アドレス順
+
+	Array<String> m_files;
+
+	HashTable<String, uint32> m_fileIndices;
+
+	// 命令列は止まるたびに解釈するので、.eh_frame をそのまま持っておく
+	Array<uint8> m_ehFrame;
+
+	size_t m_ehFrameAddress = 0;
+
+	Array<FrameCie> m_frameCies;
+
+	Array<FrameEntry> m_frameEntries; // アドレス順
+
+	// .plt / .plt.sec / .plt.got の範囲 [begin, end)
+	Array<std::pair<size_t, size_t>> m_pltRanges;
+};
+
+#endif
@@ -0,0 +1,110 @@
+﻿#include "FunctionFlowCache.hpp"
+#include "ProcessHandle.hpp"
+
+namespace
+{
+	FunctionFlow Decode(size_t begin, const Array<uint8>& bytes)
+	{
+		FunctionFlow function;
+		function.begin = begin;
+		function.end = begin + bytes.size();
+		function.blockBoundaries.push_back(begin);
+
+		const auto isInside = [&](size_t address) { return function.begin <= address && address < function.end; };
+
+		for (size_t offset = 0; offset < bytes.size();)
+		{
+			const auto decoded = DecodeInstruction(bytes.data() + offset, bytes.size() - offset);
+
+			// 関数の間の埋め草やコードの中のデータは 1 バイトずつ飛ばす
+			if (not decoded)
+			{
+				++function.undecodableBytes;
+				++offset;
+				continue;
+			}
+
+			FlowInstruction instruction{ begin + offset, decoded->length, decoded->flow };
+
+			if (decoded->relativeSize != 0)
+			{
+				instruction.target = instruction.next() + decoded->relativeDisplacement(bytes.data() + offset);
+			}
+
+			switch (instruction.flow)
+			{
+			case InstructionFlow::Call:
+			case InstructionFlow::IndirectCall:
+				function.callSites.push_back(instruction.address);
+				break;
+
+			case InstructionFlow::Return:
+				function.returnSites.push_back(instruction.address);
+				function.blockBoundaries.push_back(instruction.next());
+				break;
+
+			case InstructionFlow::Jump:
+			case InstructionFlow::ConditionalJump:
+			case InstructionFlow::Loop:
+			case InstructionFlow::IndirectJump:
+				function.jumpSites.push_back(instruction.address);
+				function.blockBoundaries.push_back(instruction.next());
+
+				if (instruction.target != 0 && isInside(instruction.target))
+				{
+					function.blockBoundaries.push_back(instruction.target);
+				}
+				break;
+
+			default:
+				break;
+			}
+
+			function.instructions.push_back(instruction);
+			offset += decoded->length;
+		}
+
+		// 最後の命令の次（関数の終わり）は関数の外
+		function.blockBoundaries.remove_if([&](size_t address) { return not isInside(address); });
+		std::sort(function.blockBoundaries.begin(), function.blockBoundaries.end());
+		function.blockBoundaries.erase(std::unique(function.blockBoundaries.begin(), function.blockBoundaries.end()), function.blockBoundaries.end());
+
+		return function;
+	}
+}
+
+const FlowInstruction* FunctionFlow::findInstruction(size_t address) const
+{
+	const auto it = std::lower_bound(instructions.begin(), instructions.end(), address,
+		[](const FlowInstruction& instruction, size_t value) { return instruction.address < value; });
+
+	return (it != instructions.end() && it->address == address) ? &*it : nullptr;
+}
+
+const FunctionFlow* FunctionFlowCache::find(const ProcessHandle& process, size_t address)
+{
+	const auto* entry = process.functionIndex().findContaining(address);
+	if (not entry || entry->size == 0)
+	{
+		return nullptr;
+	}
+
+	if (const auto it = m_functions.find(entry->address); it != m_functions.end())
+	{
+		return &it->second;
+	}
+
+	Array<uint8> bytes(entry->size);
+	if (not process.readOriginalMemory(entry->address, bytes.size(), bytes.data()))
+	{
+		return nullptr;
+	}
+
+	++m_decodeCount;
+	return &m_functions.emplace(entry->address, Decode(entry->address, bytes)).first->second;
+}
+
+void FunctionFlowCache::clear()
+{
+	m_functions.clear();
+}
@@ -0,0 +1,76 @@
+﻿#pragma once
+#include "DebugTypes.hpp"
+#include "InstructionDecoder.hpp"
+
+class ProcessHandle;
+
+// 関数の中の命令 1 つ
+struct FlowInstruction
+{
+	size_t address = 0;
+
+	uint8 length = 0;
+
+	InstructionFlow flow = InstructionFlow::Sequential;
+
+	// 相対分岐・相対 call の飛び先（それ以外は 0）
+	size_t target = 0;
+
+	size_t next() const { return address + length; }
+};
+
+// 関数 1 つ分の命令の並びと、制御が移る場所
+struct FunctionFlow
+{
+	size_t begin = 0;
+
+	size_t end = 0;
+
+	// アドレス順。解析できなかったバイトは飛ばしてあるので、隣り合う命令の間に隙間があることがある
+	Array<FlowInstruction> instructions;
+
+	// call（直接・間接）の位置
+	Array<size_t> callSites;
+
+	// ret の位置
+	Array<size_t> returnSites;
+
+	// jmp・Jcc・LOOP・間接 jmp の位置
+	Array<size_t> jumpSites;
+
+	// 基本ブロックの先頭（関数の先頭、関数の中への分岐先、分岐・ret の次の命令）。昇順
+	Array<size_t> blockBoundaries;
+
+	size_t undecodableBytes = 0;
+
+	// address から始まる命令（命令の境目でなければ nullptr）
+	const FlowInstruction* findInstruction(size_t address) const;
+};
+
+// 関数ごとに命令を一度だけ解析して覚えておく
+//
+// ステップオーバー・ステップインは止まるたびに「今の命令は call か」「この行から出ていく場所はどこか」を調べる
+// 毎回デバッグ対象のメモリを読んで解析し直す代わりに、関数に初めて入ったときに関数全体
+// （FunctionIndex の先頭と大きさ）を 1 回で読み、張ってある int3 を元のバイトに戻してから解析しておく
+// 覚えているのは元の命令なので、ブレークポイントを張ったり外したりしても解析し直す必要はない
+class FunctionFlowCache
+{
+public:
+
+	// address を含む関数（関数がわからない・読めなければ nullptr）
+	const FunctionFlow* find(const ProcessHandle& process, size_t address);
+
+	// モジュールが外れたとき・プロセスが変わったとき
+	void clear();
+
+	size_t size() const { return m_functions.size(); }
+
+	// 関数を読んで解析した回数
+	size_t decodeCount() const { return m_decodeCount; }
+
+private:
+
+	HashTable<size_t, FunctionFlow> m_functions;
+
+	size_t m_decodeCount = 0;
+};
@@ -0,0 +1,225 @@
+﻿#include "FunctionIndex.hpp"
+
+namespace
+{
+	Array<size_t> SortedAddresses(Array<size_t> addresses)
+	{
+		std::sort(addresses.begin(), addresses.end());
+		addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+		return addresses;
+	}
+
+	// 名前だけで比べる（同じ名前の範囲を探す用）
+	struct NameLess
+	{
+		bool operator()(const FunctionEntry& entry, StringView name) const { return StringView(entry.name) < name; }
+
+		bool operator()(StringView name, const FunctionEntry& entry) const { return name < StringView(entry.name); }
+	};
+
+	StringView LongestLiteral(StringView pattern)
+	{
+		StringView longest;
+		size_t begin = 0;
+		for (size_t i = 0; i <= pattern.size(); ++i)
+		{
+			if (i == pattern.size() || pattern[i] == U'*' || pattern[i] == U'?')
+			{
+				if (longest.size() < i - begin)
+				{
+					longest = pattern.substr(begin, i - begin);
+				}
+				begin = i + 1;
+			}
+		}
+		return longest;
+	}
+
+	// パスの区切りで終わっているか（Game.cpp が MyGame.cpp に一致しないように）
+	bool EndsWithPath(StringView path, StringView fileName)
+	{
+		if (not path.ends_with(fileName))
+		{
+			return false;
+		}
+
+		if (path.size() == fileName.size())
+		{
+			return true;
+		}
+
+		const char32 separator = path[path.size() - fileName.size() - 1];
+		return (separator == U'/') || (separator == U'\\');
+	}
+}
+
+void FunctionIndex::add(size_t address, size_t size, String name, String fileName)
+{
+	m_entries.push_back(FunctionEntry{ address, size, std::move(name), std::move(fileName) });
+}
+
+void FunctionIndex::build()
+{
+	std::sort(m_entries.begin(), m_entries.end(), [](const FunctionEntry& a, const FunctionEntry& b)
+	{
+		return (a.name != b.name) ? (a.name < b.name) : (a.address < b.address);
+	});
+
+	m_addressOrder.resize(m_entries.size());
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		m_addressOrder[i] = static_cast<uint32>(i);
+	}
+	std::sort(m_addressOrder.begin(), m_addressOrder.end(), [&](uint32 a, uint32 b)
+	{
+		return m_entries[a].address < m_entries[b].address;
+	});
+
+	m_files.clear();
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		if (not m_entries[i].fileName.isEmpty())
+		{
+			m_files[m_entries[i].fileName].push_back(static_cast<uint32>(i));
+		}
+	}
+}
+
+void FunctionIndex::clear()
+{
+	m_entries.clear();
+	m_addressOrder.clear();
+	m_files.clear();
+}
+
+Array<size_t> FunctionIndex::findExact(StringView name) const
+{
+	const auto [first, last] = std::equal_range(m_entries.begin(), m_entries.end(), name, NameLess{});
+
+	Array<size_t> addresses;
+	addresses.reserve(last - first);
+	for (auto it = first; it != last; ++it)
+	{
+		addresses.push_back(it->address);
+	}
+	return SortedAddresses(std::move(addresses));
+}
+
+Array<size_t> FunctionIndex::findByPrefix(StringView prefix) const
+{
+	const auto [first, last] = prefixRange(prefix);
+
+	Array<size_t> addresses;
+	addresses.reserve(last - first);
+	for (size_t i = first; i < last; ++i)
+	{
+		addresses.push_back(m_entries[i].address);
+	}
+	return SortedAddresses(std::move(addresses));
+}
+
+Array<size_t> FunctionIndex::findByPattern(StringView pattern) const
+{
+	const size_t wildcard = pattern.find_first_of(U"*?");
+	if (wildcard == StringView::npos)
+	{
+		return findExact(pattern);
+	}
+
+	const auto [first, last] = prefixRange(pattern.substr(0, wildcard));
+
+	// *Update* のように先頭がワイルドカードのときは全体を見ることになるので、
+	// 一番長いワイルドカードでない部分を含まない名前は照合する前に除く
+	const StringView literal = LongestLiteral(pattern);
+
+	Array<size_t> addresses;
+	for (size_t i = first; i < last; ++i)
+	{
+		const StringView name = m_entries[i].name;
+		if (name.find(literal) != StringView::npos && MatchPattern(pattern, name))
+		{
+			addresses.push_back(m_entries[i].address);
+		}
+	}
+	return SortedAddresses(std::move(addresses));
+}
+
+Array<size_t> FunctionIndex::findInFile(StringView fileName) const
+{
+	Array<size_t> addresses;
+
+	for (const auto& [path, indices] : m_files)
+	{
+		if (EndsWithPath(path, fileName))
+		{
+			for (const auto index : indices)
+			{
+				addresses.push_back(m_entries[index].address);
+			}
+		}
+	}
+
+	return SortedAddresses(std::move(addresses));
+}
+
+const FunctionEntry* FunctionIndex::findContaining(size_t address) const
+{
+	auto it = std::upper_bound(m_addressOrder.begin(), m_addressOrder.end(), address,
+		[&](size_t value, uint32 index) { return value < m_entries[index].address; });
+
+	if (it == m_addressOrder.begin())
+	{
+		return nullptr;
+	}
+
+	const auto& entry = m_entries[*(--it)];
+	return (address < entry.address + entry.size) ? &entry : nullptr;
+}
+
+bool FunctionIndex::MatchPattern(StringView pattern, StringView name)
+{
+	// * の位置を覚えておき、合わなければ * が 1 文字多く飲み込んだところからやり直す
+	size_t p = 0, n = 0;
+	size_t starPattern = StringView::npos, starName = 0;
+
+	while (n < name.size())
+	{
+		if (p < pattern.size() && (pattern[p] == U'?' || pattern[p] == name[n]))
+		{
+			++p;
+			++n;
+		}
+		else if (p < pattern.size() && pattern[p] == U'*')
+		{
+			starPattern = p++;
+			starName = n;
+		}
+		else if (starPattern != StringView::npos)
+		{
+			p = starPattern + 1;
+			n = ++starName;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (p < pattern.size() && pattern[p] == U'*')
+	{
+		++p;
+	}
+
+	return (p == pattern.size());
+}
+
+std::pair<size_t, size_t> FunctionIndex::prefixRange(StringView prefix) const
+{
+	const auto first = std::lower_bound(m_entries.begin(), m_entries.end(), prefix,
+		[](const FunctionEntry& entry, StringView value) { return StringView(entry.name) < value; });
+
+	const auto last = std::partition_point(first, m_entries.end(),
+		[&](const FunctionEntry& entry) { return StringView(entry.name).starts_with(prefix); });
+
+	return { static_cast<size_t>(first - m_entries.begin()), static_cast<size_t>(last - m_entries.begin()) };
+}
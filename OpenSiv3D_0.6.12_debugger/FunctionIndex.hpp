@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+struct FunctionEntry
+{
+	size_t address = 0;
+
+	size_t size = 0;
+
+	// 引数リストを除いた名前（Game::Player::update など）
+	String name;
+
+	// 先頭の命令がある行のファイル（行情報がなければ空）
+	String fileName;
+};
+
+// デバッグ対象の関数の索引（名前でまとめてブレークポイントを張る用）
+//
+// モジュールを読み込んだときに一度だけ作り、名前順に並べておく
+// 前方一致は二分探索、* と ? のパターンは最初のワイルドカードまでの前方一致で範囲を絞ってから照合する
+class FunctionIndex
+{
+public:
+
+	// 追加し終わったら build を呼ぶ
+	void add(size_t address, size_t size, String name, String fileName);
+
+	void build();
+
+	void clear();
+
+	size_t size() const { return m_entries.size(); }
+
+	const Array<FunctionEntry>& entries() const { return m_entries; }
+
+	// 名前が一致する関数の先頭アドレス（オーバーロードなど同じ名前が複数あれば全部、アドレス順）
+	Array<size_t> findExact(StringView name) const;
+
+	// 名前が prefix で始まる関数の先頭アドレス（アドレス順）
+	Array<size_t> findByPrefix(StringView prefix) const;
+
+	// * は任意の文字列、? は任意の 1 文字（例: Game::*Update*）
+	Array<size_t> findByPattern(StringView pattern) const;
+
+	// ファイル名がパスの末尾と一致するファイルの関数（例: Game.cpp, src/Game.cpp）
+	Array<size_t> findInFile(StringView fileName) const;
+
+	// address を含む関数（なければ nullptr）
+	const FunctionEntry* findContaining(size_t address) const;
+
+	static bool MatchPattern(StringView pattern, StringView name);
+
+private:
+
+	// 名前が prefix で始まる要素の範囲 [first, last)
+	std::pair<size_t, size_t> prefixRange(StringView prefix) const;
+
+	Array<FunctionEntry> m_entries; // 名前順（同じ名前はアドレス順）
+
+	// アドレス順の m_entries の添字
+	Array<uint32> m_addressOrder;
+
+	// ファイル名 → m_entries の添字
+	HashTable<String, Array<uint32>> m_files;
+};
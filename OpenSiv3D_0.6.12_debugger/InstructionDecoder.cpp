@@ -0,0 +1,571 @@
+﻿#include "InstructionDecoder.hpp"
+
+namespace
+{
+	constexpr size_t MaxInstructionLength = 15;
+
+	////////////////////////////////////////////////////////////////
+	//
+	//	プレフィックス
+	//
+
+	enum PrefixFlag : uint8
+	{
+		PrefixLegacy = 1 << 0,
+		PrefixOperandSize = 1 << 1, // 66
+		PrefixAddressSize = 1 << 2, // 67
+		PrefixRex = 1 << 3,         // 40～4F
+		PrefixRepne = 1 << 4,       // F2
+	};
+
+	constexpr std::array<uint8, 256> MakePrefixTable()
+	{
+		std::array<uint8, 256> table{};
+
+		for (const uint8 byte : { 0xF0, 0xF3, 0x2E, 0x36, 0x3E, 0x26, 0x64, 0x65 })
+		{
+			table[byte] = PrefixLegacy;
+		}
+
+		table[0xF2] = (PrefixLegacy | PrefixRepne);
+		table[0x66] = (PrefixLegacy | PrefixOperandSize);
+		table[0x67] = (PrefixLegacy | PrefixAddressSize);
+
+		for (size_t byte = 0x40; byte <= 0x4F; ++byte)
+		{
+			table[byte] = PrefixRex;
+		}
+
+		return table;
+	}
+
+	constexpr std::array<uint8, 256> PrefixTable = MakePrefixTable();
+
+	////////////////////////////////////////////////////////////////
+	//
+	//	オペコード
+	//
+
+	// 即値の種類
+	enum class Immediate : uint8
+	{
+		None,
+		Byte,
+		Word,
+		Dword,  // 66 に関係なく 4（E8, E9, 0F 8x）
+		Z,      // 66 なら 2、それ以外は 4
+		V,      // REX.W なら 8、66 なら 2、それ以外は 4（B8～BF）
+		Enter,  // iw + ib（C8）
+		Moffs,  // 67 なら 4、それ以外は 8（A0～A3）
+		Group3, // F6 / F7 の /0, /1（TEST）だけ即値を持つ
+		Extrq,  // 66 0F 78（EXTRQ）と F2 0F 78（INSERTQ）は ib ib
+	};
+
+	struct OpcodeInfo
+	{
+		bool modRM = false;
+
+		// 64 ビットモードでは使えない
+		bool invalid = false;
+
+		Immediate immediate = Immediate::None;
+
+		InstructionFlow flow = InstructionFlow::Sequential;
+
+		// FF の /2～/5 のように ModRM の reg で行き先が決まる
+		bool flowByReg = false;
+
+		// mod に関係なくレジスタを指す（0F 20～0F 23 の MOV CRn / DRn）
+		bool registerOnly = false;
+	};
+
+	using OpcodeTable = std::array<OpcodeInfo, 256>;
+
+	// 1 バイトオペコード
+	constexpr OpcodeTable MakeOneByteTable()
+	{
+		OpcodeTable table{};
+
+		// 00～3F: ALU 命令（xx0～xx3 は ModRM、xx4 は ib、xx5 は iz）
+		for (size_t op = 0x00; op < 0x40; ++op)
+		{
+			switch (op & 7)
+			{
+			case 0: case 1: case 2: case 3: table[op].modRM = true; break;
+			case 4: table[op].immediate = Immediate::Byte; break;
+			case 5: table[op].immediate = Immediate::Z; break;
+			default: break;
+			}
+		}
+
+		for (const uint8 op : { 0x06, 0x07, 0x0E, 0x16, 0x17, 0x1E, 0x1F, 0x27, 0x2F, 0x37, 0x3F,
+			0x60, 0x61, 0x82, 0x9A, 0xCE, 0xD4, 0xD5, 0xD6, 0xEA })
+		{
+			table[op].invalid = true;
+		}
+
+		// 命令の途中に現れたプレフィックスは解釈できない
+		for (const uint8 op : { 0x26, 0x2E, 0x36, 0x3E, 0x64, 0x65, 0x66, 0x67, 0xF0, 0xF2, 0xF3 })
+		{
+			table[op].invalid = true;
+		}
+
+		for (const uint8 op : { 0x63, 0x69, 0x6B, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B,
+			0x8C, 0x8D, 0x8E, 0x8F, 0xC0, 0xC1, 0xC6, 0xC7, 0xD0, 0xD1, 0xD2, 0xD3,
+			0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF, 0xF6, 0xF7, 0xFE, 0xFF })
+		{
+			table[op].modRM = true;
+		}
+
+		for (size_t op = 0x80; op <= 0x83; ++op)
+		{
+			table[op].modRM = true;
+			table[op].immediate = Immediate::Byte;
+		}
+		table[0x81].immediate = Immediate::Z;
+
+		for (const uint8 op : { 0x6A, 0x6B, 0xA8, 0xC0, 0xC1, 0xC6, 0xCD, 0xE4, 0xE5, 0xE6, 0xE7 })
+		{
+			table[op].immediate = Immediate::Byte;
+		}
+
+		for (const uint8 op : { 0x68, 0x69, 0xA9, 0xC7 })
+		{
+			table[op].immediate = Immediate::Z;
+		}
+
+		for (size_t op = 0xA0; op <= 0xA3; ++op)
+		{
+			table[op].immediate = Immediate::Moffs;
+		}
+
+		for (size_t op = 0xB0; op <= 0xB7; ++op)
+		{
+			table[op].immediate = Immediate::Byte;
+		}
+
+		for (size_t op = 0xB8; op <= 0xBF; ++op)
+		{
+			table[op].immediate = Immediate::V;
+		}
+
+		table[0xC2].immediate = Immediate::Word;
+		table[0xCA].immediate = Immediate::Word;
+		table[0xC8].immediate = Immediate::Enter;
+		table[0xF6].immediate = Immediate::Group3;
+		table[0xF7].immediate = Immediate::Group3;
+
+		// 行き先
+		for (size_t op = 0x70; op <= 0x7F; ++op)
+		{
+			table[op].immediate = Immediate::Byte;
+			table[op].flow = InstructionFlow::ConditionalJump;
+		}
+
+		for (size_t op = 0xE0; op <= 0xE3; ++op)
+		{
+			table[op].immediate = Immediate::Byte;
+			table[op].flow = InstructionFlow::Loop;
+		}
+
+		table[0xE8] = { .immediate = Immediate::Dword, .flow = InstructionFlow::Call };
+		table[0xE9] = { .immediate = Immediate::Dword, .flow = InstructionFlow::Jump };
+		table[0xEB] = { .immediate = Immediate::Byte, .flow = InstructionFlow::Jump };
+
+		for (const uint8 op : { 0xC2, 0xC3, 0xCA, 0xCB, 0xCF })
+		{
+			table[op].flow = InstructionFlow::Return;
+		}
+
+		for (const uint8 op : { 0xCC, 0xCD, 0xF1 })
+		{
+			table[op].flow = InstructionFlow::Interrupt;
+		}
+
+		table[0xFF].flowByReg = true;
+
+		return table;
+	}
+
+	// 0F xx
+	constexpr OpcodeTable MakeTwoByteTable()
+	{
+		OpcodeTable table{};
+
+		for (auto& info : table)
+		{
+			info.modRM = true;
+		}
+
+		for (const uint8 op : { 0x05, 0x06, 0x07, 0x08, 0x09, 0x0B, 0x0E,
+			0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x37, 0x77,
+			0xA0, 0xA1, 0xA2, 0xA8, 0xA9, 0xAA })
+		{
+			table[op].modRM = false;
+		}
+
+		for (size_t op = 0xC8; op <= 0xCF; ++op)
+		{
+			table[op].modRM = false;
+		}
+
+		// 0F 0F は 3DNow!（ModRM の後にオペコードが 1 バイト）
+		for (const uint8 op : { 0x0F, 0x70, 0x71, 0x72, 0x73, 0xA4, 0xAC, 0xBA, 0xC2, 0xC4, 0xC5, 0xC6 })
+		{
+			table[op].immediate = Immediate::Byte;
+		}
+
+		table[0x78].immediate = Immediate::Extrq;
+
+		for (size_t op = 0x20; op <= 0x23; ++op)
+		{
+			table[op].registerOnly = true;
+		}
+
+		for (const uint8 op : { 0x04, 0x0A, 0x0C, 0x24, 0x25, 0x26, 0x27, 0x36, 0x39, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F })
+		{
+			table[op].invalid = true;
+		}
+
+		for (size_t op = 0x80; op <= 0x8F; ++op)
+		{
+			table[op] = { .immediate = Immediate::Dword, .flow = InstructionFlow::ConditionalJump };
+		}
+
+		// UD2（0F 0B）と、ModRM を持つ UD1（0F B9）・UD0（0F FF）
+		for (const uint8 op : { 0x0B, 0xB9, 0xFF })
+		{
+			table[op].flow = InstructionFlow::Interrupt;
+		}
+
+		return table;
+	}
+
+	// 0F 38 xx と 0F 3A xx（すべて ModRM、0F 3A は ib）
+	constexpr OpcodeTable MakeThreeByteTable(const Immediate immediate)
+	{
+		OpcodeTable table{};
+
+		for (auto& info : table)
+		{
+			info.modRM = true;
+			info.immediate = immediate;
+		}
+
+		return table;
+	}
+
+	constexpr std::array<OpcodeTable, 4> OpcodeTables =
+	{
+		MakeOneByteTable(),
+		MakeTwoByteTable(),
+		MakeThreeByteTable(Immediate::None),
+		MakeThreeByteTable(Immediate::Byte),
+	};
+
+	// FF の ModRM.reg ごとの行き先
+	constexpr std::array<InstructionFlow, 8> GroupFiveFlows =
+	{
+		InstructionFlow::Sequential, InstructionFlow::Sequential,
+		InstructionFlow::IndirectCall, InstructionFlow::IndirectCall,
+		InstructionFlow::IndirectJump, InstructionFlow::IndirectJump,
+		InstructionFlow::Sequential, InstructionFlow::Sequential,
+	};
+
+	////////////////////////////////////////////////////////////////
+	//
+	//	ModRM
+	//
+
+	struct ModRMInfo
+	{
+		uint8 displacementSize = 0;
+
+		bool sib = false;
+
+		bool ripRelative = false;
+	};
+
+	constexpr std::array<ModRMInfo, 256> MakeModRMTable()
+	{
+		std::array<ModRMInfo, 256> table{};
+
+		for (size_t modRM = 0; modRM < 256; ++modRM)
+		{
+			const size_t mod = (modRM >> 6);
+			const size_t rm = (modRM & 7);
+
+			if (mod == 3)
+			{
+				continue;
+			}
+
+			table[modRM].displacementSize = static_cast<uint8>((mod == 1) ? 1 : (mod == 2) ? 4 : 0);
+			table[modRM].sib = (rm == 4);
+
+			if (mod == 0 && rm == 5)
+			{
+				table[modRM].displacementSize = 4;
+				table[modRM].ripRelative = true;
+			}
+		}
+
+		return table;
+	}
+
+	constexpr std::array<ModRMInfo, 256> ModRMTable = MakeModRMTable();
+
+	////////////////////////////////////////////////////////////////
+	//
+	//	VEX / EVEX / XOP
+	//
+
+	// C4 / C5 / 62 / 8F で始まる拡張プレフィックスの大きさ（8F は XOP のときだけ）
+	size_t ExtendedPrefixLength(const uint8* bytes, size_t available)
+	{
+		switch (bytes[0])
+		{
+		case 0xC5:
+			return 2;
+		case 0xC4:
+			return 3;
+		case 0x62:
+			return 4;
+		case 0x8F:
+			// 8F /0 (POP) と区別する: XOP ならマップが 8 以上
+			return ((2 <= available) && (8 <= (bytes[1] & 0x1F))) ? 3 : 0;
+		default:
+			return 0;
+		}
+	}
+
+	size_t ImmediateSize(Immediate immediate, uint8 prefixes, bool rexW, uint8 modRM, uint8 opcode)
+	{
+		const bool operandSize16 = (prefixes & PrefixOperandSize) && not rexW;
+
+		switch (immediate)
+		{
+		case Immediate::Byte:
+			return 1;
+		case Immediate::Word:
+			return 2;
+		case Immediate::Dword:
+			return 4;
+		case Immediate::Z:
+			return operandSize16 ? 2 : 4;
+		case Immediate::V:
+			return rexW ? 8 : operandSize16 ? 2 : 4;
+		case Immediate::Enter:
+			return 3;
+		case Immediate::Moffs:
+			return (prefixes & PrefixAddressSize) ? 4 : 8;
+		case Immediate::Group3:
+			return (((modRM >> 3) & 7) <= 1) ? ((opcode == 0xF6) ? 1 : (operandSize16 ? 2 : 4)) : 0;
+		case Immediate::Extrq:
+			return (prefixes & (PrefixOperandSize | PrefixRepne)) ? 2 : 0;
+		default:
+			return 0;
+		}
+	}
+}
+
+int64 DecodedInstruction::relativeDisplacement(const uint8* bytes) const
+{
+	if (relativeSize == 1)
+	{
+		return static_cast<int8>(bytes[relativeOffset]);
+	}
+
+	int32 displacement = 0;
+	std::memcpy(&displacement, bytes + relativeOffset, sizeof(displacement));
+	return displacement;
+}
+
+Optional<DecodedInstruction> DecodeInstruction(const uint8* bytes, size_t size)
+{
+	size = Min(size, MaxInstructionLength);
+
+	DecodedInstruction result;
+	size_t pos = 0;
+
+	// プレフィックス（REX は最後のものだけ有効。後ろにレガシープレフィックスが続けば無視される）
+	uint8 prefixes = 0;
+	bool rexW = false;
+
+	while (pos < size)
+	{
+		const uint8 flags = PrefixTable[bytes[pos]];
+
+		if (flags == 0)
+		{
+			break;
+		}
+
+		prefixes |= (flags & ~PrefixRex);
+		rexW = (flags & PrefixRex) && (bytes[pos] & 0x08);
+		++pos;
+	}
+
+	if (size <= pos)
+	{
+		return none;
+	}
+
+	Immediate immediate = Immediate::None;
+	bool registerOnly = false;
+
+	if (const size_t prefixLength = ExtendedPrefixLength(bytes + pos, size - pos))
+	{
+		// VEX / EVEX / XOP: マップはプレフィックスの中にあり、vzeroupper / vzeroall 以外は ModRM が続く
+		if (size <= pos + prefixLength)
+		{
+			return none;
+		}
+
+		const uint8 first = bytes[pos];
+		const uint8 map = (first == 0xC5) ? 1 : static_cast<uint8>(bytes[pos + 1] & ((first == 0x62) ? 0x07 : 0x1F));
+
+		if (first == 0x8F)
+		{
+			// XOP: 08 は ib、0A は id
+			immediate = (map == 0x08) ? Immediate::Byte : (map == 0x0A) ? Immediate::Dword : Immediate::None;
+		}
+		else if ((map == 0) || (3 < map && first != 0x62))
+		{
+			return none;
+		}
+		else if (map <= 3)
+		{
+			const Immediate tableImmediate = OpcodeTables[map][bytes[pos + prefixLength]].immediate;
+			immediate = (tableImmediate == Immediate::Byte) ? Immediate::Byte : Immediate::None;
+		}
+
+		result.opcodeMap = map;
+		pos += prefixLength;
+		result.opcode = bytes[pos++];
+		result.hasModRM = not (map == 1 && result.opcode == 0x77);
+	}
+	else
+	{
+		// 0F / 0F 38 / 0F 3A のエスケープ
+		if (bytes[pos] == 0x0F)
+		{
+			if (size <= pos + 1)
+			{
+				return none;
+			}
+
+			const uint8 second = bytes[pos + 1];
+			result.opcodeMap = (second == 0x38) ? 2 : (second == 0x3A) ? 3 : 1;
+			pos += (result.opcodeMap == 1) ? 1 : 2;
+
+			if (size <= pos)
+			{
+				return none;
+			}
+		}
+
+		result.opcode = bytes[pos++];
+
+		const OpcodeInfo& info = OpcodeTables[result.opcodeMap][result.opcode];
+
+		if (info.invalid)
+		{
+			return none;
+		}
+
+		result.hasModRM = info.modRM;
+		registerOnly = info.registerOnly;
+		result.flow = info.flow;
+		immediate = info.immediate;
+
+		if (result.flow == InstructionFlow::ConditionalJump)
+		{
+			result.condition = (result.opcode & 0x0F);
+		}
+
+		if (info.flowByReg)
+		{
+			if (size <= pos)
+			{
+				return none;
+			}
+
+			result.flow = GroupFiveFlows[(bytes[pos] >> 3) & 7];
+		}
+	}
+
+	if (result.hasModRM)
+	{
+		if (size <= pos)
+		{
+			return none;
+		}
+
+		result.modRM = bytes[pos++];
+		const ModRMInfo& modRM = ModRMTable[registerOnly ? (result.modRM | 0xC0) : result.modRM];
+
+		if (modRM.sib)
+		{
+			if (size <= pos)
+			{
+				return none;
+			}
+
+			// mod == 0 で base == 5 なら base の代わりに disp32
+			const uint8 sib = bytes[pos++];
+			pos += ((result.modRM < 0x40) && ((sib & 7) == 5)) ? 4 : 0;
+		}
+
+		if (modRM.ripRelative)
+		{
+			result.ripDisplacementOffset = static_cast<uint8>(pos);
+		}
+
+		pos += modRM.displacementSize;
+	}
+
+	const size_t immediateSize = ImmediateSize(immediate, prefixes, rexW, result.modRM, result.opcode);
+
+	if ((result.flow == InstructionFlow::Jump) || (result.flow == InstructionFlow::ConditionalJump)
+		|| (result.flow == InstructionFlow::Loop) || (result.flow == InstructionFlow::Call))
+	{
+		result.relativeOffset = static_cast<uint8>(pos);
+		result.relativeSize = static_cast<uint8>(immediateSize);
+	}
+
+	pos += immediateSize;
+
+	if (size < pos)
+	{
+		return none;
+	}
+
+	result.length = static_cast<uint8>(pos);
+	return result;
+}
+
+bool IsConditionSatisfied(uint8 condition, uint32 eflags)
+{
+	const bool cf = (eflags >> 0) & 1;
+	const bool pf = (eflags >> 2) & 1;
+	const bool zf = (eflags >> 6) & 1;
+	const bool sf = (eflags >> 7) & 1;
+	const bool of = (eflags >> 11) & 1;
+
+	bool result = false;
+	switch (condition >> 1)
+	{
+	case 0: result = of; break;                     // O
+	case 1: result = cf; break;                     // B
+	case 2: result = zf; break;                     // E
+	case 3: result = cf || zf; break;               // BE
+	case 4: result = sf; break;                     // S
+	case 5: result = pf; break;                     // P
+	case 6: result = (sf != of); break;             // L
+	case 7: result = zf || (sf != of); break;       // LE
+	}
+
+	// 奇数は否定（NO, AE, NE, ...）
+	return (condition & 1) ? not result : result;
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+// 命令の行き先の種類
+enum class InstructionFlow : uint8
+{
+	Sequential,      // 次の命令に進む
+	Jump,            // EB, E9
+	ConditionalJump, // 70～7F, 0F 80～0F 8F
+	Loop,            // E0～E3（LOOP / JRCXZ）
+	Call,            // E8
+	IndirectJump,    // FF /4, FF /5
+	IndirectCall,    // FF /2, FF /3
+	Return,          // C3, C2, CB, CA, CF
+	Interrupt,       // CC, CD, F1, 0F 0B・0F B9・0F FF（UD2・UD1・UD0）
+};
+
+// x86-64 の命令 1 つを解析した結果（長さと、書き換えが必要な位置）
+struct DecodedInstruction
+{
+	uint8 length = 0;
+
+	// 0: 1 バイトオペコード, 1: 0F, 2: 0F 38, 3: 0F 3A（VEX / EVEX はプレフィックスの中のマップ）
+	uint8 opcodeMap = 0;
+
+	uint8 opcode = 0;
+
+	bool hasModRM = false;
+
+	uint8 modRM = 0;
+
+	// [rip + disp32] を使っていればその disp32 の位置
+	Optional<uint8> ripDisplacementOffset;
+
+	InstructionFlow flow = InstructionFlow::Sequential;
+
+	// 分岐先の相対値の位置と大きさ（1 か 4、相対分岐でなければ 0）
+	uint8 relativeOffset = 0;
+
+	uint8 relativeSize = 0;
+
+	// ConditionalJump の条件（オペコードの下位 4 ビット）
+	uint8 condition = 0;
+
+	bool isCall() const { return (flow == InstructionFlow::Call) || (flow == InstructionFlow::IndirectCall); }
+
+	uint8 modRMReg() const { return (modRM >> 3) & 7; }
+
+	// 分岐先の相対値（次の命令の先頭から）
+	int64 relativeDisplacement(const uint8* bytes) const;
+};
+
+// 64 ビットモードの命令を解析する。解釈できない・size が足りない場合は none
+// プレフィックス・オペコード・ModRM の属性は表から引く（命令ごとの分岐を減らす）
+Optional<DecodedInstruction> DecodeInstruction(const uint8* bytes, size_t size);
+
+// Jcc の条件が EFLAGS で成り立つか
+bool IsConditionSatisfied(uint8 condition, uint32 eflags);
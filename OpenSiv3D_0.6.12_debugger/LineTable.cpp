@@ -0,0 +1,208 @@
+﻿#include "LineTable.hpp"
+
+void LineTable::add(size_t address, uint32 fileID, uint32 lineNumber)
+{
+	m_lines.push_back(SourceLine{ address, fileID, lineNumber });
+}
+
+void LineTable::build()
+{
+	// 同じアドレスでは終わりの印を先にする（前の範囲の終わりと次の範囲の始まりが同じアドレスのとき）
+	std::stable_sort(m_lines.begin(), m_lines.end(), [](const SourceLine& a, const SourceLine& b)
+	{
+		return (a.address != b.address) ? (a.address < b.address) : (a.lineNumber == 0 && b.lineNumber != 0);
+	});
+
+	// 同じ行が続く間は最初の 1 つだけを範囲の先頭にする
+	m_lineOrder.clear();
+	for (size_t i = 0; i < m_lines.size(); ++i)
+	{
+		const auto& line = m_lines[i];
+		if (line.lineNumber == 0)
+		{
+			continue;
+		}
+
+		if (i != 0)
+		{
+			const auto& previous = m_lines[i - 1];
+			if (previous.fileID == line.fileID && previous.lineNumber == line.lineNumber)
+			{
+				continue;
+			}
+		}
+
+		m_lineOrder.push_back(static_cast<uint32>(i));
+	}
+
+	std::sort(m_lineOrder.begin(), m_lineOrder.end(), [&](uint32 a, uint32 b)
+	{
+		const auto& lhs = m_lines[a];
+		const auto& rhs = m_lines[b];
+		return std::tie(lhs.fileID, lhs.lineNumber, lhs.address) < std::tie(rhs.fileID, rhs.lineNumber, rhs.address);
+	});
+
+	// 行が変わるところ（終わりの印を含む）だけを区間の先頭として残す
+	m_intervalStarts.clear();
+	m_intervals.clear();
+	for (const auto& line : m_lines)
+	{
+		if (not m_intervals.isEmpty())
+		{
+			auto& last = m_intervals.back();
+			if (last.fileID == line.fileID && last.lineNumber == line.lineNumber)
+			{
+				continue;
+			}
+
+			// 前の範囲の終わりと次の範囲の始まりが同じアドレスなら、始まりで上書きする
+			if (last.address == line.address)
+			{
+				last = line;
+				continue;
+			}
+		}
+
+		m_intervalStarts.push_back(line.address);
+		m_intervals.push_back(line);
+	}
+}
+
+void LineTable::clear()
+{
+	m_lines.clear();
+	m_lineOrder.clear();
+	m_intervalStarts.clear();
+	m_intervals.clear();
+	m_files.clear();
+}
+
+const SourceLine* LineTable::findLine(size_t address) const
+{
+	if (m_intervalStarts.isEmpty() || address < m_intervalStarts.front())
+	{
+		return nullptr;
+	}
+
+	// address 以下で最大の先頭アドレスを探す
+	// 比較の結果で base を進めるかどうかだけが変わるので、条件分岐ではなく cmov になる
+	const size_t* base = m_intervalStarts.data();
+	size_t count = m_intervalStarts.size();
+	while (1 < count)
+	{
+		const size_t half = count / 2;
+		base = (base[half] <= address) ? (base + half) : base;
+		count -= half;
+	}
+
+	const auto& line = m_intervals[base - m_intervalStarts.data()];
+	return (line.lineNumber != 0) ? &line : nullptr;
+}
+
+Array<LineRange> LineTable::findLineRanges(size_t address, size_t first, size_t last) const
+{
+	auto it = std::upper_bound(m_lines.begin(), m_lines.end(), address,
+		[](size_t value, const SourceLine& line) { return value < line.address; });
+
+	if (it == m_lines.begin() || (it - 1)->lineNumber == 0)
+	{
+		return {};
+	}
+
+	const uint32 fileID = (it - 1)->fileID;
+	const uint32 lineNumber = (it - 1)->lineNumber;
+
+	const auto begin = std::lower_bound(m_lineOrder.begin(), m_lineOrder.end(), std::pair{ fileID, lineNumber },
+		[&](uint32 index, const std::pair<uint32, uint32>& value)
+		{
+			return std::pair{ m_lines[index].fileID, m_lines[index].lineNumber } < value;
+		});
+
+	Array<LineRange> ranges;
+	for (auto order = begin; order != m_lineOrder.end() && m_lines[*order].fileID == fileID && m_lines[*order].lineNumber == lineNumber; ++order)
+	{
+		const size_t start = m_lines[*order].address;
+		if (start < first || last <= start)
+		{
+			continue;
+		}
+
+		// 行が変わるところまでが範囲（テーブルの最後なら終わりがわからない）
+		size_t next = *order + 1;
+		while (next < m_lines.size() && m_lines[next].fileID == fileID && m_lines[next].lineNumber == lineNumber)
+		{
+			++next;
+		}
+
+		if (next == m_lines.size())
+		{
+			continue;
+		}
+
+		const size_t rangeEnd = Min(m_lines[next].address, last);
+		if (start < rangeEnd)
+		{
+			ranges.push_back(LineRange{ start, rangeEnd });
+		}
+	}
+	return ranges;
+}
+
+Array<LineRange> LineTable::findLibraryRanges(size_t first, size_t last) const
+{
+	auto it = std::upper_bound(m_intervalStarts.begin(), m_intervalStarts.end(), first);
+	if (it != m_intervalStarts.begin())
+	{
+		--it;
+	}
+
+	Array<LineRange> ranges;
+	for (size_t i = (it - m_intervalStarts.begin()); (i + 1) < m_intervals.size() && m_intervalStarts[i] < last; ++i)
+	{
+		const auto& line = m_intervals[i];
+		if (line.lineNumber == 0 || m_files.isUserFile(line.fileID))
+		{
+			continue;
+		}
+
+		const size_t begin = Max(m_intervalStarts[i], first);
+		const size_t end = Min(m_intervalStarts[i + 1], last);
+		if (end <= begin)
+		{
+			continue;
+		}
+
+		if (not ranges.isEmpty() && ranges.back().end == begin)
+		{
+			ranges.back().end = end;
+		}
+		else
+		{
+			ranges.push_back(LineRange{ begin, end });
+		}
+	}
+	return ranges;
+}
+
+Array<size_t> LineTable::findLineAddresses(uint32 fileID, uint32 lineNumber) const
+{
+	auto it = std::lower_bound(m_lineOrder.begin(), m_lineOrder.end(), std::pair{ fileID, lineNumber },
+		[&](uint32 index, const std::pair<uint32, uint32>& value)
+		{
+			return std::pair{ m_lines[index].fileID, m_lines[index].lineNumber } < value;
+		});
+
+	if (it == m_lineOrder.end() || m_lines[*it].fileID != fileID)
+	{
+		return {};
+	}
+
+	const uint32 found = m_lines[*it].lineNumber;
+
+	Array<size_t> addresses;
+	for (; it != m_lineOrder.end() && m_lines[*it].fileID == fileID && m_lines[*it].lineNumber == found; ++it)
+	{
+		addresses.push_back(m_lines[*it].address);
+	}
+	return addresses;
+}
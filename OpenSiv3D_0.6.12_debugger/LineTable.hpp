@@ -0,0 +1,78 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+#include "SourceFileTable.hpp"
+
+// 行番号テーブルの 1 行（lineNumber == 0 は連続した範囲の終わり）
+struct SourceLine
+{
+	size_t address;
+	uint32 fileID;
+	uint32 lineNumber;
+};
+
+// 同じ行が続くアドレスの範囲 [begin, end)
+struct LineRange
+{
+	size_t begin;
+	size_t end;
+};
+
+// デバッグ対象の行番号テーブル（アドレス → 行と、ファイル:行 → アドレスの両方向）
+//
+// モジュールを読み込んだときに全行を一度だけ取り出し、アドレス順と（ファイル, 行）順の並びを作っておく
+// ステップ実行で行が変わったかを見るときや、保存しておいたブレークポイントを張り直すときに、1 回ごとに DbgHelp を呼ばずに済むようにする
+class LineTable
+{
+public:
+
+	// 同じパスには同じ ID を返す
+	uint32 addFile(StringView path) { return m_files.intern(path); }
+
+	// 追加し終わったら build を呼ぶ
+	void add(size_t address, uint32 fileID, uint32 lineNumber);
+
+	void build();
+
+	void clear();
+
+	size_t size() const { return m_lines.size(); }
+
+	const Array<SourceLine>& lines() const { return m_lines; }
+
+	const SourceFileTable& files() const { return m_files; }
+
+	SourceFileTable& files() { return m_files; }
+
+	// address を含む行（行情報がなければ nullptr）
+	// ステップ実行中に何度も呼ばれるので、確保も分岐もしない二分探索にしている
+	const SourceLine* findLine(size_t address) const;
+
+	// パスの末尾が fileName と一致するファイル（例: Main.cpp, src/Main.cpp）
+	Array<uint32> findFiles(StringView fileName) const { return m_files.findBySuffix(fileName); }
+
+	// 行の各範囲の先頭アドレス（アドレス順）
+	// コードのない行（空行・コメント）なら、同じファイルでその後ろにあるコードのある最初の行のもの
+	Array<size_t> findLineAddresses(uint32 fileID, uint32 lineNumber) const;
+
+	// address を含む行の、[first, last)（関数の範囲など）にある全範囲（アドレス順）
+	// ループの条件と本体のように、1 つの行が離れた複数の範囲に分かれていることがある
+	// address に行情報がなければ空
+	Array<LineRange> findLineRanges(size_t address, size_t first, size_t last) const;
+
+	// [first, last) にある、ユーザーのファイルでない行（インライン展開されたライブラリのコード）の範囲（アドレス順）
+	Array<LineRange> findLibraryRanges(size_t first, size_t last) const;
+
+private:
+
+	Array<SourceLine> m_lines; // アドレス順
+
+	// 同じ行が続く間をまとめた区間（findLine 用）
+	// 二分探索で触る先頭アドレスだけを別の配列にして、キャッシュに載りやすくする
+	Array<size_t> m_intervalStarts;
+	Array<SourceLine> m_intervals;
+
+	// 範囲の先頭になっている m_lines の添字を（ファイル, 行, アドレス）順に並べたもの
+	Array<uint32> m_lineOrder;
+
+	SourceFileTable m_files;
+};
@@ -1,174 +1,384 @@
 ﻿#include <Siv3D.hpp> // Siv3D v0.6.12
 #include "ProcessDebugger.hpp"
 #include "UserSourceFiles.hpp"
+#include "DebuggerBenchmark.hpp"
+#include "BenchmarkDebuggee.hpp"
+#include "DebugCommandQueue.hpp"
+#include "DebugLog.hpp"
+#include "DebugMetrics.hpp"
+#include "RecordingDebugBackend.hpp"
+#include "ReplayDebugBackend.hpp"
 
-enum class OperationCommandType
+// "--name 値" の値
+Optional<String> FindOptionValue(const Array<String>& args, StringView name)
 {
-	Go,
-	StepIn,
-	StepOver,
-	StepOut,
-};
+	auto it = std::find(args.begin(), args.end(), name);
+	if (it == args.end() || ++it == args.end() || it->starts_with(U"--"))
+	{
+		return none;
+	}
+	return *it;
+}
+
+void ApplyOperation(ProcessDebugger& debugger, OperationCommandType type)
+{
+	switch (type)
+	{
+	case OperationCommandType::Go:
+		break;
+	case OperationCommandType::StepIn:
+		debugger.stepIn();
+		break;
+	case OperationCommandType::StepOver:
+		debugger.stepOver();
+		break;
+	case OperationCommandType::StepOut:
+		debugger.stepOut();
+		break;
+	default: break;
+	}
+}
 
-enum class ShowCommandType
+const String& FetchDebugString(ProcessDebugger& debugger, ShowCommandType type)
 {
-	ShowGlovalVariables,
-	ShowLocalVariables,
-	ShowCallstack,
-};
+	switch (type)
+	{
+	case ShowCommandType::ShowGlovalVariables:
+		debugger.process().fetchGlobalVariables();
+		break;
+	case ShowCommandType::ShowLocalVariables:
+		debugger.process().fetchLocalVariables(debugger.userThread());
+		break;
+	case ShowCommandType::ShowCallstack:
+		debugger.process().fetchCallstack(debugger.userThread());
+		break;
+	default: break;
+	}
+
+	return debugger.process().getDebugString();
+}
+
+// --record で記録したセッションを、デバッグ対象なしで同じ操作の順に再生する
+// 止まった位置と表示した文字列を出力するので、出力の比較で回帰テストにも使える
+bool RunReplay(FilePathView tracePath)
+{
+	auto replayBackend = std::make_unique<ReplayDebugBackend>();
+	if (not replayBackend->open(tracePath))
+	{
+		return false;
+	}
+
+	auto& replay = *replayBackend;
+	ProcessDebugger debugger(std::move(replayBackend));
+
+	// 記録で止める操作をしたところでは、次のデバッグイベントの前に同じ要求をする
+	replay.setBreakRequestHandler([&debugger]() { debugger.requestDebugBreak(); });
+
+	const auto startTime = std::chrono::steady_clock::now();
+	size_t stopCount = 0;
+
+	auto runUntilStop = [&]() {
+		if (debugger.pumpDebugEvents(INFINITE).status == PumpStatus::Stopped)
+		{
+			++stopCount;
+			Console << U"stopped: {}:{}"_fmt(debugger.currentFilename(), debugger.currentLine());
+		}
+	};
+
+	if (debugger.startDebugSession(replay.exeFilePath()))
+	{
+		runUntilStop();
+
+		while (debugger.status() != ProcessStatus::None)
+		{
+			const auto commandOpt = replay.nextCommand();
+			if (not commandOpt)
+			{
+				break;
+			}
+
+			if (const auto* operation = std::get_if<OperationCommand>(&commandOpt.value()))
+			{
+				ApplyOperation(debugger, operation->type);
+				runUntilStop();
+			}
+			else if (const auto* show = std::get_if<ShowCommand>(&commandOpt.value()))
+			{
+				Console << FetchDebugString(debugger, show->type);
+			}
+		}
+	}
+
+	const double elapsedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	Console << U"replay: {} records, {} stops, {:.1f} ms"_fmt(replay.recordCount(), stopCount, elapsedMilliseconds);
+
+	return not replay.isDiverged();
+}
 
 void Main()
 {
-	ProcessDebugger debugger;
+	const auto& args = System::GetCommandLineArgs();
+
+	if (DebuggerBenchmark::IsDebuggeeMode(args))
+	{
+		if (const size_t threads = DebuggerBenchmark::DebuggeeThreads(args))
+		{
+			RunThreadedBenchmarkDebuggee(threads, DebuggerBenchmark::DebuggeeIterations(args));
+		}
+		else
+		{
+			RunBenchmarkDebuggee(DebuggerBenchmark::DebuggeeIterations(args));
+		}
+		return;
+	}
+
+	DebugLog::Start();
+
+	// --metrics [出力先.json] [間隔(秒)]：処理ごとの回数と所要時間を定期的にファイルに書き出す
+	if (auto it = std::find(args.begin(), args.end(), U"--metrics"); it != args.end())
+	{
+		FilePath metricsPath = U"debugger_metrics.json";
+		int32 intervalSeconds = 5;
+
+		if (++it != args.end() && not it->starts_with(U"--"))
+		{
+			metricsPath = *it;
+
+			if (++it != args.end() && not it->starts_with(U"--"))
+			{
+				intervalSeconds = Max(ParseOr<int32>(*it, intervalSeconds), 1);
+			}
+		}
+
+		DebugMetrics::StartPeriodicDump(metricsPath, std::chrono::seconds(intervalSeconds));
+	}
 
-	Optional<String> debugProcessPath;
+	if (const auto benchmarkOptions = DebuggerBenchmark::ParseCommandLine(args))
+	{
+		const bool succeeded = DebuggerBenchmark::Run(benchmarkOptions.value());
+		DebugMetrics::StopPeriodicDump();
+		DebugLog::Stop();
 
-	Optional<OperationCommandType> operationRequest;
+		// Siv3D の Main は終了コードを返せないので、失敗はここで終了コードにする
+		if (not succeeded)
+		{
+			std::exit(EXIT_FAILURE);
+		}
+		return;
+	}
 
-	Optional<ShowCommandType> showRequest;
+	if (const auto tracePath = FindOptionValue(args, U"--replay"))
+	{
+		RunReplay(tracePath.value());
+		DebugMetrics::StopPeriodicDump();
+		DebugLog::Stop();
+		return;
+	}
 
-	bool isTerminate = false;
+	// --record <記録ファイル>：デバッグイベントとレジスタ・メモリの読み出しを記録する
+	std::unique_ptr<DebugBackend> backend = DebugBackend::CreateDefault();
+	RecordingDebugBackend* recorder = nullptr;
+
+	if (const auto tracePath = FindOptionValue(args, U"--record"))
+	{
+		auto recordingBackend = std::make_unique<RecordingDebugBackend>(std::move(backend), tracePath.value());
+		recorder = recordingBackend.get();
+		backend = std::move(recordingBackend);
+	}
+
+	ProcessDebugger debugger(std::move(backend));
+
+	MessageQueue<DebugCommand> commandQueue;
+
+	MessageQueue<DebugResult> resultQueue;
+
+	// 終了時にデバッグ対象の実行待ちを打ち切る
+	std::stop_source stopSource;
+
+	// デバッグ対象を再開し、次に止まったときの状態を UI に返す
+	auto runUntilStop = [&]() {
+		const auto result = debugger.pumpDebugEvents(INFINITE, stopSource.get_token());
+
+		if (result.status == PumpStatus::Cancelled)
+		{
+			return;
+		}
+
+		if (result.status == PumpStatus::Stopped)
+		{
+			resultQueue.push(StoppedResult{ debugger.currentFilename(), debugger.currentFileID(), debugger.currentLine(), debugger.mainThreadID(), debugger.userThreadID() });
+		}
+		else
+		{
+			resultQueue.push(SessionEndedResult{});
+		}
+	};
 
 	auto updateDebugger = [&]() {
 
-		while (not isTerminate)
+		// コマンドが来るまではスレッドを眠らせておく
+		while (auto commandOpt = commandQueue.waitPop())
 		{
-			if (debugProcessPath)
+			const auto& command = commandOpt.value();
+
+			if (recorder && debugger && debugger.status() != ProcessStatus::None)
 			{
-				debugger.startDebugSession(debugProcessPath.value());
-				debugProcessPath = none;
-				operationRequest = none;
-				showRequest = none;
+				recorder->recordCommand(command);
 			}
 
-			if (debugger)
+			if (const auto* start = std::get_if<StartSessionCommand>(&command))
 			{
-				debugger.continueDebugSession();
+				// 前回このファイルをデバッグしたときのブレークポイントを引き継ぐ
+				debugger.loadBreakPointSession(BreakPointSession::DefaultPath(start->exeFilePath));
 
-				while (not operationRequest && not isTerminate)
+				if (debugger.startDebugSession(start->exeFilePath))
 				{
-					if (showRequest)
-					{
-						switch (showRequest.value())
-						{
-						case ShowCommandType::ShowGlovalVariables:
-							debugger.process().fetchGlobalVariables();
-							break;
-						case ShowCommandType::ShowLocalVariables:
-							debugger.process().fetchLocalVariables(debugger.userThread());
-							break;
-						case ShowCommandType::ShowCallstack:
-							debugger.process().fetchCallstack(debugger.userThread());
-							break;
-						default: break;
-						}
-
-						showRequest = none;
-					}
-
-					std::this_thread::sleep_for(std::chrono::milliseconds(0));
+					runUntilStop();
 				}
-
-				if (operationRequest)
+				else
 				{
-					switch (operationRequest.value())
-					{
-					case OperationCommandType::Go:
-						break;
-					case OperationCommandType::StepIn:
-						debugger.stepIn();
-						break;
-					case OperationCommandType::StepOver:
-						debugger.stepOver();
-						break;
-					case OperationCommandType::StepOut:
-						debugger.stepOut();
-						break;
-					default: break;
-					}
-
-					operationRequest = none;
+					resultQueue.push(SessionEndedResult{});
 				}
 			}
-			else
+			else if (const auto* operation = std::get_if<OperationCommand>(&command))
 			{
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				if (not debugger || debugger.status() == ProcessStatus::None)
+				{
+					continue;
+				}
+
+				ApplyOperation(debugger, operation->type);
+				runUntilStop();
+			}
+			else if (const auto* show = std::get_if<ShowCommand>(&command))
+			{
+				if (not debugger || debugger.status() == ProcessStatus::None)
+				{
+					continue;
+				}
+
+				resultQueue.push(ShowResult{ show->type, FetchDebugString(debugger, show->type) });
 			}
 		}
 	};
 
 	std::thread debuggerThread(updateDebugger);
 
+	// UI に表示するデバッグ対象の状態（デバッガースレッドから受け取ったもの）
+	Optional<StoppedResult> stopped;
+
+	String debugString;
+
+	bool isRunning = false;
+
+	// シングルステップごとのログ（Trace）を出すかどうか
+	bool isTraceLogEnabled = false;
+
+	auto sendOperation = [&](OperationCommandType type) {
+		commandQueue.push(OperationCommand{ type });
+		isRunning = true;
+	};
+
 	Font font(16);
 
 	while (System::Update())
 	{
+		while (auto resultOpt = resultQueue.tryPop())
+		{
+			if (auto* result = std::get_if<StoppedResult>(&resultOpt.value()))
+			{
+				stopped = std::move(*result);
+				isRunning = false;
+			}
+			else if (std::holds_alternative<SessionEndedResult>(resultOpt.value()))
+			{
+				stopped = none;
+				isRunning = false;
+			}
+			else if (auto* show = std::get_if<ShowResult>(&resultOpt.value()))
+			{
+				debugString = std::move(show->text);
+			}
+		}
+
 		if (DragDrop::HasNewFilePaths())
 		{
-			debugProcessPath = DragDrop::GetDroppedFilePaths()[0].path;
-			operationRequest = OperationCommandType::Go;
+			commandQueue.push(StartSessionCommand{ DragDrop::GetDroppedFilePaths()[0].path });
+			isRunning = true;
 		}
 
-		if (SimpleGUI::Button(U"suspend", Vec2(100, 200)))
+		// 止まっている間に要求すると、次に再開したときに止まってしまう
+		if (SimpleGUI::Button(U"suspend", Vec2(100, 200), unspecified, isRunning))
 		{
+			// 再生で同じところで止める要求をするために、実行中の操作も記録する
+			if (recorder)
+			{
+				recorder->recordCommand(BreakCommand{});
+			}
+
 			debugger.requestDebugBreak();
 		}
 		if (SimpleGUI::Button(U"resume", Vec2(300, 200)))
 		{
-			operationRequest = OperationCommandType::Go;
+			sendOperation(OperationCommandType::Go);
 		}
 		if (SimpleGUI::Button(U"stepIn", Vec2(300, 250)))
 		{
-			operationRequest = OperationCommandType::StepIn;
+			sendOperation(OperationCommandType::StepIn);
 		}
 		if (SimpleGUI::Button(U"stepOver", Vec2(300, 300)))
 		{
-			operationRequest = OperationCommandType::StepOver;
+			sendOperation(OperationCommandType::StepOver);
 		}
 		if (SimpleGUI::Button(U"stepOut", Vec2(300, 350)))
 		{
-			operationRequest = OperationCommandType::StepOut;
+			sendOperation(OperationCommandType::StepOut);
 		}
 		if (SimpleGUI::Button(U"show global", Vec2(450, 200)))
 		{
-			showRequest = ShowCommandType::ShowGlovalVariables;
+			commandQueue.push(ShowCommand{ ShowCommandType::ShowGlovalVariables });
 		}
 		if (SimpleGUI::Button(U"show local", Vec2(450, 250)))
 		{
-			showRequest = ShowCommandType::ShowLocalVariables;
+			commandQueue.push(ShowCommand{ ShowCommandType::ShowLocalVariables });
 		}
 		if (SimpleGUI::Button(U"show callstack", Vec2(450, 300)))
 		{
-			showRequest = ShowCommandType::ShowCallstack;
+			commandQueue.push(ShowCommand{ ShowCommandType::ShowCallstack });
+		}
+
+		if (SimpleGUI::CheckBox(isTraceLogEnabled, U"trace log", Vec2(450, 350)))
+		{
+			DebugLog::SetLevel(isTraceLogEnabled ? LogLevel::Trace : LogLevel::Info);
 		}
 
-		if (not operationRequest)
+		if (not isRunning)
 		{
 			font(U"入力待機中…").draw();
 		}
 
-		if (debugger && debugger.status() != ProcessStatus::None)
+		if (stopped)
 		{
-			font(U"メインスレッド：", debugger.mainThreadID()).draw(0, 30);
-			font(U"ユーザースレッド：", debugger.userThreadID()).draw(0, 50);
+			font(U"メインスレッド：", stopped->mainThreadID).draw(0, 30);
+			font(U"ユーザースレッド：", stopped->userThreadID).draw(0, 50);
 
-			font(debugger.currentFilename()).draw(0, 100);
-			font(debugger.currentLine()).draw(0, 120);
+			font(stopped->fileName).draw(0, 100);
+			font(stopped->lineNumber).draw(0, 120);
 
-			if (auto optLineStr = UserSourceFiles::TryGetLine(debugger.currentFilename(), debugger.currentLine() - 1))
+			if (auto optLineStr = UserSourceFiles::TryGetLine(stopped->fileID, stopped->lineNumber - 1))
 			{
 				font(optLineStr.value().get()).draw(0, 140);
 			}
 
-			font(debugger.process().getDebugString()).draw(0, 400);
+			font(debugString).draw(0, 400);
 		}
 	}
 
-	isTerminate = true;
-	if (debugger && debugger.status() != ProcessStatus::None)
-	{
-		DebugBreakProcess(debugger.process().getHandle());
-	}
+	stopSource.request_stop();
+	commandQueue.close();
 
 	debuggerThread.join();
+
+	DebugMetrics::StopPeriodicDump();
+	DebugLog::Stop();
 }
@@ -1,47 +1,76 @@
 ﻿#include "ProcessDebugger.hpp"
+#include "DebugLog.hpp"
+#include "DebugMetrics.hpp"
+#include "InstructionDecoder.hpp"
 
-bool ProcessDebugger::startDebugSession(const FilePathView exeFilePath)
+namespace
 {
-	if (m_processStatus != ProcessStatus::None)
+	// キャンセルを確認する間隔
+	constexpr DWORD PumpSliceMilliseconds = 10;
+
+	constexpr uint8 BreakOp = 0xCC;
+
+	constexpr size_t PageSize = 4096;
+
+	// x86-64 の命令の最大長
+	constexpr size_t MaxInstructionBytes = 15;
+
+	// これより長い行（大きなインライン展開など）は 1 命令ずつ進める
+	constexpr size_t MaxStepRangeBytes = 64 * 1024;
+
+	constexpr Metric ToMetric(BreakPointType type)
 	{
-		Console << U"デバッグが実行中です";
-		return false;
+		switch (type)
+		{
+		case BreakPointType::Init: return Metric::BreakPointInit;
+		case BreakPointType::Entry: return Metric::BreakPointEntry;
+		case BreakPointType::Code: return Metric::BreakPointCode;
+		case BreakPointType::User: return Metric::BreakPointUser;
+		case BreakPointType::StepOver: return Metric::BreakPointStepOver;
+		case BreakPointType::StepOut: return Metric::BreakPointStepOut;
+		case BreakPointType::OtherThread: return Metric::BreakPointOtherThread;
+		case BreakPointType::StepRange: return Metric::BreakPointStepRange;
+		case BreakPointType::RunTo: return Metric::BreakPointRunTo;
+		}
+
+		// default を書かないので、BreakPointType を増やして書き忘れると -Wswitch で分かる
+		return Metric::BreakPointCode;
 	}
+}
 
-	auto filepathW = Unicode::ToWstring(exeFilePath);
+ProcessDebugger::ProcessDebugger()
+	: ProcessDebugger(DebugBackend::CreateDefault()) {}
 
-	STARTUPINFO si = {};
-	si.cb = sizeof(si);
+ProcessDebugger::ProcessDebugger(std::unique_ptr<DebugBackend> backend)
+	: m_backend(std::move(backend)) {}
+
+bool ProcessDebugger::startDebugSession(const FilePathView exeFilePath, const StringView arguments)
+{
+	if (m_processStatus != ProcessStatus::None)
+	{
+		DebugLog::Write(LogLevel::Warning, LogCategory::Process, U"デバッグが実行中です");
+		return false;
+	}
 
 	PROCESS_INFORMATION pi = {};
 
-	if (not CreateProcess(
-		filepathW.c_str(),
-		NULL,
-		NULL,
-		NULL,
-		FALSE,
-		DEBUG_ONLY_THIS_PROCESS | CREATE_NEW_CONSOLE | CREATE_SUSPENDED,
-		//DEBUG_ONLY_THIS_PROCESS | CREATE_NEW_CONSOLE,
-		NULL,
-		NULL,
-		&si,
-		&pi
-	))
-	{
-		Console << U"CreateProcessに失敗しました: " << GetLastError();
+	if (not m_backend->createProcess(exeFilePath, arguments, pi))
+	{
+		DebugLog::Write(LogLevel::Error, LogCategory::Process, U"CreateProcessに失敗しました: {}", m_backend->lastError());
 		return false;
 	}
 
-	m_process = ProcessHandle(exeFilePath, pi.hProcess);
+	m_process = ProcessHandle(m_backend.get(), exeFilePath, pi.hProcess);
+	m_breakableProcess = pi.hProcess;
+	m_process.setCodePatchSource(&m_breakPointAttacher);
 	m_processID = pi.dwProcessId;
 	m_mainThreadID = pi.dwThreadId;
 	m_userMainThreadID = 0;
-	m_threadIDMap[m_mainThreadID] = ThreadHandle(pi.hThread);
+	m_threadIDMap[m_mainThreadID] = ThreadHandle(m_backend.get(), pi.hThread);
 	m_processStatus = ProcessStatus::Interrupted;
 
 	m_stoppedThreadID = m_mainThreadID;
-	ResumeThread(pi.hThread);
+	m_backend->resumeThread(pi.hThread);
 	handledException(true);
 
 	return true;
@@ -51,50 +80,166 @@ void ProcessDebugger::continueDebugSession()
 {
 	if (m_processStatus == ProcessStatus::None)
 	{
-		Console << U"プロセスを開始していません";
+		DebugLog::Write(LogLevel::Warning, LogCategory::Process, U"プロセスを開始していません");
 		return;
 	}
 
-	if (m_processStatus == ProcessStatus::Suspended)
+	pumpDebugEvents(INFINITE);
+}
+
+PumpResult ProcessDebugger::pumpDebugEvents(DWORD milliseconds, std::stop_token stopToken)
+{
+	PumpResult result;
+
+	if (m_processStatus == ProcessStatus::None)
 	{
-		m_threadIDMap[m_stoppedThreadID.value()].resume();
+		result.status = PumpStatus::Exited;
+		return result;
 	}
-	else
+
+	if (not m_isRunning)
 	{
-		ContinueDebugEvent(m_processID, m_stoppedThreadID.value(), m_alwaysContinue ? DBG_CONTINUE : m_continueStatus);
-		m_alwaysContinue = false;
+		resumeDebugSession();
 	}
 
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+
 	DEBUG_EVENT debugEvent;
 
-	while (WaitForDebugEvent(&debugEvent, INFINITE))
+	while (true)
 	{
-		if (dispatchDebugEvent(&debugEvent))
+		if (stopToken.stop_requested())
 		{
-			ContinueDebugEvent(debugEvent.dwProcessId, debugEvent.dwThreadId, m_continueStatus);
+			result.status = PumpStatus::Cancelled;
+			return result;
 		}
-		else
+
+		// キャンセルできる場合は待機を区切る
+		DWORD waitMilliseconds = stopToken.stop_possible() ? PumpSliceMilliseconds : INFINITE;
+
+		if (milliseconds != INFINITE)
+		{
+			const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0)
+			{
+				result.status = PumpStatus::Timeout;
+				return result;
+			}
+			waitMilliseconds = Min(waitMilliseconds, static_cast<DWORD>(remaining));
+		}
+
+		if (not waitForDebugEvent(debugEvent, waitMilliseconds))
 		{
-			break;
+			if (m_backend->lastError() == ERROR_SEM_TIMEOUT)
+			{
+				continue;
+			}
+
+			DebugLog::Write(LogLevel::Error, LogCategory::Event, U"WaitForDebugEventに失敗しました: {}", m_backend->lastError());
+			result.status = PumpStatus::Failed;
+			return result;
 		}
+
+		// 止まらないイベント（スレッド生成・DLLロード・デバッグ出力など）は
+		// 呼び出し元に戻らずに、届いている分をまとめて処理する
+		size_t batchSize = 0;
+		bool isStopped = false;
+
+		do
+		{
+			++batchSize;
+
+			if (dispatchDebugEvent(&debugEvent))
+			{
+				continueDebugEvent(debugEvent.dwProcessId, debugEvent.dwThreadId, m_continueStatus);
+			}
+			else
+			{
+				isStopped = true;
+				break;
+			}
+		} while (waitForDebugEvent(debugEvent, 0));
+
+		result.eventCount += batchSize;
+		result.batchSizes.push_back(batchSize);
+
+		if (isStopped)
+		{
+			m_isRunning = false;
+			result.status = (m_processStatus == ProcessStatus::None) ? PumpStatus::Exited : PumpStatus::Stopped;
+			return result;
+		}
+	}
+}
+
+void ProcessDebugger::resumeDebugSession()
+{
+	if (m_processStatus == ProcessStatus::Suspended)
+	{
+		m_threadIDMap[m_stoppedThreadID.value()].resume();
+	}
+	else
+	{
+		continueDebugEvent(m_processID, m_stoppedThreadID.value(), m_alwaysContinue ? DBG_CONTINUE : m_continueStatus);
+		m_alwaysContinue = false;
+	}
+
+	m_isRunning = true;
+}
+
+bool ProcessDebugger::waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds)
+{
+	if (not m_backend->waitForDebugEvent(debugEvent, milliseconds))
+	{
+		return false;
+	}
+
+	// 次に再開するまでデバッグ対象のメモリは変わらない
+	m_process.startMemoryCache();
+
+	if (m_continuedAt)
+	{
+		DebugMetrics::Record(Metric::EventRoundTrip, std::chrono::steady_clock::now() - m_continuedAt.value());
+		m_continuedAt.reset();
 	}
+
+	return true;
+}
+
+void ProcessDebugger::continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus)
+{
+	m_process.discardMemoryCache();
+
+	{
+		ScopedMetric metric(Metric::ContinueDebugEvent);
+		m_backend->continueDebugEvent(processID, threadID, continueStatus);
+	}
+
+	m_continuedAt = std::chrono::steady_clock::now();
 }
 
 void ProcessDebugger::requestDebugBreak()
 {
+	// スレッドの表やブレークポイントの状態はデバッグイベントを処理するスレッドだけが触る
+	const HANDLE process = m_breakableProcess;
+	if (process == NULL)
+	{
+		return;
+	}
+
 	m_requestBreak = true;
 
-	auto& mainThread = m_threadIDMap[m_userMainThreadID];
-	mainThread.suspend();
-	mainThread.setTrapFlag();
-	m_breakPointAttacher.setBeingSingleInstruction(true);
-	mainThread.resume();
+	if (not m_backend->debugBreakProcess(process))
+	{
+		m_requestBreak = false;
+		DebugLog::Write(LogLevel::Warning, LogCategory::Process, U"DebugBreakProcessに失敗しました: {}", m_backend->lastError());
+	}
 }
 
 void ProcessDebugger::suspend()
 {
 	m_threadIDMap[m_userMainThreadID].suspend();
-	Print << U"SUSPENDED";
+	DebugLog::Write(LogLevel::Info, LogCategory::Thread, U"SUSPENDED thread: {}", m_userMainThreadID);
 	m_stoppedThreadID = m_userMainThreadID;
 }
 
@@ -111,15 +256,20 @@ void ProcessDebugger::stepIn()
 {
 	if (m_processStatus == ProcessStatus::None)
 	{
-		Console << U"プロセスを開始していません";
+		DebugLog::Write(LogLevel::Warning, LogCategory::Process, U"プロセスを開始していません");
 		return;
 	}
 
 	auto& currentThread = m_threadIDMap[m_userMainThreadID];
 	m_stepHandler.saveCurrentLineInfo(m_process, currentThread);
 
+	if (beginStepRange(m_userMainThreadID, true))
+	{
+		return;
+	}
+
 	currentThread.setTrapFlag();
-	m_breakPointAttacher.setBeingSingleInstruction(true);
+	m_breakPointAttacher.setBeingSingleInstruction(m_userMainThreadID, true);
 
 	//continueDebugSession();
 }
@@ -128,7 +278,7 @@ void ProcessDebugger::stepOver()
 {
 	if (m_processStatus == ProcessStatus::None)
 	{
-		Console << U"プロセスを開始していません";
+		DebugLog::Write(LogLevel::Warning, LogCategory::Process, U"プロセスを開始していません");
 		return;
 	}
 
@@ -144,19 +294,24 @@ void ProcessDebugger::stepOver()
 
 	m_stepHandler.saveCurrentLineInfo(m_process, currentThread);
 
-	m_breakPointAttacher.setBeingStepOver(true);
+	m_breakPointAttacher.setBeingStepOver(m_userMainThreadID, true);
+
+	if (beginStepRange(m_userMainThreadID, false))
+	{
+		return;
+	}
 
 	// CALL命令→CALLの実行後にブレーク
-	if (auto callLenhOpt = m_process.tryGetCallInstructionBytesLength(context.Rip))
+	if (auto returnAddressOpt = findCallReturnAddress(context.Rip))
 	{
-		m_breakPointAttacher.setStepOverBreakPointAt(m_process, context.Rip + callLenhOpt.value());
-		m_breakPointAttacher.setBeingSingleInstruction(false);
+		m_breakPointAttacher.setStepOverBreakPointAt(m_process, m_userMainThreadID, returnAddressOpt.value());
+		m_breakPointAttacher.setBeingSingleInstruction(m_userMainThreadID, false);
 	}
 	// CALL以外→シングルステップ実行
 	else
 	{
 		currentThread.setTrapFlag();
-		m_breakPointAttacher.setBeingSingleInstruction(true);
+		m_breakPointAttacher.setBeingSingleInstruction(m_userMainThreadID, true);
 	}
 }
 
@@ -165,19 +320,343 @@ void ProcessDebugger::stepOut()
 	auto& currentThread = m_threadIDMap[m_userMainThreadID];
 	m_stepHandler.saveCurrentLineInfo(m_process, currentThread);
 
-	m_breakPointAttacher.setBeingStepOut(true);
-	m_breakPointAttacher.setBeingSingleInstruction(false);
+	m_breakPointAttacher.setBeingStepOut(m_userMainThreadID, true);
+	m_breakPointAttacher.setBeingSingleInstruction(m_userMainThreadID, false);
+
+	// 呼び出し元の戻り先にブレークポイントを張る（戻ったときに 1 回だけ止まる）
+	if (auto frameOpt = m_process.getReturnFrame(currentThread))
+	{
+		m_breakPointAttacher.setStepOutBreakPointAt(m_process, m_userMainThreadID, frameOpt->returnAddress, frameOpt->stackPointer);
+	}
+	else
+	{
+		DebugLog::Write(LogLevel::Warning, LogCategory::Step, U"呼び出し元に戻る先がわかりません");
+		m_breakPointAttacher.setBeingStepOut(m_userMainThreadID, false);
+	}
+}
+
+size_t ProcessDebugger::runToLine(StringView fileName, uint32 lineNumber)
+{
+	if (m_processStatus == ProcessStatus::None)
+	{
+		DebugLog::Write(LogLevel::Warning, LogCategory::Process, U"プロセスを開始していません");
+		return 0;
+	}
+
+	const auto& lineTable = m_process.lineTable();
+
+	Array<size_t> addresses;
+	for (const auto fileID : lineTable.findFiles(fileName))
+	{
+		addresses.append(lineTable.findLineAddresses(fileID, lineNumber));
+	}
+
+	const size_t count = m_breakPointAttacher.setRunToBreakPoints(m_process, addresses);
+	DebugLog::Write(LogLevel::Debug, LogCategory::BreakPoint, U"run to line {}: {} breakpoints", lineNumber, count);
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// 今いる命令に張ったものは、元の命令を 1 つ実行してから張り直す（すぐに当たらないように）
+	// すでに張り直しを待っていれば int3 はまだ入っていない
+	auto& currentThread = m_threadIDMap[m_userMainThreadID];
+	if (const auto contextOpt = currentThread.getContext();
+		contextOpt && not m_breakPointAttacher.needResetBreakPoint(m_userMainThreadID) && m_breakPointAttacher.recoverTemporaryBreakPoint(m_process, contextOpt->Rip))
+	{
+		currentThread.setTrapFlag();
+		m_breakPointAttacher.saveResetUserBreakPoint(m_userMainThreadID, contextOpt->Rip);
+		holdOtherThreads(m_userMainThreadID);
+	}
+
+	m_breakPointAttacher.setBeingSingleInstruction(m_userMainThreadID, false);
+	return count;
+}
+
+bool ProcessDebugger::setBreakPoint(size_t address)
+{
+	return m_breakPointAttacher.setUserBreakPointAt(m_process, address);
+}
+
+bool ProcessDebugger::cancelBreakPoint(size_t address)
+{
+	return m_breakPointAttacher.cancelUserBreakPointAt(m_process, address);
+}
+
+bool ProcessDebugger::setConditionalBreakPoint(size_t address, StringView condition)
+{
+	const auto resolver = m_process.createConditionResolver(address);
+
+	String errorMessage;
+	auto compiled = BreakPointCondition::Compile(condition, *resolver, errorMessage);
+	if (not compiled)
+	{
+		DebugLog::WriteText(LogLevel::Warning, LogCategory::BreakPoint, U"条件式を解釈できません: ", errorMessage);
+		return false;
+	}
+
+	BreakPointOptions options;
+	options.condition = std::move(*compiled);
+	return setUserBreakPointOptions(address, BreakPointKind::Conditional, std::move(options));
+}
+
+bool ProcessDebugger::setTracepoint(size_t address, StringView message, uint32 stopAtHitCount)
+{
+	const auto resolver = m_process.createConditionResolver(address);
+
+	// "i={i} hp={player.hp}" -> 文字列 { "i=", " hp=", "" } と式 { i, player.hp }
+	Array<String> literals(1);
+	BreakPointOptions options;
+	options.stopAtHitCount = stopAtHitCount;
+
+	for (size_t i = 0; i < message.size(); ++i)
+	{
+		if (message[i] != U'{')
+		{
+			literals.back().push_back(message[i]);
+			continue;
+		}
+
+		// {{ は { そのもの
+		if (i + 1 < message.size() && message[i + 1] == U'{')
+		{
+			literals.back().push_back(U'{');
+			++i;
+			continue;
+		}
+
+		const size_t close = message.find(U'}', i + 1);
+		if (close == StringView::npos)
+		{
+			DebugLog::WriteText(LogLevel::Warning, LogCategory::BreakPoint, U"トレースポイントのメッセージの { が閉じていません: ", message);
+			return false;
+		}
+
+		if (TracepointRecord::MaxValues <= options.messageValues.size())
+		{
+			DebugLog::WriteText(LogLevel::Warning, LogCategory::BreakPoint, U"トレースポイントに埋め込める値は 8 個までです: ", message);
+			return false;
+		}
+
+		String errorMessage;
+		auto compiled = BreakPointCondition::CompileValue(message.substr(i + 1, close - i - 1), *resolver, errorMessage);
+		if (not compiled)
+		{
+			DebugLog::WriteText(LogLevel::Warning, LogCategory::BreakPoint, U"トレースポイントの式を解釈できません: ", errorMessage);
+			return false;
+		}
+
+		options.messageValues.push_back(std::move(*compiled));
+		literals.emplace_back();
+		i = close;
+	}
+
+	options.messageFormatID = m_tracepointSink.addFormat(std::move(literals));
+	return setUserBreakPointOptions(address, BreakPointKind::Tracepoint, std::move(options));
+}
+
+bool ProcessDebugger::setHitCountBreakPoint(size_t address, uint32 count)
+{
+	if (count == 0)
+	{
+		return false;
+	}
+
+	BreakPointOptions options;
+	options.stopAtHitCount = count;
+	return setUserBreakPointOptions(address, BreakPointKind::HitCount, std::move(options));
+}
+
+bool ProcessDebugger::setCounterBreakPoint(size_t address)
+{
+	return setUserBreakPointOptions(address, BreakPointKind::Counter, {});
+}
+
+Optional<size_t> ProcessDebugger::setHardwareBreakPoint(size_t address)
+{
+	HardwareBreakPoint breakPoint;
+	breakPoint.address = address;
+	breakPoint.type = HardwareBreakPointType::Execute;
+	breakPoint.size = 1;
+	return allocateHardwareBreakPoint(breakPoint);
+}
+
+Optional<size_t> ProcessDebugger::setWatchPoint(size_t address, size_t size, HardwareBreakPointType type)
+{
+	if ((size != 1 && size != 2 && size != 4 && size != 8) || (address % size) != 0 || type == HardwareBreakPointType::Execute)
+	{
+		DebugLog::Write(LogLevel::Warning, LogCategory::BreakPoint, U"ウォッチポイントの範囲が不正です: {:X} ({} バイト)", address, size);
+		return none;
+	}
+
+	HardwareBreakPoint breakPoint;
+	breakPoint.address = address;
+	breakPoint.type = type;
+	breakPoint.size = static_cast<uint8>(size);
+	return allocateHardwareBreakPoint(breakPoint);
+}
+
+bool ProcessDebugger::cancelHardwareBreakPoint(size_t slot)
+{
+	if (MaxHardwareBreakPoints <= slot || not m_hardwareBreakPoints[slot])
+	{
+		return false;
+	}
+
+	bool result = true;
+	for (const auto& [threadID, thread] : m_threadIDMap)
+	{
+		result &= thread.clearHardwareBreakPoint(slot);
+	}
+
+	m_hardwareBreakPoints[slot].reset();
+	m_hasHardwareBreakPoints = std::any_of(m_hardwareBreakPoints.begin(), m_hardwareBreakPoints.end(), [](const auto& breakPoint) { return breakPoint.has_value(); });
+	return result;
+}
+
+Optional<size_t> ProcessDebugger::allocateHardwareBreakPoint(const HardwareBreakPoint& breakPoint)
+{
+	const auto it = std::find_if(m_hardwareBreakPoints.begin(), m_hardwareBreakPoints.end(), [](const auto& slot) { return not slot.has_value(); });
+	if (it == m_hardwareBreakPoints.end())
+	{
+		DebugLog::Write(LogLevel::Warning, LogCategory::BreakPoint, U"ハードウェアブレークポイントの空きがありません");
+		return none;
+	}
+
+	const size_t slot = static_cast<size_t>(it - m_hardwareBreakPoints.begin());
+
+	// デバッグレジスタはスレッドごとにあるので全スレッドに同じ設定をする
+	for (const auto& [threadID, thread] : m_threadIDMap)
+	{
+		if (not thread.setHardwareBreakPoint(slot, breakPoint))
+		{
+			DebugLog::Write(LogLevel::Warning, LogCategory::BreakPoint, U"デバッグレジスタを設定できません: thread {}", threadID);
+
+			for (const auto& [id, rollback] : m_threadIDMap)
+			{
+				rollback.clearHardwareBreakPoint(slot);
+			}
+			return none;
+		}
+	}
+
+	*it = breakPoint;
+	m_hasHardwareBreakPoints = true;
+	return slot;
+}
+
+bool ProcessDebugger::setUserBreakPointOptions(size_t address, BreakPointKind kind, BreakPointOptions options)
+{
+	if (not m_breakPointAttacher.getUserBreakPoints().contains(address))
+	{
+		m_breakPointAttacher.setUserBreakPointAt(m_process, address);
+	}
+
+	return m_breakPointAttacher.setUserBreakPointOptions(address, kind, std::move(options));
+}
+
+size_t ProcessDebugger::setBreakPoints(const Array<size_t>& addresses)
+{
+	return m_breakPointAttacher.setUserBreakPointsAt(m_process, addresses);
+}
+
+size_t ProcessDebugger::cancelBreakPoints(const Array<size_t>& addresses)
+{
+	return m_breakPointAttacher.cancelUserBreakPointsAt(m_process, addresses);
+}
+
+size_t ProcessDebugger::setFunctionBreakPoints(StringView pattern)
+{
+	return setSessionBreakPoint(SessionBreakPoint{ .fileName = String{}, .lineNumber = 0, .pattern = String{ pattern } });
+}
+
+size_t ProcessDebugger::cancelFunctionBreakPoints(StringView pattern)
+{
+	return cancelSessionBreakPoint(SessionBreakPoint{ .fileName = String{}, .lineNumber = 0, .pattern = String{ pattern } });
+}
+
+size_t ProcessDebugger::setLineBreakPoint(StringView fileName, uint32 lineNumber)
+{
+	return setSessionBreakPoint(SessionBreakPoint{ .fileName = String{ fileName }, .lineNumber = lineNumber, .pattern = String{} });
+}
+
+size_t ProcessDebugger::cancelLineBreakPoint(StringView fileName, uint32 lineNumber)
+{
+	return cancelSessionBreakPoint(SessionBreakPoint{ .fileName = String{ fileName }, .lineNumber = lineNumber, .pattern = String{} });
+}
+
+bool ProcessDebugger::loadBreakPointSession(FilePathView path)
+{
+	m_breakPointSessionPath = FilePath{ path };
+	return m_breakPointSession.load(path);
+}
+
+size_t ProcessDebugger::setSessionBreakPoint(const SessionBreakPoint& breakPoint)
+{
+	m_breakPointSession.add(breakPoint);
+	if (not m_breakPointSessionPath.isEmpty())
+	{
+		m_breakPointSession.save(m_breakPointSessionPath);
+	}
+
+	return setBreakPoints(BreakPointSession::Resolve(breakPoint, m_process.lineTable(), m_process.functionIndex()));
+}
+
+size_t ProcessDebugger::cancelSessionBreakPoint(const SessionBreakPoint& breakPoint)
+{
+	if (m_breakPointSession.remove(breakPoint) && not m_breakPointSessionPath.isEmpty())
+	{
+		m_breakPointSession.save(m_breakPointSessionPath);
+	}
+
+	return cancelBreakPoints(BreakPointSession::Resolve(breakPoint, m_process.lineTable(), m_process.functionIndex()));
+}
+
+void ProcessDebugger::restoreBreakPointSession()
+{
+	m_lastSessionRestore = SessionRestoreResult{};
+	if (m_breakPointSession.isEmpty())
+	{
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	size_t unresolved = 0;
+	const auto addresses = m_breakPointSession.resolve(m_process.lineTable(), m_process.functionIndex(), unresolved);
+
+	m_lastSessionRestore.breakPoints = m_breakPointSession.breakPoints().size();
+	m_lastSessionRestore.installed = setBreakPoints(addresses);
+	m_lastSessionRestore.unresolved = unresolved;
+	m_lastSessionRestore.elapsed = std::chrono::steady_clock::now() - start;
+
+	DebugLog::Write(LogLevel::Info, LogCategory::BreakPoint, U"restored {} breakpoints ({} addresses, {} unresolved) in {} us",
+		m_lastSessionRestore.breakPoints, m_lastSessionRestore.installed, unresolved,
+		std::chrono::duration_cast<std::chrono::microseconds>(m_lastSessionRestore.elapsed).count());
+}
+
+size_t ProcessDebugger::setFunctionTracepoints(StringView pattern, StringView message)
+{
+	// 先にまとめて張っておき、setTracepoint では設定だけ付ける
+	const auto addresses = m_process.functionIndex().findByPattern(pattern);
+	setBreakPoints(addresses);
 
-	// 現在の関数のret命令にブレークポイントを張る
-	if (auto retOpt = m_process.getRetInstructionAddress(currentThread))
+	size_t count = 0;
+	for (const auto address : addresses)
 	{
-		m_breakPointAttacher.setStepOutBreakPointAt(m_process, retOpt.value());
+		count += setTracepoint(address, message);
 	}
+	return count;
 }
 
 const String& ProcessDebugger::currentFilename()
 {
-	return m_stepHandler.lastLineInfo().fileName;
+	return m_process.sourceFilePath(m_stepHandler.lastLineInfo().fileID);
+}
+
+uint32 ProcessDebugger::currentFileID()
+{
+	return m_stepHandler.lastLineInfo().fileID;
 }
 
 int ProcessDebugger::currentLine()
@@ -187,15 +666,17 @@ int ProcessDebugger::currentLine()
 
 bool ProcessDebugger::dispatchDebugEvent(const DEBUG_EVENT* debugEvent)
 {
+	ScopedMetric metric(DebugMetrics::EventMetric(debugEvent->dwDebugEventCode));
+
 	m_stoppedThreadID = none;
 
 	switch (debugEvent->dwDebugEventCode)
 	{
 	case CREATE_PROCESS_DEBUG_EVENT:
-		Console << U"CREATE_PROCESS_DEBUG_EVENT";
+		DebugLog::Write(LogLevel::Info, LogCategory::Event, U"CREATE_PROCESS_DEBUG_EVENT");
 		return onProcessCreated(&debugEvent->u.CreateProcessInfo);
 	case CREATE_THREAD_DEBUG_EVENT:
-		Console << U"CREATE_THREAD_DEBUG_EVENT";
+		DebugLog::Write(LogLevel::Debug, LogCategory::Event, U"CREATE_THREAD_DEBUG_EVENT thread: {}", debugEvent->dwThreadId);
 		return onThreadCreated(&debugEvent->u.CreateThread, debugEvent->dwThreadId);
 	case EXCEPTION_DEBUG_EVENT:
 	{
@@ -205,261 +686,652 @@ bool ProcessDebugger::dispatchDebugEvent(const DEBUG_EVENT* debugEvent)
 		{
 			m_stoppedThreadID = debugEvent->dwThreadId;
 		}
-		return isContinue;
-	}
-	case EXIT_PROCESS_DEBUG_EVENT:
-		// false
-		Console << U"EXIT_PROCESS_DEBUG_EVENT";
-		return onProcessExited(&debugEvent->u.ExitProcess);
-	case EXIT_THREAD_DEBUG_EVENT:
-		Console << U"EXIT_THREAD_DEBUG_EVENT";
-		return onThreadExited(&debugEvent->u.ExitThread, debugEvent->dwThreadId);
-	case LOAD_DLL_DEBUG_EVENT:
-		Console << U"LOAD_DLL_DEBUG_EVENT";
-		return onDllLoaded(&debugEvent->u.LoadDll);
-	case OUTPUT_DEBUG_STRING_EVENT:
-		Console << U"OUTPUT_DEBUG_STRING_EVENT";
-		return onOutputDebugString(&debugEvent->u.DebugString);
-	case RIP_EVENT:
-		//false
-		Console << U"RIP_EVENT";
-		return onRipEvent(&debugEvent->u.RipInfo);
-	case UNLOAD_DLL_DEBUG_EVENT:
-		Console << U"UNLOAD_DLL_DEBUG_EVENT";
-		return onDllUnloaded(&debugEvent->u.UnloadDll);
+		return isContinue;
+	}
+	case EXIT_PROCESS_DEBUG_EVENT:
+		// false
+		DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXIT_PROCESS_DEBUG_EVENT");
+		return onProcessExited(&debugEvent->u.ExitProcess);
+	case EXIT_THREAD_DEBUG_EVENT:
+		DebugLog::Write(LogLevel::Debug, LogCategory::Event, U"EXIT_THREAD_DEBUG_EVENT thread: {}", debugEvent->dwThreadId);
+		return onThreadExited(&debugEvent->u.ExitThread, debugEvent->dwThreadId);
+	case LOAD_DLL_DEBUG_EVENT:
+		DebugLog::Write(LogLevel::Debug, LogCategory::Event, U"LOAD_DLL_DEBUG_EVENT thread: {}", debugEvent->dwThreadId);
+		return onDllLoaded(&debugEvent->u.LoadDll);
+	case OUTPUT_DEBUG_STRING_EVENT:
+		DebugLog::Write(LogLevel::Debug, LogCategory::Event, U"OUTPUT_DEBUG_STRING_EVENT thread: {}", debugEvent->dwThreadId);
+		return onOutputDebugString(&debugEvent->u.DebugString);
+	case RIP_EVENT:
+		//false
+		DebugLog::Write(LogLevel::Info, LogCategory::Event, U"RIP_EVENT");
+		return onRipEvent(&debugEvent->u.RipInfo);
+	case UNLOAD_DLL_DEBUG_EVENT:
+		DebugLog::Write(LogLevel::Debug, LogCategory::Event, U"UNLOAD_DLL_DEBUG_EVENT thread: {}", debugEvent->dwThreadId);
+		return onDllUnloaded(&debugEvent->u.UnloadDll);
+	default:
+		DebugLog::Write(LogLevel::Warning, LogCategory::Event, U"Unknown debug event: {}", debugEvent->dwDebugEventCode);
+		return true;
+	}
+}
+
+bool ProcessDebugger::onProcessCreated(const CREATE_PROCESS_DEBUG_INFO* pInfo)
+{
+	m_breakPointAttacher.initializeBreakPointHelper();
+	m_stepHandler.initializeSingleStepHelper();
+	m_functionFlows.clear();
+
+	if (m_process.init(pInfo))
+	{
+		if (auto entryPointOpt = m_process.findAddress(U"Main"))
+		{
+			if (m_breakPointAttacher.setUserBreakPointAt(m_process, entryPointOpt.value()))
+			{
+				DebugLog::Write(LogLevel::Debug, LogCategory::BreakPoint, U"set break point at entry function succeeded: {:X}", entryPointOpt.value());
+				//printHex(mainAddress, false);
+				//std::cout;
+			}
+			else
+			{
+				DebugLog::Write(LogLevel::Warning, LogCategory::BreakPoint, U"set break point at entry function failed");
+			}
+		}
+		else
+		{
+			DebugLog::Write(LogLevel::Warning, LogCategory::Symbol, U"cannot find entry function");
+		}
+	}
+	else
+	{
+		DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymInitialize failed: {}", m_backend->lastError());
+	}
+
+	m_backend->closeHandle(pInfo->hFile);
+
+	return true;
+}
+
+
+bool ProcessDebugger::onThreadCreated(const CREATE_THREAD_DEBUG_INFO* pInfo, DWORD threadID)
+{
+	m_threadIDMap[threadID] = ThreadHandle(m_backend.get(), pInfo->hThread);
+
+	// int3 を外している間に作られたスレッドも止めておく
+	if (m_isHoldingThreads)
+	{
+		m_threadIDMap[threadID].suspend();
+		m_heldThreadIDs.push_back(threadID);
+	}
+
+	// 後から作られたスレッドにも張ってあるハードウェアブレークポイントを設定する
+	for (size_t slot = 0; slot < MaxHardwareBreakPoints; ++slot)
+	{
+		if (m_hardwareBreakPoints[slot])
+		{
+			m_threadIDMap[threadID].setHardwareBreakPoint(slot, *m_hardwareBreakPoints[slot]);
+		}
+	}
+
+	return true;
+}
+
+bool ProcessDebugger::onException(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+{
+	switch (pInfo->ExceptionRecord.ExceptionCode)
+	{
+	case EXCEPTION_BREAKPOINT:
+		return onBreakPoint(pInfo, threadID);
+	case EXCEPTION_SINGLE_STEP:
+		return onSingleStep(pInfo, threadID);
+	case DBG_CONTROL_BREAK:
+		return onRequestedBreak(threadID);
+	case EXCEPTION_ACCESS_VIOLATION: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_ACCESS_VIOLATION"); break;
+	case EXCEPTION_DATATYPE_MISALIGNMENT: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_DATATYPE_MISALIGNMENT"); break;
+	case EXCEPTION_ARRAY_BOUNDS_EXCEEDED: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_ARRAY_BOUNDS_EXCEEDED"); break;
+	case EXCEPTION_FLT_DENORMAL_OPERAND: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_FLT_DENORMAL_OPERAND"); break;
+	case EXCEPTION_FLT_DIVIDE_BY_ZERO: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_FLT_DIVIDE_BY_ZERO"); break;
+	case EXCEPTION_FLT_INEXACT_RESULT: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_FLT_INEXACT_RESULT"); break;
+	case EXCEPTION_FLT_INVALID_OPERATION: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_FLT_INVALID_OPERATION"); break;
+	case EXCEPTION_FLT_OVERFLOW: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_FLT_OVERFLOW"); break;
+	case EXCEPTION_FLT_STACK_CHECK: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_FLT_STACK_CHECK"); break;
+	case EXCEPTION_FLT_UNDERFLOW: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_FLT_UNDERFLOW"); break;
+	case EXCEPTION_INT_DIVIDE_BY_ZERO: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_INT_DIVIDE_BY_ZERO"); break;
+	case EXCEPTION_INT_OVERFLOW: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_INT_OVERFLOW"); break;
+	case EXCEPTION_PRIV_INSTRUCTION: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_PRIV_INSTRUCTION"); break;
+	case EXCEPTION_IN_PAGE_ERROR: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_IN_PAGE_ERROR"); break;
+	case EXCEPTION_ILLEGAL_INSTRUCTION: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_ILLEGAL_INSTRUCTION"); break;
+	case EXCEPTION_NONCONTINUABLE_EXCEPTION: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_NONCONTINUABLE_EXCEPTION"); break;
+	case EXCEPTION_STACK_OVERFLOW: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_STACK_OVERFLOW"); break;
+	case EXCEPTION_INVALID_DISPOSITION: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_INVALID_DISPOSITION"); break;
+	case EXCEPTION_GUARD_PAGE: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_GUARD_PAGE"); break;
+	case EXCEPTION_INVALID_HANDLE: DebugLog::Write(LogLevel::Info, LogCategory::Event, U"EXCEPTION_INVALID_HANDLE"); break;
+	default:
+		break;
+	}
+
+	/*std::cout << "An exception was occured at ";
+	printHex(std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress), false);
+	std::cout << "." << std::endl << "Exception code: ";
+	printHex(pInfo->ExceptionRecord.ExceptionCode, true);
+	std::cout << std::endl;*/
+
+	/*if (pInfo->dwFirstChance)
+	{
+		Console << U"First chance";
+	}
+	else
+	{
+		Console << U"Second chance";
+	}*/
+
+	m_processStatus = ProcessStatus::Interrupted;
+
+	return false;
+}
+
+bool ProcessDebugger::onBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+{
+	DebugLog::Write(LogLevel::Trace, LogCategory::BreakPoint, U"onBreakPoint thread: {}", threadID);
+
+	const auto breadAddress = std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress);
+	const auto bpType = m_breakPointAttacher.getBreakPointType(breadAddress, threadID);
+
+	ScopedMetric metric(ToMetric(bpType));
+
+	switch (bpType)
+	{
+	case BreakPointType::Init:
+		handledException(true);
+		return true;
+
+	case BreakPointType::Entry:
+	{
+		m_userMainThreadID = threadID;
+		if (auto contextOpt = m_threadIDMap[threadID].getContext())
+		{
+			m_process.entryFunc(contextOpt.value().Rip);
+		}
+
+		// 前回のセッションのブレークポイントはここで（Main で止まる前に）張る
+		// プロセスが作られたときに張ると、ここより前に当たったものがエントリポイントと区別できない
+		restoreBreakPointSession();
+
+		// Windows では Main()の先頭に張ったブレークポイントがエントリになるので、そこで止まる
+		if (m_breakPointAttacher.getUserBreakPoints().contains(breadAddress))
+		{
+			return onUserBreakPoint(pInfo, threadID);
+		}
+
+		handledException(true);
+		return true;
+	}
+
+	case BreakPointType::Code:
+	{
+		uint8 byte = BreakOp;
+		const bool isRemoved = (m_process.readMemory(breadAddress, byte) && byte != BreakOp);
+
+		// requestDebugBreak によるもの（Windows は DebugBreakProcess が作ったスレッドが DbgBreakPoint の int3 を実行する）
+		// Linux の SIGTRAP は DBG_CONTROL_BREAK として届くのでここには来ない
+		if (m_requestBreak && not isRemoved)
+		{
+			return onRequestedBreak(threadID);
+		}
+
+		// 他のスレッドと同時に当たって、処理する前に外されたブレークポイント
+		if (isRemoved)
+		{
+			m_threadIDMap[threadID].backRip();
+			handledException(true);
+			return true;
+		}
+		return onNormalBreakPoint(pInfo, threadID);
+	}
+
+	case BreakPointType::User:
+		return onUserBreakPoint(pInfo, threadID);
+
+	case BreakPointType::StepOver:
+		m_breakPointAttacher.cancelStepOverBreakPoint(m_process, threadID);
+		m_threadIDMap[threadID].backRip();
+		return handleSingleStep(threadID);
+
+	case BreakPointType::StepOut:
+		return onStepOutBreakPoint(pInfo, threadID);
+
+	case BreakPointType::OtherThread:
+		return onOtherThreadBreakPoint(pInfo, threadID);
+
+	case BreakPointType::StepRange:
+		return onStepRangeBreakPoint(pInfo, threadID);
+
+	case BreakPointType::RunTo:
+		return onRunToBreakPoint(pInfo, threadID);
+
+	default: return true;
+	}
+}
+
+bool ProcessDebugger::onRequestedBreak(DWORD threadID)
+{
+	// 2 回要求された・止まっている間に要求されたときは、要求が済んだ後にもう一度届く
+	if (not m_requestBreak.exchange(false))
+	{
+		DebugLog::Write(LogLevel::Debug, LogCategory::Event, U"ignored debug break thread: {}", threadID);
+		handledException(true);
+		return true;
+	}
+
+	m_breakPointAttacher.cancelSteps(m_process);
+
+	// Windows で止まるのは DebugBreakProcess が作ったスレッドなので、行はユーザーのメインスレッドのものを返す
+	// （次のステップもユーザーのメインスレッドで行う）
+	if (const auto it = m_threadIDMap.find(m_userMainThreadID); it != m_threadIDMap.end())
+	{
+		m_stepHandler.updateCurrentLineInfo(m_process, it->second);
+	}
+
+	m_alwaysContinue = true;
+	m_processStatus = ProcessStatus::Interrupted;
+	return false;
+}
+
+bool ProcessDebugger::onNormalBreakPoint(const EXCEPTION_DEBUG_INFO*, DWORD threadID)
+{
+	if (m_breakPointAttacher.isBeingSingleInstruction(threadID))
+	{
+		handledException(true);
+		return true;
+	}
+
+	m_breakPointAttacher.cancelSteps(m_process);
+
+	//Console << U"A break point occured at ";
+	//printHex(std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress), false);
+	//Console << U".";
+
+	m_alwaysContinue = true;
+
+	m_processStatus = ProcessStatus::Interrupted;
+	return false;
+}
+
+bool ProcessDebugger::onUserBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+{
+	const auto breakAddress = std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress);
+	auto& thread = m_threadIDMap[threadID];
+
+	// 止まるかどうかは int3 を実行する前の状態（RIP がブレークポイントのアドレス）で決める
+	bool shouldStop = true;
+	auto contextOpt = thread.getContext();
+	if (contextOpt)
+	{
+		contextOpt->Rip = breakAddress;
+		shouldStop = shouldStopAtUserBreakPoint(breakAddress, threadID, *contextOpt);
+	}
+
+	// 止まらないなら int3 を張ったまま元の命令を外で実行させる（イベント 1 回、int3 の書き直しなし）
+	// ステップ実行中（TF が立っている）は元の方法にする
+	if (not shouldStop && not (contextOpt->EFlags & 0x100))
+	{
+		if (const auto* displaced = m_breakPointAttacher.prepareDisplacedInstruction(m_process, m_threadIDMap, breakAddress);
+			displaced && DisplacedStepping::Apply(*displaced, m_process, *contextOpt) && thread.setContext(*contextOpt))
+		{
+			handledException(true);
+			return true;
+		}
+	}
+
+	// 命令を元に戻す
+	if (m_breakPointAttacher.recoverUserBreakPoint(m_process, breakAddress))
+	{
+		// breakpoint実行後に元の命令が実行されるように1バイト引いて戻す
+		thread.backRip();
+
+		// 次の命令で止めてブレークポイントを復元する
+		thread.setTrapFlag();
+
+		//　再セット用にアドレスを持っておく
+		m_breakPointAttacher.saveResetUserBreakPoint(threadID, breakAddress);
+
+		// int3 を外している間に他のスレッドが素通りしないようにする
+		holdOtherThreads(threadID);
+
+		// 止まらない種類・条件なら UI に渡さずにそのまま続ける（再セットは次のシングルステップで行う）
+		if (not shouldStop)
+		{
+			handledException(true);
+			return true;
+		}
+
+		return onNormalBreakPoint(pInfo, threadID);
+	}
+
+	//通らないはず
+	assert(false);
+	return false;
+
+	//Console << U"A break point occured at ";
+	//printHex(std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress), false);
+	//Console << U".";
+
+	//m_processStatus = ProcessStatus::Interrupted;
+	//return false;
+}
+
+bool ProcessDebugger::shouldStopAtUserBreakPoint(size_t address, DWORD threadID, const CONTEXT& context)
+{
+	const auto* breakPoint = m_breakPointAttacher.getUserBreakPoints().find(address);
+	if (not breakPoint)
+	{
+		return true;
+	}
+
+	const auto* options = m_breakPointAttacher.getUserBreakPointOptions(address);
+
+	switch (breakPoint->kind)
+	{
+	case BreakPointKind::Conditional:
+		return (not options || not options->condition) || shouldStopAtCondition(*options->condition, context);
+
+	case BreakPointKind::Tracepoint:
+		if (not options)
+		{
+			return true;
+		}
+		writeTracepoint(*options, breakPoint->hitCount, threadID, context);
+		return (options->stopAtHitCount != 0) && (breakPoint->hitCount == options->stopAtHitCount);
+
+	case BreakPointKind::Counter:
+		return false;
+
+	case BreakPointKind::HitCount:
+		return (not options) || (breakPoint->hitCount == options->stopAtHitCount);
+
+	case BreakPointKind::User:
 	default:
-		Console << U"Unknown debug event";
 		return true;
 	}
 }
 
-bool ProcessDebugger::onProcessCreated(const CREATE_PROCESS_DEBUG_INFO* pInfo)
+void ProcessDebugger::writeTracepoint(const BreakPointOptions& options, uint32 hitCount, DWORD threadID, const CONTEXT& context)
 {
-	m_breakPointAttacher.initializeBreakPointHelper();
-	m_stepHandler.initializeSingleStepHelper();
+	ScopedMetric metric(Metric::TracepointWrite);
 
-	if (m_process.init(pInfo))
+	TracepointRecord record{};
+	record.timestamp = static_cast<uint64>(std::chrono::steady_clock::now().time_since_epoch().count());
+	record.formatID = options.messageFormatID;
+	record.threadID = threadID;
+	record.hitCount = hitCount;
+	record.valueCount = static_cast<uint8>(options.messageValues.size());
+
+	for (size_t i = 0; i < options.messageValues.size(); ++i)
 	{
-		if (auto entryPointOpt = m_process.findAddress(U"Main"))
+		if (const auto value = options.messageValues[i].evaluateValue(context, m_process))
 		{
-			if (m_breakPointAttacher.setUserBreakPointAt(m_process, entryPointOpt.value()))
-			{
-				Console << U"set break point at entry function succeeded: ";
-				//printHex(mainAddress, false);
-				//std::cout;
-			}
-			else
-			{
-				Console << U"set break point at entry function failed";
-			}
+			record.values[i] = *value;
 		}
 		else
 		{
-			Console << U"cannot find entry function";
+			record.failedMask |= static_cast<uint8>(1u << i);
 		}
 	}
-	else
+
+	m_tracepointSink.write(record);
+}
+
+bool ProcessDebugger::shouldStopAtCondition(const BreakPointCondition& condition, const CONTEXT& context)
+{
+	ScopedMetric metric(Metric::ConditionEvaluate);
+
+	// 評価できないときは止めて気づけるようにする
+	const auto result = condition.evaluate(context, m_process);
+	if (not result)
 	{
-		Console << U"SymInitialize failed: " << GetLastError();
+		DebugLog::WriteText(LogLevel::Warning, LogCategory::BreakPoint, U"条件式を評価できません: ", condition.expression());
+		return true;
 	}
 
-	CloseHandle(pInfo->hFile);
-
-	return true;
+	return *result;
 }
 
-
-bool ProcessDebugger::onThreadCreated(const CREATE_THREAD_DEBUG_INFO* pInfo, DWORD threadID)
+bool ProcessDebugger::onOtherThreadBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
 {
-	m_threadIDMap[threadID] = pInfo->hThread;
+	const auto breakAddress = std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress);
+
+	// ユーザーブレークポイントの止まらないヒットと同じく、元の命令を 1 つ実行させてから張り直す
+	if (m_breakPointAttacher.recoverTemporaryBreakPoint(m_process, breakAddress))
+	{
+		auto& thread = m_threadIDMap[threadID];
+		thread.backRip();
+		thread.setTrapFlag();
+		m_breakPointAttacher.saveResetUserBreakPoint(threadID, breakAddress);
+		holdOtherThreads(threadID);
+	}
+
+	handledException(true);
 	return true;
 }
 
-bool ProcessDebugger::onException(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+bool ProcessDebugger::onStepRangeBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
 {
-	switch (pInfo->ExceptionRecord.ExceptionCode)
+	const auto breakAddress = std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress);
+	auto& thread = m_threadIDMap[threadID];
+
+	// ステップオーバー中に再帰呼び出しの中（より深いフレーム）で当たったものは通り抜ける
+	if (m_breakPointAttacher.isBeingStepOver(threadID))
 	{
-	case EXCEPTION_BREAKPOINT:
-		return onBreakPoint(pInfo, threadID);
-	case EXCEPTION_SINGLE_STEP:
-		return onSingleStep(pInfo, threadID);
-	case EXCEPTION_ACCESS_VIOLATION: Console << U"EXCEPTION_ACCESS_VIOLATION\n"; break;
-	case EXCEPTION_DATATYPE_MISALIGNMENT: Console << U"EXCEPTION_DATATYPE_MISALIGNMENT\n"; break;
-	case EXCEPTION_ARRAY_BOUNDS_EXCEEDED: Console << U"EXCEPTION_ARRAY_BOUNDS_EXCEEDED\n"; break;
-	case EXCEPTION_FLT_DENORMAL_OPERAND: Console << U"EXCEPTION_FLT_DENORMAL_OPERAND\n"; break;
-	case EXCEPTION_FLT_DIVIDE_BY_ZERO: Console << U"EXCEPTION_FLT_DIVIDE_BY_ZERO\n"; break;
-	case EXCEPTION_FLT_INEXACT_RESULT: Console << U"EXCEPTION_FLT_INEXACT_RESULT\n"; break;
-	case EXCEPTION_FLT_INVALID_OPERATION: Console << U"EXCEPTION_FLT_INVALID_OPERATION\n"; break;
-	case EXCEPTION_FLT_OVERFLOW: Console << U"EXCEPTION_FLT_OVERFLOW\n"; break;
-	case EXCEPTION_FLT_STACK_CHECK: Console << U"EXCEPTION_FLT_STACK_CHECK\n"; break;
-	case EXCEPTION_FLT_UNDERFLOW: Console << U"EXCEPTION_FLT_UNDERFLOW\n"; break;
-	case EXCEPTION_INT_DIVIDE_BY_ZERO: Console << U"EXCEPTION_INT_DIVIDE_BY_ZERO\n"; break;
-	case EXCEPTION_INT_OVERFLOW: Console << U"EXCEPTION_INT_OVERFLOW\n"; break;
-	case EXCEPTION_PRIV_INSTRUCTION: Console << U"EXCEPTION_PRIV_INSTRUCTION\n"; break;
-	case EXCEPTION_IN_PAGE_ERROR: Console << U"EXCEPTION_IN_PAGE_ERROR\n"; break;
-	case EXCEPTION_ILLEGAL_INSTRUCTION: Console << U"EXCEPTION_ILLEGAL_INSTRUCTION\n"; break;
-	case EXCEPTION_NONCONTINUABLE_EXCEPTION: Console << U"EXCEPTION_NONCONTINUABLE_EXCEPTION\n"; break;
-	case EXCEPTION_STACK_OVERFLOW: Console << U"EXCEPTION_STACK_OVERFLOW\n"; break;
-	case EXCEPTION_INVALID_DISPOSITION: Console << U"EXCEPTION_INVALID_DISPOSITION\n"; break;
-	case EXCEPTION_GUARD_PAGE: Console << U"EXCEPTION_GUARD_PAGE\n"; break;
-	case EXCEPTION_INVALID_HANDLE: Console << U"EXCEPTION_INVALID_HANDLE\n"; break;
-	default:
-		break;
+		if (const auto contextOpt = thread.getContext(); contextOpt && contextOpt->Rsp < m_breakPointAttacher.stepRangeFrame(threadID))
+		{
+			return onOtherThreadBreakPoint(pInfo, threadID);
+		}
 	}
 
-	/*std::cout << "An exception was occured at ";
-	printHex(std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress), false);
-	std::cout << "." << std::endl << "Exception code: ";
-	printHex(pInfo->ExceptionRecord.ExceptionCode, true);
-	std::cout << std::endl;*/
+	const bool isUnresolved = m_breakPointAttacher.isStepRangeUnresolved(threadID, breakAddress);
+	m_breakPointAttacher.cancelStepRangeBreakPoints(m_process, threadID);
+	thread.backRip();
 
-	/*if (pInfo->dwFirstChance)
+	// ret・間接分岐はこの 1 命令だけシングルステップして行き先を見る
+	if (isUnresolved)
 	{
-		Console << U"First chance";
+		thread.setTrapFlag();
+		m_breakPointAttacher.setBeingSingleInstruction(threadID, true);
+		handledException(true);
+		return true;
 	}
-	else
+
+	// 範囲から出た（同じ行の別の範囲なら続きを実行させる）
+	return handleSingleStep(threadID);
+}
+
+bool ProcessDebugger::onRunToBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+{
+	const auto breakAddress = std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress);
+	auto& thread = m_threadIDMap[threadID];
+
+	// 最初に当たったところで、どのスレッドのものも含めて全部外す
+	m_breakPointAttacher.cancelSteps(m_process);
+	m_breakPointAttacher.setBeingSingleInstruction(threadID, false);
+	thread.backRip();
+
+	// 同じアドレスにユーザーブレークポイントがあれば、それに当たって止まったときと同じく元の命令を 1 つ実行してから張り直す
+	if (m_breakPointAttacher.recoverUserBreakPoint(m_process, breakAddress))
 	{
-		Console << U"Second chance";
-	}*/
+		thread.setTrapFlag();
+		m_breakPointAttacher.saveResetUserBreakPoint(threadID, breakAddress);
+		holdOtherThreads(threadID);
+	}
 
-	m_processStatus = ProcessStatus::Interrupted;
+	DebugLog::Write(LogLevel::Debug, LogCategory::BreakPoint, U"run to hit: {:X} thread: {}", breakAddress, threadID);
 
+	m_alwaysContinue = true;
+	m_processStatus = ProcessStatus::Interrupted;
 	return false;
 }
 
-bool ProcessDebugger::onBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+bool ProcessDebugger::beginStepRange(DWORD threadID, bool stepInto)
 {
-	Console << U"onBreakPoint thread: " << threadID;
-
-	const auto breadAddress = std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress);
-	const auto bpType = m_breakPointAttacher.getBreakPointType(breadAddress);
-
-	switch (bpType)
+	if (not m_isRangeSteppingEnabled)
 	{
-	case BreakPointType::Init:
-		handledException(true);
-		return true;
+		return false;
+	}
 
-	case BreakPointType::Entry:
+	auto& thread = m_threadIDMap[threadID];
+	const auto contextOpt = thread.getContext();
+	if (not contextOpt)
 	{
-		m_userMainThreadID = threadID;
-		if (auto contextOpt = m_threadIDMap[threadID].getContext())
-		{
-			m_process.entryFunc(contextOpt.value().Rip);
-		}
-		handledException(true);
-		return true;
+		return false;
 	}
 
-	case BreakPointType::Code:
-		return onNormalBreakPoint(pInfo, threadID);
+	// 行の範囲は今いる関数の中だけを見る（同じ行がインライン展開された先は別の実行）
+	const size_t rip = contextOpt->Rip;
+	const auto* function = m_process.functionIndex().findContaining(rip);
+	if (not function)
+	{
+		return false;
+	}
 
-	case BreakPointType::User:
-		return onUserBreakPoint(pInfo, threadID);
+	auto ranges = m_process.lineTable().findLineRanges(rip, function->address, function->address + function->size);
 
-	case BreakPointType::StepOver:
-		m_breakPointAttacher.cancelStepOverBreakPoint(m_process);
-		m_threadIDMap[threadID].backRip();
-		return handleSingleStep(threadID);
+	// 関数の先頭の行はプロローグで RSP が動くので、RSP で再帰呼び出しの中かどうかを見分けられない
+	if (ranges.any([&](const LineRange& range) { return range.begin == function->address; }))
+	{
+		return false;
+	}
 
-	case BreakPointType::StepOut:
-		return onStepOutBreakPoint(pInfo, threadID);
+	// ジャストマイコードでは、関数にインライン展開されたライブラリの行も同じ行の続きとしてまとめて実行させる
+	if (m_isJustMyCodeEnabled)
+	{
+		ranges.append(m_process.lineTable().findLibraryRanges(function->address, function->address + function->size));
+		std::sort(ranges.begin(), ranges.end(), [](const LineRange& a, const LineRange& b) { return a.begin < b.begin; });
 
-	default: return true;
+		Array<LineRange> merged;
+		for (const auto& range : ranges)
+		{
+			if (not merged.isEmpty() && range.begin <= merged.back().end)
+			{
+				merged.back().end = Max(merged.back().end, range.end);
+			}
+			else
+			{
+				merged.push_back(range);
+			}
+		}
+		ranges = std::move(merged);
 	}
-}
-
-bool ProcessDebugger::onNormalBreakPoint(const EXCEPTION_DEBUG_INFO*, DWORD)
-{
-	// DebugBreakProcess
-	//if (m_requestBreak)
-	//{
-	//	// 新規スレッドで止まるのでメインスレッドでブレークし直す
-	//	m_requestBreak = false;
-	//	RegisterHandler::setTrapFlag(m_mainThread);
-	//	//m_breakPointAttacher.setBeingSingleInstruction(true);
-	//	return true;
-	//}
 
-	if (m_breakPointAttacher.isBeingSingleInstruction())
+	size_t totalSize = 0;
+	for (const auto& range : ranges)
 	{
-		handledException(true);
-		return true;
+		totalSize += range.end - range.begin;
 	}
 
-	if (m_breakPointAttacher.isBeingStepOver())
+	if (ranges.isEmpty() || MaxStepRangeBytes < totalSize)
 	{
-		m_breakPointAttacher.cancelStepOverBreakPoint(m_process);
-		m_breakPointAttacher.setBeingStepOver(false);
+		return false;
 	}
 
-	if (m_breakPointAttacher.isBeingStepOut())
+	const auto* flow = m_functionFlows.find(m_process, rip);
+	if (not flow)
 	{
-		m_breakPointAttacher.cancelStepOutBreakPoint(m_process);
-		m_breakPointAttacher.setBeingStepOut(false);
+		return false;
 	}
 
-	//Console << U"A break point occured at ";
-	//printHex(std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress), false);
-	//Console << U".";
+	const auto exits = StepHandler::FindRangeExits(*flow, ranges, stepInto);
 
-	m_alwaysContinue = true;
+	// 今の命令の行き先がわからなければ、この 1 命令はシングルステップする
+	if (not exits || exits->unresolved.contains(rip))
+	{
+		return false;
+	}
 
-	m_processStatus = ProcessStatus::Interrupted;
-	return false;
+	m_breakPointAttacher.setStepRangeBreakPoints(m_process, threadID, *exits, contextOpt->Rsp);
+	m_breakPointAttacher.setBeingSingleInstruction(threadID, false);
+
+	DebugLog::Write(LogLevel::Trace, LogCategory::Step, U"step range {:X}: {} ranges, {} exits, {} unresolved", rip, ranges.size(), exits->targets.size(), exits->unresolved.size());
+	return true;
 }
 
-bool ProcessDebugger::onUserBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+Optional<size_t> ProcessDebugger::findCallReturnAddress(size_t address)
 {
-	const auto breakAddress = std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress);
-	// 命令を元に戻す
-	if (m_breakPointAttacher.recoverUserBreakPoint(m_process, breakAddress))
+	if (const auto* flow = m_functionFlows.find(m_process, address))
 	{
-		// breakpoint実行後に元の命令が実行されるように1バイト引いて戻す
-		m_threadIDMap[threadID].backRip();
+		if (const auto* instruction = flow->findInstruction(address))
+		{
+			if ((instruction->flow == InstructionFlow::Call) || (instruction->flow == InstructionFlow::IndirectCall))
+			{
+				return instruction->next();
+			}
+			return none;
+		}
+	}
 
-		// 次の命令で止めてブレークポイントを復元する
-		m_threadIDMap[threadID].setTrapFlag();
+	// 関数の外（索引にないモジュールなど）は、その場で読んで解析する
+	// 命令の最大長だけ読む（ページの終わりを越えて読めなければそこまで）
+	uint8 bytes[MaxInstructionBytes] = {};
+	size_t size = sizeof(bytes);
 
-		//　再セット用にアドレスを持っておく
-		m_breakPointAttacher.saveResetUserBreakPoint(breakAddress);
+	if (not m_process.readOriginalMemory(address, size, bytes))
+	{
+		size = Min(size, PageSize - (address % PageSize));
 
-		return onNormalBreakPoint(pInfo, threadID);
+		if (not m_process.readOriginalMemory(address, size, bytes))
+		{
+			return none;
+		}
 	}
 
-	//通らないはず
-	assert(false);
-	return false;
-
-	//Console << U"A break point occured at ";
-	//printHex(std::bit_cast<size_t>(pInfo->ExceptionRecord.ExceptionAddress), false);
-	//Console << U".";
+	const auto decoded = DecodeInstruction(bytes, size);
+	if (not decoded || not decoded->isCall())
+	{
+		return none;
+	}
 
-	//m_processStatus = ProcessStatus::Interrupted;
-	//return false;
+	return address + decoded->length;
 }
 
-bool ProcessDebugger::onStepOutBreakPoint(const EXCEPTION_DEBUG_INFO*, DWORD threadID)
+bool ProcessDebugger::beginRunToUserCode(DWORD threadID)
 {
-	m_breakPointAttacher.cancelStepOutBreakPoint(m_process);
-
-	m_threadIDMap[threadID].backRip();
+	if (not m_isJustMyCodeEnabled || m_process.userFunctionEntries().isEmpty())
+	{
+		return false;
+	}
 
-	auto context = m_threadIDMap[threadID].getContext().value();
+	auto& thread = m_threadIDMap[threadID];
+	const auto contextOpt = thread.getContext();
+	if (not contextOpt || m_process.isUserCode(contextOpt->Rip))
+	{
+		return false;
+	}
 
-	if (auto retLengthOpt = m_process.retInstructionLength(context.Rip))
+	// コールバックなどでユーザーの関数に入ったところか、呼び出し元に戻ったところで止まる
+	StepRangeExits exits;
+	exits.targets = m_process.userFunctionEntries();
+	if (const auto frameOpt = m_process.getReturnFrame(thread))
 	{
-		size_t retAddress;
-		m_process.readMemory(context.Rip, retAddress);
+		exits.targets.push_back(frameOpt->returnAddress);
+	}
 
-		m_breakPointAttacher.setStepOutBreakPointAt(m_process, retAddress);
+	// ライブラリから呼ばれたユーザーの関数はより深いフレームにあるので、RSP では通り抜けさせない
+	m_breakPointAttacher.setStepRangeBreakPoints(m_process, threadID, exits, 0);
+	m_breakPointAttacher.setBeingSingleInstruction(threadID, false);
 
-		handledException(true);
+	DebugLog::Write(LogLevel::Trace, LogCategory::Step, U"run to user code {:X}: {} breakpoints", contextOpt->Rip, exits.targets.size());
+	return true;
+}
 
-		return true;
+bool ProcessDebugger::onStepOutBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID)
+{
+	// 再帰呼び出しのより深いフレームが同じ戻り先に戻ってきたものは通り抜ける
+	if (const auto contextOpt = m_threadIDMap[threadID].getContext(); contextOpt && contextOpt->Rsp < m_breakPointAttacher.stepOutFrame(threadID))
+	{
+		return onOtherThreadBreakPoint(pInfo, threadID);
 	}
 
-	m_breakPointAttacher.setBeingStepOut(false);
+	m_breakPointAttacher.cancelStepOutBreakPoint(m_process, threadID);
+
+	m_threadIDMap[threadID].backRip();
+
+	m_breakPointAttacher.setBeingStepOut(threadID, false);
 
 	m_alwaysContinue = true;
 	m_processStatus = ProcessStatus::Interrupted;
@@ -468,14 +1340,34 @@ bool ProcessDebugger::onStepOutBreakPoint(const EXCEPTION_DEBUG_INFO*, DWORD thr
 
 bool ProcessDebugger::onSingleStep(const EXCEPTION_DEBUG_INFO*, DWORD threadID)
 {
-	Console << U"onSingleStep thread: " << threadID;
+	DebugLog::Write(LogLevel::Trace, LogCategory::Step, U"onSingleStep thread: {}", threadID);
+
+	if (m_breakPointAttacher.needResetBreakPoint(threadID))
+	{
+		m_breakPointAttacher.resetUserBreakPoint(m_process, threadID);
+
+		// 同じブレークポイントで止まった他のスレッドが元の命令を実行し終わるまで、このスレッドも止めておく
+		if (m_breakPointAttacher.hasPendingReset())
+		{
+			m_threadIDMap[threadID].suspend();
+			m_heldThreadIDs.push_back(threadID);
+		}
+		else
+		{
+			releaseHeldThreads();
+		}
+	}
 
-	if (m_breakPointAttacher.needResetBreakPoint())
+	// ハードウェアブレークポイントも EXCEPTION_SINGLE_STEP で通知される
+	if (m_hasHardwareBreakPoints)
 	{
-		m_breakPointAttacher.resetUserBreakPoint(m_process);
+		if (const auto slot = m_threadIDMap[threadID].takeHardwareBreakPointHit())
+		{
+			return onHardwareBreakPoint(*slot, threadID);
+		}
 	}
 
-	if (m_breakPointAttacher.isBeingSingleInstruction())
+	if (m_breakPointAttacher.isBeingSingleInstruction(threadID))
 	{
 		return handleSingleStep(threadID);
 	}
@@ -484,43 +1376,82 @@ bool ProcessDebugger::onSingleStep(const EXCEPTION_DEBUG_INFO*, DWORD threadID)
 	return true;
 }
 
+bool ProcessDebugger::onHardwareBreakPoint(size_t slot, DWORD threadID)
+{
+	ScopedMetric metric(Metric::BreakPointHardware);
+
+	auto& breakPoint = m_hardwareBreakPoints[slot];
+	if (not breakPoint)
+	{
+		handledException(true);
+		return true;
+	}
+
+	++breakPoint->hitCount;
+	DebugLog::Write(LogLevel::Debug, LogCategory::BreakPoint, U"hardware break point {} hit: {:X} thread: {}", slot, breakPoint->address, threadID);
+
+	// 命令を書き換えていないので、backRip も再設定のシングルステップもいらない
+	m_breakPointAttacher.setBeingSingleInstruction(threadID, false);
+	m_breakPointAttacher.cancelSteps(m_process);
+
+	m_alwaysContinue = true;
+	m_processStatus = ProcessStatus::Interrupted;
+	return false;
+}
+
 bool ProcessDebugger::handleSingleStep(DWORD threadID)
 {
+	ScopedMetric metric(Metric::HandleSingleStep);
+
+	// ライブラリのコードに入ったら、ユーザーのコードに戻るまでまとめて実行させる
+	if (beginRunToUserCode(threadID))
+	{
+		handledException(true);
+		return true;
+	}
+
 	auto& currentThread = m_threadIDMap[threadID];
 	if (not m_stepHandler.isLineChanged(m_process, currentThread))
 	{
-		if (m_breakPointAttacher.isBeingStepOver())
+		// 同じ行の続きは範囲から出るまでまとめて実行させる
+		if (beginStepRange(threadID, not m_breakPointAttacher.isBeingStepOver(threadID)))
+		{
+			handledException(true);
+			return true;
+		}
+
+		if (m_breakPointAttacher.isBeingStepOver(threadID))
 		{
 			if (auto contextOpt = currentThread.getContext())
 			{
 				auto context = contextOpt.value();
 
 				// 関数呼び出しだったら終了後にStepOverブレークポイントを張る
-				if (auto callLenOpt = m_process.tryGetCallInstructionBytesLength(context.Rip))
+				if (auto returnAddressOpt = findCallReturnAddress(context.Rip))
 				{
-					m_breakPointAttacher.setStepOverBreakPointAt(m_process, context.Rip + callLenOpt.value());
-					m_breakPointAttacher.setBeingSingleInstruction(false);
+					m_breakPointAttacher.setStepOverBreakPointAt(m_process, threadID, returnAddressOpt.value());
+					m_breakPointAttacher.setBeingSingleInstruction(threadID, false);
 				}
 				else
 				{
 					currentThread.setTrapFlag();
-					m_breakPointAttacher.setBeingSingleInstruction(true);
+					m_breakPointAttacher.setBeingSingleInstruction(threadID, true);
 				}
 			}
 		}
 		else
 		{
 			currentThread.setTrapFlag();
-			m_breakPointAttacher.setBeingSingleInstruction(true);
+			m_breakPointAttacher.setBeingSingleInstruction(threadID, true);
 		}
 
 		handledException(true);
 		return true;
 	}
 
-	if (m_breakPointAttacher.isBeingStepOver())
+	if (m_breakPointAttacher.isBeingStepOver(threadID))
 	{
-		m_breakPointAttacher.setBeingStepOver(false);
+		m_breakPointAttacher.setBeingStepOver(threadID, false);
 	}
 
 	m_alwaysContinue = true;
@@ -528,18 +1459,63 @@ bool ProcessDebugger::handleSingleStep(DWORD threadID)
 	return false;
 }
 
+void ProcessDebugger::holdOtherThreads(DWORD threadID)
+{
+	if (m_isHoldingThreads)
+	{
+		// 止める前に届いていたイベントのスレッドは、元の命令を実行させるために動かす
+		if (std::find(m_heldThreadIDs.begin(), m_heldThreadIDs.end(), threadID) != m_heldThreadIDs.end())
+		{
+			m_threadIDMap[threadID].resume();
+			m_heldThreadIDs.remove_if([&](DWORD id) { return id == threadID; });
+		}
+		return;
+	}
+
+	for (const auto& [id, thread] : m_threadIDMap)
+	{
+		if (id != threadID)
+		{
+			thread.suspend();
+			m_heldThreadIDs.push_back(id);
+		}
+	}
+
+	m_isHoldingThreads = true;
+}
+
+void ProcessDebugger::releaseHeldThreads()
+{
+	if (not m_isHoldingThreads || m_breakPointAttacher.hasPendingReset())
+	{
+		return;
+	}
+
+	for (const DWORD id : m_heldThreadIDs)
+	{
+		if (const auto it = m_threadIDMap.find(id); it != m_threadIDMap.end())
+		{
+			it->second.resume();
+		}
+	}
+
+	m_heldThreadIDs.clear();
+	m_isHoldingThreads = false;
+}
+
 bool ProcessDebugger::onProcessExited(const EXIT_PROCESS_DEBUG_INFO* pInfo)
 {
-	Console << U"Debuggee was terminated";
-	Console << U"Exit code: " << pInfo->dwExitCode;
+	DebugLog::Write(LogLevel::Info, LogCategory::Process, U"Debuggee was terminated. Exit code: {}", pInfo->dwExitCode);
 
 	m_process.dispose();
+	m_functionFlows.clear();
 
-	ContinueDebugEvent(m_processID, m_mainThreadID, DBG_CONTINUE);
+	m_backend->continueDebugEvent(m_processID, m_mainThreadID, DBG_CONTINUE);
 
-	CloseHandle(m_threadIDMap[m_mainThreadID].getHandle());
-	CloseHandle(m_process.getHandle());
+	m_backend->closeHandle(m_threadIDMap[m_mainThreadID].getHandle());
+	m_backend->closeHandle(m_process.getHandle());
 
+	m_breakableProcess = NULL;
 	m_processID = 0;
 	m_mainThreadID = 0;
 	m_userMainThreadID = 0;
@@ -547,8 +1523,13 @@ bool ProcessDebugger::onProcessExited(const EXIT_PROCESS_DEBUG_INFO* pInfo)
 	m_continueStatus = DBG_EXCEPTION_NOT_HANDLED;
 	m_alwaysContinue = false;
 	m_requestBreak = false;
+	m_isRunning = false;
 
 	m_threadIDMap.clear();
+	m_hardwareBreakPoints.fill(none);
+	m_hasHardwareBreakPoints = false;
+	m_heldThreadIDs.clear();
+	m_isHoldingThreads = false;
 	m_stoppedThreadID = none;
 
 	return false;
@@ -556,6 +1537,10 @@ bool ProcessDebugger::onProcessExited(const EXIT_PROCESS_DEBUG_INFO* pInfo)
 
 bool ProcessDebugger::onThreadExited(const EXIT_THREAD_DEBUG_INFO*, DWORD threadID)
 {
+	m_breakPointAttacher.onThreadExited(m_process, threadID);
+	m_heldThreadIDs.remove_if([&](DWORD id) { return id == threadID; });
+	releaseHeldThreads();
+
 	if (m_mainThreadID != threadID)
 	{
 		//auto threadHandle = m_threadIDMap[threadID];
@@ -572,14 +1557,14 @@ bool ProcessDebugger::onOutputDebugString(const OUTPUT_DEBUG_STRING_INFO* pInfo)
 
 	m_process.readMemory(reinterpret_cast<size_t>(pInfo->lpDebugStringData), pInfo->nDebugStringLength, str.data());
 
-	Console << Unicode::FromUTF8(str);
+	DebugLog::WriteText(LogLevel::Info, LogCategory::Output, U"", Unicode::FromUTF8(str));
 
 	return true;
 }
 
 bool ProcessDebugger::onRipEvent(const RIP_INFO*)
 {
-	Console << U"A RIP_EVENT occured";
+	DebugLog::Write(LogLevel::Warning, LogCategory::Event, U"A RIP_EVENT occured");
 	m_processStatus = ProcessStatus::Interrupted;
 	return false;
 }
@@ -593,5 +1578,8 @@ bool ProcessDebugger::onDllLoaded(const LOAD_DLL_DEBUG_INFO* pInfo)
 bool ProcessDebugger::onDllUnloaded(const UNLOAD_DLL_DEBUG_INFO* pInfo)
 {
 	m_process.onDllUnloaded(pInfo);
+
+	// 同じアドレスに別のモジュールが読み込まれることがあるので、解析済みの命令は捨てる
+	m_functionFlows.clear();
 	return true;
 }
@@ -1,29 +1,65 @@
 ﻿#pragma once
-#include <Windows.h>
 #include <Siv3D.hpp>
+#include "DebugBackend.hpp"
 #include "BreakPointAttacher.hpp"
+#include "BreakPointSession.hpp"
 #include "StepHandler.hpp"
+#include "FunctionFlowCache.hpp"
 #include "ProcessHandle.hpp"
 #include "ThreadHandle.hpp"
+#include "TracepointSink.hpp"
 
 enum class ProcessStatus
 {
 	None, Suspended, Interrupted
 };
 
+enum class PumpStatus
+{
+	Stopped,   // ブレークポイント・ステップ実行・例外で止まった
+	Exited,    // デバッグ対象が終了した
+	Timeout,
+	Cancelled,
+	Failed,
+};
+
+struct PumpResult
+{
+	PumpStatus status = PumpStatus::Timeout;
+
+	// 処理したイベントの数
+	size_t eventCount = 0;
+
+	// 待機せずに続けて処理したイベントの数（バッチごと）
+	Array<size_t> batchSizes;
+};
+
 class ProcessDebugger
 {
 public:
 
-	bool startDebugSession(const FilePathView exeFilePath);
+	ProcessDebugger();
+
+	explicit ProcessDebugger(std::unique_ptr<DebugBackend> backend);
 
+	bool startDebugSession(const FilePathView exeFilePath, const StringView arguments = U"");
+
+	// 次に止まるまでデバッグ対象を実行する
 	void continueDebugSession();
 
+	// 止まっていれば再開し、次に止まるか timeout / キャンセルまでイベントを処理する
+	// キャンセル・タイムアウト時はデバッグ対象は実行されたままで、次の呼び出しで続きを待つ
+	PumpResult pumpDebugEvents(DWORD milliseconds, std::stop_token stopToken = {});
+
+	bool isRunning() const { return m_isRunning; }
+
 	operator bool() const
 	{
 		return m_process.getHandle() != NULL;
 	}
 
+	// 実行中のデバッグ対象を止める。他のスレッド（UI）から呼んでよい
+	// バックエンドの debugBreakProcess だけを呼び、止まった後の処理はデバッグイベントを処理するスレッドが行う
 	void requestDebugBreak();
 	void suspend();
 	void resume();
@@ -32,6 +68,86 @@ public:
 	void stepOver();
 	void stepOut();
 
+	// fileName（パスの末尾, 例: Main.cpp）の lineNumber 行まで実行する（ブレークポイントは残さない）
+	// 行のすべての範囲（インライン展開・複製された先を含む）の先頭に一時ブレークポイントを張り、
+	// どこかで止まったら全部外す。張れたアドレスの数を返す（0 なら何もしない）
+	size_t runToLine(StringView fileName, uint32 lineNumber);
+
+	// ステップイン・ステップオーバーで、行のアドレス範囲から出るところに一時ブレークポイントを張って実行させる
+	// false にすると 1 命令ずつシングルステップする（比較用）
+	void setRangeSteppingEnabled(bool enabled) { m_isRangeSteppingEnabled = enabled; }
+
+	// ステップ実行でライブラリ（ユーザーのソース以外）のコードに入ったら、呼び出し元に戻るか
+	// ユーザーの関数に入るまでブレークポイントで実行させる
+	// false にするとユーザーのコードに戻るまでシングルステップする（比較用）
+	void setJustMyCodeEnabled(bool enabled) { m_isJustMyCodeEnabled = enabled; }
+
+	bool setBreakPoint(size_t address);
+	bool cancelBreakPoint(size_t address);
+
+	// 条件式が成り立つときだけ止まるブレークポイント（すでに張ってあれば条件を付け替える）
+	// 条件式の名前は address のスコープで一度だけ解決する。解釈できなければ false
+	bool setConditionalBreakPoint(size_t address, StringView condition);
+
+	// 当たるたびに message を TracepointSink に出力して止まらずに続けるブレークポイント
+	// message の {式} は当たったときの値に置き換える（式は条件式と同じもの、最大 8 個）
+	// stopAtHitCount を指定するとその回数目に当たったときだけ止まる
+	bool setTracepoint(size_t address, StringView message, uint32 stopAtHitCount = 0);
+
+	// count 回目に当たったときだけ止まるブレークポイント
+	bool setHitCountBreakPoint(size_t address, uint32 count);
+
+	// 当たった回数を数えるだけで止まらないブレークポイント（回数は userBreakPoints() の hitCount）
+	bool setCounterBreakPoint(size_t address);
+
+	// デバッグレジスタを使うブレークポイント（命令を書き換えないので再設定のシングルステップがいらない）
+	// 全スレッドで共通の 4 つの slot のどれかを使い、空きがなければ none
+	Optional<size_t> setHardwareBreakPoint(size_t address);
+
+	// address から size（1, 2, 4, 8）バイトへの書き込み（ReadWrite なら読み込みも）で止まる
+	// address は size に揃っている必要がある
+	Optional<size_t> setWatchPoint(size_t address, size_t size, HardwareBreakPointType type = HardwareBreakPointType::Write);
+
+	bool cancelHardwareBreakPoint(size_t slot);
+
+	const std::array<Optional<HardwareBreakPoint>, MaxHardwareBreakPoints>& hardwareBreakPoints() const { return m_hardwareBreakPoints; }
+
+	TracepointSink& tracepointSink() { return m_tracepointSink; }
+
+	const BreakPointIndex& userBreakPoints() const { return m_breakPointAttacher.getUserBreakPoints(); }
+
+	// 新しく張れた数・外した数を返す
+	size_t setBreakPoints(const Array<size_t>& addresses);
+	size_t cancelBreakPoints(const Array<size_t>& addresses);
+
+	// 名前が pattern（* と ? が使える。例: Game::*Update*）に一致する全関数の先頭にまとめて張る
+	// ファイル単位なら setBreakPoints(process().functionIndex().findInFile(U"Game.cpp")) とする
+	size_t setFunctionBreakPoints(StringView pattern);
+
+	// 一致する全関数の先頭にトレースポイントを張る（message の式は関数ごとに解決する）
+	// 張れた数を返す
+	size_t setFunctionTracepoints(StringView pattern, StringView message);
+
+	size_t cancelFunctionBreakPoints(StringView pattern);
+
+	// fileName（パスの末尾, 例: Main.cpp）の lineNumber 行に張る。張れたアドレスの数を返す
+	// 行が複数の関数に展開されていれば（インライン関数・テンプレート）それぞれに張る
+	size_t setLineBreakPoint(StringView fileName, uint32 lineNumber);
+	size_t cancelLineBreakPoint(StringView fileName, uint32 lineNumber);
+
+	// 行・関数のブレークポイントを path に保存し、次のプロセスがエントリポイントに着いたときに張り直す
+	// デバッグ対象が動いていないときに呼んでも記録だけはする
+	bool loadBreakPointSession(FilePathView path);
+
+	const BreakPointSession& breakPointSession() const { return m_breakPointSession; }
+	BreakPointSession& breakPointSession() { return m_breakPointSession; }
+
+	// ステップ実行で解析した関数の命令
+	const FunctionFlowCache& functionFlows() const { return m_functionFlows; }
+
+	// 最後にエントリポイントで張り直した結果
+	const SessionRestoreResult& lastSessionRestore() const { return m_lastSessionRestore; }
+
 	const ProcessHandle& process() const { return m_process; }
 	ProcessHandle& process() { return m_process; }
 
@@ -41,12 +157,21 @@ public:
 	ProcessStatus status() { return m_processStatus; }
 
 	const String& currentFilename();
+	uint32 currentFileID();
 	int currentLine();
 
 	DWORD mainThreadID() const { return m_mainThreadID; }
 	DWORD userThreadID() const { return m_userMainThreadID; }
 
+	DebugBackend& backend() { return *m_backend; }
+
 private:
+	void resumeDebugSession();
+
+	// バックエンドの呼び出し（往復時間を DebugMetrics に記録する）
+	bool waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds);
+	void continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus);
+
 	bool dispatchDebugEvent(const DEBUG_EVENT* debugEvent);
 
 	bool onProcessCreated(const CREATE_PROCESS_DEBUG_INFO*);
@@ -61,10 +186,46 @@ private:
 	bool onNormalBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID);
 	bool onUserBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID);
 	bool onStepOutBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID);
+	bool onOtherThreadBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID);
+	bool onStepRangeBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID);
+
+	bool onRunToBreakPoint(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID);
+
+	// requestDebugBreak で止まった（要求が済んだ後に届いたものは何もせずに続ける）
+	bool onRequestedBreak(DWORD threadID);
+
+	// threadID がいる行の範囲から出るところに一時ブレークポイントを張る
+	// 行情報がない・解析できない命令がある・今の命令が ret などのときは false（シングルステップで進める）
+	bool beginStepRange(DWORD threadID, bool stepInto);
+
+	// threadID がユーザーのコードの外にいれば、戻り先とユーザーの関数の先頭に一時ブレークポイントを張る
+	bool beginRunToUserCode(DWORD threadID);
+
+	// address の命令が call（直接・間接とも）なら戻り先。int3 で上書きした場所は元のバイトで解析する
+	// 関数の中なら解析済みの命令から答え、メモリは読まない
+	Optional<size_t> findCallReturnAddress(size_t address);
+
+	// ユーザーブレークポイントの種類ごとに、UI に渡して止まるかどうかを決める
+	// context は RIP をブレークポイントのアドレスに戻したもの
+	bool shouldStopAtUserBreakPoint(size_t address, DWORD threadID, const CONTEXT& context);
+	bool shouldStopAtCondition(const BreakPointCondition& condition, const CONTEXT& context);
+	void writeTracepoint(const BreakPointOptions& options, uint32 hitCount, DWORD threadID, const CONTEXT& context);
+
+	// 空いている slot を全スレッドのデバッグレジスタに設定する
+	Optional<size_t> allocateHardwareBreakPoint(const HardwareBreakPoint& breakPoint);
+
+	// 張ってなければ張ってから種類と設定を付ける
+	bool setUserBreakPointOptions(size_t address, BreakPointKind kind, BreakPointOptions options);
 
 	bool onSingleStep(const EXCEPTION_DEBUG_INFO* pInfo, DWORD threadID);
+	bool onHardwareBreakPoint(size_t slot, DWORD threadID);
 	bool handleSingleStep(DWORD threadID);
 
+	// int3 を外して threadID に元の命令を 1 つ実行させている間、他のスレッドを止めておく
+	// 張り直しを待つスレッドがなくなったら releaseHeldThreads で動かす
+	void holdOtherThreads(DWORD threadID);
+	void releaseHeldThreads();
+
 	bool onProcessExited(const EXIT_PROCESS_DEBUG_INFO*);
 	bool onThreadExited(const EXIT_THREAD_DEBUG_INFO*, DWORD threadID);
 	bool onOutputDebugString(const OUTPUT_DEBUG_STRING_INFO*);
@@ -72,11 +233,19 @@ private:
 	bool onDllLoaded(const LOAD_DLL_DEBUG_INFO*);
 	bool onDllUnloaded(const UNLOAD_DLL_DEBUG_INFO*);
 
+	// 行・関数のブレークポイントを記録し、セッションファイルがあれば保存する
+	size_t setSessionBreakPoint(const SessionBreakPoint& breakPoint);
+	size_t cancelSessionBreakPoint(const SessionBreakPoint& breakPoint);
+
+	void restoreBreakPointSession();
+
 	void handledException(bool handled)
 	{
 		m_continueStatus = handled ? DBG_CONTINUE : DBG_EXCEPTION_NOT_HANDLED;
 	}
 
+	std::unique_ptr<DebugBackend> m_backend;
+
 	HashTable<DWORD, ThreadHandle> m_threadIDMap;
 	ProcessHandle m_process;
 	DWORD m_processID = 0;
@@ -87,9 +256,32 @@ private:
 
 	BreakPointAttacher m_breakPointAttacher;
 	StepHandler m_stepHandler;
+	FunctionFlowCache m_functionFlows;
+	TracepointSink m_tracepointSink;
+	BreakPointSession m_breakPointSession;
+	FilePath m_breakPointSessionPath;
+	SessionRestoreResult m_lastSessionRestore;
+	std::array<Optional<HardwareBreakPoint>, MaxHardwareBreakPoints> m_hardwareBreakPoints;
+	bool m_hasHardwareBreakPoints = false;
+
+	// holdOtherThreads で止めたスレッド
+	Array<DWORD> m_heldThreadIDs;
+	bool m_isHoldingThreads = false;
+
+	bool m_isRangeSteppingEnabled = true;
+
+	bool m_isJustMyCodeEnabled = true;
 
 	bool m_alwaysContinue = false;
 	DWORD m_continueStatus = DBG_EXCEPTION_NOT_HANDLED;
 
-	bool m_requestBreak = false;
+	// requestDebugBreak から受け取ったブレークの要求（他のスレッドから書き込まれる）
+	std::atomic<bool> m_requestBreak = false;
+
+	// requestDebugBreak が使うプロセスのハンドル（プロセスがなければ NULL）
+	std::atomic<HANDLE> m_breakableProcess = NULL;
+
+	bool m_isRunning = false;
+
+	Optional<std::chrono::steady_clock::time_point> m_continuedAt;
 };
@@ -1,11 +1,280 @@
-﻿#include <Windows.h>
-#include <DbgHelp.h>
-#include <Siv3D.hpp>
+﻿#include <Siv3D.hpp>
 #include "ProcessHandle.hpp"
 #include "ThreadHandle.hpp"
+#include "DebugBackend.hpp"
+#include "DebugMetrics.hpp"
+#include "DebugLog.hpp"
 #include "UserSourceFiles.hpp"
+
+void ProcessHandle::reset()
+{
+	m_processHandle = NULL;
+	m_userGlobalVariables.clear();
+	m_functionIndex.clear();
+	m_lineTable.clear();
+	m_userCodeRanges.clear();
+	m_userFunctionEntries.clear();
+	discardMemoryCache();
+}
+
+void ProcessHandle::entryFunc(size_t /*address*/)
+{
+}
+
+bool ProcessHandle::readMemory(size_t address, size_t size, LPVOID lpBuffer) const
+{
+	++m_memoryCacheStats.reads;
+
+	const size_t firstPage = (address / MemoryPageSize) * MemoryPageSize;
+	const size_t lastPage = ((address + size - 1) / MemoryPageSize) * MemoryPageSize;
+
+	// 関数の本体のような大きな読み取りはページを埋めずにそのまま読む
+	if (not m_isMemoryCacheEnabled || size == 0 || (firstPage + MemoryPageSize) < lastPage)
+	{
+		++m_memoryCacheStats.directReads;
+		ScopedMetric metric(Metric::ReadMemory);
+		return m_backend->readMemory(m_processHandle, address, size, lpBuffer);
+	}
+
+	bool filled = false;
+	auto* out = static_cast<uint8*>(lpBuffer);
+
+	for (size_t page = firstPage; page <= lastPage; page += MemoryPageSize)
+	{
+		auto it = m_pageCache.find(page);
+		if (it == m_pageCache.end())
+		{
+			Array<uint8> bytes(MemoryPageSize);
+			{
+				ScopedMetric metric(Metric::ReadMemory);
+				if (not m_backend->readMemory(m_processHandle, page, MemoryPageSize, bytes.data()))
+				{
+					bytes.clear();
+				}
+			}
+
+			++m_memoryCacheStats.pageFills;
+			filled = true;
+			it = m_pageCache.emplace(page, std::move(bytes)).first;
+		}
+
+		// ページの一部だけ読める場合もあるので、読めないページを含むときはそのまま読む
+		if (it->second.isEmpty())
+		{
+			++m_memoryCacheStats.directReads;
+			ScopedMetric metric(Metric::ReadMemory);
+			return m_backend->readMemory(m_processHandle, address, size, lpBuffer);
+		}
+
+		const size_t from = Max(address, page);
+		const size_t to = Min(address + size, page + MemoryPageSize);
+		std::memcpy(out + (from - address), it->second.data() + (from - page), (to - from));
+	}
+
+	m_memoryCacheStats.hits += (filled ? 0 : 1);
+	return true;
+}
+
+bool ProcessHandle::readOriginalMemory(size_t address, size_t size, uint8* buffer) const
+{
+	if (not readMemory(address, size, buffer))
+	{
+		return false;
+	}
+
+	if (m_codePatchSource)
+	{
+		m_codePatchSource->restoreOriginalBytes(address, buffer, size);
+	}
+
+	return true;
+}
+
+bool ProcessHandle::writeMemory(size_t address, size_t size, LPCVOID lpBuffer) const
+{
+	bool result = false;
+	{
+		ScopedMetric metric(Metric::WriteMemory);
+		result = m_backend->writeMemory(m_processHandle, address, size, lpBuffer);
+	}
+
+	if (m_pageCache.empty() || size == 0)
+	{
+		return result;
+	}
+
+	// 書き込んだページは、書き込めたら同じ内容に更新し、失敗したら（一部だけ書けたかもしれないので）捨てる
+	const auto* in = static_cast<const uint8*>(lpBuffer);
+	for (size_t page = (address / MemoryPageSize) * MemoryPageSize; page < address + size; page += MemoryPageSize)
+	{
+		const auto it = m_pageCache.find(page);
+		if (it == m_pageCache.end())
+		{
+			continue;
+		}
+
+		if (not result || it->second.isEmpty())
+		{
+			m_pageCache.erase(it);
+			continue;
+		}
+
+		const size_t from = Max(address, page);
+		const size_t to = Min(address + size, page + MemoryPageSize);
+		std::memcpy(it->second.data() + (from - page), in + (from - address), (to - from));
+	}
+
+	return result;
+}
+
+Optional<size_t> ProcessHandle::allocateMemory(size_t nearAddress, size_t size) const
+{
+	size_t address = 0;
+	if (not m_backend->allocateMemory(m_processHandle, nearAddress, size, address))
+	{
+		DebugLog::Write(LogLevel::Warning, LogCategory::Memory, U"デバッグ対象にメモリを確保できません: {}", m_backend->lastError());
+		return none;
+	}
+
+	// 確保した場所を読めないページとして覚えているかもしれない
+	m_pageCache.clear();
+	return address;
+}
+
+void ProcessHandle::startMemoryCache()
+{
+	m_isMemoryCacheEnabled = true;
+}
+
+void ProcessHandle::discardMemoryCache()
+{
+	m_isMemoryCacheEnabled = false;
+	m_pageCache.clear();
+}
+
+Optional<LineInfo> ProcessHandle::getCurrentLineInfo(const ThreadHandle& thread) const
+{
+	auto contextOpt = thread.getContext();
+	if (not contextOpt)
+	{
+		return none;
+	}
+
+	return findLineInfo(contextOpt.value().Rip);
+}
+
+Optional<LineInfo> ProcessHandle::findLineInfo(size_t address) const
+{
+	if (m_lineTable.size() == 0)
+	{
+		return findSymbolLineInfo(address);
+	}
+
+	const auto* line = m_lineTable.findLine(address);
+	if (not line || not m_lineTable.files().isUserFile(line->fileID))
+	{
+		return none;
+	}
+
+	return LineInfo{ line->fileID, line->lineNumber };
+}
+
+void ProcessHandle::registerSourceFiles(const Array<FilePath>& userSourceFiles)
+{
+	auto& files = m_lineTable.files();
+
+	UserSourceFiles::Clear();
+	for (const auto& path : userSourceFiles)
+	{
+		const uint32 fileID = files.intern(path);
+		files.setUserFile(fileID, true);
+		UserSourceFiles::AddFile(fileID, path);
+		DebugLog::WriteText(LogLevel::Debug, LogCategory::Symbol, U"source file: ", path);
+	}
+
+	// ユーザーのファイルの行が続くアドレス範囲
+	// 次の行までだが、関数の終わりは越えない（終わりの印のない最後の行が、後ろのパディングや次の関数まで続かないように）
+	m_userCodeRanges.clear();
+	const auto& lines = m_lineTable.lines();
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		const auto& line = lines[i];
+		if (line.lineNumber == 0 || not files.isUserFile(line.fileID))
+		{
+			continue;
+		}
+
+		size_t end = (i + 1 < lines.size()) ? lines[i + 1].address : SIZE_MAX;
+		if (const auto* function = m_functionIndex.findContaining(line.address))
+		{
+			end = Min(end, function->address + function->size);
+		}
+
+		if (end == SIZE_MAX || end <= line.address)
+		{
+			continue;
+		}
+
+		if (not m_userCodeRanges.isEmpty() && m_userCodeRanges.back().end == line.address)
+		{
+			m_userCodeRanges.back().end = end;
+		}
+		else
+		{
+			m_userCodeRanges.push_back(LineRange{ line.address, end });
+		}
+	}
+
+	// 先頭がユーザーのファイルの関数は、インライン展開されたライブラリの行も含めて関数全体をユーザーのコードにする
+	m_userFunctionEntries.clear();
+	Array<LineRange> functionRanges;
+	for (const auto& entry : m_functionIndex.entries())
+	{
+		if (isUserCode(entry.address))
+		{
+			m_userFunctionEntries.push_back(entry.address);
+			functionRanges.push_back(LineRange{ entry.address, entry.address + Max<size_t>(entry.size, 1) });
+		}
+	}
+	std::sort(m_userFunctionEntries.begin(), m_userFunctionEntries.end());
+	m_userFunctionEntries.erase(std::unique(m_userFunctionEntries.begin(), m_userFunctionEntries.end()), m_userFunctionEntries.end());
+
+	// 重なった範囲をつなげ直す
+	m_userCodeRanges.append(functionRanges);
+	std::sort(m_userCodeRanges.begin(), m_userCodeRanges.end(), [](const LineRange& a, const LineRange& b) { return a.begin < b.begin; });
+	Array<LineRange> merged;
+	for (const auto& range : m_userCodeRanges)
+	{
+		if (not merged.isEmpty() && range.begin <= merged.back().end)
+		{
+			merged.back().end = Max(merged.back().end, range.end);
+		}
+		else
+		{
+			merged.push_back(range);
+		}
+	}
+	m_userCodeRanges = std::move(merged);
+
+	DebugLog::Write(LogLevel::Debug, LogCategory::Symbol, U"user code: {} ranges, {} functions", m_userCodeRanges.size(), m_userFunctionEntries.size());
+}
+
+bool ProcessHandle::isUserCode(size_t address) const
+{
+	const auto it = std::upper_bound(m_userCodeRanges.begin(), m_userCodeRanges.end(), address,
+		[](size_t value, const LineRange& range) { return value < range.begin; });
+
+	return (it != m_userCodeRanges.begin()) && (address < (it - 1)->end);
+}
+
+// ---- ここから DbgHelp によるシンボル処理（Linux 版は ProcessHandleLinux.cpp） ----
+
+#if SIV3D_PLATFORM(WINDOWS)
+
+#include <DbgHelp.h>
 #include "TypeHelper.hpp"
-#include "ProcessHandle.hpp"
+#include "DebugLog.hpp"
+#include "BreakPointCondition.hpp"
 
 namespace
 {
@@ -40,7 +309,7 @@ namespace
 		return context.Rbp + pSymbolInfo->Address;
 	}
 
-	BOOL __stdcall SourceFilesProc(PSOURCEFILEW pSourceFile, PVOID)
+	BOOL __stdcall SourceFilesProc(PSOURCEFILEW pSourceFile, PVOID UserContext)
 	{
 		std::wstring str(pSourceFile->FileName);
 		const auto fileNmae = Unicode::FromWstring(str);
@@ -61,8 +330,8 @@ namespace
 				!fileNmae.contains(UR"(\include\ThirdParty\)")
 				)
 			{
-				UserSourceFiles::AddFile(Unicode::FromWstring(str));
-				Console << Unicode::FromWstring(str);
+				// ID は行番号テーブルを作ってから振る
+				reinterpret_cast<Array<FilePath>*>(UserContext)->push_back(fileNmae);
 			}
 		}
 
@@ -77,6 +346,96 @@ namespace
 		CONTEXT context;
 	};
 
+	struct EnumFunctionsData
+	{
+		HANDLE process;
+		FunctionIndex* index;
+	};
+
+	BOOL CALLBACK EnumFunctionsCallBack(PSYMBOL_INFO pSymInfo, ULONG, PVOID UserContext)
+	{
+		auto pData = reinterpret_cast<EnumFunctionsData*>(UserContext);
+
+		if (pSymInfo->Tag == SymTagEnum::SymTagFunction && pSymInfo->Size != 0)
+		{
+			String fileName;
+
+			DWORD displacement;
+			IMAGEHLP_LINE64 lineInfo = {};
+			lineInfo.SizeOfStruct = sizeof(lineInfo);
+			if (SymGetLineFromAddr64(pData->process, pSymInfo->Address, &displacement, &lineInfo))
+			{
+				fileName = Unicode::FromUTF8(std::string(lineInfo.FileName));
+			}
+
+			pData->index->add(static_cast<size_t>(pSymInfo->Address), pSymInfo->Size, Unicode::FromUTF8(std::string(pSymInfo->Name, pSymInfo->NameLen)), std::move(fileName));
+		}
+
+		return TRUE;
+	}
+
+	struct EnumLinesData
+	{
+		LineTable* table;
+
+		// 同じファイルの行が続くので、直前のファイルと同じなら変換しない
+		std::wstring lastFileName;
+		uint32 lastFileID = 0;
+	};
+
+	BOOL CALLBACK EnumLinesCallBack(PSRCCODEINFOW pLineInfo, PVOID UserContext)
+	{
+		auto pData = reinterpret_cast<EnumLinesData*>(UserContext);
+
+		if (pData->lastFileName != pLineInfo->FileName || pData->table->files().isEmpty())
+		{
+			pData->lastFileName = pLineInfo->FileName;
+			pData->lastFileID = pData->table->addFile(Unicode::FromWstring(pData->lastFileName));
+		}
+
+		// 0xFEEFEE / 0xF00F00 はコンパイラが生成した行（ソースの行に対応しない）
+		const DWORD lineNumber = pLineInfo->LineNumber;
+		const bool isHidden = (lineNumber == 0xFEEFEE || lineNumber == 0xF00F00);
+
+		pData->table->add(static_cast<size_t>(pLineInfo->Address), pData->lastFileID, isHidden ? 0 : lineNumber);
+
+		return TRUE;
+	}
+
+	// StackWalk64 がスタックを読むときもバックエンドを通す（記録の再生ではデバッグ対象のプロセスがない）
+	// ReadMemoryRoutine には引数を渡せないので、フレームを戻している間だけバックエンドを覚えておく
+	thread_local DebugBackend* t_stackWalkBackend = nullptr;
+
+	BOOL CALLBACK StackWalkReadMemory(HANDLE hProcess, DWORD64 address, PVOID buffer, DWORD size, LPDWORD bytesRead)
+	{
+		if (not t_stackWalkBackend || not t_stackWalkBackend->readMemory(hProcess, static_cast<size_t>(address), size, buffer))
+		{
+			return FALSE;
+		}
+
+		if (bytesRead)
+		{
+			*bytesRead = size;
+		}
+		return TRUE;
+	}
+
+	struct ScopedStackWalkBackend
+	{
+		explicit ScopedStackWalkBackend(DebugBackend* backend)
+			: previous(t_stackWalkBackend)
+		{
+			t_stackWalkBackend = backend;
+		}
+
+		~ScopedStackWalkBackend()
+		{
+			t_stackWalkBackend = previous;
+		}
+
+		DebugBackend* previous;
+	};
+
 	BOOL CALLBACK EnumVariablesCallBack(PSYMBOL_INFO pSymInfo, ULONG SymbolSize, PVOID UserContext)
 	{
 		auto pUserData = reinterpret_cast<EnumUserData*>(UserContext);
@@ -125,7 +484,7 @@ namespace
 			{
 				if (!pUserData->systemVarNameList.contains(varName))
 				{
-					Console << U"U\"" << varName << U"\",";
+					DebugLog::WriteText(LogLevel::Debug, LogCategory::Symbol, U"global variable: ", varName);
 
 					VariableInfo varInfo;
 					varInfo.address = GetSymbolAddress(pSymInfo, pUserData->process, pUserData->context);
@@ -290,7 +649,7 @@ namespace
 }
 
 
-ProcessHandle::ProcessHandle(const FilePathView exeFilePath, HANDLE process) :m_processHandle(process)
+ProcessHandle::ProcessHandle(DebugBackend* backend, const FilePathView exeFilePath, HANDLE process) :m_backend(backend), m_processHandle(process)
 {
 	auto filepathW = Unicode::ToWstring(exeFilePath);
 	// Machineタイプの識別
@@ -301,7 +660,7 @@ ProcessHandle::ProcessHandle(const FilePathView exeFilePath, HANDLE process) :m_
 	auto pDosHeader = static_cast<IMAGE_DOS_HEADER*>(pvView);
 	if (pDosHeader->e_magic != IMAGE_DOS_SIGNATURE)
 	{
-		Console << U"Invalid MS-DOS signature.";
+		DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"Invalid MS-DOS signature.");
 	}
 
 	auto pNtHeaders = reinterpret_cast<IMAGE_NT_HEADERS*>(static_cast<LPBYTE>(pvView) + pDosHeader->e_lfanew);
@@ -313,12 +672,6 @@ ProcessHandle::ProcessHandle(const FilePathView exeFilePath, HANDLE process) :m_
 	CloseHandle(hFile);
 }
 
-void ProcessHandle::reset()
-{
-	m_processHandle = NULL;
-	m_userGlobalVariables.clear();
-}
-
 bool ProcessHandle::init(const CREATE_PROCESS_DEBUG_INFO* pInfo)
 {
 	SymSetOptions(SYMOPT_LOAD_LINES);
@@ -340,9 +693,10 @@ bool ProcessHandle::init(const CREATE_PROCESS_DEBUG_INFO* pInfo)
 			moduleInfo.SizeOfStruct = sizeof(IMAGEHLP_MODULE64);
 			if (SymGetModuleInfo64(m_processHandle, moduleAddress, &moduleInfo) && moduleInfo.SymType == SYM_TYPE::SymPdb)
 			{
-				if (not SymEnumSourceFilesW(m_processHandle, (DWORD64)pInfo->lpBaseOfImage, NULL, SourceFilesProc, this))
+				Array<FilePath> userSourceFiles;
+				if (not SymEnumSourceFilesW(m_processHandle, (DWORD64)pInfo->lpBaseOfImage, NULL, SourceFilesProc, &userSourceFiles))
 				{
-					Console << U"SymEnumSourceFilesW failed: " << GetLastError();
+					DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymEnumSourceFilesW failed: {}", GetLastError());
 				}
 
 				// グローバル変数リストの取得
@@ -359,37 +713,86 @@ bool ProcessHandle::init(const CREATE_PROCESS_DEBUG_INFO* pInfo)
 					}
 					else
 					{
-						Console << U"SymEnumSymbols failed: " << GetLastError();
+						DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymEnumSymbols failed: {}", GetLastError());
 					}
 				}
+
+				// 関数の索引（パターンでまとめてブレークポイントを張る用）
+				{
+					const auto start = std::chrono::steady_clock::now();
+
+					m_functionIndex.clear();
+					EnumFunctionsData functionsData{ m_processHandle, &m_functionIndex };
+					if (not SymEnumSymbols(m_processHandle, (DWORD64)pInfo->lpBaseOfImage, NULL, EnumFunctionsCallBack, &functionsData))
+					{
+						DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymEnumSymbols failed: {}", GetLastError());
+					}
+					m_functionIndex.build();
+
+					m_functionIndexBuildTime = std::chrono::steady_clock::now() - start;
+					DebugLog::Write(LogLevel::Debug, LogCategory::Symbol, U"function index: {} functions, {} us", m_functionIndex.size(),
+						std::chrono::duration_cast<std::chrono::microseconds>(m_functionIndexBuildTime).count());
+				}
+
+				// 行番号テーブル（保存しておいたブレークポイントをファイル:行から張り直す用）
+				{
+					const auto start = std::chrono::steady_clock::now();
+
+					m_lineTable.clear();
+					EnumLinesData linesData{ &m_lineTable };
+					if (not SymEnumLinesW(m_processHandle, (DWORD64)pInfo->lpBaseOfImage, NULL, NULL, EnumLinesCallBack, &linesData))
+					{
+						DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymEnumLinesW failed: {}", GetLastError());
+					}
+
+					// DbgHelp の行には範囲の終わりがないので、関数の終わりに終わりの印（行番号 0）を入れる
+					// （入れないと関数の最後の行が次の関数やパディングまで続いていることになる）
+					for (const auto& function : m_functionIndex.entries())
+					{
+						m_lineTable.add(function.address + function.size, 0, 0);
+					}
+					m_lineTable.build();
+					registerSourceFiles(userSourceFiles);
+
+					m_lineTableBuildTime = std::chrono::steady_clock::now() - start;
+					DebugLog::Write(LogLevel::Debug, LogCategory::Symbol, U"line table: {} lines, {} files, {} us", m_lineTable.size(), m_lineTable.files().size(),
+						std::chrono::duration_cast<std::chrono::microseconds>(m_lineTableBuildTime).count());
+				}
 			}
 			return true;
 		}
 		else
 		{
-			Console << U"SymLoadModule64 failed: " << GetLastError();
+			DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymLoadModule64 failed: {}", GetLastError());
 			return false;
 		}
 	}
 	else
 	{
-		Console << U"SymInitialize failed: " << GetLastError();
+		DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymInitialize failed: {}", GetLastError());
 		return false;
 	}
 }
 
-void ProcessHandle::entryFunc(size_t /*address*/)
-{
-}
-
 void ProcessHandle::dispose()
 {
 	SymCleanup(m_processHandle);
 	m_processHandle = NULL;
+	m_functionIndex.clear();
+	m_lineTable.clear();
+	m_userCodeRanges.clear();
+	m_userFunctionEntries.clear();
+	discardMemoryCache();
 }
 
 void ProcessHandle::onDllLoaded(const LOAD_DLL_DEBUG_INFO* pInfo) const
 {
+	// 記録の再生時はファイルハンドルがない
+	if (pInfo->hFile == NULL)
+	{
+		return;
+	}
+
 	DWORD64 moduleAddress = SymLoadModule64(
 		m_processHandle,
 		pInfo->hFile,
@@ -401,7 +804,7 @@ void ProcessHandle::onDllLoaded(const LOAD_DLL_DEBUG_INFO* pInfo) const
 
 	if (moduleAddress == 0)
 	{
-		Console << U"SymLoadModule64 failed: " << GetLastError();
+		DebugLog::Write(LogLevel::Error, LogCategory::Symbol, U"SymLoadModule64 failed: {}", GetLastError());
 	}
 
 	CloseHandle(pInfo->hFile);
@@ -423,76 +826,7 @@ Optional<size_t> ProcessHandle::findAddress(const String& symbolName) const
 	return none;
 }
 
-Optional<size_t> ProcessHandle::tryGetCallInstructionBytesLength(size_t address) const
-{
-	std::uint8_t instruction[10];
-
-	size_t numOfBytes;
-	auto pAddress = reinterpret_cast<LPVOID>(address);
-	ReadProcessMemory(
-		m_processHandle,
-		pAddress,
-		instruction,
-		sizeof(instruction) / sizeof(std::uint8_t),
-		&numOfBytes);
-
-	switch (instruction[0])
-	{
-	case 0xE8:
-		return 5;
-
-	case 0x9A:
-		return 7;
-
-	case 0xFF:
-		switch (instruction[1])
-		{
-		case 0x10:
-		case 0x11:
-		case 0x12:
-		case 0x13:
-		case 0x16:
-		case 0x17:
-		case 0xD0:
-		case 0xD1:
-		case 0xD2:
-		case 0xD3:
-		case 0xD4:
-		case 0xD5:
-		case 0xD6:
-		case 0xD7:
-			return 2;
-
-		case 0x14:
-		case 0x50:
-		case 0x51:
-		case 0x52:
-		case 0x53:
-		case 0x54:
-		case 0x55:
-		case 0x56:
-		case 0x57:
-			return 3;
-
-		case 0x15:
-		case 0x90:
-		case 0x91:
-		case 0x92:
-		case 0x93:
-		case 0x95:
-		case 0x96:
-		case 0x97:
-			return 6;
-
-		case 0x94:
-			return 7;
-		}
-	default:
-		return none;
-	}
-}
-
-Optional<size_t> ProcessHandle::getRetInstructionAddress(const ThreadHandle& thread) const
+Optional<ReturnFrame> ProcessHandle::getReturnFrame(const ThreadHandle& thread) const
 {
 	auto contextOpt = thread.getContext();
 	if (not contextOpt)
@@ -500,67 +834,46 @@ Optional<size_t> ProcessHandle::getRetInstructionAddress(const ThreadHandle& thr
 		return none;
 	}
 
-	const auto& context = contextOpt.value();
-
-	DWORD64 displacement;
-	SYMBOL_INFO symbol = {};
-	symbol.SizeOfStruct = sizeof(SYMBOL_INFO);
-
-	if (not SymFromAddr(
-		m_processHandle,
-		context.Rip,
-		&displacement,
-		&symbol))
+	auto& context = contextOpt.value();
+	STACKFRAME64 stackFrame = {};
+	stackFrame.AddrPC.Mode = AddrModeFlat;
+	stackFrame.AddrPC.Offset = context.Rip;
+	stackFrame.AddrStack.Mode = AddrModeFlat;
+	stackFrame.AddrStack.Offset = context.Rsp;
+	stackFrame.AddrFrame.Mode = AddrModeFlat;
+	stackFrame.AddrFrame.Offset = context.Rbp;
+
+	// x64 の StackWalk64 は SymFunctionTableAccess64 で引いた .pdata / .xdata の UNWIND_INFO でフレームを戻す
+	// 1 回目が今のフレーム、2 回目が呼び出し元のフレーム（PC が戻り先、スタックが戻ったときの RSP）
+	const ScopedStackWalkBackend stackWalkBackend(m_backend);
+	for (int frame = 0; frame < 2; ++frame)
 	{
-		return none;
-	}
-
-	// symbol.Address: 関数の最初の命令アドレス, symbol.Size: 関数の全ての命令のバイト長
-	const size_t endAddress = symbol.Address + symbol.Size;
-
-	if (auto lenOpt = retInstructionLength(endAddress - 3); lenOpt && lenOpt.value() == 3)
-	{
-		return endAddress - lenOpt.value();
-	}
-
-	if (auto lenOpt = retInstructionLength(endAddress - 1); lenOpt && lenOpt.value() == 1)
-	{
-		return endAddress - lenOpt.value();
-	}
-
-	return none;
-}
-
-Optional<size_t> ProcessHandle::retInstructionLength(size_t address) const
-{
-	std::uint8_t readByte;
-	size_t numOfBytes;
-	auto pAddress = reinterpret_cast<LPVOID>(address);
-	ReadProcessMemory(m_processHandle, pAddress, &readByte, 1, &numOfBytes);
-
-	if (readByte == 0xC3 || readByte == 0xCB)
-	{
-		return 1;
+		if (not StackWalk64(
+			m_machineType,
+			m_processHandle,
+			thread.getHandle(),
+			&stackFrame,
+			&context,
+			StackWalkReadMemory,
+			SymFunctionTableAccess64,
+			SymGetModuleBase64,
+			NULL))
+		{
+			DebugLog::Write(LogLevel::Debug, LogCategory::Step, U"StackWalk64 failed: {}", GetLastError());
+			return none;
+		}
 	}
 
-	if (readByte == 0xC2 || readByte == 0xCA)
+	if (stackFrame.AddrPC.Offset == 0)
 	{
-		return 3;
+		return none;
 	}
 
-	return none;
+	return ReturnFrame{ static_cast<size_t>(stackFrame.AddrPC.Offset), static_cast<size_t>(stackFrame.AddrStack.Offset) };
 }
 
-Optional<LineInfo> ProcessHandle::getCurrentLineInfo(const ThreadHandle& thread) const
+Optional<LineInfo> ProcessHandle::findSymbolLineInfo(size_t address) const
 {
-	auto contextOpt = thread.getContext();
-	if (not contextOpt)
-	{
-		return none;
-	}
-
-	const auto context = contextOpt.value();
-
 	DWORD displacement;
 	IMAGEHLP_LINE64 lineInfo = {};
 	lineInfo.SizeOfStruct = sizeof(lineInfo);
@@ -568,41 +881,283 @@ Optional<LineInfo> ProcessHandle::getCurrentLineInfo(const ThreadHandle& thread)
 	if (SymGetLineFromAddr64(
 		//process,
 		m_processHandle,
-		context.Rip,
+		address,
 		&displacement,
 		&lineInfo))
 	{
-		LineInfo currentLineInfo;
-		currentLineInfo.fileName = Unicode::FromUTF8(std::string(lineInfo.FileName));
-		currentLineInfo.lineNumber = lineInfo.LineNumber;
-		if (not currentLineInfo.fileName.ends_with(U"Main.cpp"))
+		const auto fileID = m_lineTable.files().find(Unicode::FromUTF8(std::string(lineInfo.FileName)));
+		if (not fileID || not m_lineTable.files().isUserFile(*fileID))
 		{
 			return none;
 		}
-		return currentLineInfo;
+		return LineInfo{ *fileID, static_cast<uint32>(lineInfo.LineNumber) };
 	}
 	else
 	{
-		Console << U"error: " << GetLastError();
+		DebugLog::Write(LogLevel::Trace, LogCategory::Symbol, U"SymGetLineFromAddr64 failed: {}", GetLastError());
 	}
 
 	return none;
 }
 
-bool ProcessHandle::readMemory(size_t address, size_t size, LPVOID lpBuffer) const
+namespace
 {
-	size_t numOfBytes;
-	auto pAddress = reinterpret_cast<LPVOID>(address);
-	return ReadProcessMemory(m_processHandle, pAddress, lpBuffer, size, &numOfBytes);
+	// CodeView のレジスタ番号（cvconst.h の CV_AMD64_RBP / CV_AMD64_RSP）
+	constexpr ULONG CvAmd64Rbp = 334;
+	constexpr ULONG CvAmd64Rsp = 335;
+
+	ConditionValueType ToConditionValueType(CBaseTypeEnum type)
+	{
+		switch (type)
+		{
+		case cbtBool:      return ConditionValueType::Bool;
+		case cbtChar:      return ConditionValueType::Int8;
+		case cbtUChar:     return ConditionValueType::UInt8;
+		case cbtWChar:     return ConditionValueType::UInt16;
+		case cbtShort:     return ConditionValueType::Int16;
+		case cbtUShort:    return ConditionValueType::UInt16;
+		case cbtInt:       return ConditionValueType::Int32;
+		case cbtUInt:      return ConditionValueType::UInt32;
+		case cbtLong:      return ConditionValueType::Int32;
+		case cbtULong:     return ConditionValueType::UInt32;
+		case cbtLongLong:  return ConditionValueType::Int64;
+		case cbtULongLong: return ConditionValueType::UInt64;
+		case cbtFloat:     return ConditionValueType::Float;
+		case cbtDouble:    return ConditionValueType::Double;
+		default:           return ConditionValueType::None;
+		}
+	}
+
+	// SymEnumSymbols で見つけたローカル変数
+	struct FoundLocal
+	{
+		std::string name;
+		bool found = false;
+		ULONG flags = 0;
+		ULONG registerID = 0;
+		ULONG64 address = 0;
+		ULONG typeIndex = 0;
+		ULONG64 modBase = 0;
+	};
+
+	BOOL CALLBACK FindLocalCallBack(PSYMBOL_INFO pSymInfo, ULONG, PVOID UserContext)
+	{
+		auto pFound = reinterpret_cast<FoundLocal*>(UserContext);
+
+		if (pSymInfo->Tag != SymTagEnum::SymTagData || pFound->name != std::string_view(pSymInfo->Name, pSymInfo->NameLen))
+		{
+			return TRUE;
+		}
+
+		pFound->found = true;
+		pFound->flags = pSymInfo->Flags;
+		pFound->registerID = pSymInfo->Register;
+		pFound->address = pSymInfo->Address;
+		pFound->typeIndex = pSymInfo->TypeIndex;
+		pFound->modBase = pSymInfo->ModBase;
+		return FALSE;
+	}
+
+	// DbgHelp の型情報で、ローカル変数（RBP/RSP 相対）・グローバル変数・メンバーを解決する
+	// 関数の先頭の命令ではまだフレームができていないので、ローカル変数は正しく読めない
+	class DbgHelpConditionResolver : public ConditionSymbolResolver
+	{
+	public:
+
+		DbgHelpConditionResolver(const ProcessHandle& process, size_t address)
+			: m_process(process)
+			, m_address(address) {}
+
+		Optional<ConditionSymbol> findVariable(StringView name) const override
+		{
+			const HANDLE processHandle = m_process.getHandle();
+			const std::string utf8Name = Unicode::ToUTF8(name);
+
+			// address のスコープのローカル変数・引数
+			IMAGEHLP_STACK_FRAME stackFrame = {};
+			stackFrame.InstructionOffset = m_address;
+			if (SymSetContext(processHandle, &stackFrame, NULL) || GetLastError() == ERROR_SUCCESS)
+			{
+				FoundLocal local;
+				local.name = utf8Name;
+				SymEnumSymbols(processHandle, 0, utf8Name.c_str(), FindLocalCallBack, &local);
+
+				if (local.found && (local.flags & SYMFLAG_REGREL))
+				{
+					if (local.registerID != CvAmd64Rbp && local.registerID != CvAmd64Rsp)
+					{
+						return none;
+					}
+
+					m_modBase = local.modBase;
+					auto symbol = fromType(local.typeIndex);
+					symbol.registerOffset = static_cast<uint16>((local.registerID == CvAmd64Rbp) ? offsetof(CONTEXT, Rbp) : offsetof(CONTEXT, Rsp));
+					symbol.offset = static_cast<int64>(local.address);
+					return symbol;
+				}
+			}
+
+			// グローバル変数
+			alignas(SYMBOL_INFO) char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME * sizeof(CHAR)] = {};
+			auto pSymbol = reinterpret_cast<PSYMBOL_INFO>(buffer);
+			pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+			pSymbol->MaxNameLen = MAX_SYM_NAME;
+
+			if (SymFromName(processHandle, utf8Name.c_str(), pSymbol)
+				&& pSymbol->Tag == SymTagEnum::SymTagData
+				&& (pSymbol->Flags & (SYMFLAG_REGREL | SYMFLAG_REGISTER)) == 0)
+			{
+				m_modBase = pSymbol->ModBase;
+				auto symbol = fromType(pSymbol->TypeIndex);
+				symbol.offset = static_cast<int64>(pSymbol->Address);
+				return symbol;
+			}
+
+			return none;
+		}
+
+		Optional<ConditionSymbol> findMember(const ConditionSymbol& parent, StringView name) const override
+		{
+			return findMemberIn(parent.typeID, Unicode::ToWstring(name), 0);
+		}
+
+		Optional<ConditionSymbol> findPointee(const ConditionSymbol& pointer) const override
+		{
+			if (pointer.pointeeTypeID == 0)
+			{
+				return none;
+			}
+			return fromType(pointer.pointeeTypeID);
+		}
+
+	private:
+
+		ConditionSymbol fromType(ULONG typeID) const
+		{
+			const HANDLE processHandle = m_process.getHandle();
+
+			ConditionSymbol symbol;
+			symbol.typeID = typeID;
+
+			DWORD tag = 0;
+			SymGetTypeInfo(processHandle, m_modBase, typeID, TI_GET_SYMTAG, &tag);
+
+			switch (tag)
+			{
+			case SymTagBaseType:
+				symbol.type = ToConditionValueType(GetCBaseType(m_process, typeID, m_modBase));
+				break;
+
+			case SymTagPointerType:
+			{
+				DWORD pointeeTypeID = 0;
+				SymGetTypeInfo(processHandle, m_modBase, typeID, TI_GET_TYPEID, &pointeeTypeID);
+				symbol.type = ConditionValueType::Pointer;
+				symbol.pointeeTypeID = pointeeTypeID;
+				break;
+			}
+
+			case SymTagEnum:
+			{
+				ULONG64 length = 0;
+				SymGetTypeInfo(processHandle, m_modBase, typeID, TI_GET_LENGTH, &length);
+				symbol.type = (length == 1) ? ConditionValueType::Int8
+					: (length == 2) ? ConditionValueType::Int16
+					: (length == 8) ? ConditionValueType::Int64
+					: ConditionValueType::Int32;
+				break;
+			}
+
+			default:
+				break;
+			}
+
+			return symbol;
+		}
+
+		// 基底クラスもたどる
+		Optional<ConditionSymbol> findMemberIn(ULONG typeID, const std::wstring& name, int64 baseOffset) const
+		{
+			const HANDLE processHandle = m_process.getHandle();
+
+			DWORD memberCount = 0;
+			if (not SymGetTypeInfo(processHandle, m_modBase, typeID, TI_GET_CHILDRENCOUNT, &memberCount) || memberCount == 0)
+			{
+				return none;
+			}
+
+			Array<uint8> paramsBuffer(sizeof(TI_FINDCHILDREN_PARAMS) + memberCount * sizeof(ULONG));
+			auto pFindParams = reinterpret_cast<TI_FINDCHILDREN_PARAMS*>(paramsBuffer.data());
+			pFindParams->Start = 0;
+			pFindParams->Count = memberCount;
+
+			if (not SymGetTypeInfo(processHandle, m_modBase, typeID, TI_FINDCHILDREN, pFindParams))
+			{
+				return none;
+			}
+
+			for (DWORD index = 0; index < memberCount; ++index)
+			{
+				const ULONG memberID = pFindParams->ChildId[index];
+
+				DWORD memberTag = 0;
+				SymGetTypeInfo(processHandle, m_modBase, memberID, TI_GET_SYMTAG, &memberTag);
+
+				DWORD memberTypeID = 0;
+				SymGetTypeInfo(processHandle, m_modBase, memberID, TI_GET_TYPEID, &memberTypeID);
+
+				// static メンバーはオフセットを持たないので除かれる
+				DWORD offset = 0;
+				if (not SymGetTypeInfo(processHandle, m_modBase, memberID, TI_GET_OFFSET, &offset))
+				{
+					continue;
+				}
+
+				if (memberTag == SymTagBaseClass)
+				{
+					if (auto found = findMemberIn(memberTypeID, name, baseOffset + offset))
+					{
+						return found;
+					}
+					continue;
+				}
+
+				if (memberTag != SymTagData)
+				{
+					continue;
+				}
+
+				WCHAR* memberName = nullptr;
+				if (not SymGetTypeInfo(processHandle, m_modBase, memberID, TI_GET_SYMNAME, &memberName) || not memberName)
+				{
+					continue;
+				}
+
+				const bool matched = (name == memberName);
+				LocalFree(memberName);
+
+				if (matched)
+				{
+					auto symbol = fromType(memberTypeID);
+					symbol.offset = baseOffset + offset;
+					return symbol;
+				}
+			}
+
+			return none;
+		}
+
+		const ProcessHandle& m_process;
+
+		size_t m_address;
+
+		mutable ULONG64 m_modBase = 0;
+	};
 }
 
-bool ProcessHandle::writeMemory(size_t address, size_t size, LPCVOID lpBuffer) const
+std::unique_ptr<ConditionSymbolResolver> ProcessHandle::createConditionResolver(size_t address) const
 {
-	size_t numOfBytes;
-	auto pAddress = reinterpret_cast<LPVOID>(address);
-	auto success1 = WriteProcessMemory(m_processHandle, pAddress, lpBuffer, size, &numOfBytes);
-	auto success2 = FlushInstructionCache(m_processHandle, pAddress, size);
-	return success1 && success2;
+	return std::make_unique<DbgHelpConditionResolver>(*this, address);
 }
 
 String printHex(size_t value, bool hasPrefix)
@@ -709,6 +1264,7 @@ void ProcessHandle::fetchCallstack(const ThreadHandle& thread)
 		stackFrame.AddrFrame.Mode = AddrModeFlat;
 		stackFrame.AddrFrame.Offset = context.Rbp;
 
+		const ScopedStackWalkBackend stackWalkBackend(m_backend);
 		while (true)
 		{
 			if (not StackWalk64(
@@ -717,7 +1273,7 @@ void ProcessHandle::fetchCallstack(const ThreadHandle& thread)
 				thread.getHandle(),
 				&stackFrame,
 				&context,
-				NULL,
+				StackWalkReadMemory,
 				SymFunctionTableAccess64,
 				SymGetModuleBase64,
 				NULL))
@@ -749,3 +1305,5 @@ void ProcessHandle::fetchCallstack(const ThreadHandle& thread)
 		}
 	}
 }
+
+#endif
@@ -1,13 +1,52 @@
 ﻿#pragma once
-#include <Windows.h>
+#include "DebugTypes.hpp"
+#include "ElfModule.hpp"
+#include "FunctionIndex.hpp"
+#include "LineTable.hpp"
 
+// ファイルは行番号テーブルの SourceFileTable の ID（パスは ProcessHandle::lineTable().files() から引く）
 struct LineInfo
 {
-	String fileName;
-	size_t lineNumber;
+	uint32 fileID = SourceFileTable::InvalidID;
+	uint32 lineNumber = 0;
+};
+
+// 今の関数から戻る先
+struct ReturnFrame
+{
+	// 呼び出し元の call の次の命令
+	size_t returnAddress;
+
+	// 戻ったときの RSP（CFA）。再帰呼び出しで同じ戻り先に深いフレームから戻ったものと見分ける
+	size_t stackPointer;
 };
 
 class ThreadHandle;
+class DebugBackend;
+class ConditionSymbolResolver;
+
+// デバッガがコードに書き込んだ int3 を元のバイトに戻す（BreakPointAttacher が実装する）
+class CodePatchSource
+{
+public:
+
+	virtual ~CodePatchSource() = default;
+
+	// address から size バイトの bytes のうち、int3 で上書きしてある場所を元のバイトにする
+	virtual void restoreOriginalBytes(size_t address, uint8* bytes, size_t size) const = 0;
+};
+
+// 止まっている間のメモリの読み取りの内訳
+struct MemoryCacheStats
+{
+	// readMemory の呼び出し回数と、そのうちデバッグ対象を読まずに済んだ回数
+	uint64 reads = 0;
+	uint64 hits = 0;
+
+	// デバッグ対象を読んだ回数（ページを埋めた回数と、キャッシュを通さずに読んだ回数）
+	uint64 pageFills = 0;
+	uint64 directReads = 0;
+};
 
 struct VariableInfo
 {
@@ -24,7 +63,7 @@ public:
 
 	ProcessHandle() = default;
 
-	ProcessHandle(const FilePathView exeFilePath, HANDLE process);
+	ProcessHandle(DebugBackend* backend, const FilePathView exeFilePath, HANDLE process);
 
 	void reset();
 
@@ -40,16 +79,46 @@ public:
 
 	Optional<size_t> findAddress(const String& symbolName) const;
 
-	Optional<size_t> tryGetCallInstructionBytesLength(size_t address) const;
+	// 実行ファイルの全関数の索引（init で作る）
+	const FunctionIndex& functionIndex() const { return m_functionIndex; }
+
+	// 索引を作るのにかかった時間（行情報の取得を含む）
+	std::chrono::nanoseconds functionIndexBuildTime() const { return m_functionIndexBuildTime; }
 
-	Optional<size_t> getRetInstructionAddress(const ThreadHandle& thread) const;
+	// 実行ファイルの行番号テーブル（init で作る）
+	const LineTable& lineTable() const { return m_lineTable; }
 
-	Optional<size_t> retInstructionLength(size_t address) const;
+	std::chrono::nanoseconds lineTableBuildTime() const { return m_lineTableBuildTime; }
+
+	// アンワインド情報（Windows は .pdata / .xdata、Linux は .eh_frame）から呼び出し元に戻る先を求める
+	Optional<ReturnFrame> getReturnFrame(const ThreadHandle& thread) const;
 
 	Optional<LineInfo> getCurrentLineInfo(const ThreadHandle& thread) const;
 
+	// address の行（ユーザーのソース以外なら none）
+	// 行番号テーブルから引き、テーブルを作れなかったときだけシンボルから引く
+	Optional<LineInfo> findLineInfo(size_t address) const;
+
+	// 行番号テーブルを使わずに DbgHelp（Linux では ElfModule）から引く（ファイルの ID は行番号テーブルのもの）
+	Optional<LineInfo> findSymbolLineInfo(size_t address) const;
+
+	// ID のファイルのパス（わからなければ空文字列）
+	const String& sourceFilePath(uint32 fileID) const { return m_lineTable.files().path(fileID); }
+
+	// address がユーザーのソースのコードか（ライブラリ・CRT・DLL・行情報のないコードなら false）
+	// ユーザーの関数にインライン展開されたライブラリのコードは true
+	bool isUserCode(size_t address) const;
+
+	// ユーザーのソースにある関数の先頭（アドレス順）
+	// ライブラリのコードを実行させている間に、コールバックなどでユーザーのコードに入ったら止まれるようにする
+	const Array<size_t>& userFunctionEntries() const { return m_userFunctionEntries; }
+
+	// address で止まったときに見える変数の名前を解決する（条件付きブレークポイントの条件式用）
+	std::unique_ptr<ConditionSymbolResolver> createConditionResolver(size_t address) const;
+
 	HANDLE getHandle() const { return m_processHandle; }
 
+	// 止まっている間はページのキャッシュから読む（startMemoryCache を参照）
 	bool readMemory(size_t address, size_t size, LPVOID lpBuffer) const;
 
 	template<typename T>
@@ -58,6 +127,10 @@ public:
 		return readMemory(address, sizeof(T), &buffer);
 	}
 
+	// readMemory と同じだが、デバッガが書き込んだ int3 は元のバイトに戻して返す（命令を解析する用）
+	bool readOriginalMemory(size_t address, size_t size, uint8* buffer) const;
+
+	// キャッシュしてあるページにも書き込む
 	bool writeMemory(size_t address, size_t size, LPCVOID lpBuffer) const;
 
 	template<typename T>
@@ -66,6 +139,22 @@ public:
 		return writeMemory(address, sizeof(T), &buffer);
 	}
 
+	// デバッグ対象に読み書き・実行できるメモリを確保する（nearAddress の ±2GB 以内を優先する）
+	Optional<size_t> allocateMemory(size_t nearAddress, size_t size) const;
+
+	// デバッグイベントで止まっている間、読んだメモリを 4 KiB のページ単位で覚えておく
+	// 命令の解析や変数の表示は数バイトずつ何度も読むので、同じページは 1 回の読み取りで済ませる
+	// 止まったら startMemoryCache、再開する前に discardMemoryCache を呼ぶ（実行中はデバッグ対象が書き換えるので使わない）
+	void startMemoryCache();
+
+	void discardMemoryCache();
+
+	const MemoryCacheStats& memoryCacheStats() const { return m_memoryCacheStats; }
+
+	void setCodePatchSource(const CodePatchSource* source) { m_codePatchSource = source; }
+
+	static constexpr size_t MemoryPageSize = 4096;
+
 	void fetchGlobalVariables();
 
 	void fetchLocalVariables(const ThreadHandle& thread);
@@ -79,8 +168,30 @@ public:
 
 private:
 
+	// 行番号テーブルを作ったあとで、ユーザーのソースのファイルに印を付けて読み込んでおき、
+	// ユーザーのコードのアドレス範囲と関数の先頭を求めておく（モジュールごとに 1 回）
+	void registerSourceFiles(const Array<FilePath>& userSourceFiles);
+
+	DebugBackend* m_backend = nullptr;
 	HANDLE m_processHandle = NULL;
 	Array<VariableInfo> m_userGlobalVariables;
 	String m_debugString;
 	WORD m_machineType = 0;
+	FunctionIndex m_functionIndex;
+	std::chrono::nanoseconds m_functionIndexBuildTime{ 0 };
+	LineTable m_lineTable;
+	std::chrono::nanoseconds m_lineTableBuildTime{ 0 };
+	Array<LineRange> m_userCodeRanges; // アドレス順、隣り合う範囲はつなげてある
+	Array<size_t> m_userFunctionEntries;
+
+	// ページの先頭 → 中身（読めなかったページは空）
+	mutable HashTable<size_t, Array<uint8>> m_pageCache;
+	mutable MemoryCacheStats m_memoryCacheStats;
+	bool m_isMemoryCacheEnabled = false;
+	const CodePatchSource* m_codePatchSource = nullptr;
+
+#if SIV3D_PLATFORM(LINUX)
+	FilePath m_exeFilePath;
+	ElfModule m_module;
+#endif
 };
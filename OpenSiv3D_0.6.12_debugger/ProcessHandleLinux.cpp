@@ -0,0 +1,283 @@
+﻿#include <Siv3D.hpp>
+#include "ProcessHandle.hpp"
+#include "ThreadHandle.hpp"
+#include "DebugLog.hpp"
+#include "BreakPointCondition.hpp"
+
+// ProcessHandle のシンボル処理の Linux 版
+// DbgHelp の代わりに ElfModule（.symtab と .debug_line）を使う
+
+#if SIV3D_PLATFORM(LINUX)
+
+namespace
+{
+	bool IsUserSourceFile(const String& fileName)
+	{
+		return (fileName.ends_with(U".cpp") || fileName.ends_with(U".hpp"))
+			&& not fileName.starts_with(U"/usr/")
+			&& not fileName.contains(U"/include/Siv3D/")
+			&& not fileName.contains(U"/include/ThirdParty/");
+	}
+
+	// .symtab のグローバル変数だけを解決する
+	// 型の情報は読んでいないので、大きさが 1/2/4/8 バイトの変数を符号付き整数として扱う
+	class ElfConditionResolver : public ConditionSymbolResolver
+	{
+	public:
+
+		explicit ElfConditionResolver(const ElfModule& module)
+			: m_module(module) {}
+
+		Optional<ConditionSymbol> findVariable(StringView name) const override
+		{
+			const auto* variable = m_module.findVariable(name);
+			if (not variable)
+			{
+				return none;
+			}
+
+			ConditionSymbol symbol;
+			symbol.offset = static_cast<int64>(variable->address);
+
+			switch (variable->size)
+			{
+			case 1: symbol.type = ConditionValueType::Int8; break;
+			case 2: symbol.type = ConditionValueType::Int16; break;
+			case 4: symbol.type = ConditionValueType::Int32; break;
+			case 8: symbol.type = ConditionValueType::Int64; break;
+			default: break;
+			}
+
+			return symbol;
+		}
+
+		Optional<ConditionSymbol> findMember(const ConditionSymbol&, StringView) const override
+		{
+			return none;
+		}
+
+		Optional<ConditionSymbol> findPointee(const ConditionSymbol&) const override
+		{
+			return none;
+		}
+
+	private:
+
+		const ElfModule& m_module;
+	};
+}
+
+ProcessHandle::ProcessHandle(DebugBackend* backend, const FilePathView exeFilePath, HANDLE process)
+	: m_backend(backend)
+	, m_processHandle(process)
+	, m_machineType(IMAGE_FILE_MACHINE_AMD64)
+	, m_exeFilePath(exeFilePath)
+{
+}
+
+bool ProcessHandle::init(const CREATE_PROCESS_DEBUG_INFO* pInfo)
+{
+	if (not m_module.load(m_exeFilePath, reinterpret_cast<size_t>(pInfo->lpBaseOfImage)))
+	{
+		DebugLog::WriteText(LogLevel::Error, LogCategory::Symbol, U"ELF の読み込みに失敗しました: ", m_exeFilePath);
+		return false;
+	}
+
+	// 関数の索引（パターンでまとめてブレークポイントを張る用）
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		m_functionIndex.clear();
+		for (const auto& function : m_module.functions())
+		{
+			if (function.size == 0)
+			{
+				continue;
+			}
+
+			const auto line = m_module.findLine(function.address);
+			m_functionIndex.add(function.address, function.size, function.name, (line ? m_module.files()[line->fileIndex] : String{}));
+		}
+		m_functionIndex.build();
+
+		m_functionIndexBuildTime = std::chrono::steady_clock::now() - start;
+		DebugLog::Write(LogLevel::Debug, LogCategory::Symbol, U"function index: {} functions, {} us", m_functionIndex.size(),
+			std::chrono::duration_cast<std::chrono::microseconds>(m_functionIndexBuildTime).count());
+	}
+
+	// 行番号テーブル（保存しておいたブレークポイントをファイル:行から張り直す用）
+	// ファイルは ElfModule と同じ順に登録するので、fileIndex がそのまま ID になる
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		m_lineTable.clear();
+		for (const auto& fileName : m_module.files())
+		{
+			m_lineTable.addFile(fileName);
+		}
+		for (const auto& line : m_module.lines())
+		{
+			m_lineTable.add(line.address, line.fileIndex, line.lineNumber);
+		}
+		m_lineTable.build();
+
+		Array<FilePath> userSourceFiles;
+		for (const auto& fileName : m_module.files())
+		{
+			if (IsUserSourceFile(fileName))
+			{
+				userSourceFiles.push_back(fileName);
+			}
+		}
+		registerSourceFiles(userSourceFiles);
+
+		m_lineTableBuildTime = std::chrono::steady_clock::now() - start;
+		DebugLog::Write(LogLevel::Debug, LogCategory::Symbol, U"line table: {} lines, {} files, {} us", m_lineTable.size(), m_lineTable.files().size(),
+			std::chrono::duration_cast<std::chrono::microseconds>(m_lineTableBuildTime).count());
+	}
+
+	return true;
+}
+
+void ProcessHandle::dispose()
+{
+	m_module.clear();
+	m_functionIndex.clear();
+	m_lineTable.clear();
+	m_userCodeRanges.clear();
+	m_userFunctionEntries.clear();
+	m_processHandle = NULL;
+	discardMemoryCache();
+}
+
+void ProcessHandle::onDllLoaded(const LOAD_DLL_DEBUG_INFO*) const
+{
+}
+
+void ProcessHandle::onDllUnloaded(const UNLOAD_DLL_DEBUG_INFO*) const
+{
+}
+
+Optional<size_t> ProcessHandle::findAddress(const String& symbolName) const
+{
+	// 索引には大きさのある関数しかない
+	if (const auto addresses = m_functionIndex.findExact(symbolName); not addresses.isEmpty())
+	{
+		return addresses.front();
+	}
+	return m_module.findAddress(symbolName);
+}
+
+Optional<ReturnFrame> ProcessHandle::getReturnFrame(const ThreadHandle& thread) const
+{
+	auto contextOpt = thread.getContext();
+	if (not contextOpt)
+	{
+		return none;
+	}
+
+	const auto& context = contextOpt.value();
+
+	size_t cfa = 0;
+	int64 returnAddressOffset = -8;
+
+	if (const auto rule = m_module.findFrameRule(context.Rip))
+	{
+		// DWARF のレジスタ番号の順
+		const DWORD64 registers[] = {
+			context.Rax, context.Rdx, context.Rcx, context.Rbx, context.Rsi, context.Rdi, context.Rbp, context.Rsp,
+			context.R8, context.R9, context.R10, context.R11, context.R12, context.R13, context.R14, context.R15,
+		};
+
+		if (std::size(registers) <= rule->cfaRegister)
+		{
+			return none;
+		}
+
+		cfa = static_cast<size_t>(registers[rule->cfaRegister] + rule->cfaOffset);
+		returnAddressOffset = rule->returnAddressOffset;
+	}
+	else if (context.Rbp != 0)
+	{
+		// .eh_frame にない関数はフレームポインタをたどる（-fno-omit-frame-pointer でビルドされている前提）
+		cfa = static_cast<size_t>(context.Rbp + 16);
+	}
+	else
+	{
+		return none;
+	}
+
+	size_t returnAddress = 0;
+	if (not readMemory(cfa + returnAddressOffset, returnAddress) || returnAddress == 0)
+	{
+		return none;
+	}
+
+	return ReturnFrame{ returnAddress, cfa };
+}
+
+Optional<LineInfo> ProcessHandle::findSymbolLineInfo(size_t address) const
+{
+	// 行番号テーブルには ElfModule と同じ順にファイルを登録してあるので、fileIndex がそのまま ID
+	if (const auto line = m_module.findLine(address); line && m_lineTable.files().isUserFile(line->fileIndex))
+	{
+		return LineInfo{ line->fileIndex, line->lineNumber };
+	}
+
+	return none;
+}
+
+std::unique_ptr<ConditionSymbolResolver> ProcessHandle::createConditionResolver(size_t) const
+{
+	return std::make_unique<ElfConditionResolver>(m_module);
+}
+
+void ProcessHandle::fetchGlobalVariables()
+{
+	m_debugString = U"Linux では変数の表示に対応していません";
+}
+
+void ProcessHandle::fetchLocalVariables(const ThreadHandle&)
+{
+	m_debugString = U"Linux では変数の表示に対応していません";
+}
+
+void ProcessHandle::fetchCallstack(const ThreadHandle& thread)
+{
+	m_debugString = U"";
+
+	auto contextOpt = thread.getContext();
+	if (not contextOpt)
+	{
+		return;
+	}
+
+	// フレームポインタをたどる（-fno-omit-frame-pointer でビルドされている前提）
+	size_t pc = contextOpt.value().Rip;
+	size_t frame = contextOpt.value().Rbp;
+
+	for (int depth = 0; depth < 256 && pc != 0; ++depth)
+	{
+		m_debugString += U"{:0>8X}  "_fmt(pc);
+
+		if (const auto function = m_module.findFunction(pc))
+		{
+			m_debugString += function->name + U"\n";
+		}
+		else
+		{
+			m_debugString += U"??\n";
+		}
+
+		size_t frameData[2] = {};
+		if (frame == 0 || not readMemory(frame, sizeof(frameData), frameData))
+		{
+			break;
+		}
+
+		frame = frameData[0];
+		pc = frameData[1];
+	}
+}
+
+#endif
@@ -0,0 +1,1024 @@
+﻿#include "PtraceDebugBackend.hpp"
+
+#if SIV3D_PLATFORM(LINUX)
+
+#include <cerrno>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+#include <elf.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/personality.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+namespace
+{
+	// SIGCHLD が届くたびに書き込まれる eventfd と、それより前に設定されていたハンドラー
+	int g_childEventFile = -1;
+	struct sigaction g_previousChildAction = {};
+
+	// lastError は GetLastError と同じく呼び出したスレッドごと（debugBreakProcess は UI スレッドから呼ばれる）
+	thread_local int t_lastError = 0;
+
+	void OnChildSignal(int signal, siginfo_t* info, void* context)
+	{
+		const int savedErrno = errno;
+		const uint64 one = 1;
+		[[maybe_unused]] const auto written = write(g_childEventFile, &one, sizeof(one));
+		errno = savedErrno;
+
+		if (g_previousChildAction.sa_flags & SA_SIGINFO)
+		{
+			g_previousChildAction.sa_sigaction(signal, info, context);
+		}
+		else if (g_previousChildAction.sa_handler != SIG_DFL && g_previousChildAction.sa_handler != SIG_IGN)
+		{
+			g_previousChildAction.sa_handler(signal);
+		}
+	}
+
+	// waitForDebugEvent の時間付き待ちで poll する fd（作れなければ -1）
+	// トレース対象の停止は SIGCHLD で知らされるが、どのスレッドに配られるかは決まらないので
+	// signalfd（SIGCHLD を全スレッドでブロックする必要がある）ではなくハンドラーから eventfd に書き込む
+	int GetChildEventFile()
+	{
+		static const int file = []()
+		{
+			g_childEventFile = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			if (g_childEventFile == -1)
+			{
+				return -1;
+			}
+
+			struct sigaction action = {};
+			action.sa_sigaction = OnChildSignal;
+			action.sa_flags = SA_SIGINFO | SA_RESTART;
+			sigemptyset(&action.sa_mask);
+
+			if (sigaction(SIGCHLD, &action, &g_previousChildAction) != 0)
+			{
+				close(g_childEventFile);
+				g_childEventFile = -1;
+			}
+			return g_childEventFile;
+		}();
+
+		return file;
+	}
+
+	// 実行ファイルが /proc/pid/maps 上でマップされている先頭アドレス
+	size_t GetImageBase(pid_t pid, const std::string& exePath)
+	{
+		char resolved[PATH_MAX] = {};
+		const std::string realPath = realpath(exePath.c_str(), resolved) ? resolved : exePath;
+
+		std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+		std::string line;
+		while (std::getline(maps, line))
+		{
+			const auto pathPos = line.find('/');
+			if (pathPos == std::string::npos || line.substr(pathPos) != realPath)
+			{
+				continue;
+			}
+
+			return std::stoull(line.substr(0, line.find('-')), nullptr, 16);
+		}
+
+		return 0;
+	}
+
+	// 実行ファイルのエントリポイント（_start）の実行時アドレス
+	size_t GetEntryAddress(const std::string& exePath, size_t imageBase)
+	{
+		std::ifstream file(exePath, std::ios::binary);
+
+		Elf64_Ehdr header = {};
+		if (not file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.e_type != ET_DYN)
+		{
+			return header.e_entry;
+		}
+
+		// PIE は先頭の PT_LOAD からのずれをロードバイアスとする
+		for (size_t i = 0; i < header.e_phnum; ++i)
+		{
+			Elf64_Phdr program = {};
+			file.seekg(header.e_phoff + i * sizeof(Elf64_Phdr));
+			if (file.read(reinterpret_cast<char*>(&program), sizeof(program)) && program.p_type == PT_LOAD)
+			{
+				return imageBase - (program.p_vaddr & ~(program.p_align - 1)) + header.e_entry;
+			}
+		}
+
+		return header.e_entry;
+	}
+
+	// /proc/pid/maps の隙間のうち、nearAddress に一番近く size が入るところの先頭
+	size_t FindFreeRegion(pid_t pid, size_t nearAddress, size_t size)
+	{
+		constexpr size_t PageSize = 4096;
+		constexpr size_t LowestAddress = 0x10000;
+
+		std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+		std::string line;
+
+		size_t previousEnd = LowestAddress;
+		size_t best = 0;
+		size_t bestDistance = SIZE_MAX;
+
+		const auto consider = [&](size_t gapBegin, size_t gapEnd)
+		{
+			if (gapEnd <= gapBegin || gapEnd - gapBegin < size)
+			{
+				return;
+			}
+
+			// 隙間の中で nearAddress に一番近い位置
+			const size_t candidate = (gapEnd <= nearAddress) ? (gapEnd - size) / PageSize * PageSize : gapBegin;
+			const size_t distance = (candidate < nearAddress) ? (nearAddress - candidate) : (candidate - nearAddress);
+			if (distance < bestDistance)
+			{
+				best = candidate;
+				bestDistance = distance;
+			}
+		};
+
+		while (std::getline(maps, line))
+		{
+			const auto dash = line.find('-');
+			const size_t begin = std::stoull(line.substr(0, dash), nullptr, 16);
+			const size_t end = std::stoull(line.substr(dash + 1), nullptr, 16);
+			consider(previousEnd, begin);
+			previousEnd = Max(previousEnd, end);
+		}
+
+		return best;
+	}
+
+	void ToContext(const user_regs_struct& regs, CONTEXT& context)
+	{
+		context.EFlags = static_cast<DWORD>(regs.eflags);
+		context.Rax = regs.rax;
+		context.Rcx = regs.rcx;
+		context.Rdx = regs.rdx;
+		context.Rbx = regs.rbx;
+		context.Rsp = regs.rsp;
+		context.Rbp = regs.rbp;
+		context.Rsi = regs.rsi;
+		context.Rdi = regs.rdi;
+		context.R8 = regs.r8;
+		context.R9 = regs.r9;
+		context.R10 = regs.r10;
+		context.R11 = regs.r11;
+		context.R12 = regs.r12;
+		context.R13 = regs.r13;
+		context.R14 = regs.r14;
+		context.R15 = regs.r15;
+		context.Rip = regs.rip;
+	}
+
+	// CONTEXT_FULL / CONTEXT_DEBUG_REGISTERS から CONTEXT_AMD64 を除いたビット
+	constexpr DWORD ContextRegistersMask = 0x0000000BL;
+	constexpr DWORD ContextDebugRegistersMask = 0x00000010L;
+
+	size_t DebugRegisterOffset(size_t index)
+	{
+		return offsetof(struct user, u_debugreg) + index * sizeof(unsigned long);
+	}
+
+	bool PeekDebugRegister(pid_t tid, size_t index, uint64& value)
+	{
+		errno = 0;
+		const long result = ptrace(PTRACE_PEEKUSER, tid, reinterpret_cast<void*>(DebugRegisterOffset(index)), nullptr);
+		value = static_cast<uint64>(result);
+		return errno == 0;
+	}
+
+	bool ReadDebugRegisters(pid_t tid, std::array<uint64, 8>& cache, bool& hasCache, CONTEXT& context)
+	{
+		if (not hasCache)
+		{
+			for (const size_t index : { 0, 1, 2, 3, 7 })
+			{
+				if (not PeekDebugRegister(tid, index, cache[index]))
+				{
+					return false;
+				}
+			}
+			hasCache = true;
+		}
+
+		if (not PeekDebugRegister(tid, 6, cache[6]))
+		{
+			return false;
+		}
+
+		context.Dr0 = cache[0];
+		context.Dr1 = cache[1];
+		context.Dr2 = cache[2];
+		context.Dr3 = cache[3];
+		context.Dr6 = cache[6];
+		context.Dr7 = cache[7];
+		return true;
+	}
+
+	// DR7 で有効にするときにアドレスが検査されるので、DR0～DR3 を先に書く
+	bool WriteDebugRegisters(pid_t tid, std::array<uint64, 8>& cache, bool& hasCache, const CONTEXT& context)
+	{
+		const std::pair<size_t, DWORD64> registers[] = {
+			{ 0, context.Dr0 }, { 1, context.Dr1 }, { 2, context.Dr2 }, { 3, context.Dr3 }, { 6, context.Dr6 }, { 7, context.Dr7 },
+		};
+
+		for (const auto& [index, value] : registers)
+		{
+			if (hasCache && cache[index] == value)
+			{
+				continue;
+			}
+
+			if (ptrace(PTRACE_POKEUSER, tid, reinterpret_cast<void*>(DebugRegisterOffset(index)), reinterpret_cast<void*>(value)) == -1)
+			{
+				hasCache = false;
+				return false;
+			}
+			cache[index] = value;
+		}
+
+		hasCache = true;
+		return true;
+	}
+
+	void FromContext(const CONTEXT& context, user_regs_struct& regs)
+	{
+		regs.eflags = context.EFlags;
+		regs.rax = context.Rax;
+		regs.rcx = context.Rcx;
+		regs.rdx = context.Rdx;
+		regs.rbx = context.Rbx;
+		regs.rsp = context.Rsp;
+		regs.rbp = context.Rbp;
+		regs.rsi = context.Rsi;
+		regs.rdi = context.Rdi;
+		regs.r8 = context.R8;
+		regs.r9 = context.R9;
+		regs.r10 = context.R10;
+		regs.r11 = context.R11;
+		regs.r12 = context.R12;
+		regs.r13 = context.R13;
+		regs.r14 = context.R14;
+		regs.r15 = context.R15;
+		regs.rip = context.Rip;
+	}
+
+	DWORD ToExceptionCode(int signal)
+	{
+		switch (signal)
+		{
+		case SIGSEGV: return EXCEPTION_ACCESS_VIOLATION;
+		case SIGBUS: return EXCEPTION_IN_PAGE_ERROR;
+		case SIGILL: return EXCEPTION_ILLEGAL_INSTRUCTION;
+		case SIGFPE: return EXCEPTION_INT_DIVIDE_BY_ZERO;
+		default: return 0;
+		}
+	}
+}
+
+PtraceDebugBackend::~PtraceDebugBackend()
+{
+	if (m_pid != 0)
+	{
+		kill(m_pid, SIGKILL);
+	}
+
+	if (m_memFile != -1)
+	{
+		close(m_memFile);
+	}
+}
+
+bool PtraceDebugBackend::createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo)
+{
+	const std::string path = Unicode::ToUTF8(exeFilePath);
+
+	// exec に渡す引数は fork の前に用意しておく
+	Array<std::string> argumentStrings = { path };
+	{
+		std::istringstream stream(Unicode::ToUTF8(arguments));
+		std::string argument;
+		while (stream >> argument)
+		{
+			argumentStrings.push_back(argument);
+		}
+	}
+
+	Array<char*> argv;
+	for (auto& argument : argumentStrings)
+	{
+		argv.push_back(argument.data());
+	}
+	argv.push_back(nullptr);
+
+	const pid_t pid = fork();
+
+	if (pid == -1)
+	{
+		t_lastError = errno;
+		return false;
+	}
+
+	if (pid == 0)
+	{
+		// 記録したアドレスを次回の起動でも使えるように ASLR を切る
+		ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+		personality(ADDR_NO_RANDOMIZE);
+		execv(path.c_str(), argv.data());
+		_exit(127);
+	}
+
+	// exec 直後の SIGTRAP で停止している
+	int status = 0;
+	if (waitpid(pid, &status, __WALL) == -1 || not WIFSTOPPED(status))
+	{
+		t_lastError = errno;
+		return false;
+	}
+
+	ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+
+	m_pid = pid;
+	m_tracerThreadID = std::this_thread::get_id();
+	m_memFile = open(("/proc/" + std::to_string(pid) + "/mem").c_str(), O_RDWR);
+	m_pendingEvents.clear();
+	m_threads.clear();
+
+	// CREATE_SUSPENDED 相当：最初の ResumeThread まで再開しない
+	auto& mainThread = m_threads[pid];
+	mainThread.tid = pid;
+	mainThread.stopped = true;
+	mainThread.suspendCount = 1;
+	m_isInEvent = true;
+
+	processInfo.hProcess = ToHandle(pid);
+	processInfo.hThread = ToHandle(pid);
+	processInfo.dwProcessId = static_cast<DWORD>(pid);
+	processInfo.dwThreadId = static_cast<DWORD>(pid);
+
+	// Windows と同じく CREATE_PROCESS → ローダーのブレークポイント の順に通知する
+	DEBUG_EVENT createEvent = {};
+	createEvent.dwDebugEventCode = CREATE_PROCESS_DEBUG_EVENT;
+	createEvent.dwProcessId = static_cast<DWORD>(pid);
+	createEvent.dwThreadId = static_cast<DWORD>(pid);
+	createEvent.u.CreateProcessInfo.hFile = NULL;
+	createEvent.u.CreateProcessInfo.hProcess = ToHandle(pid);
+	createEvent.u.CreateProcessInfo.hThread = ToHandle(pid);
+	createEvent.u.CreateProcessInfo.lpBaseOfImage = reinterpret_cast<LPVOID>(GetImageBase(pid, path));
+	m_pendingEvents.push_back(createEvent);
+
+	// ProcessDebugger はローダーの次のブレークポイントでユーザーのメインスレッドを特定する（Windows では Main()の int3）
+	// Linux では Main より前にセッションのブレークポイントを張れるよう、_start に一時的なブレークポイントを張ってそれにする
+	m_entryAddress = GetEntryAddress(path, reinterpret_cast<size_t>(createEvent.u.CreateProcessInfo.lpBaseOfImage));
+	const uint8 breakOp = 0xCC;
+	m_isEntryArmed = readMemory(processInfo.hProcess, m_entryAddress, 1, &m_entryOriginal)
+		&& writeMemory(processInfo.hProcess, m_entryAddress, 1, &breakOp);
+
+	user_regs_struct regs = {};
+	ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+
+	DEBUG_EVENT initEvent = {};
+	initEvent.dwDebugEventCode = EXCEPTION_DEBUG_EVENT;
+	initEvent.dwProcessId = static_cast<DWORD>(pid);
+	initEvent.dwThreadId = static_cast<DWORD>(pid);
+	initEvent.u.Exception.ExceptionRecord.ExceptionCode = EXCEPTION_BREAKPOINT;
+	initEvent.u.Exception.ExceptionRecord.ExceptionAddress = reinterpret_cast<LPVOID>(regs.rip);
+	initEvent.u.Exception.dwFirstChance = 1;
+	m_pendingEvents.push_back(initEvent);
+
+	return true;
+}
+
+bool PtraceDebugBackend::waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds)
+{
+	{
+		std::lock_guard lock(m_mutex);
+
+		if (not m_pendingEvents.empty())
+		{
+			debugEvent = m_pendingEvents.front();
+			m_pendingEvents.pop_front();
+
+			// suspendThread の停止待ちの間に保留したイベントは、まだ他のスレッドが動いている
+			if (not m_isInEvent)
+			{
+				stopOtherThreads(static_cast<pid_t>(debugEvent.dwThreadId));
+			}
+			return true;
+		}
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+	const int childEventFile = (milliseconds == INFINITE) ? -1 : GetChildEventFile();
+
+	while (true)
+	{
+		// waitpid より先に読み捨てる（waitpid の後に届いた SIGCHLD は次の poll で拾う）
+		if (childEventFile != -1)
+		{
+			uint64 count = 0;
+			[[maybe_unused]] const auto read = ::read(childEventFile, &count, sizeof(count));
+		}
+
+		int status = 0;
+		const int options = __WALL | (milliseconds == INFINITE ? 0 : WNOHANG);
+		const pid_t tid = waitpid(-1, &status, options);
+
+		if (tid == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			t_lastError = errno;
+			return false;
+		}
+
+		if (tid == 0)
+		{
+			const auto now = std::chrono::steady_clock::now();
+			if (deadline <= now)
+			{
+				t_lastError = ERROR_SEM_TIMEOUT;
+				return false;
+			}
+
+			// 次の SIGCHLD か期限まで眠る（eventfd が作れなければ 1 ms ごとに見直す）
+			const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+			pollfd childEvent = { childEventFile, POLLIN, 0 };
+			poll(&childEvent, 1, (childEventFile == -1) ? 1 : static_cast<int>(remaining));
+			continue;
+		}
+
+		// waitpid で待っている間は UI スレッドからの setTrapFlag を受け付けられるようにロックしない
+		std::lock_guard lock(m_mutex);
+
+		if (translateStatus(tid, status, debugEvent))
+		{
+			stopOtherThreads(tid);
+			return true;
+		}
+	}
+}
+
+bool PtraceDebugBackend::continueDebugEvent(DWORD, DWORD threadID, DWORD continueStatus)
+{
+	std::lock_guard lock(m_mutex);
+
+	if (auto it = m_threads.find(static_cast<pid_t>(threadID)); it != m_threads.end())
+	{
+		if (continueStatus != DBG_EXCEPTION_NOT_HANDLED)
+		{
+			it->second.pendingSignal = 0;
+		}
+	}
+
+	// 保留中のイベントがあれば停止したまま次のイベントを通知する
+	if (not m_pendingEvents.empty())
+	{
+		return true;
+	}
+
+	m_isInEvent = false;
+
+	for (auto& [tid, thread] : m_threads)
+	{
+		if (thread.stopped && thread.suspendCount == 0)
+		{
+			resumeTracedThread(thread);
+		}
+	}
+
+	return true;
+}
+
+bool PtraceDebugBackend::getThreadContext(HANDLE thread, CONTEXT& context)
+{
+	std::lock_guard lock(m_mutex);
+
+	const pid_t tid = ToID(thread);
+	auto it = m_threads.find(tid);
+	if (it == m_threads.end() || not it->second.stopped || not isTracerThread())
+	{
+		t_lastError = ESRCH;
+		return false;
+	}
+
+	if (context.ContextFlags & ContextRegistersMask)
+	{
+		user_regs_struct regs = {};
+		if (ptrace(PTRACE_GETREGS, tid, nullptr, &regs) == -1)
+		{
+			t_lastError = errno;
+			return false;
+		}
+
+		ToContext(regs, context);
+
+		if (it->second.singleStep)
+		{
+			context.EFlags |= 0x100;
+		}
+	}
+
+	if ((context.ContextFlags & ContextDebugRegistersMask) && not ReadDebugRegisters(tid, it->second.debugRegisters, it->second.hasDebugRegisters, context))
+	{
+		t_lastError = errno;
+		return false;
+	}
+
+	return true;
+}
+
+bool PtraceDebugBackend::setThreadContext(HANDLE thread, const CONTEXT& context)
+{
+	std::lock_guard lock(m_mutex);
+
+	const pid_t tid = ToID(thread);
+	auto it = m_threads.find(tid);
+	if (it == m_threads.end() || not it->second.stopped || not isTracerThread())
+	{
+		t_lastError = ESRCH;
+		return false;
+	}
+
+	if (context.ContextFlags & ContextRegistersMask)
+	{
+		user_regs_struct regs = {};
+		if (ptrace(PTRACE_GETREGS, tid, nullptr, &regs) == -1)
+		{
+			t_lastError = errno;
+			return false;
+		}
+
+		// TFビットはレジスタに書かず、再開方法で表現する
+		FromContext(context, regs);
+		regs.eflags &= ~0x100ull;
+		it->second.singleStep = (context.EFlags & 0x100) != 0;
+
+		if (ptrace(PTRACE_SETREGS, tid, nullptr, &regs) == -1)
+		{
+			t_lastError = errno;
+			return false;
+		}
+	}
+
+	if ((context.ContextFlags & ContextDebugRegistersMask) && not WriteDebugRegisters(tid, it->second.debugRegisters, it->second.hasDebugRegisters, context))
+	{
+		t_lastError = errno;
+		return false;
+	}
+
+	return true;
+}
+
+bool PtraceDebugBackend::setTrapFlag(HANDLE thread)
+{
+	std::lock_guard lock(m_mutex);
+
+	auto it = m_threads.find(ToID(thread));
+	if (it == m_threads.end())
+	{
+		t_lastError = ESRCH;
+		return false;
+	}
+
+	auto& tracedThread = it->second;
+	tracedThread.singleStep = true;
+
+	// 実行中のスレッドは一度止めてからシングルステップで再開させる
+	if (not tracedThread.stopped && not tracedThread.breakRequested)
+	{
+		tracedThread.breakRequested = true;
+		syscall(SYS_tgkill, m_pid, tracedThread.tid, SIGSTOP);
+	}
+
+	return true;
+}
+
+void PtraceDebugBackend::suspendThread(HANDLE thread)
+{
+	std::lock_guard lock(m_mutex);
+
+	const pid_t tid = ToID(thread);
+	auto it = m_threads.find(tid);
+	if (it == m_threads.end())
+	{
+		return;
+	}
+
+	auto& tracedThread = it->second;
+	if (++tracedThread.suspendCount != 1 || tracedThread.stopped)
+	{
+		return;
+	}
+
+	// 実行中のスレッドは SIGSTOP で止める。止まったときの SIGSTOP は translateStatus で読み捨て、
+	// suspendCount が 0 に戻るまで再開しない
+	if (not tracedThread.expectInitialStop && not tracedThread.ignoreStop && not tracedThread.breakRequested)
+	{
+		syscall(SYS_tgkill, m_pid, tid, SIGSTOP);
+		tracedThread.ignoreStop = true;
+	}
+
+	// SuspendThread と同じく止まってから戻る（waitpid はトレーサースレッドでしか呼べない）
+	if (isTracerThread())
+	{
+		waitUntilStopped(tid);
+	}
+}
+
+void PtraceDebugBackend::resumeThread(HANDLE thread)
+{
+	std::lock_guard lock(m_mutex);
+
+	auto it = m_threads.find(ToID(thread));
+	if (it == m_threads.end() || it->second.suspendCount == 0)
+	{
+		return;
+	}
+
+	auto& tracedThread = it->second;
+	if (--tracedThread.suspendCount == 0 && tracedThread.stopped && not m_isInEvent && isTracerThread())
+	{
+		resumeTracedThread(tracedThread);
+	}
+}
+
+bool PtraceDebugBackend::readMemory(HANDLE process, size_t address, size_t size, void* buffer)
+{
+	iovec local = { buffer, size };
+	iovec remote = { reinterpret_cast<void*>(address), size };
+
+	if (process_vm_readv(ToID(process), &local, 1, &remote, 1, 0) == static_cast<ssize_t>(size))
+	{
+		return true;
+	}
+
+	// 読み取り権限のないページは /proc/pid/mem 経由で読む
+	if (m_memFile != -1 && pread(m_memFile, buffer, size, static_cast<off_t>(address)) == static_cast<ssize_t>(size))
+	{
+		return true;
+	}
+
+	t_lastError = errno;
+	return false;
+}
+
+bool PtraceDebugBackend::writeMemory(HANDLE, size_t address, size_t size, const void* buffer)
+{
+	// /proc/pid/mem への書き込みはコード領域の保護を無視できる（x64 では命令キャッシュのフラッシュは不要）
+	if (m_memFile != -1 && pwrite(m_memFile, buffer, size, static_cast<off_t>(address)) == static_cast<ssize_t>(size))
+	{
+		return true;
+	}
+
+	t_lastError = errno;
+	return false;
+}
+
+bool PtraceDebugBackend::allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address)
+{
+	std::lock_guard lock(m_mutex);
+
+	// 止まっているスレッドに mmap のシステムコールを 1 回だけ実行させる
+	auto it = std::find_if(m_threads.begin(), m_threads.end(), [](const auto& thread) { return thread.second.stopped; });
+	if (it == m_threads.end() || not isTracerThread())
+	{
+		t_lastError = ESRCH;
+		return false;
+	}
+
+	const pid_t tid = it->first;
+
+	user_regs_struct saved = {};
+	if (ptrace(PTRACE_GETREGS, tid, nullptr, &saved) == -1)
+	{
+		t_lastError = errno;
+		return false;
+	}
+
+	// RIP の位置を syscall (0F 05) に一時的に書き換える
+	uint8 originalBytes[2] = {};
+	constexpr uint8 SyscallBytes[2] = { 0x0F, 0x05 };
+	if (not readMemory(process, saved.rip, sizeof(originalBytes), originalBytes)
+		|| not writeMemory(process, saved.rip, sizeof(SyscallBytes), SyscallBytes))
+	{
+		return false;
+	}
+
+	const size_t hint = FindFreeRegion(ToID(process), nearAddress, size);
+
+	user_regs_struct regs = saved;
+	regs.rax = SYS_mmap;
+	regs.rdi = hint;
+	regs.rsi = size;
+	regs.rdx = PROT_READ | PROT_WRITE | PROT_EXEC;
+	regs.r10 = MAP_PRIVATE | MAP_ANONYMOUS | (hint ? MAP_FIXED_NOREPLACE : 0);
+	regs.r8 = static_cast<unsigned long long>(-1);
+	regs.r9 = 0;
+
+	// システムコールの途中で止まっていた場合に、再開時の再実行の処理が働かないようにする
+	regs.orig_rax = static_cast<unsigned long long>(-1);
+
+	bool executed = false;
+	if (ptrace(PTRACE_SETREGS, tid, nullptr, &regs) != -1)
+	{
+		// 途中で別のシグナルで止まった場合は、再開時に配送するようにしてやり直す
+		for (int retry = 0; retry < 4 && not executed; ++retry)
+		{
+			int status = 0;
+			if (ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) == -1 || waitpid(tid, &status, __WALL) == -1 || not WIFSTOPPED(status))
+			{
+				break;
+			}
+
+			const int signal = WSTOPSIG(status);
+			if (signal == SIGTRAP)
+			{
+				executed = true;
+			}
+			else if (signal != SIGSTOP)
+			{
+				it->second.pendingSignal = signal;
+			}
+		}
+	}
+
+	user_regs_struct result = {};
+	if (executed)
+	{
+		ptrace(PTRACE_GETREGS, tid, nullptr, &result);
+	}
+
+	writeMemory(process, saved.rip, sizeof(originalBytes), originalBytes);
+	ptrace(PTRACE_SETREGS, tid, nullptr, &saved);
+
+	// 失敗すると -errno が返る
+	if (not executed || static_cast<int64>(result.rax) < 0)
+	{
+		t_lastError = executed ? static_cast<int>(-static_cast<int64>(result.rax)) : errno;
+		return false;
+	}
+
+	address = static_cast<size_t>(result.rax);
+	return true;
+}
+
+bool PtraceDebugBackend::debugBreakProcess(HANDLE process)
+{
+	if (syscall(SYS_tgkill, ToID(process), ToID(process), SIGTRAP) != 0)
+	{
+		t_lastError = errno;
+		return false;
+	}
+	return true;
+}
+
+void PtraceDebugBackend::closeHandle(HANDLE)
+{
+}
+
+uint32 PtraceDebugBackend::lastError() const
+{
+	return static_cast<uint32>(t_lastError);
+}
+
+bool PtraceDebugBackend::translateStatus(pid_t tid, int status, DEBUG_EVENT& debugEvent)
+{
+	debugEvent = {};
+	debugEvent.dwProcessId = static_cast<DWORD>(m_pid);
+	debugEvent.dwThreadId = static_cast<DWORD>(tid);
+
+	if (WIFEXITED(status) || WIFSIGNALED(status))
+	{
+		const DWORD exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		m_threads.erase(tid);
+
+		if (tid != m_pid)
+		{
+			debugEvent.dwDebugEventCode = EXIT_THREAD_DEBUG_EVENT;
+			debugEvent.u.ExitThread.dwExitCode = exitCode;
+			return true;
+		}
+
+		debugEvent.dwDebugEventCode = EXIT_PROCESS_DEBUG_EVENT;
+		debugEvent.u.ExitProcess.dwExitCode = exitCode;
+
+		m_threads.clear();
+		m_pendingEvents.clear();
+		m_pid = 0;
+		if (m_memFile != -1)
+		{
+			close(m_memFile);
+			m_memFile = -1;
+		}
+		return true;
+	}
+
+	if (not WIFSTOPPED(status))
+	{
+		return false;
+	}
+
+	// clone の通知より先に新しいスレッドの SIGSTOP が届くこともある
+	auto& thread = m_threads[tid];
+	thread.tid = tid;
+	thread.stopped = true;
+
+	const int signal = WSTOPSIG(status);
+
+	if (signal == SIGTRAP && (status >> 16) == PTRACE_EVENT_CLONE)
+	{
+		unsigned long newThreadID = 0;
+		ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &newThreadID);
+
+		const auto newTid = static_cast<pid_t>(newThreadID);
+		if (not m_threads.contains(newTid))
+		{
+			auto& newThread = m_threads[newTid];
+			newThread.tid = newTid;
+			newThread.expectInitialStop = true;
+		}
+
+		debugEvent.dwThreadId = static_cast<DWORD>(newTid);
+		debugEvent.dwDebugEventCode = CREATE_THREAD_DEBUG_EVENT;
+		debugEvent.u.CreateThread.hThread = ToHandle(newTid);
+		return true;
+	}
+
+	if (signal == SIGSTOP)
+	{
+		if (thread.expectInitialStop || thread.ignoreStop || thread.breakRequested)
+		{
+			thread.expectInitialStop = false;
+			thread.ignoreStop = false;
+
+			// setTrapFlag による停止要求はシングルステップで再開してブレークさせる
+			// suspendThread で止めたスレッドは resumeThread まで止めておく
+			if (thread.suspendCount != 0)
+			{
+				thread.breakRequested = false;
+			}
+			else if (thread.breakRequested)
+			{
+				thread.breakRequested = false;
+				resumeTracedThread(thread);
+			}
+			else if (not m_isInEvent)
+			{
+				resumeTracedThread(thread);
+			}
+			return false;
+		}
+
+		if (thread.suspendCount == 0)
+		{
+			resumeTracedThread(thread);
+		}
+		return false;
+	}
+
+	if (signal == SIGTRAP)
+	{
+		siginfo_t info = {};
+		ptrace(PTRACE_GETSIGINFO, tid, nullptr, &info);
+
+		user_regs_struct regs = {};
+		ptrace(PTRACE_GETREGS, tid, nullptr, &regs);
+
+		debugEvent.dwDebugEventCode = EXCEPTION_DEBUG_EVENT;
+		debugEvent.u.Exception.dwFirstChance = 1;
+
+		// ハードウェアブレークポイントも Windows と同様にシングルステップとして通知する
+		if (info.si_code == TRAP_TRACE || info.si_code == TRAP_HWBKPT)
+		{
+			thread.singleStep = false;
+			debugEvent.u.Exception.ExceptionRecord.ExceptionCode = EXCEPTION_SINGLE_STEP;
+			debugEvent.u.Exception.ExceptionRecord.ExceptionAddress = reinterpret_cast<LPVOID>(regs.rip);
+			return true;
+		}
+
+		// debugBreakProcess の tgkill は int3 と区別して通知する（RIP は止まった命令のまま）
+		if (info.si_code == SI_TKILL)
+		{
+			debugEvent.u.Exception.ExceptionRecord.ExceptionCode = DBG_CONTROL_BREAK;
+			debugEvent.u.Exception.ExceptionRecord.ExceptionAddress = reinterpret_cast<LPVOID>(regs.rip);
+			return true;
+		}
+
+		// int3 の実行後は RIP が1バイト進んでいる
+		const bool isInt3 = (info.si_code == SI_KERNEL || info.si_code == TRAP_BRKPT);
+
+		// _start に張ったブレークポイントは元に戻してから通知する
+		if (isInt3 && m_isEntryArmed && regs.rip - 1 == m_entryAddress)
+		{
+			m_isEntryArmed = false;
+			writeMemory(ToHandle(m_pid), m_entryAddress, 1, &m_entryOriginal);
+			regs.rip = m_entryAddress;
+			ptrace(PTRACE_SETREGS, tid, nullptr, &regs);
+
+			debugEvent.u.Exception.ExceptionRecord.ExceptionCode = EXCEPTION_BREAKPOINT;
+			debugEvent.u.Exception.ExceptionRecord.ExceptionAddress = reinterpret_cast<LPVOID>(m_entryAddress);
+			return true;
+		}
+
+		debugEvent.u.Exception.ExceptionRecord.ExceptionCode = EXCEPTION_BREAKPOINT;
+		debugEvent.u.Exception.ExceptionRecord.ExceptionAddress = reinterpret_cast<LPVOID>(isInt3 ? regs.rip - 1 : regs.rip);
+		return true;
+	}
+
+	if (const auto exceptionCode = ToExceptionCode(signal))
+	{
+		thread.pendingSignal = signal;
+
+		siginfo_t info = {};
+		ptrace(PTRACE_GETSIGINFO, tid, nullptr, &info);
+
+		debugEvent.dwDebugEventCode = EXCEPTION_DEBUG_EVENT;
+		debugEvent.u.Exception.dwFirstChance = 1;
+		debugEvent.u.Exception.ExceptionRecord.ExceptionCode = exceptionCode;
+		debugEvent.u.Exception.ExceptionRecord.ExceptionAddress = info.si_addr;
+		return true;
+	}
+
+	// デバッガが関与しないシグナルはそのまま配送する
+	thread.pendingSignal = signal;
+	resumeTracedThread(thread);
+	return false;
+}
+
+void PtraceDebugBackend::stopOtherThreads(pid_t eventThreadID)
+{
+	m_isInEvent = true;
+
+	Array<pid_t> waitingThreads;
+
+	for (auto& [tid, thread] : m_threads)
+	{
+		if (tid == eventThreadID || thread.stopped)
+		{
+			continue;
+		}
+
+		if (not thread.expectInitialStop && not thread.ignoreStop)
+		{
+			syscall(SYS_tgkill, m_pid, tid, SIGSTOP);
+			thread.ignoreStop = true;
+		}
+
+		waitingThreads.push_back(tid);
+	}
+
+	for (const auto tid : waitingThreads)
+	{
+		waitUntilStopped(tid);
+	}
+}
+
+void PtraceDebugBackend::waitUntilStopped(pid_t tid)
+{
+	// 停止を待つ間に起きたイベントは保留して後で通知する
+	while (m_threads.contains(tid) && not m_threads[tid].stopped)
+	{
+		int status = 0;
+		if (waitpid(tid, &status, __WALL) == -1)
+		{
+			m_threads.erase(tid);
+			break;
+		}
+
+		DEBUG_EVENT pendingEvent;
+		if (translateStatus(tid, status, pendingEvent))
+		{
+			m_pendingEvents.push_back(pendingEvent);
+		}
+	}
+}
+
+void PtraceDebugBackend::resumeTracedThread(TracedThread& thread)
+{
+	const auto request = thread.singleStep ? PTRACE_SINGLESTEP : PTRACE_CONT;
+	ptrace(request, thread.tid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(thread.pendingSignal)));
+
+	thread.stopped = false;
+	thread.pendingSignal = 0;
+}
+
+#endif
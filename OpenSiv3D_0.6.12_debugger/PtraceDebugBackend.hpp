@@ -0,0 +1,131 @@
+﻿#pragma once
+#include "DebugBackend.hpp"
+
+#if SIV3D_PLATFORM(LINUX)
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <sys/types.h>
+
+// ptrace / waitpid によるバックエンド
+// waitpid のステータスを Win32 と同じ DEBUG_EVENT に変換して返し、
+// イベント通知中は Windows と同様に全スレッドを停止させておく
+class PtraceDebugBackend : public DebugBackend
+{
+public:
+
+	~PtraceDebugBackend() override;
+
+	bool createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo) override;
+
+	bool waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds) override;
+
+	bool continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus) override;
+
+	bool getThreadContext(HANDLE thread, CONTEXT& context) override;
+
+	bool setThreadContext(HANDLE thread, const CONTEXT& context) override;
+
+	bool setTrapFlag(HANDLE thread) override;
+
+	void suspendThread(HANDLE thread) override;
+
+	void resumeThread(HANDLE thread) override;
+
+	bool readMemory(HANDLE process, size_t address, size_t size, void* buffer) override;
+
+	bool writeMemory(HANDLE process, size_t address, size_t size, const void* buffer) override;
+
+	bool allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address) override;
+
+	bool debugBreakProcess(HANDLE process) override;
+
+	void closeHandle(HANDLE handle) override;
+
+	uint32 lastError() const override;
+
+	static HANDLE ToHandle(pid_t id)
+	{
+		return reinterpret_cast<HANDLE>(static_cast<intptr_t>(id));
+	}
+
+	static pid_t ToID(HANDLE handle)
+	{
+		return static_cast<pid_t>(reinterpret_cast<intptr_t>(handle));
+	}
+
+private:
+
+	struct TracedThread
+	{
+		pid_t tid = 0;
+
+		// ptrace-stop 中か
+		bool stopped = false;
+
+		// 次の再開を PTRACE_SINGLESTEP で行う（Windows の TF ビットに相当）
+		bool singleStep = false;
+
+		// 実行中に setTrapFlag された
+		bool breakRequested = false;
+
+		// clone 直後の SIGSTOP をまだ受け取っていない
+		bool expectInitialStop = false;
+
+		// こちらから送った SIGSTOP を読み捨てる
+		bool ignoreStop = false;
+
+		// 未処理の例外として再開時に配送するシグナル
+		int pendingSignal = 0;
+
+		int suspendCount = 0;
+
+		// 最後に読み書きした DR0～DR7（DR6 は止まるたびに変わるので毎回読む）
+		// デバッグレジスタは PEEKUSER / POKEUSER で 1 つずつしか読み書きできないので、変わったものだけ書く
+		std::array<uint64, 8> debugRegisters = {};
+
+		bool hasDebugRegisters = false;
+	};
+
+	// true を返したときは debugEvent を通知する
+	bool translateStatus(pid_t tid, int status, DEBUG_EVENT& debugEvent);
+
+	// Windows と同じく、イベント通知中は他のスレッドも止めておく
+	void stopOtherThreads(pid_t eventThreadID);
+
+	// tid が ptrace-stop になるまで待つ（トレーサースレッドから呼ぶ）
+	void waitUntilStopped(pid_t tid);
+
+	void resumeTracedThread(TracedThread& thread);
+
+	bool isTracerThread() const
+	{
+		return std::this_thread::get_id() == m_tracerThreadID;
+	}
+
+	pid_t m_pid = 0;
+
+	int m_memFile = -1;
+
+	std::thread::id m_tracerThreadID;
+
+	// UI スレッドからの suspend/setTrapFlag と、トレーサースレッドの処理を排他する
+	std::recursive_mutex m_mutex;
+
+	HashTable<pid_t, TracedThread> m_threads;
+
+	std::deque<DEBUG_EVENT> m_pendingEvents;
+
+	bool m_isInEvent = false;
+
+	// メインスレッドの開始を通知するための _start のブレークポイント
+	size_t m_entryAddress = 0;
+
+	uint8 m_entryOriginal = 0;
+
+	bool m_isEntryArmed = false;
+};
+
+#endif
@@ -0,0 +1,219 @@
+﻿#include "RecordingDebugBackend.hpp"
+
+using DebugTrace::RecordKind;
+using DebugTrace::PayloadWriter;
+
+namespace
+{
+	constexpr size_t FlushThreshold = 64 * 1024;
+}
+
+RecordingDebugBackend::RecordingDebugBackend(std::unique_ptr<DebugBackend> backend, FilePathView tracePath)
+	: m_backend(std::move(backend))
+	, m_writer(tracePath)
+{
+	const auto header = DebugTrace::CurrentHeader();
+	m_writer.write(&header, sizeof(header));
+}
+
+RecordingDebugBackend::~RecordingDebugBackend()
+{
+	std::lock_guard lock(m_mutex);
+	flush();
+}
+
+void RecordingDebugBackend::recordCommand(const DebugCommand& command)
+{
+	PayloadWriter payload;
+	if (not payload.writeCommand(command))
+	{
+		return;
+	}
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::Command, payload);
+}
+
+bool RecordingDebugBackend::createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo)
+{
+	const bool result = m_backend->createProcess(exeFilePath, arguments, processInfo);
+
+	const std::string path = Unicode::ToUTF8(exeFilePath);
+
+	PayloadWriter payload;
+	payload.write(result);
+	payload.write(m_backend->lastError());
+	payload.writeProcessInformation(processInfo);
+	payload.writeBytes(path.data(), path.size());
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::CreateProcess, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds)
+{
+	const bool result = m_backend->waitForDebugEvent(debugEvent, milliseconds);
+
+	PayloadWriter payload;
+	payload.write(result);
+	payload.write(m_backend->lastError());
+	if (result)
+	{
+		payload.writeDebugEvent(debugEvent);
+	}
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::WaitForDebugEvent, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus)
+{
+	const bool result = m_backend->continueDebugEvent(processID, threadID, continueStatus);
+
+	PayloadWriter payload;
+	payload.write(result);
+	payload.write(m_backend->lastError());
+	payload.write(threadID);
+	payload.write(continueStatus);
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::ContinueDebugEvent, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::getThreadContext(HANDLE thread, CONTEXT& context)
+{
+	const bool result = m_backend->getThreadContext(thread, context);
+
+	std::lock_guard lock(m_mutex);
+
+	PayloadWriter payload;
+	payload.write(reinterpret_cast<uint64>(thread));
+	payload.write(result);
+	payload.write(m_backend->lastError());
+	if (result)
+	{
+		payload.writeContextDelta(context, m_lastContexts[thread]);
+	}
+
+	writeRecord(RecordKind::GetThreadContext, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::setThreadContext(HANDLE thread, const CONTEXT& context)
+{
+	const bool result = m_backend->setThreadContext(thread, context);
+
+	PayloadWriter payload;
+	payload.write(reinterpret_cast<uint64>(thread));
+	payload.write(result);
+	payload.write(m_backend->lastError());
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::SetThreadContext, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::setTrapFlag(HANDLE thread)
+{
+	// バックエンド内部でのレジスタの読み書きは記録しない
+	const bool result = m_backend->setTrapFlag(thread);
+
+	PayloadWriter payload;
+	payload.write(reinterpret_cast<uint64>(thread));
+	payload.write(result);
+	payload.write(m_backend->lastError());
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::SetTrapFlag, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::readMemory(HANDLE process, size_t address, size_t size, void* buffer)
+{
+	const bool result = m_backend->readMemory(process, address, size, buffer);
+
+	PayloadWriter payload;
+	payload.write(static_cast<uint64>(address));
+	payload.write(static_cast<uint64>(size));
+	payload.write(result);
+	payload.write(m_backend->lastError());
+	if (result)
+	{
+		payload.writeBytes(buffer, size);
+	}
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::ReadMemory, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::writeMemory(HANDLE process, size_t address, size_t size, const void* buffer)
+{
+	const bool result = m_backend->writeMemory(process, address, size, buffer);
+
+	PayloadWriter payload;
+	payload.write(static_cast<uint64>(address));
+	payload.write(static_cast<uint64>(size));
+	payload.write(result);
+	payload.write(m_backend->lastError());
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::WriteMemory, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address)
+{
+	const bool result = m_backend->allocateMemory(process, nearAddress, size, address);
+
+	PayloadWriter payload;
+	payload.write(static_cast<uint64>(nearAddress));
+	payload.write(static_cast<uint64>(size));
+	payload.write(result);
+	payload.write(m_backend->lastError());
+	payload.write(static_cast<uint64>(result ? address : 0));
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::AllocateMemory, payload);
+	return result;
+}
+
+bool RecordingDebugBackend::debugBreakProcess(HANDLE process)
+{
+	const bool result = m_backend->debugBreakProcess(process);
+
+	PayloadWriter payload;
+	payload.write(result);
+	payload.write(m_backend->lastError());
+
+	std::lock_guard lock(m_mutex);
+	writeRecord(RecordKind::DebugBreakProcess, payload);
+	return result;
+}
+
+void RecordingDebugBackend::writeRecord(RecordKind kind, const PayloadWriter& payload)
+{
+	const auto& data = payload.data();
+	const uint32 length = static_cast<uint32>(data.size());
+
+	m_buffer.push_back(static_cast<uint8>(kind));
+	m_buffer.insert(m_buffer.end(), reinterpret_cast<const uint8*>(&length), reinterpret_cast<const uint8*>(&length) + sizeof(length));
+	m_buffer.insert(m_buffer.end(), data.begin(), data.end());
+
+	if (FlushThreshold <= m_buffer.size())
+	{
+		flush();
+	}
+}
+
+void RecordingDebugBackend::flush()
+{
+	if (not m_buffer.empty())
+	{
+		m_writer.write(m_buffer.data(), m_buffer.size());
+		m_buffer.clear();
+	}
+}
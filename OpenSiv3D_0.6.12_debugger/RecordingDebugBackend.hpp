@@ -0,0 +1,67 @@
+﻿#pragma once
+#include "DebugBackend.hpp"
+#include "DebugTrace.hpp"
+#include <mutex>
+
+// 実際のバックエンドに処理を委ねつつ、デバッグイベントとレジスタ・メモリの読み出し結果を
+// 記録ファイルに書き出す（ReplayDebugBackend で再生できる）
+class RecordingDebugBackend : public DebugBackend
+{
+public:
+
+	RecordingDebugBackend(std::unique_ptr<DebugBackend> backend, FilePathView tracePath);
+
+	~RecordingDebugBackend() override;
+
+	bool isOpen() const { return static_cast<bool>(m_writer); }
+
+	// UI からの操作も記録して、再生時に同じ順番で同じ操作をできるようにする
+	void recordCommand(const DebugCommand& command);
+
+	bool createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo) override;
+
+	bool waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds) override;
+
+	bool continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus) override;
+
+	bool getThreadContext(HANDLE thread, CONTEXT& context) override;
+
+	bool setThreadContext(HANDLE thread, const CONTEXT& context) override;
+
+	bool setTrapFlag(HANDLE thread) override;
+
+	void suspendThread(HANDLE thread) override { m_backend->suspendThread(thread); }
+
+	void resumeThread(HANDLE thread) override { m_backend->resumeThread(thread); }
+
+	bool readMemory(HANDLE process, size_t address, size_t size, void* buffer) override;
+
+	bool writeMemory(HANDLE process, size_t address, size_t size, const void* buffer) override;
+
+	bool allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address) override;
+
+	bool debugBreakProcess(HANDLE process) override;
+
+	void closeHandle(HANDLE handle) override { m_backend->closeHandle(handle); }
+
+	uint32 lastError() const override { return m_backend->lastError(); }
+
+private:
+
+	// m_mutex を取った状態で呼ぶ
+	void writeRecord(DebugTrace::RecordKind kind, const DebugTrace::PayloadWriter& payload);
+
+	void flush();
+
+	std::unique_ptr<DebugBackend> m_backend;
+
+	std::mutex m_mutex;
+
+	BinaryWriter m_writer;
+
+	// 書き出す前にためておく
+	Array<uint8> m_buffer;
+
+	// スレッドごとの前回のレジスタ（差分で記録する）
+	HashTable<HANDLE, DebugTrace::Registers> m_lastContexts;
+};
@@ -0,0 +1,493 @@
+﻿#include "ReplayDebugBackend.hpp"
+#include "DebugLog.hpp"
+
+using DebugTrace::RecordKind;
+using DebugTrace::PayloadReader;
+
+namespace
+{
+	// 記録と食い違ったときの lastError()
+	constexpr uint32 DivergedError = 13; // ERROR_INVALID_DATA
+
+	// 像にないメモリ・レジスタを読もうとしたときの lastError()
+	constexpr uint32 NotRecordedError = 299; // ERROR_PARTIAL_COPY
+}
+
+bool ReplayDebugBackend::open(FilePathView tracePath)
+{
+	BinaryReader reader(tracePath);
+	if (not reader)
+	{
+		DebugLog::WriteText(LogLevel::Error, LogCategory::Process, U"記録ファイルを開けません: ", tracePath);
+		return false;
+	}
+
+	m_data.resize(static_cast<size_t>(reader.size()));
+	reader.read(m_data.data(), m_data.size());
+
+	DebugTrace::Header header;
+	if (m_data.size() < sizeof(header))
+	{
+		return false;
+	}
+
+	std::memcpy(&header, m_data.data(), sizeof(header));
+	if (not DebugTrace::IsCompatible(header))
+	{
+		DebugLog::Write(LogLevel::Error, LogCategory::Process, U"このバージョンの記録ファイルではありません");
+		return false;
+	}
+
+	m_records.clear();
+	m_position = 0;
+	m_memory.clear();
+	m_contexts.clear();
+	m_recordedRegisters.clear();
+	m_commands.clear();
+	m_continue.reset();
+	m_allocations.clear();
+	m_isDiverged = false;
+
+	for (size_t offset = sizeof(header); offset < m_data.size();)
+	{
+		uint32 length = 0;
+		if (m_data.size() < offset + 1 + sizeof(length))
+		{
+			break;
+		}
+
+		std::memcpy(&length, m_data.data() + offset + 1, sizeof(length));
+
+		const size_t payloadOffset = offset + 1 + sizeof(length);
+		if (m_data.size() < payloadOffset + length)
+		{
+			// 記録の途中で終わっている
+			break;
+		}
+
+		m_records.push_back({ static_cast<RecordKind>(m_data[offset]), payloadOffset, length });
+		offset = payloadOffset + length;
+	}
+
+	// デバッグ対象のパスは最初の CreateProcess に入っている
+	for (const auto& record : m_records)
+	{
+		if (record.kind == RecordKind::CreateProcess)
+		{
+			PayloadReader payload(m_data.data() + record.offset, record.length);
+			bool result;
+			uint32 error;
+			PROCESS_INFORMATION processInfo;
+			if (payload.read(result) && payload.read(error) && payload.readProcessInformation(processInfo))
+			{
+				m_exeFilePath = Unicode::FromUTF8(std::string_view(reinterpret_cast<const char*>(payload.current()), payload.remaining()));
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+Optional<DebugCommand> ReplayDebugBackend::nextCommand()
+{
+	if (m_isDiverged || m_commands.empty())
+	{
+		return none;
+	}
+
+	DebugCommand command = std::move(m_commands.front());
+	m_commands.pop_front();
+	return command;
+}
+
+bool ReplayDebugBackend::createProcess(const FilePathView, const StringView, PROCESS_INFORMATION& processInfo)
+{
+	auto payload = next(RecordKind::CreateProcess);
+	if (not payload)
+	{
+		return false;
+	}
+
+	const bool result = readResult(*payload);
+	payload->readProcessInformation(processInfo);
+
+	loadSection();
+	return result;
+}
+
+bool ReplayDebugBackend::waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD)
+{
+	if (not m_commands.empty())
+	{
+		diverge(U"記録された操作の前に再開しました");
+		return false;
+	}
+
+	if (m_isBreakRequested)
+	{
+		m_isBreakRequested = false;
+
+		if (m_breakRequestHandler)
+		{
+			m_breakRequestHandler();
+		}
+	}
+
+	auto payload = next(RecordKind::WaitForDebugEvent);
+	if (not payload)
+	{
+		return false;
+	}
+
+	const bool result = readResult(*payload);
+	if (result && not payload->readDebugEvent(debugEvent))
+	{
+		diverge(U"DEBUG_EVENT");
+		return false;
+	}
+
+	loadSection();
+
+	if (not result)
+	{
+		return false;
+	}
+
+#if SIV3D_PLATFORM(WINDOWS)
+	// 記録時のファイルハンドルは使えないので、シンボルの読み込み用に開き直す
+	if (debugEvent.dwDebugEventCode == CREATE_PROCESS_DEBUG_EVENT)
+	{
+		m_exeFileHandle = CreateFileW(m_exeFilePath.toWstr().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+		debugEvent.u.CreateProcessInfo.hFile = m_exeFileHandle;
+	}
+	else if (debugEvent.dwDebugEventCode == LOAD_DLL_DEBUG_EVENT)
+	{
+		debugEvent.u.LoadDll.hFile = NULL;
+	}
+#endif
+
+	return true;
+}
+
+bool ReplayDebugBackend::continueDebugEvent(DWORD, DWORD threadID, DWORD continueStatus)
+{
+	if (m_isDiverged)
+	{
+		m_lastError = DivergedError;
+		return false;
+	}
+
+	if (not m_continue)
+	{
+		return true;
+	}
+
+	const ContinueRecord recorded = m_continue.value();
+	m_continue.reset();
+
+	if (recorded.threadID != threadID || recorded.continueStatus != continueStatus)
+	{
+		diverge(U"ContinueDebugEvent の引数");
+		return false;
+	}
+
+	m_lastError = recorded.error;
+	return recorded.result;
+}
+
+bool ReplayDebugBackend::getThreadContext(HANDLE thread, CONTEXT& context)
+{
+	const auto it = m_contexts.find(thread);
+	if (it == m_contexts.end())
+	{
+		m_lastError = NotRecordedError;
+		return false;
+	}
+
+	context = it->second;
+	return true;
+}
+
+bool ReplayDebugBackend::setThreadContext(HANDLE thread, const CONTEXT& context)
+{
+	m_contexts[thread] = context;
+	return true;
+}
+
+bool ReplayDebugBackend::setTrapFlag(HANDLE thread)
+{
+	constexpr DWORD TrapFlag = 0x100;
+
+	const auto it = m_contexts.find(thread);
+	if (it == m_contexts.end())
+	{
+		m_lastError = NotRecordedError;
+		return false;
+	}
+
+	it->second.EFlags |= TrapFlag;
+	return true;
+}
+
+bool ReplayDebugBackend::readMemory(HANDLE, size_t address, size_t size, void* buffer)
+{
+	auto* bytes = static_cast<uint8*>(buffer);
+
+	for (size_t done = 0; done < size;)
+	{
+		const size_t pageAddress = (address + done) & ~(PageSize - 1);
+		const size_t pageOffset = (address + done) - pageAddress;
+		const size_t count = Min(PageSize - pageOffset, size - done);
+
+		const auto it = m_memory.find(pageAddress);
+		if (it == m_memory.end())
+		{
+			m_lastError = NotRecordedError;
+			return false;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (not it->second.valid[pageOffset + i])
+			{
+				m_lastError = NotRecordedError;
+				return false;
+			}
+		}
+
+		std::memcpy(bytes + done, it->second.bytes.data() + pageOffset, count);
+		done += count;
+	}
+
+	return true;
+}
+
+bool ReplayDebugBackend::writeMemory(HANDLE, size_t address, size_t size, const void* buffer)
+{
+	const auto* bytes = static_cast<const uint8*>(buffer);
+
+	for (size_t done = 0; done < size;)
+	{
+		const size_t pageAddress = (address + done) & ~(PageSize - 1);
+		const size_t pageOffset = (address + done) - pageAddress;
+		const size_t count = Min(PageSize - pageOffset, size - done);
+
+		auto& page = m_memory[pageAddress];
+		std::memcpy(page.bytes.data() + pageOffset, bytes + done, count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			page.valid.set(pageOffset + i);
+		}
+
+		done += count;
+	}
+
+	return true;
+}
+
+bool ReplayDebugBackend::allocateMemory(HANDLE, size_t, size_t, size_t& address)
+{
+	if (m_allocations.empty())
+	{
+		m_lastError = NotRecordedError;
+		return false;
+	}
+
+	const AllocationRecord recorded = m_allocations.front();
+	m_allocations.pop_front();
+
+	m_lastError = recorded.error;
+	address = recorded.address;
+	return recorded.result;
+}
+
+bool ReplayDebugBackend::debugBreakProcess(HANDLE)
+{
+	// 止める操作は BreakCommand として記録され、記録されたデバッグイベントがその結果を再現する
+	return true;
+}
+
+void ReplayDebugBackend::closeHandle(HANDLE handle)
+{
+	// 開き直した実行ファイルのハンドルだけが本物で、ほかは記録時の値
+	if (handle != NULL && handle == m_exeFileHandle)
+	{
+#if SIV3D_PLATFORM(WINDOWS)
+		CloseHandle(handle);
+#endif
+		m_exeFileHandle = NULL;
+	}
+}
+
+Optional<PayloadReader> ReplayDebugBackend::next(RecordKind kind)
+{
+	if (m_isDiverged)
+	{
+		m_lastError = DivergedError;
+		return none;
+	}
+
+	// 記録の終わり（食い違いではない）
+	if (m_records.size() <= m_position)
+	{
+		m_lastError = DivergedError;
+		return none;
+	}
+
+	const auto& record = m_records[m_position];
+	if (record.kind != kind)
+	{
+		diverge(U"デバッグイベントの順番");
+		return none;
+	}
+
+	++m_position;
+	return PayloadReader(m_data.data() + record.offset, record.length);
+}
+
+void ReplayDebugBackend::loadSection()
+{
+	HashTable<size_t, std::bitset<PageSize>> loadedMemory;
+	HashSet<HANDLE> loadedThreads;
+
+	m_continue.reset();
+
+	for (; m_position < m_records.size(); ++m_position)
+	{
+		const auto& record = m_records[m_position];
+		if (record.kind == RecordKind::CreateProcess || record.kind == RecordKind::WaitForDebugEvent)
+		{
+			break;
+		}
+
+		PayloadReader payload(m_data.data() + record.offset, record.length);
+		bool result = false;
+		uint32 error = 0;
+
+		switch (record.kind)
+		{
+		case RecordKind::GetThreadContext:
+		{
+			HANDLE thread = NULL;
+			if (not payload.readPointer(thread) || not payload.read(result) || not payload.read(error) || not result)
+			{
+				break;
+			}
+
+			auto& registers = m_recordedRegisters[thread];
+			if (not payload.readContextDelta(registers))
+			{
+				diverge(U"CONTEXT の差分");
+				return;
+			}
+
+			// 区間で最初に読まれた値が、このデバッグイベントで止まったときのレジスタ
+			if (loadedThreads.insert(thread).second)
+			{
+				m_contexts[thread] = DebugTrace::FromRegisters(registers);
+			}
+			break;
+		}
+		case RecordKind::ReadMemory:
+		{
+			uint64 address = 0, size = 0;
+			if (payload.read(address) && payload.read(size) && payload.read(result) && payload.read(error)
+				&& result && size <= payload.remaining())
+			{
+				loadMemory(static_cast<size_t>(address), payload.current(), static_cast<size_t>(size), loadedMemory);
+			}
+			break;
+		}
+		case RecordKind::ContinueDebugEvent:
+		{
+			ContinueRecord recorded;
+			if (not m_continue && payload.read(recorded.result) && payload.read(recorded.error)
+				&& payload.read(recorded.threadID) && payload.read(recorded.continueStatus))
+			{
+				m_continue = recorded;
+			}
+			break;
+		}
+		case RecordKind::AllocateMemory:
+		{
+			uint64 nearAddress = 0, size = 0, address = 0;
+			AllocationRecord recorded;
+			if (payload.read(nearAddress) && payload.read(size) && payload.read(recorded.result) && payload.read(recorded.error) && payload.read(address))
+			{
+				recorded.address = static_cast<size_t>(address);
+				m_allocations.push_back(recorded);
+			}
+			break;
+		}
+		case RecordKind::Command:
+		{
+			DebugCommand command;
+			if (not payload.readCommand(command))
+			{
+				break;
+			}
+
+			// 止める操作は実行中に行うので、止まっている間の操作とは分けておく
+			if (std::holds_alternative<BreakCommand>(command))
+			{
+				m_isBreakRequested = true;
+			}
+			else
+			{
+				m_commands.push_back(std::move(command));
+			}
+			break;
+		}
+		default:
+			// SetThreadContext / SetTrapFlag / WriteMemory / DebugBreakProcess は再生中の呼び出しで像に当たる
+			break;
+		}
+	}
+}
+
+void ReplayDebugBackend::loadMemory(size_t address, const uint8* data, size_t size, HashTable<size_t, std::bitset<PageSize>>& loaded)
+{
+	for (size_t done = 0; done < size;)
+	{
+		const size_t pageAddress = (address + done) & ~(PageSize - 1);
+		const size_t pageOffset = (address + done) - pageAddress;
+		const size_t count = Min(PageSize - pageOffset, size - done);
+
+		auto& page = m_memory[pageAddress];
+		auto& loadedBytes = loaded[pageAddress];
+
+		for (size_t i = pageOffset; i < pageOffset + count; ++i)
+		{
+			if (not loadedBytes[i])
+			{
+				page.bytes[i] = data[done + (i - pageOffset)];
+				page.valid.set(i);
+				loadedBytes.set(i);
+			}
+		}
+
+		done += count;
+	}
+}
+
+bool ReplayDebugBackend::readResult(PayloadReader& reader)
+{
+	bool result = false;
+	uint32 error = 0;
+	reader.read(result);
+	reader.read(error);
+	m_lastError = error;
+	return result;
+}
+
+void ReplayDebugBackend::diverge(StringView reason)
+{
+	if (not m_isDiverged)
+	{
+		DebugLog::WriteText(LogLevel::Error, LogCategory::Process, U"記録と食い違いました: ", U"{} (record {})"_fmt(reason, m_position));
+	}
+
+	m_isDiverged = true;
+	m_lastError = DivergedError;
+}
@@ -0,0 +1,157 @@
+﻿#pragma once
+#include "DebugBackend.hpp"
+#include "DebugTrace.hpp"
+#include <bitset>
+#include <deque>
+#include <functional>
+
+// RecordingDebugBackend で記録したファイルから、記録時と同じ結果を返すバックエンド
+// デバッグ対象は起動しない
+//
+// 記録をデバッグイベントごとの区間に分け、区間に入るときにその区間で読まれたメモリとレジスタを
+// アドレスをキーにしたメモリの像・スレッドごとのレジスタの像に反映する
+// 区間の中の読み書きは呼び出しの順番に関係なく像から答え、書き込みは像に当てる
+// デバッグイベントの順番と ContinueDebugEvent の引数が記録と食い違ったところで失敗を返す
+//
+// シンボル・行情報は記録された実行ファイルのパスから読み込むので、そのファイルは残しておく必要がある
+class ReplayDebugBackend : public DebugBackend
+{
+public:
+
+	// 記録ファイル全体を読み込む
+	bool open(FilePathView tracePath);
+
+	// 記録したときのデバッグ対象
+	const FilePath& exeFilePath() const { return m_exeFilePath; }
+
+	// 今の区間で記録された UI からの操作を順に返す（BreakCommand は含まない）
+	Optional<DebugCommand> nextCommand();
+
+	// 記録された BreakCommand の次のデバッグイベントを返す前に呼ぶ（ProcessDebugger::requestDebugBreak を渡す）
+	void setBreakRequestHandler(std::function<void()> handler) { m_breakRequestHandler = std::move(handler); }
+
+	bool isFinished() const { return m_records.size() <= m_position && m_commands.empty(); }
+
+	bool isDiverged() const { return m_isDiverged; }
+
+	size_t recordCount() const { return m_records.size(); }
+
+	bool createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo) override;
+
+	bool waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds) override;
+
+	bool continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus) override;
+
+	bool getThreadContext(HANDLE thread, CONTEXT& context) override;
+
+	bool setThreadContext(HANDLE thread, const CONTEXT& context) override;
+
+	bool setTrapFlag(HANDLE thread) override;
+
+	void suspendThread(HANDLE) override {}
+
+	void resumeThread(HANDLE) override {}
+
+	bool readMemory(HANDLE process, size_t address, size_t size, void* buffer) override;
+
+	bool writeMemory(HANDLE process, size_t address, size_t size, const void* buffer) override;
+
+	bool allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address) override;
+
+	bool debugBreakProcess(HANDLE process) override;
+
+	void closeHandle(HANDLE handle) override;
+
+	uint32 lastError() const override { return m_lastError; }
+
+private:
+
+	static constexpr size_t PageSize = 4096;
+
+	struct Record
+	{
+		DebugTrace::RecordKind kind;
+
+		size_t offset;
+
+		size_t length;
+	};
+
+	// メモリの像の 1 ページ（記録で読まれたか再生中に書いたバイトだけ valid）
+	struct MemoryPage
+	{
+		std::array<uint8, PageSize> bytes = {};
+
+		std::bitset<PageSize> valid;
+	};
+
+	struct ContinueRecord
+	{
+		DWORD threadID = 0;
+
+		DWORD continueStatus = 0;
+
+		bool result = false;
+
+		uint32 error = 0;
+	};
+
+	struct AllocationRecord
+	{
+		bool result = false;
+
+		uint32 error = 0;
+
+		size_t address = 0;
+	};
+
+	// 次のレコードが kind でなければ食い違いとして none を返す
+	Optional<DebugTrace::PayloadReader> next(DebugTrace::RecordKind kind);
+
+	// 次の CreateProcess / WaitForDebugEvent までのレコードを像に反映する
+	void loadSection();
+
+	// 区間の中で先に読まれたバイトは上書きしない（後の読み出しは再生中の書き込みで再現される）
+	void loadMemory(size_t address, const uint8* data, size_t size, HashTable<size_t, std::bitset<PageSize>>& loaded);
+
+	// 結果とエラーコードを読んで lastError に反映する
+	bool readResult(DebugTrace::PayloadReader& reader);
+
+	void diverge(StringView reason);
+
+	Array<uint8> m_data;
+
+	Array<Record> m_records;
+
+	size_t m_position = 0;
+
+	FilePath m_exeFilePath;
+
+	HANDLE m_exeFileHandle = NULL;
+
+	// ページの先頭アドレス → ページ
+	HashTable<size_t, MemoryPage> m_memory;
+
+	// スレッドごとの今のレジスタ
+	HashTable<HANDLE, CONTEXT> m_contexts;
+
+	// 記録の差分を当てるためのスレッドごとの前回のレジスタ
+	HashTable<HANDLE, DebugTrace::Registers> m_recordedRegisters;
+
+	// 今の区間の UI からの操作
+	std::deque<DebugCommand> m_commands;
+
+	Optional<ContinueRecord> m_continue;
+
+	std::function<void()> m_breakRequestHandler;
+
+	// 今の区間で実行中に止める操作が記録されていた
+	bool m_isBreakRequested = false;
+
+	// 記録された順の確保の結果
+	std::deque<AllocationRecord> m_allocations;
+
+	uint32 m_lastError = 0;
+
+	bool m_isDiverged = false;
+};
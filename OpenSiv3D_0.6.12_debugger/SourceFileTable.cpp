@@ -0,0 +1,79 @@
+﻿#include "SourceFileTable.hpp"
+
+namespace
+{
+	// パスの区切りで終わっているか（Main.cpp が MyMain.cpp に一致しないように）
+	bool EndsWithPath(StringView path, StringView fileName)
+	{
+		if (not path.ends_with(fileName))
+		{
+			return false;
+		}
+
+		if (path.size() == fileName.size())
+		{
+			return true;
+		}
+
+		const char32 separator = path[path.size() - fileName.size() - 1];
+		return (separator == U'/') || (separator == U'\\');
+	}
+}
+
+uint32 SourceFileTable::intern(StringView path)
+{
+	const String key{ path };
+	if (const auto it = m_ids.find(key); it != m_ids.end())
+	{
+		return it->second;
+	}
+
+	const uint32 fileID = static_cast<uint32>(m_paths.size());
+	m_paths.push_back(key);
+	m_isUserFile.push_back(false);
+	m_ids.emplace(key, fileID);
+	return fileID;
+}
+
+Optional<uint32> SourceFileTable::find(StringView path) const
+{
+	if (const auto it = m_ids.find(String{ path }); it != m_ids.end())
+	{
+		return it->second;
+	}
+	return none;
+}
+
+const String& SourceFileTable::path(uint32 fileID) const
+{
+	static const String Empty;
+	return (fileID < m_paths.size()) ? m_paths[fileID] : Empty;
+}
+
+Array<uint32> SourceFileTable::findBySuffix(StringView fileName) const
+{
+	Array<uint32> fileIDs;
+	for (size_t i = 0; i < m_paths.size(); ++i)
+	{
+		if (EndsWithPath(m_paths[i], fileName))
+		{
+			fileIDs.push_back(static_cast<uint32>(i));
+		}
+	}
+	return fileIDs;
+}
+
+void SourceFileTable::setUserFile(uint32 fileID, bool isUserFile)
+{
+	if (fileID < m_isUserFile.size())
+	{
+		m_isUserFile[fileID] = isUserFile;
+	}
+}
+
+void SourceFileTable::clear()
+{
+	m_paths.clear();
+	m_isUserFile.clear();
+	m_ids.clear();
+}
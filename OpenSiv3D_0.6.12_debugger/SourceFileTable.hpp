@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+// デバッグ対象のソースファイルのパスを、モジュールごとに 1 度だけ登録して小さな整数の ID で扱う
+//
+// 行情報・ステップ実行・ソースの表示ではパスの文字列ではなく ID を比べる
+// パスが要るのは画面やログに出すときだけ
+class SourceFileTable
+{
+public:
+
+	static constexpr uint32 InvalidID = 0xFFFF'FFFF;
+
+	// 同じパスには同じ ID を返す
+	uint32 intern(StringView path);
+
+	Optional<uint32> find(StringView path) const;
+
+	// 登録していない ID なら空文字列
+	const String& path(uint32 fileID) const;
+
+	// パスの末尾が fileName と一致するファイル（例: Main.cpp, src/Main.cpp）
+	Array<uint32> findBySuffix(StringView fileName) const;
+
+	// ステップ実行で止まるユーザーのファイルか
+	void setUserFile(uint32 fileID, bool isUserFile);
+
+	bool isUserFile(uint32 fileID) const
+	{
+		return (fileID < m_isUserFile.size()) && m_isUserFile[fileID];
+	}
+
+	size_t size() const { return m_paths.size(); }
+
+	bool isEmpty() const { return m_paths.isEmpty(); }
+
+	void clear();
+
+private:
+
+	Array<String> m_paths;
+
+	Array<bool> m_isUserFile;
+
+	HashTable<String, uint32> m_ids;
+};
@@ -1,8 +1,8 @@
-﻿#include <Windows.h>
-#include <DbgHelp.h>
-#include "StepHandler.hpp"
+﻿#include "StepHandler.hpp"
 #include "ProcessHandle.hpp"
 #include "ThreadHandle.hpp"
+#include "DebugMetrics.hpp"
+#include "InstructionDecoder.hpp"
 
 void StepHandler::initializeSingleStepHelper()
 {
@@ -18,14 +18,17 @@ void StepHandler::saveCurrentLineInfo(const ProcessHandle& process, const Thread
 	}
 	else
 	{
-		m_lastLineInfoMap[thread.getHandle()].fileName = U"";
-		m_lastLineInfoMap[thread.getHandle()].lineNumber = 0;
+		m_lastLineInfoMap[thread.getHandle()] = LineInfo{};
 	}
 }
 
 bool StepHandler::isLineChanged(const ProcessHandle& process, const ThreadHandle& thread)
 {
-	auto lineInfoOpt = process.getCurrentLineInfo(thread);
+	Optional<LineInfo> lineInfoOpt;
+	{
+		ScopedMetric metric(Metric::LineLookup);
+		lineInfoOpt = process.getCurrentLineInfo(thread);
+	}
 
 	// 行情報の取得に失敗したときは同じ行とみなす
 	if (not lineInfoOpt.has_value())
@@ -36,7 +39,8 @@ bool StepHandler::isLineChanged(const ProcessHandle& process, const ThreadHandle
 	const auto& current = lineInfoOpt.value();
 	m_lastCheckedLineInfo = current;
 
-	if (current.lineNumber == m_lastLineInfoMap[thread.getHandle()].lineNumber && current.fileName == m_lastLineInfoMap[thread.getHandle()].fileName)
+	const auto& last = m_lastLineInfoMap[thread.getHandle()];
+	if (current.lineNumber == last.lineNumber && current.fileID == last.fileID)
 	{
 		return false;
 	}
@@ -44,3 +48,96 @@ bool StepHandler::isLineChanged(const ProcessHandle& process, const ThreadHandle
 	return true;
 }
 
+void StepHandler::updateCurrentLineInfo(const ProcessHandle& process, const ThreadHandle& thread)
+{
+	ScopedMetric metric(Metric::LineLookup);
+	m_lastCheckedLineInfo = process.getCurrentLineInfo(thread).value_or(LineInfo{});
+}
+
+Optional<StepRangeExits> StepHandler::FindRangeExits(const FunctionFlow& function, const Array<LineRange>& ranges, bool stepInto)
+{
+	const auto isInside = [&](size_t address)
+	{
+		for (const auto& range : ranges)
+		{
+			if (range.begin <= address && address < range.end)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	StepRangeExits exits;
+
+	for (const auto& range : ranges)
+	{
+		const auto* first = function.findInstruction(range.begin);
+		if (not first)
+		{
+			return none;
+		}
+
+		bool fallsThrough = true;
+
+		for (size_t index = (first - function.instructions.data()), address = range.begin; address < range.end; ++index)
+		{
+			// 解析できなかったバイトがある・命令が範囲の終わりをまたぐ
+			if (function.instructions.size() <= index || function.instructions[index].address != address
+				|| range.end < function.instructions[index].next())
+			{
+				return none;
+			}
+
+			const auto& instruction = function.instructions[index];
+			address = instruction.next();
+			fallsThrough = true;
+
+			switch (instruction.flow)
+			{
+			case InstructionFlow::Jump:
+				fallsThrough = false;
+				[[fallthrough]];
+			case InstructionFlow::ConditionalJump:
+			case InstructionFlow::Loop:
+				if (not isInside(instruction.target))
+				{
+					exits.targets.push_back(instruction.target);
+				}
+				break;
+
+			case InstructionFlow::Call:
+				// ステップオーバーなら呼び出し先はそのまま実行させ、戻ってきたところから続ける
+				if (stepInto)
+				{
+					exits.targets.push_back(instruction.target);
+				}
+				break;
+
+			case InstructionFlow::Return:
+			case InstructionFlow::IndirectJump:
+				exits.unresolved.push_back(instruction.address);
+				fallsThrough = false;
+				break;
+
+			case InstructionFlow::IndirectCall:
+				if (stepInto)
+				{
+					exits.unresolved.push_back(instruction.address);
+				}
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		// 最後の命令の次は範囲の外
+		if (fallsThrough && not isInside(range.end))
+		{
+			exits.targets.push_back(range.end);
+		}
+	}
+
+	return exits;
+}
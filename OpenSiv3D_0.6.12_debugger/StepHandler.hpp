@@ -1,11 +1,23 @@
 ﻿#pragma once
-#include <Windows.h>
+#include "DebugTypes.hpp"
 #include <Siv3D.hpp>
 #include "ProcessHandle.hpp"
+#include "FunctionFlowCache.hpp"
 
 class ThreadHandle;
 class ProcessHandle;
 
+// 行を最後まで実行させるための一時ブレークポイントの位置
+struct StepRangeExits
+{
+	// 行の範囲の外への分岐先と、範囲の終わり（ステップインなら呼び出し先も）
+	Array<size_t> targets;
+
+	// 行き先が実行するまでわからない命令（ret・間接 jmp、ステップインなら間接 call）
+	// ここで止めてこの命令だけシングルステップする
+	Array<size_t> unresolved;
+};
+
 class StepHandler
 {
 public:
@@ -16,11 +28,18 @@ public:
 
 	bool isLineChanged(const ProcessHandle& process, const ThreadHandle& thread);
 
+	// thread の今の行を lastLineInfo にする（行情報がなければ空）
+	void updateCurrentLineInfo(const ProcessHandle& process, const ThreadHandle& thread);
+
 	const LineInfo& lastLineInfo()
 	{
 		return m_lastCheckedLineInfo;
 	}
 
+	// 関数の解析済みの命令から、行の範囲から出ていく場所を返す（範囲の中に解析できない命令があれば none）
+	// 行の中のループや呼び出しは止まらずに実行させ、範囲から出たときだけ止まれるようにする
+	static Optional<StepRangeExits> FindRangeExits(const FunctionFlow& function, const Array<LineRange>& ranges, bool stepInto);
+
 private:
 
 	HashTable<HANDLE, LineInfo> m_lastLineInfoMap; // スレッドID -> 行情報
@@ -1,14 +1,26 @@
 ﻿#include <Siv3D.hpp>
 #include "ThreadHandle.hpp"
+#include "DebugBackend.hpp"
+#include "DebugLog.hpp"
+
+void ThreadHandle::suspend() const
+{
+	m_backend->suspendThread(m_threadHandle);
+}
+
+void ThreadHandle::resume() const
+{
+	m_backend->resumeThread(m_threadHandle);
+}
 
 Optional<CONTEXT> ThreadHandle::getContext() const
 {
 	CONTEXT context = {};
 	context.ContextFlags = CONTEXT_FULL;
 
-	if (not GetThreadContext(m_threadHandle, &context))
+	if (not m_backend->getThreadContext(m_threadHandle, context))
 	{
-		Console << U"GetThreadContext failed: " << GetLastError();
+		DebugLog::Write(LogLevel::Warning, LogCategory::Thread, U"GetThreadContext failed: {}", m_backend->lastError());
 		return none;
 	}
 
@@ -17,9 +29,9 @@ Optional<CONTEXT> ThreadHandle::getContext() const
 
 bool ThreadHandle::setContext(const CONTEXT& context) const
 {
-	if (not SetThreadContext(m_threadHandle, &context))
+	if (not m_backend->setThreadContext(m_threadHandle, context))
 	{
-		Console << U"SetThreadContext failed: " << GetLastError();
+		DebugLog::Write(LogLevel::Warning, LogCategory::Thread, U"SetThreadContext failed: {}", m_backend->lastError());
 		return false;
 	}
 
@@ -28,12 +40,120 @@ bool ThreadHandle::setContext(const CONTEXT& context) const
 
 void ThreadHandle::setTrapFlag() const
 {
-	if (auto contextOpt = getContext())
+	m_backend->setTrapFlag(m_threadHandle);
+}
+
+namespace
+{
+	// EFLAGS の RF（再開した命令の実行ブレークポイントを 1 回だけ無視する）
+	constexpr DWORD ResumeFlag = 0x10000;
+
+	// DR6 の B0～B3
+	constexpr DWORD64 Dr6HitMask = 0b1111;
+
+	DWORD64& DebugAddressRegister(CONTEXT& context, size_t slot)
 	{
-		auto context = contextOpt.value();
-		context.EFlags |= 0x100; // TFビット
-		setContext(context);
+		switch (slot)
+		{
+		case 0: return context.Dr0;
+		case 1: return context.Dr1;
+		case 2: return context.Dr2;
+		default: return context.Dr3;
+		}
+	}
+
+	// DR7 の LEN の値（1, 2, 8, 4 バイト → 00, 01, 10, 11）
+	DWORD64 LengthBits(uint8 size)
+	{
+		switch (size)
+		{
+		case 2: return 0b01;
+		case 8: return 0b10;
+		case 4: return 0b11;
+		default: return 0b00;
+		}
+	}
+}
+
+bool ThreadHandle::setHardwareBreakPoint(size_t slot, const HardwareBreakPoint& breakPoint) const
+{
+	CONTEXT context = {};
+	context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+
+	if (MaxHardwareBreakPoints <= slot || not m_backend->getThreadContext(m_threadHandle, context))
+	{
+		return false;
+	}
+
+	const DWORD64 control = static_cast<DWORD64>(breakPoint.type) | (LengthBits(breakPoint.size) << 2);
+
+	DebugAddressRegister(context, slot) = breakPoint.address;
+
+	// L0～L3 は 2 ビットおき、R/W・LEN は 16 ビット目から 4 ビットずつ
+	context.Dr7 &= ~((0b11ull << (slot * 2)) | (0b1111ull << (16 + slot * 4)));
+	context.Dr7 |= (1ull << (slot * 2)) | (control << (16 + slot * 4));
+	context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+
+	return setContext(context);
+}
+
+bool ThreadHandle::clearHardwareBreakPoint(size_t slot) const
+{
+	CONTEXT context = {};
+	context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+
+	if (MaxHardwareBreakPoints <= slot || not m_backend->getThreadContext(m_threadHandle, context))
+	{
+		return false;
+	}
+
+	DebugAddressRegister(context, slot) = 0;
+	context.Dr7 &= ~((0b11ull << (slot * 2)) | (0b1111ull << (16 + slot * 4)));
+	context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+
+	return setContext(context);
+}
+
+Optional<size_t> ThreadHandle::takeHardwareBreakPointHit() const
+{
+	CONTEXT context = {};
+	context.ContextFlags = CONTEXT_FULL | CONTEXT_DEBUG_REGISTERS;
+
+	if (not m_backend->getThreadContext(m_threadHandle, context))
+	{
+		return none;
+	}
+
+	// 有効にしていない slot のビットは無視する
+	const DWORD64 hits = context.Dr6 & Dr6HitMask;
+	Optional<size_t> hitSlot;
+	for (size_t slot = 0; slot < MaxHardwareBreakPoints; ++slot)
+	{
+		if ((hits & (1ull << slot)) && (context.Dr7 & (1ull << (slot * 2))))
+		{
+			hitSlot = slot;
+			break;
+		}
 	}
+
+	if (not hitSlot)
+	{
+		return none;
+	}
+
+	context.Dr6 = 0;
+	context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+
+	const bool isExecute = ((context.Dr7 >> (16 + *hitSlot * 4)) & 0b11) == 0;
+	if (isExecute)
+	{
+		context.EFlags |= ResumeFlag;
+		context.ContextFlags |= CONTEXT_FULL;
+	}
+
+	setContext(context);
+
+	return hitSlot;
 }
 
 void ThreadHandle::backRip() const
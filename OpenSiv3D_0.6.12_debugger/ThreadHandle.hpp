@@ -1,5 +1,31 @@
 ﻿#pragma once
-#include <Windows.h>
+#include "DebugTypes.hpp"
+
+class DebugBackend;
+
+// DR7 の R/W ビットの値（x86 には読み込みだけを検出する設定はない）
+enum class HardwareBreakPointType : uint8
+{
+	Execute = 0b00,
+	Write = 0b01,
+	ReadWrite = 0b11,
+};
+
+// デバッグレジスタ DR0～DR3 の 1 つ分
+struct HardwareBreakPoint
+{
+	size_t address = 0;
+
+	HardwareBreakPointType type = HardwareBreakPointType::Execute;
+
+	// 1, 2, 4, 8（Execute は 1）。address はこの大きさに揃っている必要がある
+	uint8 size = 1;
+
+	uint32 hitCount = 0;
+};
+
+// DR0～DR3
+constexpr size_t MaxHardwareBreakPoints = 4;
 
 class ThreadHandle
 {
@@ -7,17 +33,11 @@ public:
 
 	ThreadHandle() = default;
 
-	ThreadHandle(HANDLE thread) :m_threadHandle(thread) {}
+	ThreadHandle(DebugBackend* backend, HANDLE thread) :m_backend(backend), m_threadHandle(thread) {}
 
-	void suspend() const
-	{
-		SuspendThread(m_threadHandle);
-	}
+	void suspend() const;
 
-	void resume() const
-	{
-		ResumeThread(m_threadHandle);
-	}
+	void resume() const;
 
 	Optional<CONTEXT> getContext() const;
 
@@ -27,9 +47,20 @@ public:
 
 	void backRip() const;
 
+	// デバッグレジスタ slot（0～3）を設定して DR7 で有効にする
+	bool setHardwareBreakPoint(size_t slot, const HardwareBreakPoint& breakPoint) const;
+
+	bool clearHardwareBreakPoint(size_t slot) const;
+
+	// DR6 を見て、ハードウェアブレークポイントで止まっていればその slot を返す
+	// DR6 は消し、実行ブレークポイントなら同じ命令で再び止まらないように RF を立てる
+	Optional<size_t> takeHardwareBreakPointHit() const;
+
 	HANDLE getHandle() const { return m_threadHandle; }
 
 private:
 
+	DebugBackend* m_backend = nullptr;
+
 	HANDLE m_threadHandle = NULL;
 };
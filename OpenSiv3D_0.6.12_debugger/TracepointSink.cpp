@@ -0,0 +1,180 @@
+﻿#include "TracepointSink.hpp"
+
+namespace
+{
+	constexpr auto DrainInterval = std::chrono::milliseconds(20);
+}
+
+TracepointSink::~TracepointSink()
+{
+	{
+		std::lock_guard lock(m_drainMutex);
+		m_isRunning = false;
+	}
+
+	m_condition.notify_all();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	std::lock_guard lock(m_drainMutex);
+	drain();
+}
+
+uint32 TracepointSink::addFormat(Array<String> literals)
+{
+	uint32 formatID;
+	{
+		std::lock_guard lock(m_mutex);
+		formatID = static_cast<uint32>(m_formats.size());
+		m_formats.push_back(std::make_unique<const Array<String>>(std::move(literals)));
+	}
+
+	start();
+	return formatID;
+}
+
+bool TracepointSink::setOutputPath(FilePathView path)
+{
+	std::lock_guard lock(m_drainMutex);
+	return m_writer.open(path);
+}
+
+void TracepointSink::write(const TracepointRecord& record)
+{
+	std::lock_guard lock(m_mutex);
+
+	if (MaxPendingRecords <= m_pending.size())
+	{
+		m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	m_pending.push_back(record);
+}
+
+void TracepointSink::flush()
+{
+	std::lock_guard lock(m_drainMutex);
+	drain();
+}
+
+Array<String> TracepointSink::recentLines() const
+{
+	std::lock_guard lock(m_linesMutex);
+
+	Array<String> lines;
+	lines.reserve(m_recentLines.size());
+	for (size_t i = 0; i < m_recentLines.size(); ++i)
+	{
+		lines.push_back(m_recentLines[(m_recentLinesHead + i) % m_recentLines.size()]);
+	}
+	return lines;
+}
+
+void TracepointSink::start()
+{
+	std::lock_guard lock(m_drainMutex);
+
+	if (m_thread.joinable())
+	{
+		return;
+	}
+
+	m_isRunning = true;
+	m_thread = std::thread([this] { run(); });
+}
+
+void TracepointSink::run()
+{
+	std::unique_lock lock(m_drainMutex);
+
+	while (m_isRunning)
+	{
+		m_condition.wait_for(lock, DrainInterval, [this] { return not m_isRunning; });
+		drain();
+	}
+}
+
+void TracepointSink::drain()
+{
+	Array<const Array<String>*> formats;
+	{
+		std::lock_guard lock(m_mutex);
+		m_draining.clear();
+		m_draining.swap(m_pending);
+
+		if (m_draining.empty())
+		{
+			return;
+		}
+
+		formats.reserve(m_formats.size());
+		for (const auto& literals : m_formats)
+		{
+			formats.push_back(literals.get());
+		}
+	}
+
+	for (const auto& record : m_draining)
+	{
+		const String line = format(record, *formats[record.formatID]);
+
+		if (m_writer)
+		{
+			m_writer.writeln(line);
+		}
+		else
+		{
+			Console << line;
+		}
+
+		std::lock_guard lock(m_linesMutex);
+		if (m_recentLines.size() < MaxRecentLines)
+		{
+			m_recentLines.push_back(line);
+		}
+		else
+		{
+			m_recentLines[m_recentLinesHead] = line;
+			m_recentLinesHead = (m_recentLinesHead + 1) % MaxRecentLines;
+		}
+	}
+
+	m_writtenCount.fetch_add(m_draining.size(), std::memory_order_relaxed);
+}
+
+String TracepointSink::format(const TracepointRecord& record, const Array<String>& literals) const
+{
+	String line = U"[{}] "_fmt(record.threadID);
+
+	for (size_t i = 0; i < literals.size(); ++i)
+	{
+		line += literals[i];
+
+		if (i < record.valueCount)
+		{
+			const auto& value = record.values[i];
+			if (record.failedMask & (1u << i))
+			{
+				line += U"??";
+			}
+			else if (value.isFloat)
+			{
+				line += Format(value.f);
+			}
+			else if (value.isUnsigned)
+			{
+				line += Format(static_cast<uint64>(value.i));
+			}
+			else
+			{
+				line += Format(value.i);
+			}
+		}
+	}
+
+	return line;
+}
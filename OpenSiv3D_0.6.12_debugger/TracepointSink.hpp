@@ -0,0 +1,109 @@
+﻿#pragma once
+#include "DebugTypes.hpp"
+#include "BreakPointCondition.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+// トレースポイントに当たったときの記録（書式化前）
+struct TracepointRecord
+{
+	static constexpr size_t MaxValues = 8;
+
+	uint64 timestamp;
+
+	uint32 formatID;
+
+	DWORD threadID;
+
+	uint32 hitCount;
+
+	uint8 valueCount;
+
+	// 評価できなかった値のビット
+	uint8 failedMask;
+
+	ConditionValue values[MaxValues];
+};
+
+// トレースポイントの出力先
+//
+// ブレークポイントを処理するスレッドは記録をバイナリのまま積むだけにして、
+// 書式化とファイル・Console への書き出しはバックグラウンドのスレッドでまとめて行う
+class TracepointSink
+{
+public:
+
+	TracepointSink() = default;
+
+	~TracepointSink();
+
+	TracepointSink(const TracepointSink&) = delete;
+	TracepointSink& operator=(const TracepointSink&) = delete;
+
+	// メッセージの書式を登録して ID を返す（literals は埋め込む値の数 + 1 個）
+	uint32 addFormat(Array<String> literals);
+
+	// 出力先のファイル（指定しなければ Console）
+	bool setOutputPath(FilePathView path);
+
+	// 溜まりすぎている場合は捨てる
+	void write(const TracepointRecord& record);
+
+	// 溜まっている記録を今すぐ書き出す
+	void flush();
+
+	// 最近書き出した行（古い順）
+	Array<String> recentLines() const;
+
+	uint64 writtenCount() const { return m_writtenCount.load(std::memory_order_relaxed); }
+
+	uint64 droppedCount() const { return m_droppedCount.load(std::memory_order_relaxed); }
+
+	static constexpr size_t MaxPendingRecords = 1 << 16;
+
+	static constexpr size_t MaxRecentLines = 256;
+
+private:
+
+	void start();
+
+	void run();
+
+	// m_drainMutex を取った状態で呼ぶ
+	void drain();
+
+	String format(const TracepointRecord& record, const Array<String>& literals) const;
+
+	// 書き込み側と共有する
+	std::mutex m_mutex;
+
+	Array<TracepointRecord> m_pending;
+
+	// 書式は消さないので、要素のアドレスは変わらない
+	Array<std::unique_ptr<const Array<String>>> m_formats;
+
+	// 書き出しスレッド側
+	std::mutex m_drainMutex;
+
+	std::condition_variable m_condition;
+
+	std::thread m_thread;
+
+	bool m_isRunning = false;
+
+	Array<TracepointRecord> m_draining;
+
+	TextWriter m_writer;
+
+	mutable std::mutex m_linesMutex;
+
+	Array<String> m_recentLines;
+
+	size_t m_recentLinesHead = 0;
+
+	std::atomic<uint64> m_writtenCount = 0;
+
+	std::atomic<uint64> m_droppedCount = 0;
+};
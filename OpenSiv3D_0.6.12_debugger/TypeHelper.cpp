@@ -1,8 +1,10 @@
-﻿#include <Windows.h>
-#include <DbgHelp.h>
-#include "TypeHelper.hpp"
+﻿#include "TypeHelper.hpp"
 #include "ProcessHandle.hpp"
 
+#if SIV3D_PLATFORM(WINDOWS)
+
+#include <DbgHelp.h>
+
 CBaseTypeEnum GetCBaseType(const ProcessHandle& process, int typeID, size_t modBase);
 std::wstring GetBaseTypeName(const ProcessHandle& process, int typeID, size_t modBase);
 std::wstring GetPointerTypeName(const ProcessHandle& process, int typeID, size_t modBase);
@@ -814,3 +816,5 @@ wchar_t ConvertToSafeWChar(wchar_t ch)
 
 	return ch;
 }
+
+#endif
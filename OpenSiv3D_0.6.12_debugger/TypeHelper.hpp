@@ -1,5 +1,5 @@
 ﻿#pragma once
-#include <Windows.h>
+#include "DebugTypes.hpp"
 
 enum BaseTypeEnum {
 	btNoType = 0,
@@ -84,4 +84,7 @@ std::wstring GetTypeValue(const ProcessHandle& process, int typeID, size_t modBa
 
 bool IsSimpleType(const ProcessHandle& process, DWORD typeID, size_t modBase);
 
+// typeID は基本型であること
+CBaseTypeEnum GetCBaseType(const ProcessHandle& process, int typeID, size_t modBase);
+
 std::wstring GetCBaseTypeValue(CBaseTypeEnum cBaseType, const BYTE* pData);
@@ -1,6 +1,8 @@
 ﻿#pragma once
 #include <Siv3D.hpp>
 
+// ユーザーのソースファイルの中身（停止した行を表示する用）
+// ファイルは行番号テーブルの SourceFileTable の ID で引く
 class UserSourceFiles
 {
 public:
@@ -11,26 +13,38 @@ public:
 		return instance;
 	}
 
-	static void AddFile(FilePathView path)
+	// 新しいデバッグ対象を読み込むとき（ID が振り直される）
+	static void Clear()
+	{
+		i().m_sourceTable.clear();
+	}
+
+	static void AddFile(uint32 fileID, FilePathView path)
 	{
 		if (!FileSystem::Exists(path))
 		{
 			Print << U"not exist path: " << path;
 		}
 
+		auto& sourceTable = i().m_sourceTable;
+		if (sourceTable.size() <= fileID)
+		{
+			sourceTable.resize(fileID + 1);
+		}
+
 		TextReader reader(path);
-		reader.readLines(i().m_sourceTable[path]);
+		reader.readLines(sourceTable[fileID]);
 	}
 
-	static Optional<std::reference_wrapper<const String>> TryGetLine(FilePathView path, size_t lineNumber)
+	static Optional<std::reference_wrapper<const String>> TryGetLine(uint32 fileID, size_t lineNumber)
 	{
-		auto& instance = i();
-		if (!instance.m_sourceTable.contains(path))
+		const auto& sourceTable = i().m_sourceTable;
+		if (sourceTable.size() <= fileID)
 		{
 			return none;
 		}
 
-		const auto& lines = instance.m_sourceTable[path];
+		const auto& lines = sourceTable[fileID];
 		if (lines.size() <= lineNumber)
 		{
 			return none;
@@ -41,5 +55,5 @@ public:
 
 private:
 
-	HashTable<FilePath, Array<String>> m_sourceTable;
+	Array<Array<String>> m_sourceTable; // ファイルの ID -> 行
 };
@@ -0,0 +1,137 @@
+﻿#include "WindowsDebugBackend.hpp"
+
+#if SIV3D_PLATFORM(WINDOWS)
+
+bool WindowsDebugBackend::createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo)
+{
+	auto filepathW = Unicode::ToWstring(exeFilePath);
+
+	// CreateProcess はコマンドラインのバッファを書き換えるのでコピーを渡す
+	auto commandLineW = Unicode::ToWstring(U"\"{}\" {}"_fmt(exeFilePath, arguments));
+
+	STARTUPINFO si = {};
+	si.cb = sizeof(si);
+
+	return CreateProcess(
+		filepathW.c_str(),
+		commandLineW.data(),
+		NULL,
+		NULL,
+		FALSE,
+		DEBUG_ONLY_THIS_PROCESS | CREATE_NEW_CONSOLE | CREATE_SUSPENDED,
+		NULL,
+		NULL,
+		&si,
+		&processInfo
+	);
+}
+
+bool WindowsDebugBackend::waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds)
+{
+	return WaitForDebugEvent(&debugEvent, milliseconds);
+}
+
+bool WindowsDebugBackend::continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus)
+{
+	return ContinueDebugEvent(processID, threadID, continueStatus);
+}
+
+bool WindowsDebugBackend::getThreadContext(HANDLE thread, CONTEXT& context)
+{
+	return GetThreadContext(thread, &context);
+}
+
+bool WindowsDebugBackend::setThreadContext(HANDLE thread, const CONTEXT& context)
+{
+	return SetThreadContext(thread, &context);
+}
+
+void WindowsDebugBackend::suspendThread(HANDLE thread)
+{
+	SuspendThread(thread);
+}
+
+void WindowsDebugBackend::resumeThread(HANDLE thread)
+{
+	ResumeThread(thread);
+}
+
+bool WindowsDebugBackend::readMemory(HANDLE process, size_t address, size_t size, void* buffer)
+{
+	size_t numOfBytes;
+	auto pAddress = reinterpret_cast<LPVOID>(address);
+	return ReadProcessMemory(process, pAddress, buffer, size, &numOfBytes);
+}
+
+bool WindowsDebugBackend::writeMemory(HANDLE process, size_t address, size_t size, const void* buffer)
+{
+	size_t numOfBytes;
+	auto pAddress = reinterpret_cast<LPVOID>(address);
+	auto success1 = WriteProcessMemory(process, pAddress, buffer, size, &numOfBytes);
+	auto success2 = FlushInstructionCache(process, pAddress, size);
+	return success1 && success2;
+}
+
+bool WindowsDebugBackend::allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address)
+{
+	SYSTEM_INFO systemInfo = {};
+	GetSystemInfo(&systemInfo);
+	const size_t granularity = systemInfo.dwAllocationGranularity;
+
+	// nearAddress から手前に向かって、空いている領域を 2GB 以内で探す
+	constexpr size_t SearchRange = 0x7FF00000;
+	const size_t lowest = (SearchRange < nearAddress) ? (nearAddress - SearchRange) : granularity;
+
+	size_t candidate = nearAddress / granularity * granularity;
+	while (lowest < candidate)
+	{
+		MEMORY_BASIC_INFORMATION info = {};
+		if (not VirtualQueryEx(process, reinterpret_cast<LPCVOID>(candidate), &info, sizeof(info)))
+		{
+			break;
+		}
+
+		if (info.State == MEM_FREE)
+		{
+			if (const auto allocated = VirtualAllocEx(process, reinterpret_cast<LPVOID>(candidate), size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE))
+			{
+				address = reinterpret_cast<size_t>(allocated);
+				return true;
+			}
+		}
+
+		// この領域の手前へ
+		const size_t regionBase = reinterpret_cast<size_t>(info.AllocationBase ? info.AllocationBase : info.BaseAddress) / granularity * granularity;
+		if (regionBase < granularity)
+		{
+			break;
+		}
+		candidate = regionBase - granularity;
+	}
+
+	// 近くに取れなければどこでもよい（RIP 相対の命令はずらせなくなる）
+	if (const auto allocated = VirtualAllocEx(process, nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE))
+	{
+		address = reinterpret_cast<size_t>(allocated);
+		return true;
+	}
+
+	return false;
+}
+
+bool WindowsDebugBackend::debugBreakProcess(HANDLE process)
+{
+	return DebugBreakProcess(process);
+}
+
+void WindowsDebugBackend::closeHandle(HANDLE handle)
+{
+	CloseHandle(handle);
+}
+
+uint32 WindowsDebugBackend::lastError() const
+{
+	return GetLastError();
+}
+
+#endif
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include "DebugBackend.hpp"
+
+#if SIV3D_PLATFORM(WINDOWS)
+
+// Win32 デバッグ API によるバックエンド
+class WindowsDebugBackend : public DebugBackend
+{
+public:
+
+	bool createProcess(const FilePathView exeFilePath, const StringView arguments, PROCESS_INFORMATION& processInfo) override;
+
+	bool waitForDebugEvent(DEBUG_EVENT& debugEvent, DWORD milliseconds) override;
+
+	bool continueDebugEvent(DWORD processID, DWORD threadID, DWORD continueStatus) override;
+
+	bool getThreadContext(HANDLE thread, CONTEXT& context) override;
+
+	bool setThreadContext(HANDLE thread, const CONTEXT& context) override;
+
+	void suspendThread(HANDLE thread) override;
+
+	void resumeThread(HANDLE thread) override;
+
+	bool readMemory(HANDLE process, size_t address, size_t size, void* buffer) override;
+
+	bool writeMemory(HANDLE process, size_t address, size_t size, const void* buffer) override;
+
+	bool allocateMemory(HANDLE process, size_t nearAddress, size_t size, size_t& address) override;
+
+	bool debugBreakProcess(HANDLE process) override;
+
+	void closeHandle(HANDLE handle) override;
+
+	uint32 lastError() const override;
+};
+
+#endif